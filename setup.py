@@ -8,6 +8,7 @@ import json
 import hashlib
 import tarfile
 import sysconfig
+import shlex
 from urllib.request import urlretrieve
 from wheel.bdist_wheel import bdist_wheel
 from setuptools.command.sdist import sdist
@@ -21,7 +22,7 @@ if os.name == 'nt':
     import vswhere
 
 #####################
-src_files = ['P7Zip.cpp', 'TitanArchive.cpp', 'Compat.cpp']
+src_files = ['P7Zip.cpp', 'TitanArchive.cpp', 'Compat.cpp', 'ArchiveCache.cpp', 'ArchiveIndex.cpp', 'ArchiveTree.cpp', 'ThreadPool.cpp', 'PathMatcher.cpp', 'ItemPipe.cpp', 'ArchiveStats.cpp', 'Trace.cpp']
 os_libs = []
 if os.name == 'nt':
     os_libs += ['OleAut32.lib']
@@ -32,6 +33,7 @@ DEPS_DIR = os.path.relpath(os.path.join(SETUP_DIR, 'deps'))
 SRC_DIR = os.path.relpath(os.path.join(SETUP_DIR, 'src'))
 PACKAGE_DIR = os.path.join(SRC_DIR, 'titanarchive')
 BIN_DIR = os.path.join(SETUP_DIR, 'build')
+PGO_TRAINING_SCALE = 0.25
 #####################
 
 if 'microsoft' in platform.uname()[3].lower() and SETUP_DIR.startswith('/mnt/c'):
@@ -40,6 +42,16 @@ if 'microsoft' in platform.uname()[3].lower() and SETUP_DIR.startswith('/mnt/c')
 src_files = [os.path.join(SRC_DIR, path) for path in src_files]
 bin_files = []
 
+# Optional CPython extension, titanarchive.py falls back to ctypes when it fails to build
+native_extension = setuptools.Extension(
+    'titanarchive._titanarchive',
+    sources = [os.path.join(SRC_DIR, 'PyTitanArchive.cpp')],
+    include_dirs = [SRC_DIR],
+    extra_compile_args = ['/EHsc'] if os.name == 'nt' else ['-std=c++14'],
+    libraries = [] if os.name == 'nt' else ['dl'],
+    language = 'c++',
+    optional = True)
+
 try:
     os.mkdir(BIN_DIR)
 except FileExistsError:
@@ -89,15 +101,38 @@ def windows_build(arch, debug=False):
         bin_files.append(os.path.relpath(bin_file))
 
 
-def linux_build(arch, debug=False):
+def linux_build(arch, debug=False, static_7z=False, pgo=False, pgo_archives=None):
     gpp_path = shutil.which('g++')
 
     if gpp_path is None or shutil.which('cc') is None:
         raise Exception('Unable to build, missing cc and/or g++')
+    if pgo and debug:
+        raise Exception('Profile-guided builds are optimized builds and cannot be debug builds')
+
+    gpp_args = ['-shared', '-fPIC', '-Wall', '-std=c++14']
+
+    if debug:
+        gpp_args += ['-O0', '-g3']
+    else:
+        gpp_args += ['-O3', '-g0']
+
+    if arch == 32:
+        gpp_args += ['-m32']
+        bin_file = os.path.join(BIN_DIR, 'TitanArchive32.so')
+    elif arch == 64:
+        bin_file = os.path.join(BIN_DIR, 'TitanArchive64.so')
+    p7zip_bin_file = os.path.join(BIN_DIR, 'TitanArchive{}-7z.so'.format(arch))
+
+    if static_7z:
+        # One library, only the TitanArchive API stays visible so LTO can inline across 7-Zip and our streams
+        gpp_args += ['-flto', '-fvisibility=hidden', '-fvisibility-inlines-hidden', '-DTITANARCHIVE_STATIC_7Z']
 
     with tempfile.TemporaryDirectory() as tmpdirname:
         extract_deps(tmpdirname)
         p7zip_build_dir = os.path.join(tmpdirname, '7z-src', 'CPP', '7zip', 'Bundles', 'Format7zF')
+        # Both PGO passes link here, profiles are matched by object and output paths
+        lib_dir = os.path.join(tmpdirname, 'lib')
+        os.mkdir(lib_dir)
 
         if arch == 32:
             os.environ['USE_ASM'] = ''
@@ -109,26 +144,58 @@ def linux_build(arch, debug=False):
         else:
             raise Exception('Unknown architecture specified')
 
-        subprocess.run(p7zip_build_args, cwd=p7zip_build_dir, check=True)
-        bin_file = os.path.join(BIN_DIR, 'TitanArchive{}-7z.so'.format(arch))
-        shutil.copy2(os.path.join(out_dir, '7z.so'), bin_file)
+        def build(profile_args):
+            p7zip_objects = []
+            p7zip_make_args = list(p7zip_build_args)
+            p7zip_arch_args = list(profile_args)
+
+            if static_7z:
+                p7zip_arch_args += ['-flto', '-fvisibility=hidden', '-fvisibility-inlines-hidden']
+            if p7zip_arch_args:
+                # MY_ARCH reaches every compile and link of the bundle
+                p7zip_make_args.append('MY_ARCH={}'.format(' '.join((['-m32'] if arch == 32 else []) + p7zip_arch_args)))
+
+            subprocess.run(p7zip_make_args, cwd=p7zip_build_dir, check=True)
+            if static_7z:
+                p7zip_objects = [os.path.join(out_dir, f) for f in sorted(os.listdir(out_dir)) if f.endswith('.o')]
+            else:
+                shutil.copy2(os.path.join(out_dir, '7z.so'), os.path.join(lib_dir, os.path.basename(p7zip_bin_file)))
+
+            subprocess.run([gpp_path, *gpp_args, *profile_args, *src_files, *p7zip_objects, '-o', os.path.join(lib_dir, os.path.basename(bin_file)), *os_libs, '-lpthread'], check=True)
+
+        if pgo:
+            profile_dir = os.path.join(tmpdirname, 'profile')
+            build(['-fprofile-generate={}'.format(profile_dir), '-fprofile-update=prefer-atomic'])
+            pgo_train(arch, os.path.join(lib_dir, os.path.basename(bin_file)), tmpdirname, pgo_archives)
+            subprocess.run([*p7zip_build_args, 'clean'], cwd=p7zip_build_dir, check=True)
+            # Code the corpus never reached is optimized as usual rather than for size
+            build(['-fprofile-use={}'.format(profile_dir), '-fprofile-correction', '-fprofile-partial-training', '-Wno-missing-profile'])
+        else:
+            build([])
+
+        if not static_7z:
+            shutil.copy2(os.path.join(lib_dir, os.path.basename(p7zip_bin_file)), p7zip_bin_file)
+            bin_files.append(os.path.relpath(p7zip_bin_file))
+        shutil.copy2(os.path.join(lib_dir, os.path.basename(bin_file)), bin_file)
         bin_files.append(os.path.relpath(bin_file))
 
-    gpp_args = ['-shared', '-fPIC', '-Wall', '-std=c++14']
+def build_benchmark(bin_file, extra_args=[]):
+    gpp_path = shutil.which('g++')
+    if gpp_path is None:
+        raise Exception('Unable to build, missing g++')
+    subprocess.run([gpp_path, '-O2', '-std=c++14', *extra_args, '-I', SRC_DIR, os.path.join(SETUP_DIR, 'tests', 'benchmark.cpp'), '-o', bin_file, '-ldl', '-lpthread'], check=True)
 
-    if debug:
-        gpp_args += ['-O0', '-g3']
-    else:
-        gpp_args += ['-O3', '-g0']
+def pgo_train(arch, lib_file, work_dir, pgo_archives):
+    # The benchmark scenarios cover opening, listing, lookups and extraction of every generated format,
+    # pgo_archives adds real compressed data so decoder loops are trained as well
+    bench_file = os.path.join(work_dir, 'benchmark')
+    bench_args = ['--lib', os.path.abspath(lib_file), '--scale', str(PGO_TRAINING_SCALE), '--iterations', '1', '--output', os.devnull]
 
-    if arch == 32:
-        gpp_args += ['-m32']
-        bin_file = os.path.join(BIN_DIR, 'TitanArchive32.so')
-    elif arch == 64:
-        bin_file = os.path.join(BIN_DIR, 'TitanArchive64.so')
+    if pgo_archives:
+        bench_args += ['--archives', os.path.abspath(pgo_archives)]
 
-    subprocess.run([gpp_path, *gpp_args, *src_files, '-o', bin_file, *os_libs], check=True)
-    bin_files.append(os.path.relpath(bin_file))
+    build_benchmark(bench_file, ['-m32'] if arch == 32 else [])
+    subprocess.run([bench_file, *bench_args], check=True)
 
 def sha256_file(path):
     h = hashlib.sha256()
@@ -159,30 +226,61 @@ def extract_deps(path):
         else:
             raise Exception('Unsupported archive')
 
-def build_code(plat_name, debug):
+def build_code(plat_name, debug, static_7z=False, pgo=False, pgo_archives=None):
+    if static_7z and not plat_name.startswith('linux'):
+        raise Exception('Linking 7-Zip into TitanArchive is only supported on Linux')
+    if pgo and not plat_name.startswith('linux'):
+        raise Exception('Profile-guided builds are only supported on Linux')
     if plat_name == 'win-amd64':
         windows_build(64, debug)
     elif plat_name == 'win32':
         windows_build(32, debug)
     elif plat_name == 'linux-x86_64':
-        linux_build(64, debug)
+        linux_build(64, debug, static_7z, pgo, pgo_archives)
     elif plat_name == 'linux-x86':
-        linux_build(32, debug)
+        linux_build(32, debug, static_7z, pgo, pgo_archives)
     else:
         raise Exception('Unknown / Missing build platform specified')
 
 class TitanArchiveBuildCLib(build_clib):
-    user_options = [('debug', 'g', 'compile with debugging information'), ('platform=', 'p', 'specify the target platform')]
+    user_options = [('debug', 'g', 'compile with debugging information'), ('platform=', 'p', 'specify the target platform'),
+                    ('static-7z', 's', 'link 7-Zip into TitanArchive with LTO instead of building a separate module'),
+                    ('pgo', None, 'build instrumented, train on the benchmark corpus and rebuild with the profiles'),
+                    ('pgo-archives=', None, 'directory of archives added to the profile training run')]
 
     def run(self):
         download_deps()
-        build_code(self.platform, False if self.debug is None else True)
+        build_code(self.platform, False if self.debug is None else True, bool(self.static_7z), bool(self.pgo), self.pgo_archives)
 
     def initialize_options(self):
         build_clib.initialize_options(self)
         self.platform = None
+        self.static_7z = None
+        self.pgo = None
+        self.pgo_archives = None
+
+class TitanArchiveBenchmark(setuptools.Command):
+    description = 'build and run the native benchmark harness in tests/benchmark.cpp'
+    user_options = [('args=', 'a', 'arguments passed to the benchmark harness')]
+
+    def run(self):
+        if os.name != 'posix':
+            raise Exception('The native benchmark harness is only supported on posix platforms')
+        bin_file = os.path.join(BIN_DIR, 'benchmark')
+        build_benchmark(bin_file)
+        subprocess.run([bin_file, *shlex.split(self.args)], check=True)
+
+    def initialize_options(self):
+        self.args = ''
+
+    def finalize_options(self):
+        pass
 
 class TitanArchiveBDistWheel(bdist_wheel):
+    user_options = bdist_wheel.user_options + [('static-7z', None, 'link 7-Zip into TitanArchive with LTO instead of building a separate module'),
+                                               ('pgo', None, 'build instrumented, train on the benchmark corpus and rebuild with the profiles'),
+                                               ('pgo-archives=', None, 'directory of archives added to the profile training run')]
+
     def run(self):
         if not self.plat_name_supplied:
             self.plat_name = sysconfig.get_platform()
@@ -190,9 +288,15 @@ class TitanArchiveBDistWheel(bdist_wheel):
         if self.plat_name not in SUPPORTED_PLATFORMS:
             raise Exception('Invalid platform name. Options: {}'.format(SUPPORTED_PLATFORMS))
         download_deps()
-        build_code(self.plat_name, False)
+        build_code(self.plat_name, False, bool(self.static_7z), bool(self.pgo), self.pgo_archives)
         bdist_wheel.run(self)
 
+    def initialize_options(self):
+        bdist_wheel.initialize_options(self)
+        self.static_7z = None
+        self.pgo = None
+        self.pgo_archives = None
+
 class TitanArchiveSDist(sdist):
     def run(self):
         download_deps()
@@ -208,7 +312,8 @@ setuptools.setup(
     url = 'https://github.com/4d61726b/TitanArchive',
     packages = setuptools.find_packages(where=SRC_DIR),
     package_dir = {'': SRC_DIR},
+    ext_modules = [native_extension],
     python_requires = '>=3',
-    cmdclass = {'bdist_wheel': TitanArchiveBDistWheel, 'sdist': TitanArchiveSDist, 'build_clib': TitanArchiveBuildCLib},
+    cmdclass = {'bdist_wheel': TitanArchiveBDistWheel, 'sdist': TitanArchiveSDist, 'build_clib': TitanArchiveBuildCLib, 'benchmark': TitanArchiveBenchmark},
     data_files = [('DLLs' if os.name == 'nt' else 'lib', bin_files)],
 )
@@ -0,0 +1,196 @@
+#include <cstring>
+
+#include "ArchiveCache.hpp"
+
+using namespace std;
+
+// Rough cost of the header state a handler keeps per item once opened
+constexpr uint64_t ui64ItemCost = 512;
+constexpr size_t szMaxIdleHandlers = 8;
+
+static uint64_t Fnv1a(uint64_t ui64Hash, const uint8_t* pBuf, uint64_t ui64BufSize)
+{
+    for (uint64_t i = 0; i < ui64BufSize; ++i)
+    {
+        ui64Hash ^= pBuf[i];
+        ui64Hash *= 0x100000001b3ULL;
+    }
+    return ui64Hash;
+}
+
+ArchiveCacheKey ArchiveCacheKey::FromFile(const CompatFileIdentity& cfiFile, const wchar_t* wszPassword)
+{
+    ArchiveCacheKey ackKey = {cfiFile, wszPassword ? wszPassword : L""};
+    return ackKey;
+}
+
+bool ArchiveCacheKey::operator==(const ArchiveCacheKey& other) const
+{
+    return cfiFile.ui64Device == other.cfiFile.ui64Device &&
+           cfiFile.ui64Inode == other.cfiFile.ui64Inode &&
+           cfiFile.ui64Size == other.cfiFile.ui64Size &&
+           cfiFile.i64MTime == other.cfiFile.i64MTime &&
+           wstrPassword == other.wstrPassword;
+}
+
+size_t ArchiveCacheKeyHash::operator()(const ArchiveCacheKey& ackKey) const
+{
+    uint64_t ui64Hash = 0xcbf29ce484222325ULL;
+
+    ui64Hash = Fnv1a(ui64Hash, reinterpret_cast<const uint8_t*>(&ackKey.cfiFile), sizeof(ackKey.cfiFile));
+
+    return static_cast<size_t>(ui64Hash ^ hash<wstring>()(ackKey.wstrPassword));
+}
+
+CArchiveCache& CArchiveCache::Instance()
+{
+    static CArchiveCache s_acCache;
+    return s_acCache;
+}
+
+void CArchiveCache::Configure(uint64_t ui64MemoryBudget)
+{
+    vector<IdleHandler> vecReleased;
+
+    m_mLock.lock();
+    m_ui64MemoryBudget = ui64MemoryBudget;
+    EvictLocked(vecReleased);
+    m_mLock.unlock();
+
+    ReleaseHandlers(vecReleased);
+}
+
+bool CArchiveCache::IsEnabled()
+{
+    lock_guard<mutex> lgLock(m_mLock);
+    return m_ui64MemoryBudget != 0;
+}
+
+bool CArchiveCache::Acquire(const ArchiveCacheKey& ackKey, const wchar_t* wszFormat, ArchiveCacheLease* pLease)
+{
+    lock_guard<mutex> lgLock(m_mLock);
+
+    auto iterEntry = m_mapEntries.find(ackKey);
+    if (iterEntry == m_mapEntries.end())
+    {
+        return false;
+    }
+
+    ArchiveCacheEntry& aceEntry = *iterEntry->second;
+    if (wszFormat && aceEntry.wstrFormat != wszFormat)
+    {
+        return false;
+    }
+
+    pLease->spMmap = aceEntry.spMmap;
+    pLease->wstrFormat = aceEntry.wstrFormat;
+    pLease->pHandler = nullptr;
+    pLease->spOwner.reset();
+
+    if (!aceEntry.vecIdleHandlers.empty())
+    {
+        IdleHandler& ihHandler = aceEntry.vecIdleHandlers.back();
+        pLease->pHandler = ihHandler.pHandler;
+        pLease->spOwner = move(ihHandler.spOwner);
+        aceEntry.ui64Cost -= ihHandler.ui64Cost;
+        m_ui64MemoryUsed -= ihHandler.ui64Cost;
+        aceEntry.vecIdleHandlers.pop_back();
+    }
+
+    m_lstEntries.splice(m_lstEntries.begin(), m_lstEntries, iterEntry->second);
+
+    return true;
+}
+
+void CArchiveCache::Release(const ArchiveCacheKey& ackKey, const shared_ptr<CompatMmap>& spMmap, const wstring& wstrFormat, IUnknown* pHandler, const shared_ptr<const void>& spOwner, uint32_t ui32ItemCount)
+{
+    vector<IdleHandler> vecReleased;
+    uint64_t ui64HandlerCost = ui32ItemCount * ui64ItemCost;
+
+    m_mLock.lock();
+
+    if (m_ui64MemoryBudget == 0)
+    {
+        m_mLock.unlock();
+        pHandler->Release();
+        return;
+    }
+
+    auto iterEntry = m_mapEntries.find(ackKey);
+    if (iterEntry == m_mapEntries.end())
+    {
+        ArchiveCacheEntry aceEntry;
+        aceEntry.ackKey = ackKey;
+        aceEntry.spMmap = spMmap;
+        aceEntry.wstrFormat = wstrFormat;
+        aceEntry.ui64Cost = spMmap ? spMmap->Length() : 0;
+        m_ui64MemoryUsed += aceEntry.ui64Cost;
+
+        m_lstEntries.push_front(move(aceEntry));
+        iterEntry = m_mapEntries.emplace(ackKey, m_lstEntries.begin()).first;
+    }
+    else
+    {
+        m_lstEntries.splice(m_lstEntries.begin(), m_lstEntries, iterEntry->second);
+    }
+
+    ArchiveCacheEntry& aceEntry = *iterEntry->second;
+    if (aceEntry.wstrFormat == wstrFormat && aceEntry.vecIdleHandlers.size() < szMaxIdleHandlers)
+    {
+        aceEntry.vecIdleHandlers.push_back({pHandler, spOwner, ui64HandlerCost});
+        aceEntry.ui64Cost += ui64HandlerCost;
+        m_ui64MemoryUsed += ui64HandlerCost;
+    }
+    else
+    {
+        vecReleased.push_back({pHandler, spOwner, 0});
+    }
+
+    EvictLocked(vecReleased);
+
+    m_mLock.unlock();
+
+    ReleaseHandlers(vecReleased);
+}
+
+void CArchiveCache::Flush()
+{
+    vector<IdleHandler> vecReleased;
+    uint64_t ui64MemoryBudget;
+
+    m_mLock.lock();
+    ui64MemoryBudget = m_ui64MemoryBudget;
+    m_ui64MemoryBudget = 0;
+    EvictLocked(vecReleased);
+    m_ui64MemoryBudget = ui64MemoryBudget;
+    m_mLock.unlock();
+
+    ReleaseHandlers(vecReleased);
+}
+
+void CArchiveCache::ReleaseHandlers(vector<IdleHandler>& vecReleased)
+{
+    // Handlers go first, their owners may unload the module they live in
+    for (IdleHandler& ihHandler : vecReleased)
+    {
+        ihHandler.pHandler->Release();
+    }
+    vecReleased.clear();
+}
+
+void CArchiveCache::EvictLocked(vector<IdleHandler>& vecReleased)
+{
+    while (!m_lstEntries.empty() && (m_ui64MemoryUsed > m_ui64MemoryBudget || m_ui64MemoryBudget == 0))
+    {
+        ArchiveCacheEntry& aceEntry = m_lstEntries.back();
+
+        for (IdleHandler& ihHandler : aceEntry.vecIdleHandlers)
+        {
+            vecReleased.push_back(move(ihHandler));
+        }
+
+        m_ui64MemoryUsed -= aceEntry.ui64Cost;
+        m_mapEntries.erase(aceEntry.ackKey);
+        m_lstEntries.pop_back();
+    }
+}
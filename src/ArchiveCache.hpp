@@ -0,0 +1,82 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+#include "Compat.hpp"
+
+struct ArchiveCacheKey
+{
+    CompatFileIdentity cfiFile;
+    std::wstring wstrPassword;
+
+    static ArchiveCacheKey FromFile(const CompatFileIdentity& cfiFile, const wchar_t* wszPassword);
+
+    bool operator==(const ArchiveCacheKey& other) const;
+};
+
+struct ArchiveCacheKeyHash
+{
+    size_t operator()(const ArchiveCacheKey& ackKey) const;
+};
+
+struct ArchiveCacheLease
+{
+    std::shared_ptr<CompatMmap> spMmap;
+    std::wstring wstrFormat;
+    IUnknown* pHandler = nullptr;   // An opened IInArchive, or nullptr when only the mapping is cached
+    std::shared_ptr<const void> spOwner;    // Keeps the module pHandler was created by loaded
+};
+
+// Process-wide LRU of opened archives. Idle handlers stay opened on their (shared) mapping
+// so a later open of the same archive skips mmap, format discovery and header parsing.
+// Only archives opened from disk are cached, a memory buffer belongs to the caller and
+// may be freed or rewritten once its context is closed.
+class CArchiveCache
+{
+public:
+    static CArchiveCache& Instance();
+
+    void Configure(uint64_t ui64MemoryBudget);
+    bool IsEnabled();
+    bool Acquire(const ArchiveCacheKey& ackKey, const wchar_t* wszFormat, ArchiveCacheLease* pLease);
+    void Release(const ArchiveCacheKey& ackKey, const std::shared_ptr<CompatMmap>& spMmap, const std::wstring& wstrFormat, IUnknown* pHandler, const std::shared_ptr<const void>& spOwner, uint32_t ui32ItemCount);
+    void Flush();
+
+private:
+    CArchiveCache() {}
+    CArchiveCache(const CArchiveCache&) = delete;
+    CArchiveCache& operator=(const CArchiveCache&) = delete;
+
+    struct IdleHandler
+    {
+        IUnknown* pHandler;
+        std::shared_ptr<const void> spOwner;
+        uint64_t ui64Cost;
+    };
+
+    struct ArchiveCacheEntry
+    {
+        ArchiveCacheKey ackKey;
+        std::shared_ptr<CompatMmap> spMmap;
+        std::wstring wstrFormat;
+        std::vector<IdleHandler> vecIdleHandlers;
+        uint64_t ui64Cost = 0;
+    };
+
+    using EntryList = std::list<ArchiveCacheEntry>;
+
+    static void ReleaseHandlers(std::vector<IdleHandler>& vecReleased);
+    void EvictLocked(std::vector<IdleHandler>& vecReleased);
+
+    std::mutex m_mLock;
+    uint64_t m_ui64MemoryBudget = 0;
+    uint64_t m_ui64MemoryUsed = 0;
+    EntryList m_lstEntries;   // Most recently used first
+    std::unordered_map<ArchiveCacheKey, EntryList::iterator, ArchiveCacheKeyHash> m_mapEntries;
+};
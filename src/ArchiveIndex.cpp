@@ -0,0 +1,169 @@
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+
+#include "ArchiveIndex.hpp"
+
+using namespace std;
+
+constexpr char szIndexMagic[8] = {'T', 'A', 'I', 'N', 'D', 'E', 'X', '\0'};
+constexpr uint32_t ui32IndexVersion = 1;
+
+struct ArchiveIndexHeader
+{
+    char szMagic[8];
+    uint32_t ui32Version;
+    uint32_t ui32WcharSize;
+    CompatFileIdentity cfiFile;
+    char szFormat[32];
+    uint32_t ui32ItemCount;
+    uint32_t ui32Reserved;
+    uint64_t ui64PoolLength;
+};
+
+CArchiveIndex::CArchiveIndex(const wstring& wstrFormat, vector<ArchiveIndexRecord>&& vecRecords, vector<wchar_t>&& vecPool) :
+    m_wstrFormat(wstrFormat), m_vecRecords(move(vecRecords)), m_vecPool(move(vecPool))
+{
+    m_pRecords = m_vecRecords.data();
+    m_pPool = m_vecPool.data();
+    m_ui32ItemCount = static_cast<uint32_t>(m_vecRecords.size());
+    m_ui64PoolLength = m_vecPool.size();
+}
+
+shared_ptr<CArchiveIndex> CArchiveIndex::Load(const wchar_t* wszIndexPath, const CompatFileIdentity& cfiFile, const wchar_t* wszFormat)
+{
+    shared_ptr<CArchiveIndex> spIndex;
+    const ArchiveIndexHeader* pHeader;
+    off64_t off64Size;
+    int iFd;
+
+    iFd = CompatOpenArchive(wszIndexPath);
+    if (iFd == -1)
+    {
+        return nullptr;
+    }
+
+    off64Size = lseek64(iFd, 0, SEEK_END);
+    if (off64Size < static_cast<off64_t>(sizeof(ArchiveIndexHeader)) || static_cast<uint64_t>(off64Size) > SIZE_MAX)
+    {
+        close(iFd);
+        return nullptr;
+    }
+
+    try
+    {
+        spIndex.reset(new CArchiveIndex());
+    }
+    catch (...)
+    {
+        close(iFd);
+        return nullptr;
+    }
+
+    spIndex->m_cmMmap.Set(iFd, static_cast<size_t>(off64Size));
+    close(iFd);
+    if (spIndex->m_cmMmap.Addr() == reinterpret_cast<void*>(-1))
+    {
+        return nullptr;
+    }
+
+    pHeader = static_cast<const ArchiveIndexHeader*>(spIndex->m_cmMmap.Addr());
+    if (memcmp(pHeader->szMagic, szIndexMagic, sizeof(szIndexMagic)) != 0 ||
+        pHeader->ui32Version != ui32IndexVersion ||
+        pHeader->ui32WcharSize != sizeof(wchar_t) ||
+        memcmp(&pHeader->cfiFile, &cfiFile, sizeof(CompatFileIdentity)) != 0 ||
+        pHeader->szFormat[sizeof(pHeader->szFormat) - 1] != '\0')
+    {
+        return nullptr;
+    }
+
+    spIndex->m_wstrFormat = conv(string(pHeader->szFormat)).c_str();
+    if (wszFormat && spIndex->m_wstrFormat != wszFormat)
+    {
+        return nullptr;
+    }
+
+    // Bound both counts by the payload before multiplying so a crafted header can't wrap the size check
+    uint64_t ui64Payload = static_cast<uint64_t>(off64Size) - sizeof(ArchiveIndexHeader);
+    if (pHeader->ui32ItemCount > ui64Payload / sizeof(ArchiveIndexRecord))
+    {
+        return nullptr;
+    }
+    ui64Payload -= static_cast<uint64_t>(pHeader->ui32ItemCount) * sizeof(ArchiveIndexRecord);
+    if (pHeader->ui64PoolLength > ui64Payload / sizeof(wchar_t) ||
+        pHeader->ui64PoolLength * sizeof(wchar_t) != ui64Payload)
+    {
+        return nullptr;
+    }
+
+    spIndex->m_ui32ItemCount = pHeader->ui32ItemCount;
+    spIndex->m_ui64PoolLength = pHeader->ui64PoolLength;
+    spIndex->m_pRecords = reinterpret_cast<const ArchiveIndexRecord*>(pHeader + 1);
+    spIndex->m_pPool = reinterpret_cast<const wchar_t*>(spIndex->m_pRecords + spIndex->m_ui32ItemCount);
+
+    // Every path must be terminated inside the pool since callers use them as C strings
+    for (uint32_t i = 0; i < spIndex->m_ui32ItemCount; ++i)
+    {
+        const ArchiveIndexRecord& airRecord = spIndex->m_pRecords[i];
+        if (!(airRecord.ui32Flags & kFlagHasPath))
+        {
+            continue;
+        }
+        if (airRecord.ui64PathOffset >= spIndex->m_ui64PoolLength ||
+            spIndex->m_ui64PoolLength - airRecord.ui64PathOffset <= airRecord.ui32PathLength ||
+            spIndex->m_pPool[airRecord.ui64PathOffset + airRecord.ui32PathLength] != L'\0')
+        {
+            return nullptr;
+        }
+    }
+
+    return spIndex;
+}
+
+bool CArchiveIndex::Save(const wchar_t* wszIndexPath, const CompatFileIdentity& cfiFile) const
+{
+    ArchiveIndexHeader aihHeader;
+    wstring wstrTempPath;
+    string strFormat = conv(m_wstrFormat).c_str();
+    FILE* pFile;
+    bool bWritten;
+
+    if (strFormat.size() >= sizeof(aihHeader.szFormat))
+    {
+        return false;
+    }
+
+    memset(&aihHeader, 0, sizeof(aihHeader));
+    memcpy(aihHeader.szMagic, szIndexMagic, sizeof(szIndexMagic));
+    aihHeader.ui32Version = ui32IndexVersion;
+    aihHeader.ui32WcharSize = sizeof(wchar_t);
+    aihHeader.cfiFile = cfiFile;
+    memcpy(aihHeader.szFormat, strFormat.c_str(), strFormat.size());
+    aihHeader.ui32ItemCount = m_ui32ItemCount;
+    aihHeader.ui64PoolLength = m_ui64PoolLength;
+
+    pFile = CompatCreateTemp(wszIndexPath, wstrTempPath);
+    if (!pFile)
+    {
+        return false;
+    }
+
+    bWritten = fwrite(&aihHeader, sizeof(aihHeader), 1, pFile) == 1 &&
+               fwrite(m_pRecords, sizeof(ArchiveIndexRecord), m_ui32ItemCount, pFile) == m_ui32ItemCount &&
+               fwrite(m_pPool, sizeof(wchar_t), static_cast<size_t>(m_ui64PoolLength), pFile) == m_ui64PoolLength;
+
+    if (fclose(pFile) != 0)
+    {
+        bWritten = false;
+    }
+
+    // Readers only ever see a complete sidecar
+    if (!bWritten || CompatRename(wstrTempPath.c_str(), wszIndexPath) != 0)
+    {
+        CompatRemove(wstrTempPath.c_str());
+        return false;
+    }
+
+    return true;
+}
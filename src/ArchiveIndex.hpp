@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <vector>
+
+#include "Compat.hpp"
+
+struct ArchiveIndexRecord
+{
+    uint64_t ui64Size;
+    uint64_t ui64PackSize;
+    uint64_t ui64Offset;
+    uint64_t ui64MTime;
+    uint64_t ui64PathOffset;      // In wchar_t units from the start of the path pool
+    uint32_t ui32PathLength;      // In wchar_t units, excluding the terminator
+    uint32_t ui32Flags;
+};
+
+// Item table of an opened archive. It is either built from the handler or loaded from a
+// sidecar file, in which case records and paths are served straight from the mapping.
+class CArchiveIndex
+{
+public:
+    enum : uint32_t
+    {
+        kFlagIsDir = 1 << 0,
+        kFlagHasPath = 1 << 1,
+        kFlagHasPackSize = 1 << 2,
+        kFlagHasOffset = 1 << 3
+    };
+
+    CArchiveIndex(const std::wstring& wstrFormat, std::vector<ArchiveIndexRecord>&& vecRecords, std::vector<wchar_t>&& vecPool);
+
+    static std::shared_ptr<CArchiveIndex> Load(const wchar_t* wszIndexPath, const CompatFileIdentity& cfiFile, const wchar_t* wszFormat);
+    bool Save(const wchar_t* wszIndexPath, const CompatFileIdentity& cfiFile) const;
+
+    uint32_t ItemCount() const
+    {
+        return m_ui32ItemCount;
+    }
+
+    const ArchiveIndexRecord& Record(uint32_t ui32Index) const
+    {
+        return m_pRecords[ui32Index];
+    }
+
+    // Returns nullptr when the handler did not provide a path for the item
+    const wchar_t* Path(uint32_t ui32Index) const
+    {
+        return (m_pRecords[ui32Index].ui32Flags & kFlagHasPath) ? m_pPool + m_pRecords[ui32Index].ui64PathOffset : nullptr;
+    }
+
+    const std::wstring& Format() const
+    {
+        return m_wstrFormat;
+    }
+
+private:
+    CArchiveIndex() {}
+    CArchiveIndex(const CArchiveIndex&) = delete;
+    CArchiveIndex& operator=(const CArchiveIndex&) = delete;
+
+    std::wstring m_wstrFormat;
+    std::vector<ArchiveIndexRecord> m_vecRecords;
+    std::vector<wchar_t> m_vecPool;
+    CompatMmap m_cmMmap;
+
+    const ArchiveIndexRecord* m_pRecords = nullptr;
+    const wchar_t* m_pPool = nullptr;
+    uint32_t m_ui32ItemCount = 0;
+    uint64_t m_ui64PoolLength = 0;
+};
@@ -0,0 +1,407 @@
+#include <new>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "ArchiveStats.hpp"
+
+using namespace std;
+
+constexpr int64_t i64FreeSlot = INT64_MIN;
+
+StatsBlock::StatsBlock()
+{
+    Reset();
+}
+
+void StatsBlock::Add(StatsCounter scCounter, uint64_t ui64Value)
+{
+    rgui64Counters[static_cast<uint32_t>(scCounter)].fetch_add(ui64Value, memory_order_relaxed);
+}
+
+void StatsBlock::Record(StatsHistogram shHistogram, uint64_t ui64Ns)
+{
+    Histogram& hHistogram = rgHistograms[static_cast<uint32_t>(shHistogram)];
+    uint64_t ui64Us = ui64Ns / 1000;
+    uint32_t ui32Bucket = 0;
+    uint64_t ui64Max;
+
+    // Bucket i holds [4^(i - 1), 4^i) us
+    while (ui64Us && ui32Bucket < ARCHIVE_STATS_HISTOGRAM_BUCKETS - 1)
+    {
+        ui64Us >>= 2;
+        ++ui32Bucket;
+    }
+
+    hHistogram.ui64Count.fetch_add(1, memory_order_relaxed);
+    hHistogram.ui64TotalNs.fetch_add(ui64Ns, memory_order_relaxed);
+    hHistogram.rgui64Buckets[ui32Bucket].fetch_add(1, memory_order_relaxed);
+    ui64Max = hHistogram.ui64MaxNs.load(memory_order_relaxed);
+    while (ui64Ns > ui64Max && !hHistogram.ui64MaxNs.compare_exchange_weak(ui64Max, ui64Ns, memory_order_relaxed))
+    {
+    }
+}
+
+void StatsBlock::Fail(HRESULT hrError)
+{
+    for (Failure& fSlot : rgFailures)
+    {
+        int64_t i64Error = fSlot.i64Error.load(memory_order_relaxed);
+
+        if (i64Error == i64FreeSlot)
+        {
+            // Claim the slot, another thread may have claimed it for the same or another error
+            fSlot.i64Error.compare_exchange_strong(i64Error, hrError, memory_order_relaxed);
+            if (i64Error == i64FreeSlot)
+            {
+                i64Error = hrError;
+            }
+        }
+        if (i64Error == hrError)
+        {
+            fSlot.ui64Count.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+    }
+
+    ui64OtherFailures.fetch_add(1, memory_order_relaxed);
+}
+
+void StatsBlock::AddTo(ArchiveStats* pStats) const
+{
+    uint64_t* rgui64Counters[] =
+    {
+        &pStats->ui64Opens,
+        &pStats->ui64HeaderBytesRead,
+        &pStats->ui64PropertyCalls,
+        &pStats->ui64ItemsDecoded,
+        &pStats->ui64BytesDecoded,
+        &pStats->ui64BytesCopied,
+        &pStats->ui64IterateItemsCalls,
+        &pStats->ui64ThreadsSpawned,
+        &pStats->ui64MmapBytes,
+        &pStats->ui64MajorFaults,
+    };
+    ArchiveStatsHistogram* rgashHistograms[] = { &pStats->ashOpen, &pStats->ashExtract, &pStats->ashIterateItems };
+
+    static_assert(sizeof(rgui64Counters) / sizeof(rgui64Counters[0]) == static_cast<size_t>(StatsCounter::Count), "Counter missing from ArchiveStats");
+    static_assert(sizeof(rgashHistograms) / sizeof(rgashHistograms[0]) == static_cast<size_t>(StatsHistogram::Count), "Histogram missing from ArchiveStats");
+
+    for (uint32_t i = 0; i < static_cast<uint32_t>(StatsCounter::Count); ++i)
+    {
+        *rgui64Counters[i] += this->rgui64Counters[i].load(memory_order_relaxed);
+    }
+
+    for (uint32_t i = 0; i < static_cast<uint32_t>(StatsHistogram::Count); ++i)
+    {
+        const Histogram& hHistogram = rgHistograms[i];
+        ArchiveStatsHistogram* pashOut = rgashHistograms[i];
+
+        pashOut->ui64Count += hHistogram.ui64Count.load(memory_order_relaxed);
+        pashOut->ui64TotalNs += hHistogram.ui64TotalNs.load(memory_order_relaxed);
+        pashOut->ui64MaxNs = max(pashOut->ui64MaxNs, hHistogram.ui64MaxNs.load(memory_order_relaxed));
+        for (uint32_t j = 0; j < ARCHIVE_STATS_HISTOGRAM_BUCKETS; ++j)
+        {
+            pashOut->rgui64Buckets[j] += hHistogram.rgui64Buckets[j].load(memory_order_relaxed);
+        }
+    }
+
+    for (const Failure& fSlot : rgFailures)
+    {
+        int64_t i64Error = fSlot.i64Error.load(memory_order_relaxed);
+        uint64_t ui64Count = fSlot.ui64Count.load(memory_order_relaxed);
+        uint32_t j;
+
+        if (i64Error == i64FreeSlot || !ui64Count)
+        {
+            continue;
+        }
+        for (j = 0; j < pStats->ui32FailureCount && pStats->rgFailures[j].hrError != static_cast<HRESULT>(i64Error); ++j)
+        {
+        }
+        if (j == ARCHIVE_STATS_MAX_FAILURES)
+        {
+            pStats->ui64OtherFailures += ui64Count;
+            continue;
+        }
+        if (j == pStats->ui32FailureCount)
+        {
+            pStats->rgFailures[j].hrError = static_cast<HRESULT>(i64Error);
+            ++pStats->ui32FailureCount;
+        }
+        pStats->rgFailures[j].ui64Count += ui64Count;
+    }
+    pStats->ui64OtherFailures += ui64OtherFailures.load(memory_order_relaxed);
+}
+
+void StatsBlock::Reset()
+{
+    for (atomic<uint64_t>& ui64Counter : rgui64Counters)
+    {
+        ui64Counter.store(0, memory_order_relaxed);
+    }
+    for (Histogram& hHistogram : rgHistograms)
+    {
+        hHistogram.ui64Count.store(0, memory_order_relaxed);
+        hHistogram.ui64TotalNs.store(0, memory_order_relaxed);
+        hHistogram.ui64MaxNs.store(0, memory_order_relaxed);
+        for (atomic<uint64_t>& ui64Bucket : hHistogram.rgui64Buckets)
+        {
+            ui64Bucket.store(0, memory_order_relaxed);
+        }
+    }
+    for (Failure& fSlot : rgFailures)
+    {
+        fSlot.i64Error.store(i64FreeSlot, memory_order_relaxed);
+        fSlot.ui64Count.store(0, memory_order_relaxed);
+    }
+    ui64OtherFailures.store(0, memory_order_relaxed);
+}
+
+// Process totals are split in one block per thread. Blocks of exited threads keep their counts
+// and are handed to the next new thread. The registry is never destroyed so threads exiting during
+// shutdown can still return their block.
+namespace
+{
+    struct StatsRegistry
+    {
+        mutex mLock;
+        vector<StatsBlock*> vecBlocks;
+        vector<StatsBlock*> vecFreeBlocks;
+    };
+
+    StatsRegistry& Registry()
+    {
+        static StatsRegistry* s_psrRegistry = new StatsRegistry();
+        return *s_psrRegistry;
+    }
+
+    struct ThreadBlock
+    {
+        ~ThreadBlock()
+        {
+            if (psbBlock)
+            {
+                StatsRegistry& srRegistry = Registry();
+                lock_guard<mutex> lgLock(srRegistry.mLock);
+                srRegistry.vecFreeBlocks.push_back(psbBlock);
+            }
+        }
+
+        StatsBlock* psbBlock = nullptr;
+    };
+
+    thread_local ThreadBlock s_tbBlock;
+
+    atomic_uint s_uiNextThreadSlot(0);
+    thread_local uint32_t s_ui32ThreadSlot = s_uiNextThreadSlot.fetch_add(1, memory_order_relaxed);
+
+    // nullptr when the block could not be allocated, the increment is dropped then
+    StatsBlock* CurrentThreadBlock()
+    {
+        if (!s_tbBlock.psbBlock)
+        {
+            StatsRegistry& srRegistry = Registry();
+            lock_guard<mutex> lgLock(srRegistry.mLock);
+
+            if (!srRegistry.vecFreeBlocks.empty())
+            {
+                s_tbBlock.psbBlock = srRegistry.vecFreeBlocks.back();
+                srRegistry.vecFreeBlocks.pop_back();
+            }
+            else
+            {
+                try
+                {
+                    srRegistry.vecBlocks.reserve(srRegistry.vecBlocks.size() + 1);
+                    s_tbBlock.psbBlock = new StatsBlock();
+                    srRegistry.vecBlocks.push_back(s_tbBlock.psbBlock);
+                }
+                catch (...)
+                {
+                    return nullptr;
+                }
+            }
+        }
+
+        return s_tbBlock.psbBlock;
+    }
+}
+
+CArchiveStats::CArchiveStats() : m_bInlineClaimed(false)
+{
+    for (atomic<StatsBlock*>& pShard : m_rgpShards)
+    {
+        pShard.store(nullptr, memory_order_relaxed);
+    }
+}
+
+CArchiveStats::~CArchiveStats()
+{
+    for (atomic<StatsBlock*>& pShard : m_rgpShards)
+    {
+        StatsBlock* psbShard = pShard.load(memory_order_relaxed);
+        if (psbShard != &m_sbBlock)
+        {
+            delete psbShard;
+        }
+    }
+}
+
+StatsBlock& CArchiveStats::CurrentShard()
+{
+    atomic<StatsBlock*>& pShard = m_rgpShards[s_ui32ThreadSlot % ui32StatsShards];
+    StatsBlock* psbShard = pShard.load(memory_order_acquire);
+    StatsBlock* psbExpected = nullptr;
+
+    if (psbShard)
+    {
+        return *psbShard;
+    }
+
+    // Most contexts are only used by one thread, it records into the inline block
+    if (!m_bInlineClaimed.exchange(true, memory_order_relaxed))
+    {
+        psbShard = &m_sbBlock;
+    }
+    else
+    {
+        psbShard = new (nothrow) StatsBlock();
+        if (!psbShard)
+        {
+            return m_sbBlock;
+        }
+    }
+
+    if (!pShard.compare_exchange_strong(psbExpected, psbShard, memory_order_acq_rel))
+    {
+        // Another thread of the same shard won the race, m_sbBlock is still summed if it lost it
+        if (psbShard != &m_sbBlock)
+        {
+            delete psbShard;
+        }
+        psbShard = psbExpected;
+    }
+
+    return *psbShard;
+}
+
+void CArchiveStats::Add(StatsCounter scCounter, uint64_t ui64Value)
+{
+    CurrentShard().Add(scCounter, ui64Value);
+    GlobalAdd(scCounter, ui64Value);
+}
+
+void CArchiveStats::Record(StatsHistogram shHistogram, uint64_t ui64Ns)
+{
+    StatsBlock* psbBlock = CurrentThreadBlock();
+
+    CurrentShard().Record(shHistogram, ui64Ns);
+    if (psbBlock)
+    {
+        psbBlock->Record(shHistogram, ui64Ns);
+    }
+}
+
+void CArchiveStats::Fail(HRESULT hrError)
+{
+    CurrentShard().Fail(hrError);
+    GlobalFail(hrError);
+}
+
+void CArchiveStats::Get(ArchiveStats* pStats) const
+{
+    memset(pStats, 0, sizeof(*pStats));
+    m_sbBlock.AddTo(pStats);
+    for (const atomic<StatsBlock*>& pShard : m_rgpShards)
+    {
+        const StatsBlock* psbShard = pShard.load(memory_order_acquire);
+        if (psbShard && psbShard != &m_sbBlock)
+        {
+            psbShard->AddTo(pStats);
+        }
+    }
+}
+
+void CArchiveStats::Reset()
+{
+    m_sbBlock.Reset();
+    for (atomic<StatsBlock*>& pShard : m_rgpShards)
+    {
+        StatsBlock* psbShard = pShard.load(memory_order_acquire);
+        if (psbShard && psbShard != &m_sbBlock)
+        {
+            psbShard->Reset();
+        }
+    }
+}
+
+void CArchiveStats::GlobalAdd(StatsCounter scCounter, uint64_t ui64Value)
+{
+    StatsBlock* psbBlock = CurrentThreadBlock();
+
+    if (psbBlock)
+    {
+        psbBlock->Add(scCounter, ui64Value);
+    }
+}
+
+void CArchiveStats::GlobalFail(HRESULT hrError)
+{
+    StatsBlock* psbBlock = CurrentThreadBlock();
+
+    if (psbBlock)
+    {
+        psbBlock->Fail(hrError);
+    }
+}
+
+void CArchiveStats::GlobalGet(ArchiveStats* pStats)
+{
+    StatsRegistry& srRegistry = Registry();
+    lock_guard<mutex> lgLock(srRegistry.mLock);
+
+    memset(pStats, 0, sizeof(*pStats));
+    for (const StatsBlock* psbBlock : srRegistry.vecBlocks)
+    {
+        psbBlock->AddTo(pStats);
+    }
+}
+
+void CArchiveStats::GlobalReset()
+{
+    StatsRegistry& srRegistry = Registry();
+    lock_guard<mutex> lgLock(srRegistry.mLock);
+
+    for (StatsBlock* psbBlock : srRegistry.vecBlocks)
+    {
+        psbBlock->Reset();
+    }
+}
+
+CStatsTimer::CStatsTimer(CArchiveStats* pStats, StatsHistogram shHistogram) : m_pStats(pStats), m_shHistogram(shHistogram)
+{
+    if (m_pStats)
+    {
+        if (m_shHistogram == StatsHistogram::Open)
+        {
+            m_ui64MajorFaults = CompatThreadMajorFaults();
+        }
+        m_tpStart = chrono::steady_clock::now();
+    }
+}
+
+CStatsTimer::~CStatsTimer()
+{
+    if (m_pStats)
+    {
+        const uint64_t ui64Ns = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - m_tpStart).count());
+        m_pStats->Record(m_shHistogram, ui64Ns);
+        if (m_shHistogram == StatsHistogram::Open)
+        {
+            m_pStats->Add(StatsCounter::MajorFaults, CompatThreadMajorFaults() - m_ui64MajorFaults);
+        }
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "TitanArchive.hpp"
+
+enum class StatsCounter : uint32_t
+{
+    Opens,
+    HeaderBytesRead,
+    PropertyCalls,
+    ItemsDecoded,
+    BytesDecoded,
+    BytesCopied,
+    IterateItemsCalls,
+    ThreadsSpawned,
+    MmapBytes,
+    MajorFaults,
+    Count
+};
+
+enum class StatsHistogram : uint32_t
+{
+    Open,
+    Extract,
+    IterateItems,
+    Count
+};
+
+// Relaxed counters, summed when a snapshot is taken. Increments racing a reset may survive it.
+struct StatsBlock
+{
+    struct Histogram
+    {
+        std::atomic<uint64_t> ui64Count;
+        std::atomic<uint64_t> ui64TotalNs;
+        std::atomic<uint64_t> ui64MaxNs;
+        std::atomic<uint64_t> rgui64Buckets[ARCHIVE_STATS_HISTOGRAM_BUCKETS];
+    };
+
+    struct Failure
+    {
+        std::atomic<int64_t> i64Error;      // HRESULT, INT64_MIN while the slot is free
+        std::atomic<uint64_t> ui64Count;
+    };
+
+    StatsBlock();
+
+    void Add(StatsCounter scCounter, uint64_t ui64Value);
+    void Record(StatsHistogram shHistogram, uint64_t ui64Ns);
+    void Fail(HRESULT hrError);
+    void AddTo(ArchiveStats* pStats) const;
+    void Reset();
+
+    std::atomic<uint64_t> rgui64Counters[static_cast<uint32_t>(StatsCounter::Count)];
+    Histogram rgHistograms[static_cast<uint32_t>(StatsHistogram::Count)];
+    Failure rgFailures[ARCHIVE_STATS_MAX_FAILURES];
+    std::atomic<uint64_t> ui64OtherFailures;
+};
+
+constexpr uint32_t ui32StatsShards = 8;
+
+// Counters of one context. Everything recorded is also added to the process totals, which are
+// kept per thread so threads working on different contexts never share a cache line. Threads
+// sharing a context (clones working for ExtractArchiveItems) record into separate shards.
+class CArchiveStats
+{
+public:
+    CArchiveStats();
+    ~CArchiveStats();
+
+    void Add(StatsCounter scCounter, uint64_t ui64Value);
+    void Record(StatsHistogram shHistogram, uint64_t ui64Ns);
+    void Fail(HRESULT hrError);
+    void Get(ArchiveStats* pStats) const;
+    void Reset();
+
+    // Process totals only, for work that does not belong to a context
+    static void GlobalAdd(StatsCounter scCounter, uint64_t ui64Value);
+    static void GlobalFail(HRESULT hrError);
+    static void GlobalGet(ArchiveStats* pStats);
+    static void GlobalReset();
+
+private:
+    CArchiveStats(const CArchiveStats&) = delete;
+    CArchiveStats& operator=(const CArchiveStats&) = delete;
+
+    // Shard of the calling thread, set on first use
+    StatsBlock& CurrentShard();
+
+    StatsBlock m_sbBlock;                       // Shard of the first recording thread, and the fallback when allocating one fails
+    std::atomic_bool m_bInlineClaimed;
+    std::atomic<StatsBlock*> m_rgpShards[ui32StatsShards];
+};
+
+// Records the duration of the calling thread's work between construction and destruction, and
+// for opens its major faults too. Sampling faults costs a syscall, so it is kept to coarse calls.
+// pStats may be nullptr.
+class CStatsTimer
+{
+public:
+    CStatsTimer(CArchiveStats* pStats, StatsHistogram shHistogram);
+    ~CStatsTimer();
+
+private:
+    CStatsTimer(const CStatsTimer&) = delete;
+    CStatsTimer& operator=(const CStatsTimer&) = delete;
+
+    CArchiveStats* m_pStats;
+    StatsHistogram m_shHistogram;
+    uint64_t m_ui64MajorFaults = 0;
+    std::chrono::steady_clock::time_point m_tpStart;
+};
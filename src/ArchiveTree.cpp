@@ -0,0 +1,192 @@
+#include <climits>
+#include <cstring>
+#include <cwchar>
+#include <algorithm>
+
+#include "ArchiveTree.hpp"
+
+using namespace std;
+
+size_t CArchiveTree::NodeKeyHash::operator()(const NodeKey& nkKey) const
+{
+    // FNV-1a over the parent and the name characters
+    uint64_t ui64Hash = (0xcbf29ce484222325ULL ^ nkKey.ui32Parent) * 0x100000001b3ULL;
+
+    for (uint32_t i = 0; i < nkKey.ui32NameLength; ++i)
+    {
+        ui64Hash ^= static_cast<uint64_t>(nkKey.wszName[i]);
+        ui64Hash *= 0x100000001b3ULL;
+    }
+
+    return static_cast<size_t>(ui64Hash);
+}
+
+bool CArchiveTree::NodeKeyEqual::operator()(const NodeKey& nkLeft, const NodeKey& nkRight) const
+{
+    return nkLeft.ui32Parent == nkRight.ui32Parent && nkLeft.ui32NameLength == nkRight.ui32NameLength &&
+        wmemcmp(nkLeft.wszName, nkRight.wszName, nkLeft.ui32NameLength) == 0;
+}
+
+CArchiveTree::CArchiveTree(const CArchiveIndex& aiIndex)
+{
+    vector<uint32_t> vecChildEnd;
+    uint64_t ui64NamesLength = 1;
+
+    // Components of a path never take more room than the path itself plus a terminator each
+    for (uint32_t i = 0; i < aiIndex.ItemCount(); ++i)
+    {
+        if (aiIndex.Path(i))
+        {
+            ui64NamesLength += aiIndex.Record(i).ui32PathLength + 1;
+        }
+    }
+
+    m_vecNames.reserve(ui64NamesLength);
+    m_mapNodes.reserve(aiIndex.ItemCount() + 1);
+    m_vecNodes.reserve(aiIndex.ItemCount() + 1);
+
+    m_vecNames.push_back(L'\0');
+    m_vecNodes.push_back({0, 0, 0, UINT_MAX, kRootNode, 0, 0});
+
+    for (uint32_t i = 0; i < aiIndex.ItemCount(); ++i)
+    {
+        const wchar_t* wszItemPath = aiIndex.Path(i);
+        uint32_t ui32Node = kRootNode;
+
+        // Parents are created on demand so directories without an item of their own still appear
+        for (const wchar_t* pChar = wszItemPath; pChar && *pChar != L'\0';)
+        {
+            const wchar_t* pEnd = pChar;
+
+            while (*pEnd != L'\0' && *pEnd != SLASH_CHAR)
+            {
+                ++pEnd;
+            }
+            if (pEnd != pChar)
+            {
+                ui32Node = AddChild(ui32Node, pChar, static_cast<uint32_t>(pEnd - pChar));
+            }
+            pChar = *pEnd == L'\0' ? pEnd : pEnd + 1;
+        }
+
+        // Later items win over earlier ones with the same path, as they do on extraction
+        m_vecNodes[ui32Node].ui32ItemIndex = i;
+    }
+
+    // Child lists are laid out contiguously per parent
+    for (uint32_t i = 1; i < m_vecNodes.size(); ++i)
+    {
+        ++m_vecNodes[m_vecNodes[i].ui32Parent].ui32ChildCount;
+    }
+
+    vecChildEnd.resize(m_vecNodes.size());
+    for (uint32_t i = 0, ui32Start = 0; i < m_vecNodes.size(); ++i)
+    {
+        m_vecNodes[i].ui32ChildStart = ui32Start;
+        vecChildEnd[i] = ui32Start;
+        ui32Start += m_vecNodes[i].ui32ChildCount;
+    }
+
+    m_vecChildren.resize(m_vecNodes.size() - 1);
+    for (uint32_t i = 1; i < m_vecNodes.size(); ++i)
+    {
+        m_vecChildren[vecChildEnd[m_vecNodes[i].ui32Parent]++] = i;
+    }
+
+    for (const ArchiveTreeNode& atnNode : m_vecNodes)
+    {
+        sort(m_vecChildren.begin() + atnNode.ui32ChildStart, m_vecChildren.begin() + atnNode.ui32ChildStart + atnNode.ui32ChildCount, [this](uint32_t ui32Left, uint32_t ui32Right)
+        {
+            return wcscmp(NodeName(ui32Left), NodeName(ui32Right)) < 0;
+        });
+    }
+}
+
+uint32_t CArchiveTree::AddChild(uint32_t ui32Parent, const wchar_t* wszName, uint32_t ui32NameLength)
+{
+    const uint32_t ui32Node = static_cast<uint32_t>(m_vecNodes.size());
+    const uint64_t ui64NameOffset = m_vecNames.size();
+    const ArchiveTreeNode& atnParent = m_vecNodes[ui32Parent];
+    const uint64_t ui64PathLength = atnParent.ui64PathLength + (ui32Parent == kRootNode ? 0 : 1) + ui32NameLength;
+
+    auto iterNode = m_mapNodes.find({ui32Parent, ui32NameLength, wszName});
+    if (iterNode != m_mapNodes.end())
+    {
+        return iterNode->second;
+    }
+
+    m_vecNames.insert(m_vecNames.end(), wszName, wszName + ui32NameLength);
+    m_vecNames.push_back(L'\0');
+    m_vecNodes.push_back({ui64NameOffset, ui64PathLength, ui32NameLength, UINT_MAX, ui32Parent, 0, 0});
+    m_mapNodes.emplace(NodeKey{ui32Parent, ui32NameLength, m_vecNames.data() + ui64NameOffset}, ui32Node);
+
+    return ui32Node;
+}
+
+void CArchiveTree::CopyNodePath(uint32_t ui32Node, wchar_t* wszOut) const
+{
+    uint64_t ui64Pos = m_vecNodes[ui32Node].ui64PathLength;
+
+    // Filled from the end while walking up to the root
+    while (ui32Node != kRootNode)
+    {
+        const ArchiveTreeNode& atnNode = m_vecNodes[ui32Node];
+
+        ui64Pos -= atnNode.ui32NameLength;
+        memcpy(wszOut + ui64Pos, m_vecNames.data() + atnNode.ui64NameOffset, atnNode.ui32NameLength * sizeof(wchar_t));
+        if (atnNode.ui32Parent != kRootNode)
+        {
+            wszOut[--ui64Pos] = SLASH_CHAR;
+        }
+        ui32Node = atnNode.ui32Parent;
+    }
+}
+
+bool CArchiveTree::Find(const wchar_t* wszPath, uint32_t* pui32ItemIndex) const
+{
+    uint32_t ui32Node;
+
+    if (!FindNode(wszPath, &ui32Node))
+    {
+        return false;
+    }
+
+    // The root only resolves to an item when the archive has one without a path
+    if (ui32Node == kRootNode && m_vecNodes[ui32Node].ui32ItemIndex == UINT_MAX)
+    {
+        return false;
+    }
+
+    *pui32ItemIndex = m_vecNodes[ui32Node].ui32ItemIndex;
+
+    return true;
+}
+
+bool CArchiveTree::FindNode(const wchar_t* wszPath, uint32_t* pui32Node) const
+{
+    uint32_t ui32Node = kRootNode;
+
+    for (const wchar_t* pChar = wszPath; *pChar != L'\0';)
+    {
+        const wchar_t* pEnd = pChar;
+
+        while (*pEnd != L'\0' && *pEnd != SLASH_CHAR)
+        {
+            ++pEnd;
+        }
+        if (pEnd != pChar)
+        {
+            auto iterNode = m_mapNodes.find({ui32Node, static_cast<uint32_t>(pEnd - pChar), pChar});
+            if (iterNode == m_mapNodes.end())
+            {
+                return false;
+            }
+            ui32Node = iterNode->second;
+        }
+        pChar = *pEnd == L'\0' ? pEnd : pEnd + 1;
+    }
+
+    *pui32Node = ui32Node;
+
+    return true;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "ArchiveIndex.hpp"
+
+// Directory tree of an opened archive keyed by parent node and name, so memory and build time
+// stay linear in the total path length however deep the nesting. It includes the directories
+// that only exist as parents of other items, children are sorted by name.
+class CArchiveTree
+{
+public:
+    static constexpr uint32_t kRootNode = 0;
+
+    explicit CArchiveTree(const CArchiveIndex& aiIndex);
+
+    // Paths are matched component by component, repeated, leading and trailing separators are ignored.
+    // *pui32ItemIndex is UINT_MAX for directories that have no item of their own.
+    bool Find(const wchar_t* wszPath, uint32_t* pui32ItemIndex) const;
+    bool FindNode(const wchar_t* wszPath, uint32_t* pui32Node) const;
+
+    uint32_t NodeItemIndex(uint32_t ui32Node) const
+    {
+        return m_vecNodes[ui32Node].ui32ItemIndex;
+    }
+
+    // Length of the normalized path of the node from the root, in wchar_t units
+    uint64_t NodePathLength(uint32_t ui32Node) const
+    {
+        return m_vecNodes[ui32Node].ui64PathLength;
+    }
+
+    // Writes the NodePathLength characters of the path, without a terminator
+    void CopyNodePath(uint32_t ui32Node, wchar_t* wszOut) const;
+
+    const wchar_t* NodeName(uint32_t ui32Node) const
+    {
+        return m_vecNames.data() + m_vecNodes[ui32Node].ui64NameOffset;
+    }
+
+    uint32_t ChildCount(uint32_t ui32Node) const
+    {
+        return m_vecNodes[ui32Node].ui32ChildCount;
+    }
+
+    uint32_t Child(uint32_t ui32Node, uint32_t ui32Child) const
+    {
+        return m_vecChildren[m_vecNodes[ui32Node].ui32ChildStart + ui32Child];
+    }
+
+private:
+    CArchiveTree(const CArchiveTree&) = delete;
+    CArchiveTree& operator=(const CArchiveTree&) = delete;
+
+    struct ArchiveTreeNode
+    {
+        uint64_t ui64NameOffset;         // Into m_vecNames, NUL terminated
+        uint64_t ui64PathLength;
+        uint32_t ui32NameLength;
+        uint32_t ui32ItemIndex;
+        uint32_t ui32Parent;
+        uint32_t ui32ChildStart;         // Into m_vecChildren
+        uint32_t ui32ChildCount;
+    };
+
+    // Names of stored keys point into m_vecNames, which is sized up front and never reallocated
+    struct NodeKey
+    {
+        uint32_t ui32Parent;
+        uint32_t ui32NameLength;
+        const wchar_t* wszName;
+    };
+
+    struct NodeKeyHash
+    {
+        size_t operator()(const NodeKey& nkKey) const;
+    };
+
+    struct NodeKeyEqual
+    {
+        bool operator()(const NodeKey& nkLeft, const NodeKey& nkRight) const;
+    };
+
+    uint32_t AddChild(uint32_t ui32Parent, const wchar_t* wszName, uint32_t ui32NameLength);
+
+    std::vector<ArchiveTreeNode> m_vecNodes;
+    std::vector<uint32_t> m_vecChildren;
+    std::vector<wchar_t> m_vecNames;
+    std::unordered_map<NodeKey, uint32_t /* Node */, NodeKeyHash, NodeKeyEqual> m_mapNodes;
+};
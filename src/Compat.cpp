@@ -1,5 +1,7 @@
+#include <atomic>
 #include <string>
 
+#include <cerrno>
 #include <cwchar>
 #include <cstdlib>
 #include <cstring>
@@ -8,6 +10,12 @@
 
 #if defined(_WIN32)
 #include <sys\stat.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <sched.h>
 #endif
 
 #include "Compat.hpp"
@@ -47,7 +55,124 @@ string conv(wstring from)
     return to;
 }
 
+// Locale independent, unlike wcstombs. Returns the encoded length, szOut may be nullptr to only
+// measure. UTF-16 surrogate pairs are combined and unpaired surrogates become U+FFFD.
+size_t CompatWideToUtf8(const wchar_t* wszStr, size_t szLength, char* szOut)
+{
+    size_t szOutLength = 0;
+
+    for (size_t i = 0; i < szLength; ++i)
+    {
+        uint32_t ui32Char = static_cast<uint32_t>(wszStr[i]);
+        char szEncoded[4];
+        size_t szEncodedLength;
+
+        if (sizeof(wchar_t) == 2 && ui32Char >= 0xd800 && ui32Char <= 0xdbff && i + 1 < szLength &&
+            static_cast<uint32_t>(wszStr[i + 1]) >= 0xdc00 && static_cast<uint32_t>(wszStr[i + 1]) <= 0xdfff)
+        {
+            ui32Char = 0x10000 + ((ui32Char - 0xd800) << 10) + (static_cast<uint32_t>(wszStr[++i]) - 0xdc00);
+        }
+        else if ((ui32Char >= 0xd800 && ui32Char <= 0xdfff) || ui32Char > 0x10ffff)
+        {
+            ui32Char = 0xfffd;
+        }
+
+        if (ui32Char < 0x80)
+        {
+            szEncoded[0] = static_cast<char>(ui32Char);
+            szEncodedLength = 1;
+        }
+        else if (ui32Char < 0x800)
+        {
+            szEncoded[0] = static_cast<char>(0xc0 | (ui32Char >> 6));
+            szEncoded[1] = static_cast<char>(0x80 | (ui32Char & 0x3f));
+            szEncodedLength = 2;
+        }
+        else if (ui32Char < 0x10000)
+        {
+            szEncoded[0] = static_cast<char>(0xe0 | (ui32Char >> 12));
+            szEncoded[1] = static_cast<char>(0x80 | ((ui32Char >> 6) & 0x3f));
+            szEncoded[2] = static_cast<char>(0x80 | (ui32Char & 0x3f));
+            szEncodedLength = 3;
+        }
+        else
+        {
+            szEncoded[0] = static_cast<char>(0xf0 | (ui32Char >> 18));
+            szEncoded[1] = static_cast<char>(0x80 | ((ui32Char >> 12) & 0x3f));
+            szEncoded[2] = static_cast<char>(0x80 | ((ui32Char >> 6) & 0x3f));
+            szEncoded[3] = static_cast<char>(0x80 | (ui32Char & 0x3f));
+            szEncodedLength = 4;
+        }
+
+        if (szOut)
+        {
+            memcpy(szOut + szOutLength, szEncoded, szEncodedLength);
+        }
+        szOutLength += szEncodedLength;
+    }
+
+    return szOutLength;
+}
+
+// Inverse of CompatWideToUtf8. Returns the decoded length in wchar_t units, wszOut may be nullptr
+// to only measure. Malformed sequences become U+FFFD, one per offending byte.
+size_t CompatUtf8ToWide(const char* szStr, size_t szLength, wchar_t* wszOut)
+{
+    const uint8_t* pBytes = reinterpret_cast<const uint8_t*>(szStr);
+    size_t szOutLength = 0;
+
+    for (size_t i = 0; i < szLength;)
+    {
+        uint32_t ui32Char = pBytes[i];
+        size_t szSequenceLength = ui32Char < 0x80 ? 1 : ui32Char >= 0xc2 && ui32Char <= 0xdf ? 2 : ui32Char >= 0xe0 && ui32Char <= 0xef ? 3 : ui32Char >= 0xf0 && ui32Char <= 0xf4 ? 4 : 0;
+        bool bValid = szSequenceLength != 0 && i + szSequenceLength <= szLength;
+
+        if (bValid && szSequenceLength > 1)
+        {
+            ui32Char &= 0x7f >> szSequenceLength;
+            for (size_t j = 1; j < szSequenceLength && bValid; ++j)
+            {
+                bValid = (pBytes[i + j] & 0xc0) == 0x80;
+                ui32Char = (ui32Char << 6) | (pBytes[i + j] & 0x3f);
+            }
+
+            // Overlong forms, surrogates and values past U+10FFFF are not valid UTF-8
+            bValid = bValid && !(szSequenceLength == 3 && (ui32Char < 0x800 || (ui32Char >= 0xd800 && ui32Char <= 0xdfff))) &&
+                     !(szSequenceLength == 4 && (ui32Char < 0x10000 || ui32Char > 0x10ffff));
+        }
+
+        if (!bValid)
+        {
+            ui32Char = 0xfffd;
+            szSequenceLength = 1;
+        }
+        i += szSequenceLength;
+
+        if (sizeof(wchar_t) == 2 && ui32Char >= 0x10000)
+        {
+            if (wszOut)
+            {
+                wszOut[szOutLength] = static_cast<wchar_t>(0xd800 + ((ui32Char - 0x10000) >> 10));
+                wszOut[szOutLength + 1] = static_cast<wchar_t>(0xdc00 + ((ui32Char - 0x10000) & 0x3ff));
+            }
+            szOutLength += 2;
+        }
+        else
+        {
+            if (wszOut)
+            {
+                wszOut[szOutLength] = static_cast<wchar_t>(ui32Char);
+            }
+            ++szOutLength;
+        }
+    }
+
+    return szOutLength;
+}
+
 #if !defined(_WIN32)
+namespace TitanCompat
+{
 uint32_t SysStringByteLen(const BSTR bstrElement)
 {
     return *(reinterpret_cast<uint32_t*>(bstrElement) - 1);
@@ -82,10 +207,106 @@ void SysFreeString(BSTR bstrStr)
 {
     free(reinterpret_cast<uint32_t*>(bstrStr) - 1);
 }
+}
+
+// File names are bytes on POSIX, encode them as UTF-8 rather than through the process locale. Lone
+// U+DC80-U+DCFF are the bytes Python's surrogateescape could not decode and go back out unchanged.
+static string PathToUtf8(const wchar_t* wszPath)
+{
+    string strPath;
+    const wchar_t* wszRun = wszPath;
+
+    for (const wchar_t* wszChar = wszPath;; ++wszChar)
+    {
+        if (*wszChar == L'\0' || (*wszChar >= 0xdc80 && *wszChar <= 0xdcff))
+        {
+            size_t szRunLength = static_cast<size_t>(wszChar - wszRun);
+            size_t szOffset = strPath.size();
+
+            strPath.resize(szOffset + CompatWideToUtf8(wszRun, szRunLength, nullptr));
+            CompatWideToUtf8(wszRun, szRunLength, &strPath[szOffset]);
+            if (*wszChar == L'\0')
+            {
+                break;
+            }
+            strPath.push_back(static_cast<char>(*wszChar - 0xdc00));
+            wszRun = wszChar + 1;
+        }
+    }
+
+    return strPath;
+}
 
 int CompatOpenArchive(const wchar_t* wszFilename)
 {
-    return open(conv(wszFilename).c_str(), O_RDONLY);
+    return open(PathToUtf8(wszFilename).c_str(), O_RDONLY);
+}
+
+int CompatOpenArchiveBytes(const char* szFilename)
+{
+    return open(szFilename, O_RDONLY);
+}
+
+bool CompatGetFileIdentity(int iFd, CompatFileIdentity* pIdentity)
+{
+    struct stat stFile;
+
+    if (fstat(iFd, &stFile) != 0)
+    {
+        return false;
+    }
+
+    pIdentity->ui64Device = stFile.st_dev;
+    pIdentity->ui64Inode = stFile.st_ino;
+    pIdentity->ui64Size = stFile.st_size;
+    pIdentity->i64MTime = static_cast<int64_t>(stFile.st_mtim.tv_sec) * 1000000000 + stFile.st_mtim.tv_nsec;
+
+    return true;
+}
+
+FILE* CompatFopen(const wchar_t* wszFilename, const wchar_t* wszMode)
+{
+    return fopen(PathToUtf8(wszFilename).c_str(), conv(wszMode).c_str());
+}
+
+int CompatRename(const wchar_t* wszFrom, const wchar_t* wszTo)
+{
+    return rename(PathToUtf8(wszFrom).c_str(), PathToUtf8(wszTo).c_str());
+}
+
+int CompatRemove(const wchar_t* wszFilename)
+{
+    return remove(PathToUtf8(wszFilename).c_str());
+}
+
+bool CompatPinCurrentThread(uint32_t ui32Cpu)
+{
+    cpu_set_t csCpus;
+
+    if (ui32Cpu >= CPU_SETSIZE)
+    {
+        return false;
+    }
+
+    CPU_ZERO(&csCpus);
+    CPU_SET(ui32Cpu, &csCpus);
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(csCpus), &csCpus) == 0;
+}
+
+uint64_t CompatThreadMajorFaults()
+{
+    struct rusage ruUsage;
+
+#if defined(RUSAGE_THREAD)
+    if (getrusage(RUSAGE_THREAD, &ruUsage) == 0)
+#else
+    if (getrusage(RUSAGE_SELF, &ruUsage) == 0)
+#endif
+    {
+        return static_cast<uint64_t>(ruUsage.ru_majflt);
+    }
+    return 0;
 }
 #endif
 
@@ -102,4 +323,93 @@ int CompatOpenArchive(const wchar_t* wszFilename)
     }
     return iFd;
 }
-#endif
\ No newline at end of file
+
+int CompatOpenArchiveBytes(const char* szFilename)
+{
+    size_t szLength = strlen(szFilename);
+    wstring wstrFilename(CompatUtf8ToWide(szFilename, szLength, nullptr), L'\0');
+
+    CompatUtf8ToWide(szFilename, szLength, &wstrFilename[0]);
+
+    return CompatOpenArchive(wstrFilename.c_str());
+}
+
+bool CompatGetFileIdentity(int iFd, CompatFileIdentity* pIdentity)
+{
+    BY_HANDLE_FILE_INFORMATION bhfiFile;
+
+    if (!GetFileInformationByHandle(reinterpret_cast<HANDLE>(_get_osfhandle(iFd)), &bhfiFile))
+    {
+        return false;
+    }
+
+    pIdentity->ui64Device = bhfiFile.dwVolumeSerialNumber;
+    pIdentity->ui64Inode = (static_cast<uint64_t>(bhfiFile.nFileIndexHigh) << 32) | bhfiFile.nFileIndexLow;
+    pIdentity->ui64Size = (static_cast<uint64_t>(bhfiFile.nFileSizeHigh) << 32) | bhfiFile.nFileSizeLow;
+    pIdentity->i64MTime = static_cast<int64_t>((static_cast<uint64_t>(bhfiFile.ftLastWriteTime.dwHighDateTime) << 32) | bhfiFile.ftLastWriteTime.dwLowDateTime);
+
+    return true;
+}
+
+FILE* CompatFopen(const wchar_t* wszFilename, const wchar_t* wszMode)
+{
+    FILE* pFile = nullptr;
+
+    if (_wfopen_s(&pFile, wszFilename, wszMode) != 0)
+    {
+        return nullptr;
+    }
+    return pFile;
+}
+
+int CompatRename(const wchar_t* wszFrom, const wchar_t* wszTo)
+{
+    return MoveFileExW(wszFrom, wszTo, MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+}
+
+int CompatRemove(const wchar_t* wszFilename)
+{
+    return _wremove(wszFilename);
+}
+
+bool CompatPinCurrentThread(uint32_t ui32Cpu)
+{
+    if (ui32Cpu >= sizeof(DWORD_PTR) * 8)
+    {
+        return false;
+    }
+
+    return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << ui32Cpu) != 0;
+}
+
+uint64_t CompatThreadMajorFaults()
+{
+    // Windows only counts page faults per process and does not tell hard from soft ones
+    return 0;
+}
+#endif
+
+FILE* CompatCreateTemp(const wchar_t* wszTarget, wstring& wstrTempPath)
+{
+    static atomic_uint s_uiNextTemp(0);
+#if defined(_WIN32)
+    wstring wstrPrefix = wstring(wszTarget) + L"." + to_wstring(_getpid()) + L".";
+#else
+    wstring wstrPrefix = wstring(wszTarget) + L"." + to_wstring(getpid()) + L".";
+#endif
+
+    // The pid keeps processes apart and the counter keeps threads apart, the exclusive open catches the rest
+    for (uint32_t ui32Attempt = 0; ui32Attempt < 100; ui32Attempt++)
+    {
+        FILE* pFile;
+
+        wstrTempPath = wstrPrefix + to_wstring(s_uiNextTemp++) + L".tmp";
+        pFile = CompatFopen(wstrTempPath.c_str(), L"wbx");
+        if (pFile || errno != EEXIST)
+        {
+            return pFile;
+        }
+    }
+
+    return nullptr;
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdio>
+
 #define DEFINE_GUID_CE(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) constexpr GUID name = {l, w1, w2, {b1, b2,  b3,  b4,  b5,  b6,  b7,  b8}}
 
 #if defined(_WIN32)
@@ -36,12 +38,18 @@ typedef void*                               CompatModule;
 #define E_NOINTERFACE (0x80004002)
 #define E_OUTOFMEMORY (0x80004003)
 #define E_NOTIMPL     (0x80004001)
+#define E_ABORT       (0x80004004)
+#define E_INVALIDARG  (0x80070057)
 #define STG_E_INVALIDFUNCTION ((HRESULT)0x80030001L)
 #define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
 #define FAILED(hr) (((HRESULT)(hr)) < 0)
 #define SLASH_STR                           L"/"
 #define SLASH_CHAR                          L'/'
 
+// Mirrors of the 7-Zip COM types. They get their own namespace so a build linking 7-Zip in
+// (TITANARCHIVE_STATIC_7Z) holds one definition of each of 7-Zip's global types and functions.
+namespace TitanCompat
+{
 typedef struct _GUID {
     uint32_t  Data1;
     uint16_t  Data2;
@@ -70,7 +78,11 @@ typedef struct {
 typedef uint16_t VARTYPE;
 typedef uint32_t PROPID;
 
+#define VT_EMPTY	(0)
 #define VT_BSTR		(8)
+#define VT_BOOL		(11)
+#define VT_UI4		(19)
+#define VT_UI8		(21)
 
 typedef wchar_t* BSTR;
 typedef short VARIANT_BOOL;
@@ -123,14 +135,38 @@ typedef enum tagSTREAM_SEEK
 uint32_t SysStringByteLen(const BSTR bstrElement);
 BSTR SysAllocString(const wchar_t* wszStr);
 void SysFreeString(BSTR bstrStr);
+}
+
+using namespace TitanCompat;
 #else
 #error "Unknown Platform"
 #endif
 #endif
 
+struct CompatFileIdentity
+{
+    uint64_t ui64Device;
+    uint64_t ui64Inode;
+    uint64_t ui64Size;
+    int64_t i64MTime;
+};
+
 int CompatOpenArchive(const wchar_t* wszFilename);
+// Opens a file name in the file system encoding, raw bytes on POSIX and UTF-8 on Windows
+int CompatOpenArchiveBytes(const char* szFilename);
+bool CompatGetFileIdentity(int iFd, CompatFileIdentity* pIdentity);
+FILE* CompatFopen(const wchar_t* wszFilename, const wchar_t* wszMode);
+int CompatRename(const wchar_t* wszFrom, const wchar_t* wszTo);
+int CompatRemove(const wchar_t* wszFilename);
+// Creates a file next to wszTarget that no other writer can be using and returns its path in wstrTempPath
+FILE* CompatCreateTemp(const wchar_t* wszTarget, std::wstring& wstrTempPath);
+bool CompatPinCurrentThread(uint32_t ui32Cpu);
+// Major page faults taken by the calling thread (the whole process where threads are not tracked)
+uint64_t CompatThreadMajorFaults();
 std::wstring conv(std::string from);
 std::string conv(std::wstring from);
+size_t CompatWideToUtf8(const wchar_t* wszStr, size_t szLength, char* szOut);
+size_t CompatUtf8ToWide(const char* szStr, size_t szLength, wchar_t* wszOut);
 
 class CompatMmap
 {
@@ -153,6 +189,11 @@ public:
         return *this;
     }
 
+    size_t Length() const
+    {
+        return m_szLength;
+    }
+
     void* Addr()
     {
 #if defined(_WIN32)
@@ -192,6 +233,7 @@ public:
         if (!m_pAddr)
         {
             Clear();
+            return;
         }
 #else
 #if defined(__GNUC__)
@@ -199,11 +241,13 @@ public:
         if (m_pAddr == reinterpret_cast<void*>(-1))
         {
             Clear();
+            return;
         }
 #else
 #error "Unknown Platform"
 #endif
 #endif
+        m_szLength = szLength;
     }
 
     void Clear(bool bFree = true)
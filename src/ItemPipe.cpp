@@ -0,0 +1,85 @@
+#include <cstring>
+#include <algorithm>
+
+#include "ItemPipe.hpp"
+
+using namespace std;
+
+CItemPipe::CItemPipe(size_t szCapacity) : m_vecBuf(szCapacity ? szCapacity : 1)
+{
+}
+
+bool CItemPipe::Write(const uint8_t* pData, size_t szSize)
+{
+    unique_lock<mutex> ulLock(m_mLock);
+
+    while (szSize)
+    {
+        m_cvWritable.wait(ulLock, [this] { return m_bCancelled || m_szUsed < m_vecBuf.size(); });
+        if (m_bCancelled)
+        {
+            return false;
+        }
+
+        // Copies up to the end of the free region or the end of the ring, whichever is first
+        const size_t szTail = (m_szHead + m_szUsed) % m_vecBuf.size();
+        const size_t szChunk = min(szSize, min(m_vecBuf.size() - m_szUsed, m_vecBuf.size() - szTail));
+        memcpy(m_vecBuf.data() + szTail, pData, szChunk);
+        m_szUsed += szChunk;
+        pData += szChunk;
+        szSize -= szChunk;
+
+        m_cvReadable.notify_one();
+    }
+
+    return true;
+}
+
+void CItemPipe::Finish(HRESULT hrResult)
+{
+    lock_guard<mutex> lgLock(m_mLock);
+    m_bFinished = true;
+    m_hrResult = hrResult;
+    m_cvReadable.notify_one();
+}
+
+size_t CItemPipe::Read(uint8_t* pBuf, size_t szSize, HRESULT* phrResult)
+{
+    unique_lock<mutex> ulLock(m_mLock);
+    size_t szRead = 0;
+
+    *phrResult = S_OK;
+    if (!szSize)
+    {
+        return 0;
+    }
+
+    m_cvReadable.wait(ulLock, [this] { return m_bFinished || m_szUsed; });
+
+    while (szRead < szSize && m_szUsed)
+    {
+        const size_t szChunk = min(szSize - szRead, min(m_szUsed, m_vecBuf.size() - m_szHead));
+        memcpy(pBuf + szRead, m_vecBuf.data() + m_szHead, szChunk);
+        m_szHead = (m_szHead + szChunk) % m_vecBuf.size();
+        m_szUsed -= szChunk;
+        szRead += szChunk;
+    }
+
+    if (szRead)
+    {
+        m_cvWritable.notify_one();
+    }
+    else
+    {
+        *phrResult = m_hrResult;
+    }
+
+    return szRead;
+}
+
+void CItemPipe::Cancel()
+{
+    lock_guard<mutex> lgLock(m_mLock);
+    m_bCancelled = true;
+    m_cvWritable.notify_one();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <condition_variable>
+
+#include "Compat.hpp"
+
+// Bounded byte pipe between a thread decoding an item and the thread reading it. The writer
+// blocks while the pipe is full and the reader while it is empty, so memory stays at the capacity.
+class CItemPipe
+{
+public:
+    CItemPipe(size_t szCapacity);
+
+    // Blocks until all of pData is queued, false once the reader cancelled
+    bool Write(const uint8_t* pData, size_t szSize);
+    // Called by the writer after the last Write with the decoding result
+    void Finish(HRESULT hrResult);
+
+    // Blocks until data is available, returns 0 at the end of the item. *phrResult receives the
+    // decoding result once the end is reached and S_OK before.
+    size_t Read(uint8_t* pBuf, size_t szSize, HRESULT* phrResult);
+    // Wakes a blocked writer, its following writes fail
+    void Cancel();
+
+private:
+    std::mutex m_mLock;
+    std::condition_variable m_cvReadable;
+    std::condition_variable m_cvWritable;
+    std::vector<uint8_t> m_vecBuf;
+    size_t m_szHead = 0;    // Next byte to read
+    size_t m_szUsed = 0;
+    bool m_bFinished = false;
+    bool m_bCancelled = false;
+    HRESULT m_hrResult = S_OK;
+};
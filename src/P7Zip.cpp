@@ -1,30 +1,34 @@
 #include <cstdlib>
 #include <cstring>
 
+#include <map>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <chrono>
+#include <algorithm>
 
 #include <fcntl.h>
 
 #include "Compat.hpp"
 #include "P7Zip.hpp"
+#include "ArchiveCache.hpp"
+#include "ThreadPool.hpp"
+#include "PathMatcher.hpp"
+#include "Trace.hpp"
 
 using namespace std;
 
-static CompatModule s_p7zModule = nullptr;
-static bool s_bIsInitialized = false;
-
-using fnCreateObject = HRESULT(*)(const GUID*, const GUID*, void**);
-using fnGetNumberOfFormats = HRESULT(*)(uint32_t*);
-using fnGetHandlerProperty2 = HRESULT(*)(uint32_t, PROPID, PROPVARIANT*);
-static fnCreateObject s_CreateObject = nullptr;
-static fnGetNumberOfFormats s_GetNumberOfFormats = nullptr;
-static fnGetHandlerProperty2 s_GetHandlerProperty2 = nullptr;
-static unordered_map<wstring /* Name */, ArchiveType> s_mapSupportedFormats;
-static wstring s_wstrSupportedFormats;
+// The published FormatRegistry, nullptr while uninitialized. Readers register in the current
+// epoch before loading the slot so a publisher only frees the previous slot once every reader
+// that could have loaded it holds its own reference. Opening never takes a lock (std::atomic_load
+// on a shared_ptr would), publishers are serialized by s_mRegistryLock.
+static atomic<shared_ptr<const FormatRegistry>*> s_pspRegistry(nullptr);
+static atomic<uint32_t> s_ui32RegistryEpoch(0);
+static atomic<uint32_t> s_ui32RegistryReaders[2];
+static mutex s_mRegistryLock;
 
 // #define SINGLE_THREADED_ITERATION
 
@@ -32,15 +36,27 @@ static wstring s_wstrSupportedFormats;
 #pragma message("Single threaded iteration is enabled")
 #endif
 
+// Per item cost of IterateItems callbacks in nanoseconds, measured on every run. The initial
+// guess keeps ranges below 500 items on the calling thread.
+static atomic<uint64_t> s_ui64ItemCost(400);
+constexpr uint64_t ui64ParallelCostThreshold = 200000;
+constexpr uint64_t ui64ChunkCost = 50000;
+
+// Closed handlers kept per format, enough for a burst of concurrent opens
+constexpr size_t szMaxPooledHandlers = 16;
+
+// Decoded bytes an item stream buffers ahead of its reader when no size is given
+constexpr uint64_t ui64DefaultItemStreamBuffer = 1 << 20;
+
 #define INIT_CHECK()                                                    \
-if (!s_bIsInitialized)                                                  \
+if (!s_pspRegistry.load())                                              \
 {                                                                       \
     SetError(E_FAIL, "GlobalInitialize has not been called");           \
     return ARCHIVER_STATUS_FAILURE;                                     \
 }
 #define ARCHIVE_LOADED()                                                \
 INIT_CHECK()                                                            \
-if (!m_pInArchive)                                                      \
+if (!m_pInArchive && !m_spIndex)                                        \
 {                                                                       \
     SetError(E_FAIL, L"Archive has not been loaded");                   \
     return ARCHIVER_STATUS_FAILURE;                                     \
@@ -56,6 +72,67 @@ if (!val)                                                               \
     return ARCHIVER_STATUS_FAILURE;                                     \
 }
 
+#if defined(TITANARCHIVE_STATIC_7Z)
+// Entry points of the 7-Zip Format7zF bundle when it is linked into this library. The COM types
+// are left opaque, ours are only mirrors of 7-Zip's and would be a second definition under LTO.
+extern "C"
+{
+    HRESULT CreateObject(const void* pClassId, const void* pInterfaceId, void** ppObject);
+    HRESULT GetNumberOfFormats(uint32_t* pui32NumFormats);
+    HRESULT GetHandlerProperty2(uint32_t ui32FormatIndex, PROPID propId, void* pValue);
+}
+#endif
+
+static shared_ptr<const FormatRegistry> AcquireFormatRegistry()
+{
+    shared_ptr<const FormatRegistry> spRegistry;
+    shared_ptr<const FormatRegistry>* pspRegistry;
+    uint32_t ui32Epoch;
+
+    for (;;)
+    {
+        ui32Epoch = s_ui32RegistryEpoch.load();
+        s_ui32RegistryReaders[ui32Epoch & 1].fetch_add(1);
+        if (s_ui32RegistryEpoch.load() == ui32Epoch)
+        {
+            break;
+        }
+        // A publisher moved on before this reader was counted, it may not wait for us
+        s_ui32RegistryReaders[ui32Epoch & 1].fetch_sub(1);
+    }
+
+    pspRegistry = s_pspRegistry.load();
+    if (pspRegistry)
+    {
+        spRegistry = *pspRegistry;
+    }
+
+    s_ui32RegistryReaders[ui32Epoch & 1].fetch_sub(1);
+
+    return spRegistry;
+}
+
+// Caller holds s_mRegistryLock
+static void PublishFormatRegistry(shared_ptr<const FormatRegistry>* pspRegistry)
+{
+    shared_ptr<const FormatRegistry>* pspPrevious = s_pspRegistry.exchange(pspRegistry);
+    uint32_t ui32Epoch = s_ui32RegistryEpoch.fetch_add(1);
+
+    // Readers arriving from now on count in the other epoch, so this only waits for the ones
+    // that may still be copying the previous slot
+    while (s_ui32RegistryReaders[ui32Epoch & 1].load() != 0)
+    {
+        this_thread::yield();
+    }
+
+    delete pspPrevious;
+}
+
+static shared_ptr<void> ShareModule(CompatModule pModule)
+{
+    return shared_ptr<void>(pModule, [](void* pLoaded) { dlclose(static_cast<CompatModule>(pLoaded)); });
+}
+
 C7ZipArchiver::C7ZipArchiver() {}
 
 C7ZipArchiver::~C7ZipArchiver()
@@ -65,21 +142,60 @@ C7ZipArchiver::~C7ZipArchiver()
 
 ARCHIVER_STATUS C7ZipArchiver::OpenArchiveMemory(uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword, const wchar_t* wszFormat)
 {
+    TRACE_SCOPE("OpenArchiveMemory", ui64BufSize, wszFormat);
     INIT_CHECK();
     CloseArchive();
-    
+
+    if (!AttachFormatRegistry())
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    // Memory opens bypass the archive cache, an idle handler would outlive the caller's buffer
+    if (OpenInArchive(pBuf, ui64BufSize, wszPassword, wszFormat) != ARCHIVER_STATUS_SUCCESS)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    m_pBuf = pBuf;
+    m_ui64BufSize = ui64BufSize;
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::OpenInArchive(uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword, const wchar_t* wszFormat)
+{
     HRESULT hr;
     IInArchive* pInArchive = nullptr;
     CBufInStream* pBufInStream = nullptr;
     CArchiveOpenCallback* pArchiveOpenCallback = nullptr;
+    CStatsTimer stOpen(m_pStats, StatsHistogram::Open);
 
     if (!wszFormat)
     {
         wszFormat = DiscoverArchiveFormat(pBuf, ui64BufSize);
         if (!wszFormat)
         {
-            SetError(E_FAIL, L"Unable to discover archive format");
-            return ARCHIVER_STATUS_FAILURE;
+            if (m_vecTrialFormats.empty())
+            {
+                SetError(E_FAIL, L"Unable to discover archive format");
+                return ARCHIVER_STATUS_FAILURE;
+            }
+
+            pInArchive = TrialOpenArchive(pBuf, ui64BufSize, wszPassword, &wszFormat);
+            if (!pInArchive)
+            {
+                return ARCHIVER_STATUS_FAILURE;
+            }
+            m_pInArchive = pInArchive;
+            m_wstrArchiveFormat = wszFormat;
+
+            if (wszPassword)
+            {
+                m_wstrPassword = wszPassword;
+            }
+
+            return ARCHIVER_STATUS_SUCCESS;
         }
     }
 
@@ -118,7 +234,12 @@ ARCHIVER_STATUS C7ZipArchiver::OpenArchiveMemory(uint8_t* pBuf, uint64_t ui64Buf
         pArchiveOpenCallback->AddRef();
     }
 
-    hr = m_pInArchive->Open(pBufInStream, nullptr, pArchiveOpenCallback);
+    {
+        TRACE_SCOPE("InArchiveOpen", ui64BufSize, wszFormat);
+        hr = m_pInArchive->Open(pBufInStream, nullptr, pArchiveOpenCallback);
+    }
+    m_pStats->Add(StatsCounter::Opens, 1);
+    m_pStats->Add(StatsCounter::HeaderBytesRead, pBufInStream->GetBytesRead());
 
     if (pArchiveOpenCallback)
     {
@@ -127,9 +248,12 @@ ARCHIVER_STATUS C7ZipArchiver::OpenArchiveMemory(uint8_t* pBuf, uint64_t ui64Buf
 
     pBufInStream->Release();
 
-    if (FAILED(hr))
+    // Handlers return S_FALSE when the data is not in their format
+    if (hr != S_OK)
     {
-        SetError(hr, L"InArchive Open failed");
+        SetError(FAILED(hr) ? hr : E_FAIL, L"InArchive Open failed");
+        RecycleInArchive(m_pInArchive, wszFormat);
+        m_pInArchive = nullptr;
         return ARCHIVER_STATUS_FAILURE;
     }
 
@@ -137,21 +261,30 @@ ARCHIVER_STATUS C7ZipArchiver::OpenArchiveMemory(uint8_t* pBuf, uint64_t ui64Buf
 }
 
 ARCHIVER_STATUS C7ZipArchiver::OpenArchiveDisk(const wchar_t* wszPath, const wchar_t* wszPassword, const wchar_t* wszFormat)
+{
+    return OpenArchiveDiskIndexed(wszPath, nullptr, wszPassword, wszFormat);
+}
+
+ARCHIVER_STATUS C7ZipArchiver::OpenArchiveDiskIndexed(const wchar_t* wszPath, const wchar_t* wszIndexPath, const wchar_t* wszPassword, const wchar_t* wszFormat)
 {
     INIT_CHECK();
     CloseArchive();
 
-    int iFd;
+    return OpenOwnedFD(CompatOpenArchive(wszPath), wszIndexPath, wszPassword, wszFormat);
+}
+
+// Opens the archive on a descriptor the context owns and closes, iFd is -1 when the open failed
+ARCHIVER_STATUS C7ZipArchiver::OpenOwnedFD(int iFd, const wchar_t* wszIndexPath, const wchar_t* wszPassword, const wchar_t* wszFormat)
+{
     ARCHIVER_STATUS asStatus;
-    
-    iFd = CompatOpenArchive(wszPath);
+
     if (iFd == -1)
     {
         SetError(errno, L"Unable to open file");
         return ARCHIVER_STATUS_FAILURE;
     }
 
-    asStatus = OpenArchiveFD(iFd, wszPassword, wszFormat);
+    asStatus = OpenArchiveFDIndexed(iFd, wszIndexPath, wszPassword, wszFormat);
     if (asStatus != ARCHIVER_STATUS_SUCCESS)
     {
         close(iFd);
@@ -165,12 +298,28 @@ ARCHIVER_STATUS C7ZipArchiver::OpenArchiveDisk(const wchar_t* wszPath, const wch
 
 ARCHIVER_STATUS C7ZipArchiver::OpenArchiveFD(int iFd, const wchar_t* wszPassword, const wchar_t* wszFormat)
 {
+    return OpenArchiveFDIndexed(iFd, nullptr, wszPassword, wszFormat);
+}
+
+ARCHIVER_STATUS C7ZipArchiver::OpenArchiveFDIndexed(int iFd, const wchar_t* wszIndexPath, const wchar_t* wszPassword, const wchar_t* wszFormat)
+{
+    TRACE_SCOPE("OpenArchiveFD", static_cast<uint64_t>(iFd), wszFormat);
     INIT_CHECK();
     CloseArchive();
 
-    CompatMmap cmMmap;
+    if (!AttachFormatRegistry())
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    shared_ptr<CompatMmap> spMmap;
     off64_t off64Size;
-    ARCHIVER_STATUS asStatus;
+    ArchiveCacheKey ackKey;
+    ArchiveCacheLease aclLease;
+    shared_ptr<CArchiveIndex> spIndex;
+    CompatFileIdentity cfiFile;
+    bool bHasFileIdentity;
+    bool bUseCache = false;
 
     iFd = dup(iFd);
     if (iFd == -1)
@@ -201,22 +350,103 @@ ARCHIVER_STATUS C7ZipArchiver::OpenArchiveFD(int iFd, const wchar_t* wszPassword
         return ARCHIVER_STATUS_FAILURE;
     }
 
-    cmMmap.Set(iFd, static_cast<size_t>(off64Size));
-    if (cmMmap.Addr() == reinterpret_cast<void*>(-1))
+    bHasFileIdentity = CompatGetFileIdentity(iFd, &cfiFile);
+
+    // A valid sidecar answers metadata queries, the handler is only opened once an item is extracted
+    if (wszIndexPath && bHasFileIdentity)
+    {
+        spIndex = CArchiveIndex::Load(wszIndexPath, cfiFile, wszFormat);
+    }
+
+    if (!spIndex && m_bCacheAttached && CArchiveCache::Instance().IsEnabled() && bHasFileIdentity)
+    {
+        bUseCache = true;
+        ackKey = ArchiveCacheKey::FromFile(cfiFile, wszPassword);
+        if (CArchiveCache::Instance().Acquire(ackKey, wszFormat, &aclLease))
+        {
+            close(iFd);
+
+            if (aclLease.pHandler)
+            {
+                AdoptCachedArchive(aclLease, wszPassword);
+                m_ackCacheKey = move(ackKey);
+                m_bHasCacheKey = true;
+                m_bHasFileIdentity = true;
+                m_cfiFile = cfiFile;
+                if (wszIndexPath && BuildArchiveIndex() == ARCHIVER_STATUS_SUCCESS)
+                {
+                    m_spIndex->Save(wszIndexPath, m_cfiFile);
+                }
+                return ARCHIVER_STATUS_SUCCESS;
+            }
+
+            spMmap = aclLease.spMmap;
+            wszFormat = aclLease.wstrFormat.c_str();
+        }
+    }
+
+    if (!spMmap)
     {
-        SetError(errno, L"Unable to mmap file");
+        try
+        {
+            spMmap = make_shared<CompatMmap>();
+        }
+        catch (...)
+        {
+            SetError(E_OUTOFMEMORY, L"Out of memory creating CompatMmap");
+            close(iFd);
+            return ARCHIVER_STATUS_FAILURE;
+        }
+
+        spMmap->Set(iFd, static_cast<size_t>(off64Size));
+        if (spMmap->Addr() == reinterpret_cast<void*>(-1))
+        {
+            SetError(errno, L"Unable to mmap file");
+            close(iFd);
+            return ARCHIVER_STATUS_FAILURE;
+        }
         close(iFd);
-        return ARCHIVER_STATUS_FAILURE;
+        m_pStats->Add(StatsCounter::MmapBytes, spMmap->Length());
     }
-    close(iFd);
 
-    asStatus = OpenArchiveMemory(static_cast<uint8_t*>(cmMmap.Addr()), off64Size, wszPassword, wszFormat);
-    if (asStatus != ARCHIVER_STATUS_SUCCESS)
+    m_pBuf = static_cast<uint8_t*>(spMmap->Addr());
+    m_ui64BufSize = spMmap->Length();
+    m_bHasFileIdentity = bHasFileIdentity;
+    m_cfiFile = cfiFile;
+
+    if (spIndex)
+    {
+        m_spMmap = move(spMmap);
+        m_spIndex = move(spIndex);
+        m_wstrArchiveFormat = m_spIndex->Format();
+        if (wszPassword)
+        {
+            m_wstrPassword = wszPassword;
+        }
+        return ARCHIVER_STATUS_SUCCESS;
+    }
+
+    if (OpenInArchive(m_pBuf, m_ui64BufSize, wszPassword, wszFormat) != ARCHIVER_STATUS_SUCCESS)
     {
+        m_pBuf = nullptr;
+        m_ui64BufSize = 0;
+        m_bHasFileIdentity = false;
         return ARCHIVER_STATUS_FAILURE;
     }
 
-    m_cmMmap = move(cmMmap);
+    m_spMmap = move(spMmap);
+
+    if (bUseCache)
+    {
+        m_ackCacheKey = move(ackKey);
+        m_bHasCacheKey = true;
+    }
+
+    // A missing or stale sidecar is rebuilt, failing to write it does not fail the open
+    if (wszIndexPath && bHasFileIdentity && BuildArchiveIndex() == ARCHIVER_STATUS_SUCCESS)
+    {
+        m_spIndex->Save(wszIndexPath, m_cfiFile);
+    }
 
     return ARCHIVER_STATUS_SUCCESS;
 }
@@ -268,6 +498,12 @@ ARCHIVER_STATUS C7ZipArchiver::GetArchiveItemCount(uint32_t* pArchiveItemCount)
 
     HRESULT hr;
 
+    if (m_spIndex)
+    {
+        *pArchiveItemCount = m_spIndex->ItemCount();
+        return ARCHIVER_STATUS_SUCCESS;
+    }
+
     hr = m_pInArchive->GetNumberOfItems(pArchiveItemCount);
     if (FAILED(hr))
     {
@@ -283,10 +519,12 @@ ARCHIVER_STATUS C7ZipArchiver::ListDirectory(const wchar_t* wszPath, ArchiveItem
 {
     ARCHIVE_LOADED();
     
-    unordered_map<wstring, ArchiveItem*> mapItems;
-    volatile bool bHasDirectory = false;
-    volatile bool bHasFailure = false;
-    mutex mLock;
+    ArchiveItem* pItems;
+    wchar_t* pPool;
+    uint32_t ui32ItemCount;
+    uint64_t ui64PoolLength = 0;
+    uint32_t ui32Node;
+    bool bHasRootItem;
 
     *ppItems = nullptr;
     
@@ -295,592 +533,2056 @@ ARCHIVER_STATUS C7ZipArchiver::ListDirectory(const wchar_t* wszPath, ArchiveItem
         *pItemCount = 0;
     }
 
-    if (IterateItems([=, &mLock, &bHasFailure, &bHasDirectory, &mapItems](uint32_t ui32Start, uint32_t ui32End)
-    {
-        C7ZipProperty c7zPropPath(m_pInArchive);
-        unordered_set<wstring> setDiscoveredDirectories;
-        unordered_map<wstring, ArchiveItem*> mapLocalItems;
-        
-        for (uint32_t i = ui32Start; i < ui32End && !bHasFailure; ++i)
-        {
-            wchar_t* pSlash = nullptr;
-            
-            if (FAILED(c7zPropPath.GetProperty(i, kpidPath)))
-            {
-                continue;
-            }
-
-            if (c7zPropPath->bstrVal)
-            {
-                pSlash = wcsrchr(c7zPropPath->bstrVal, SLASH_CHAR);
-            }
-
-            if (!pSlash)
-            {
-                if (*wszPath == L'\0')
-                {
-                    ArchiveItem* pItem;
-                    if (GetArchiveItemProperties(i, &pItem) == ARCHIVER_STATUS_FAILURE)
-                    {
-                        bHasFailure = true;
-                        break;
-                    }
-                    else
-                    {
-                        mapLocalItems[pItem->wszPath] = pItem;
-                    }
-                }
-            }
-            else
-            {
-                *pSlash = L'\0';
-                if (wcscmp(wszPath, c7zPropPath->bstrVal) == 0)
-                {
-                    *pSlash = SLASH_CHAR;
-                    if (*(pSlash + 1) != L'\0' && !wcschr(pSlash + 1, SLASH_CHAR))
-                    {
-                        ArchiveItem* pItem;
-                        if (GetArchiveItemProperties(i, &pItem) == ARCHIVER_STATUS_FAILURE)
-                        {
-                            bHasFailure = true;
-                            break;
-                        }
-                        else
-                        {
-                            mapLocalItems[pItem->wszPath] = pItem;
-                        }
-                    }
-                }
-                else
-                {
-                    if (!wcschr(c7zPropPath->bstrVal, SLASH_CHAR) && *wszPath == L'\0')
-                    {
-                        setDiscoveredDirectories.insert(c7zPropPath->bstrVal);
-                    }
-                    
-                    *pSlash = SLASH_CHAR;
-                }
-            }
-            
-            if (!bHasDirectory && wcswcs(c7zPropPath->bstrVal, wszPath) == c7zPropPath->bstrVal)
-            {
-                bHasDirectory = true;
-            }
-            
-        }
-        
-        mLock.lock();
-        for (const auto& iterItem : mapLocalItems)
-        {
-            auto iterItem2 = mapItems.find(iterItem.first);
-            if (iterItem2 != mapItems.end())
-            {
-                FreeArchiveItem(iterItem2->second);
-            }
-            mapItems[iterItem.first] = iterItem.second;
-        }
-        
-        for (const wstring& wstrDirectory : setDiscoveredDirectories)
-        {
-            if (mapItems.find(wstrDirectory) == mapItems.end())
-            {
-                ArchiveItem* pItem = CreateDirectoryPlaceholder(wstrDirectory.c_str());
-                if (!pItem)
-                {
-                    bHasFailure = true;
-                    break;
-                }
-                else
-                {
-                    mapItems[wstrDirectory] = pItem;
-                }
-            }
-        }
-        mLock.unlock();
-        
-    }) == ARCHIVER_STATUS_FAILURE)
+    if (EnsureArchiveTree() != ARCHIVER_STATUS_SUCCESS)
     {
         return ARCHIVER_STATUS_FAILURE;
     }
 
-    for (auto iterItemNext = mapItems.begin(); iterItemNext != mapItems.end();)
-    {
-        auto iterItem = iterItemNext++;
-        wchar_t* wszOldPath = iterItem->second->wszPath;
-        wchar_t* wszBaseName;
-        if (iterItemNext != mapItems.end())
-        {
-            iterItem->second->pItemNext = iterItemNext->second;
-        }
-        wszBaseName = wcsrchr(wszOldPath, SLASH_CHAR);
-        wszBaseName = wszBaseName ? wszBaseName + 1 : wszOldPath;
-        if (wszBaseName != wszOldPath)
-        {
-            iterItem->second->wszPath = SysAllocString(wszBaseName);
-            SysFreeString(wszOldPath);
-        }
-    }
-    
-    if (bHasFailure || !bHasDirectory)
+    if (!m_spArchiveTree->FindNode(wszPath, &ui32Node))
     {
-        if (mapItems.size() > 0)
-        {
-            FreeArchiveItem(mapItems.begin()->second);
-        }
+        SetError(E_FAIL, L"Path not found");
         return ARCHIVER_STATUS_FAILURE;
     }
 
-    if (mapItems.size() > 0)
+    // An item without a path is listed at the root
+    bHasRootItem = ui32Node == CArchiveTree::kRootNode && m_spArchiveTree->NodeItemIndex(ui32Node) != UINT_MAX;
+    ui32ItemCount = m_spArchiveTree->ChildCount(ui32Node) + (bHasRootItem ? 1 : 0);
+
+    if (ui32ItemCount == 0)
     {
-        *ppItems = mapItems.begin()->second;
+        return ARCHIVER_STATUS_SUCCESS;
     }
 
-    if (pItemCount)
+    for (uint32_t i = 0; i < m_spArchiveTree->ChildCount(ui32Node); ++i)
     {
-        *pItemCount = mapItems.size();
+        ui64PoolLength += wcslen(m_spArchiveTree->NodeName(m_spArchiveTree->Child(ui32Node, i))) + 1;
     }
+    ui64PoolLength += bHasRootItem ? 1 : 0;
 
-    return ARCHIVER_STATUS_SUCCESS;
-}
-
-ARCHIVER_STATUS C7ZipArchiver::GetArchiveItemProperties(const wchar_t* wszPath, ArchiveItem** ppItem)
-{
-    ARCHIVE_LOADED();
-
-    volatile uint32_t ui32FoundItem = UINT_MAX;
-    volatile bool bHasDirectory = false;
-    
-    if (IterateItems([=, &bHasDirectory, &ui32FoundItem](uint32_t ui32Start, uint32_t ui32End)
-    {
-        C7ZipProperty c7zPropPath(m_pInArchive);
-        
-        for (uint32_t i = ui32Start; i < ui32End && ui32FoundItem == UINT_MAX; ++i)
-        {
-            if (FAILED(c7zPropPath.GetProperty(i, kpidPath)))
-            {
-                continue;
-            }
-            
-            if (c7zPropPath->bstrVal)
-            {
-                if (wcscmp(wszPath, c7zPropPath->bstrVal) == 0)
-                {
-                    ui32FoundItem = i;
-                }
-                else if (!bHasDirectory && wcswcs(c7zPropPath->bstrVal, wszPath) == c7zPropPath->bstrVal)
-                {
-                    bHasDirectory = true;
-                }
-            }
-            else if (wszPath[0] == L'\0')
-            {
-                ui32FoundItem = i;
-            }
-        }
-    }) == ARCHIVER_STATUS_FAILURE)
+    pItems = CreateArchiveItems(ui32ItemCount, ui64PoolLength);
+    if (!pItems)
     {
         return ARCHIVER_STATUS_FAILURE;
     }
+    pPool = reinterpret_cast<wchar_t*>(pItems + ui32ItemCount);
 
-    if (ui32FoundItem == UINT_MAX)
+    for (uint32_t i = 0; i < ui32ItemCount; ++i)
     {
-        if (!bHasDirectory || wszPath[0] == L'\0')
+        uint32_t ui32Child = bHasRootItem ? (i == 0 ? ui32Node : m_spArchiveTree->Child(ui32Node, i - 1)) : m_spArchiveTree->Child(ui32Node, i);
+        uint32_t ui32ItemIndex = m_spArchiveTree->NodeItemIndex(ui32Child);
+        const wchar_t* wszName = m_spArchiveTree->NodeName(ui32Child);
+        size_t szNameLength = wcslen(wszName);
+
+        if (ui32ItemIndex == UINT_MAX)
         {
-            SetError(E_FAIL, L"Path not found");
-            return ARCHIVER_STATUS_FAILURE;
+            pItems[i].ui32Index = UINT_MAX;
+            pItems[i].cIsDir = 1;
         }
-        
-        *ppItem = CreateDirectoryPlaceholder(wszPath);
-        if (!*ppItem)
+        else
         {
-            return ARCHIVER_STATUS_FAILURE;
+            FillArchiveItem(ui32ItemIndex, &pItems[i]);
         }
-        
-        return ARCHIVER_STATUS_SUCCESS;
+
+        memcpy(pPool, wszName, szNameLength * sizeof(wchar_t));
+        pItems[i].wszPath = pPool;
+        pPool += szNameLength + 1;
+    }
+
+    *ppItems = pItems;
+
+    if (pItemCount)
+    {
+        *pItemCount = ui32ItemCount;
     }
 
-    return GetArchiveItemProperties(ui32FoundItem, ppItem);
+    return ARCHIVER_STATUS_SUCCESS;
 }
 
-ARCHIVER_STATUS C7ZipArchiver::GetArchiveItemProperties(uint32_t ui32ItemIndex, ArchiveItem** ppItem)
+ARCHIVER_STATUS C7ZipArchiver::WalkArchive(const wchar_t* wszRoot, ArchiveItem** ppItems, uint64_t* pItemCount)
 {
     ARCHIVE_LOADED();
 
-    C7ZipProperty c7zPropPath(m_pInArchive);
-    C7ZipProperty c7zPropIsDir(m_pInArchive);
-    C7ZipProperty c7zPropSize(m_pInArchive);
-    C7ZipProperty c7zPropMTime(m_pInArchive);
-    uint32_t ui32ItemCount;
-    HRESULT hr;
+    vector<uint32_t> vecNodes;
+    vector<uint32_t> vecStack;
+    ArchiveItem* pItems;
+    wchar_t* pPool;
+    uint64_t ui64PoolLength = 0;
+    uint32_t ui32Root;
 
-    hr = m_pInArchive->GetNumberOfItems(&ui32ItemCount);
-    if (FAILED(hr))
-    {
-        SetError(hr, "GetNumberOfItems failed");
-        return ARCHIVER_STATUS_FAILURE;
-    }
+    *ppItems = nullptr;
 
-    if (ui32ItemIndex >= ui32ItemCount)
+    if (pItemCount)
     {
-        SetError(E_FAIL, "Invalid item index");
-        return ARCHIVER_STATUS_FAILURE;
+        *pItemCount = 0;
     }
 
-    if (FAILED(c7zPropPath.GetProperty(ui32ItemIndex, kpidPath)))
+    if (EnsureArchiveTree() != ARCHIVER_STATUS_SUCCESS)
     {
-        c7zPropPath->bstrVal = nullptr;
+        return ARCHIVER_STATUS_FAILURE;
     }
 
-    hr = c7zPropIsDir.GetProperty(ui32ItemIndex, kpidIsDir);
-    if (FAILED(hr))
+    if (!m_spArchiveTree->FindNode(wszRoot, &ui32Root))
     {
-        SetError(hr, L"GetProperty failed (kpidIsDir)");
+        SetError(E_FAIL, L"Path not found");
         return ARCHIVER_STATUS_FAILURE;
     }
 
-    hr = c7zPropSize.GetProperty(ui32ItemIndex, kpidSize);
-    if (FAILED(hr))
+    try
     {
-        SetError(hr, L"GetProperty failed (kpidSize)");
+        // As with ListDirectory, an item without a path is listed at the root
+        if (ui32Root == CArchiveTree::kRootNode && m_spArchiveTree->NodeItemIndex(ui32Root) != UINT_MAX)
+        {
+            vecNodes.push_back(ui32Root);
+        }
+
+        // Pre-order, each directory comes right before its sorted children
+        for (uint32_t i = m_spArchiveTree->ChildCount(ui32Root); i > 0; --i)
+        {
+            vecStack.push_back(m_spArchiveTree->Child(ui32Root, i - 1));
+        }
+
+        while (!vecStack.empty())
+        {
+            uint32_t ui32Node = vecStack.back();
+            vecStack.pop_back();
+            vecNodes.push_back(ui32Node);
+
+            for (uint32_t i = m_spArchiveTree->ChildCount(ui32Node); i > 0; --i)
+            {
+                vecStack.push_back(m_spArchiveTree->Child(ui32Node, i - 1));
+            }
+        }
+    }
+    catch (...)
+    {
+        SetError(E_OUTOFMEMORY, L"Unable to walk archive");
         return ARCHIVER_STATUS_FAILURE;
     }
 
-    hr = c7zPropMTime.GetProperty(ui32ItemIndex, kpidMTime);
-    if (FAILED(hr))
+    if (vecNodes.empty())
     {
-        SetError(hr, L"GetProperty failed (kpidMTime)");
-        return ARCHIVER_STATUS_FAILURE;
+        return ARCHIVER_STATUS_SUCCESS;
     }
-    
-    *ppItem = static_cast<ArchiveItem*>(calloc(1, sizeof(ArchiveItem)));
-    if (!*ppItem)
+
+    for (uint32_t ui32Node : vecNodes)
+    {
+        ui64PoolLength += m_spArchiveTree->NodePathLength(ui32Node) + 1;
+    }
+
+    pItems = CreateArchiveItems(static_cast<uint32_t>(vecNodes.size()), ui64PoolLength);
+    if (!pItems)
     {
-        SetError(E_OUTOFMEMORY, L"Unable to create ArchiveItem");
         return ARCHIVER_STATUS_FAILURE;
     }
-    
-    (*ppItem)->ui32Index = ui32ItemIndex;
-    (*ppItem)->wszPath = c7zPropPath.Release().bstrVal;
-    if (!(*ppItem)->wszPath)
+    pPool = reinterpret_cast<wchar_t*>(pItems + vecNodes.size());
+
+    for (size_t i = 0; i < vecNodes.size(); ++i)
     {
-        wchar_t* wszEmptyPath = SysAllocString(L"");
-        if (!wszEmptyPath)
+        uint32_t ui32ItemIndex = m_spArchiveTree->NodeItemIndex(vecNodes[i]);
+        uint64_t ui64PathLength = m_spArchiveTree->NodePathLength(vecNodes[i]);
+
+        if (ui32ItemIndex == UINT_MAX)
         {
-            SetError(E_OUTOFMEMORY, L"Unable to create empty path string");
-            free(*ppItem);
-            return ARCHIVER_STATUS_FAILURE;
+            pItems[i].ui32Index = UINT_MAX;
+            pItems[i].cIsDir = 1;
+        }
+        else
+        {
+            FillArchiveItem(ui32ItemIndex, &pItems[i]);
         }
-        (*ppItem)->wszPath = wszEmptyPath;
+
+        m_spArchiveTree->CopyNodePath(vecNodes[i], pPool);
+        pItems[i].wszPath = pPool;
+        pPool += ui64PathLength + 1;
+    }
+
+    *ppItems = pItems;
+
+    if (pItemCount)
+    {
+        *pItemCount = vecNodes.size();
     }
-    (*ppItem)->cIsDir = c7zPropIsDir->boolVal == VARIANT_TRUE;
-    (*ppItem)->ui64Size = c7zPropSize->uhVal.QuadPart;
-    (*ppItem)->ftModTime = c7zPropMTime->filetime;
 
     return ARCHIVER_STATUS_SUCCESS;
 }
 
-ARCHIVER_STATUS C7ZipArchiver::FreeArchiveItem(ArchiveItem* pItem)
-{   
-    while (pItem)
+ARCHIVER_STATUS C7ZipArchiver::GetArchiveItemProperties(const wchar_t* wszPath, ArchiveItem** ppItem)
+{
+    ARCHIVE_LOADED();
+
+    uint32_t ui32ItemIndex;
+
+    if (EnsureArchiveTree() != ARCHIVER_STATUS_SUCCESS)
     {
-        ArchiveItem* pItemNext = pItem->pItemNext;
-        SysFreeString(pItem->wszPath);
-        free(pItem);
-        pItem = pItemNext;
+        return ARCHIVER_STATUS_FAILURE;
     }
 
-    return ARCHIVER_STATUS_SUCCESS;
+    if (!m_spArchiveTree->Find(wszPath, &ui32ItemIndex))
+    {
+        SetError(E_FAIL, L"Path not found");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    if (ui32ItemIndex == UINT_MAX)
+    {
+        *ppItem = CreateDirectoryPlaceholder(wszPath);
+        if (!*ppItem)
+        {
+            return ARCHIVER_STATUS_FAILURE;
+        }
+        
+        return ARCHIVER_STATUS_SUCCESS;
+    }
+
+    return GetArchiveItemProperties(ui32ItemIndex, ppItem);
 }
 
-ARCHIVER_STATUS C7ZipArchiver::ExtractArchiveItemToBuffer(uint32_t ui32ItemIndex, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword)
+ARCHIVER_STATUS C7ZipArchiver::GetArchiveItemProperties(uint32_t ui32ItemIndex, ArchiveItem** ppItem)
 {
     ARCHIVE_LOADED();
 
+    C7ZipProperty c7zPropPath(m_pInArchive, m_pStats);
+    C7ZipProperty c7zPropIsDir(m_pInArchive, m_pStats);
+    C7ZipProperty c7zPropSize(m_pInArchive, m_pStats);
+    C7ZipProperty c7zPropMTime(m_pInArchive, m_pStats);
+    const wchar_t* wszItemPath;
+    size_t szPathLength;
+    uint32_t ui32ItemCount;
     HRESULT hr;
-    CArchiveExtractCallback* pArchiveExtractCallback;
-    IArchiveExtractCallback* pArchiveExtractCallbackInterface;
 
-    if (!wszPassword && !m_wstrPassword.empty())
+    if (m_spIndex)
     {
-        wszPassword = m_wstrPassword.c_str();
+        if (ui32ItemIndex >= m_spIndex->ItemCount())
+        {
+            SetError(E_FAIL, "Invalid item index");
+            return ARCHIVER_STATUS_FAILURE;
+        }
+
+        wszItemPath = m_spIndex->Path(ui32ItemIndex);
+        szPathLength = wszItemPath ? m_spIndex->Record(ui32ItemIndex).ui32PathLength : 0;
+
+        *ppItem = CreateArchiveItems(1, szPathLength + 1);
+        if (!*ppItem)
+        {
+            return ARCHIVER_STATUS_FAILURE;
+        }
+
+        FillArchiveItem(ui32ItemIndex, *ppItem);
+        (*ppItem)->wszPath = reinterpret_cast<wchar_t*>(*ppItem + 1);
+        if (wszItemPath)
+        {
+            memcpy((*ppItem)->wszPath, wszItemPath, szPathLength * sizeof(wchar_t));
+        }
+
+        return ARCHIVER_STATUS_SUCCESS;
     }
-    
-    try
-    {        
-        pArchiveExtractCallback = new CArchiveExtractCallback(pBuf, ui64BufSize, wszPassword);
+
+    hr = m_pInArchive->GetNumberOfItems(&ui32ItemCount);
+    if (FAILED(hr))
+    {
+        SetError(hr, "GetNumberOfItems failed");
+        return ARCHIVER_STATUS_FAILURE;
     }
-    catch (...)
+
+    if (ui32ItemIndex >= ui32ItemCount)
     {
-        SetError(E_OUTOFMEMORY, L"Out of memory creating CArchiveExtractCallback");
+        SetError(E_FAIL, "Invalid item index");
         return ARCHIVER_STATUS_FAILURE;
     }
 
-    hr = pArchiveExtractCallback->QueryInterface(IID_IArchiveExtractCallback, reinterpret_cast<void**>(&pArchiveExtractCallbackInterface));
+    if (FAILED(c7zPropPath.GetProperty(ui32ItemIndex, kpidPath)) || c7zPropPath->vt != VT_BSTR)
+    {
+        c7zPropPath->bstrVal = nullptr;
+    }
+
+    hr = c7zPropIsDir.GetProperty(ui32ItemIndex, kpidIsDir);
     if (FAILED(hr))
     {
-        SetError(hr, L"QueryInterface failed on CArchiveExtractCallback");
+        SetError(hr, L"GetProperty failed (kpidIsDir)");
         return ARCHIVER_STATUS_FAILURE;
     }
 
-    hr = m_pInArchive->Extract(&ui32ItemIndex, 1, 0, pArchiveExtractCallbackInterface);
-    pArchiveExtractCallback->Release();
+    hr = c7zPropSize.GetProperty(ui32ItemIndex, kpidSize);
+    if (FAILED(hr))
+    {
+        SetError(hr, L"GetProperty failed (kpidSize)");
+        return ARCHIVER_STATUS_FAILURE;
+    }
 
+    hr = c7zPropMTime.GetProperty(ui32ItemIndex, kpidMTime);
     if (FAILED(hr))
     {
-        SetError(hr, L"InArchive Extract failed");
+        SetError(hr, L"GetProperty failed (kpidMTime)");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    wszItemPath = c7zPropPath->bstrVal;
+    szPathLength = wszItemPath ? wcslen(wszItemPath) : 0;
+
+    *ppItem = CreateArchiveItems(1, szPathLength + 1);
+    if (!*ppItem)
+    {
         return ARCHIVER_STATUS_FAILURE;
     }
+    
+    (*ppItem)->ui32Index = ui32ItemIndex;
+    (*ppItem)->wszPath = reinterpret_cast<wchar_t*>(*ppItem + 1);
+    if (wszItemPath)
+    {
+        memcpy((*ppItem)->wszPath, wszItemPath, szPathLength * sizeof(wchar_t));
+    }
+    (*ppItem)->cIsDir = c7zPropIsDir->boolVal == VARIANT_TRUE;
+    (*ppItem)->ui64Size = c7zPropSize->uhVal.QuadPart;
+    (*ppItem)->ftModTime = c7zPropMTime->filetime;
 
     return ARCHIVER_STATUS_SUCCESS;
 }
 
-ARCHIVER_STATUS C7ZipArchiver::ExtractArchiveItemToBuffer(const wchar_t* wszPath, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword)
+ARCHIVER_STATUS C7ZipArchiver::GetArchiveItemSize(uint32_t ui32ItemIndex, uint64_t* pui64Size)
 {
     ARCHIVE_LOADED();
 
-    ArchiveItem* aiElement;
-    uint32_t ui32ItemIndex;
+    C7ZipProperty c7zPropSize(m_pInArchive, m_pStats);
+    uint32_t ui32ItemCount;
+    HRESULT hr;
+
+    if (m_spIndex)
+    {
+        if (ui32ItemIndex >= m_spIndex->ItemCount())
+        {
+            SetError(E_FAIL, "Invalid item index");
+            return ARCHIVER_STATUS_FAILURE;
+        }
+
+        *pui64Size = m_spIndex->Record(ui32ItemIndex).ui64Size;
+        return ARCHIVER_STATUS_SUCCESS;
+    }
+
+    hr = m_pInArchive->GetNumberOfItems(&ui32ItemCount);
+    if (FAILED(hr))
+    {
+        SetError(hr, "GetNumberOfItems failed");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    if (ui32ItemIndex >= ui32ItemCount)
+    {
+        SetError(E_FAIL, "Invalid item index");
+        return ARCHIVER_STATUS_FAILURE;
+    }
 
-    if (GetArchiveItemProperties(wszPath, &aiElement) != ARCHIVER_STATUS_SUCCESS)
+    hr = c7zPropSize.GetProperty(ui32ItemIndex, kpidSize);
+    if (FAILED(hr))
     {
+        SetError(hr, L"GetProperty failed (kpidSize)");
         return ARCHIVER_STATUS_FAILURE;
     }
 
-    ui32ItemIndex = aiElement->ui32Index;
+    *pui64Size = c7zPropSize->uhVal.QuadPart;
 
-    FreeArchiveItem(aiElement);
+    return ARCHIVER_STATUS_SUCCESS;
+}
 
-    return ExtractArchiveItemToBuffer(ui32ItemIndex, pBuf, ui64BufSize, wszPassword);
+ARCHIVER_STATUS C7ZipArchiver::FreeArchiveItem(ArchiveItem* pItem)
+{
+    // Items and their paths are one allocation owned by the first item
+    free(pItem);
+
+    return ARCHIVER_STATUS_SUCCESS;
 }
 
-ARCHIVER_STATUS C7ZipArchiver::CloseArchive()
+ARCHIVER_STATUS C7ZipArchiver::GetArchiveItemPropertiesEx(uint32_t ui32ItemIndex, uint32_t ui32Properties, ArchiveItemEx** ppItem)
 {
-    INIT_CHECK();
+    ARCHIVE_LOADED();
 
-    if (m_pInArchive)
+    constexpr struct
     {
-        m_pInArchive->Release();
-        m_pInArchive = nullptr;
+        uint32_t ui32Property;
+        PROPID propId;
+    } propertyIds[] =
+    {
+        {ARCHIVE_ITEM_PROPERTY_PACK_SIZE, kpidPackSize},
+        {ARCHIVE_ITEM_PROPERTY_METHOD, kpidMethod},
+        {ARCHIVE_ITEM_PROPERTY_CRC, kpidCRC},
+        {ARCHIVE_ITEM_PROPERTY_BLOCK, kpidBlock},
+        {ARCHIVE_ITEM_PROPERTY_OFFSET, kpidOffset},
+        {ARCHIVE_ITEM_PROPERTY_ENCRYPTED, kpidEncrypted}
+    };
+
+    ArchiveItem* pItem;
+    ArchiveItemEx aieExtra = {};
+    wstring wstrMethod;
+    uint32_t ui32HandlerProperties = ui32Properties & ARCHIVE_ITEM_PROPERTY_ALL;
+    size_t szPathLength;
+    wchar_t* pPool;
+
+    *ppItem = nullptr;
+
+    if (GetArchiveItemProperties(ui32ItemIndex, &pItem) != ARCHIVER_STATUS_SUCCESS)
+    {
+        return ARCHIVER_STATUS_FAILURE;
     }
 
-    m_wstrArchiveFormat.clear();
+    // The index already tried the handler for these, so it has nothing more to offer
+    if (m_spIndex)
+    {
+        const ArchiveIndexRecord& airRecord = m_spIndex->Record(ui32ItemIndex);
 
-    m_cmMmap.Clear();
+        if ((ui32HandlerProperties & ARCHIVE_ITEM_PROPERTY_PACK_SIZE) && (airRecord.ui32Flags & CArchiveIndex::kFlagHasPackSize))
+        {
+            aieExtra.ui32Properties |= ARCHIVE_ITEM_PROPERTY_PACK_SIZE;
+            aieExtra.ui64PackSize = airRecord.ui64PackSize;
+        }
+        if ((ui32HandlerProperties & ARCHIVE_ITEM_PROPERTY_OFFSET) && (airRecord.ui32Flags & CArchiveIndex::kFlagHasOffset))
+        {
+            aieExtra.ui32Properties |= ARCHIVE_ITEM_PROPERTY_OFFSET;
+            aieExtra.ui64Offset = airRecord.ui64Offset;
+        }
+        ui32HandlerProperties &= ~(ARCHIVE_ITEM_PROPERTY_PACK_SIZE | ARCHIVE_ITEM_PROPERTY_OFFSET);
+    }
 
-    if (m_iFd != -1)
+    if (ui32HandlerProperties)
     {
-        close(m_iFd);
-        m_iFd = -1;
+        if (EnsureInArchive() != ARCHIVER_STATUS_SUCCESS)
+        {
+            FreeArchiveItem(pItem);
+            return ARCHIVER_STATUS_FAILURE;
+        }
+
+        C7ZipProperty c7zProp(m_pInArchive, m_pStats);
+
+        // Properties the handler does not provide are left out rather than failing the call
+        for (const auto& itElem : propertyIds)
+        {
+            if (!(ui32HandlerProperties & itElem.ui32Property) ||
+                FAILED(c7zProp.GetProperty(ui32ItemIndex, itElem.propId)) || c7zProp->vt == VT_EMPTY)
+            {
+                continue;
+            }
+
+            switch (itElem.ui32Property)
+            {
+            case ARCHIVE_ITEM_PROPERTY_PACK_SIZE:
+                aieExtra.ui64PackSize = c7zProp->vt == VT_UI4 ? c7zProp->ulVal : c7zProp->uhVal.QuadPart;
+                break;
+            case ARCHIVE_ITEM_PROPERTY_METHOD:
+                if (c7zProp->vt != VT_BSTR || !c7zProp->bstrVal)
+                {
+                    continue;
+                }
+                try
+                {
+                    wstrMethod = c7zProp->bstrVal;
+                }
+                catch (...)
+                {
+                    FreeArchiveItem(pItem);
+                    SetError(E_OUTOFMEMORY, L"Unable to create ArchiveItemEx");
+                    return ARCHIVER_STATUS_FAILURE;
+                }
+                break;
+            case ARCHIVE_ITEM_PROPERTY_CRC:
+                aieExtra.ui32Crc = c7zProp->ulVal;
+                break;
+            case ARCHIVE_ITEM_PROPERTY_BLOCK:
+                aieExtra.ui64Block = c7zProp->vt == VT_UI4 ? c7zProp->ulVal : c7zProp->uhVal.QuadPart;
+                break;
+            case ARCHIVE_ITEM_PROPERTY_OFFSET:
+                aieExtra.ui64Offset = c7zProp->vt == VT_UI4 ? c7zProp->ulVal : c7zProp->uhVal.QuadPart;
+                break;
+            case ARCHIVE_ITEM_PROPERTY_ENCRYPTED:
+                aieExtra.cIsEncrypted = c7zProp->boolVal == VARIANT_TRUE;
+                break;
+            }
+
+            aieExtra.ui32Properties |= itElem.ui32Property;
+        }
     }
 
-    m_wstrPassword.clear();
+    szPathLength = wcslen(pItem->wszPath);
+
+    *ppItem = static_cast<ArchiveItemEx*>(calloc(1, sizeof(ArchiveItemEx) + (szPathLength + 1 + wstrMethod.size() + 1) * sizeof(wchar_t)));
+    if (!*ppItem)
+    {
+        FreeArchiveItem(pItem);
+        SetError(E_OUTOFMEMORY, L"Unable to create ArchiveItemEx");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    **ppItem = aieExtra;
+    (*ppItem)->aiItem = *pItem;
+    (*ppItem)->aiItem.pItemNext = nullptr;
+
+    pPool = reinterpret_cast<wchar_t*>(*ppItem + 1);
+    memcpy(pPool, pItem->wszPath, szPathLength * sizeof(wchar_t));
+    (*ppItem)->aiItem.wszPath = pPool;
+    pPool += szPathLength + 1;
+
+    if (aieExtra.ui32Properties & ARCHIVE_ITEM_PROPERTY_METHOD)
+    {
+        memcpy(pPool, wstrMethod.c_str(), wstrMethod.size() * sizeof(wchar_t));
+        (*ppItem)->wszMethod = pPool;
+    }
+
+    FreeArchiveItem(pItem);
 
     return ARCHIVER_STATUS_SUCCESS;
 }
 
-ARCHIVER_STATUS C7ZipArchiver::GetError(HRESULT* pHr, const wchar_t** ppError)
+ARCHIVER_STATUS C7ZipArchiver::FreeArchiveItemEx(ArchiveItemEx* pItem)
 {
-    if (!pHr && !ppError)
+    // Paths and method names live in the same allocation
+    free(pItem);
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::FindArchiveItems(const wchar_t* wszPattern, uint32_t ui32Kind, uint32_t** ppIndices, uint32_t* pui32Count)
+{
+    ARCHIVE_LOADED();
+
+    map<uint32_t /* Start index */, vector<uint32_t>> mapRanges;
+    CPathMatcher pmMatcher;
+    volatile bool bHasFailure = false;
+    volatile bool bPathTooLong = false;
+    uint32_t ui32MatchCount = 0;
+    mutex mLock;
+
+    *ppIndices = nullptr;
+    *pui32Count = 0;
+
+    if (!pmMatcher.Compile(wszPattern, ui32Kind))
     {
+        SetError(E_INVALIDARG, L"Invalid pattern");
         return ARCHIVER_STATUS_FAILURE;
     }
 
-    if (pHr)
+    if (EnsureArchiveIndex() != ARCHIVER_STATUS_SUCCESS)
     {
-        *pHr = m_hrError;
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    if (IterateItems([&](uint32_t ui32Start, uint32_t ui32End)
+    {
+        vector<uint32_t> vecLocalIndices;
+
+        try
+        {
+            for (uint32_t i = ui32Start; i < ui32End; ++i)
+            {
+                const wchar_t* wszItemPath = m_spIndex->Path(i);
+                if (wszItemPath && !pmMatcher.CanMatch(wszItemPath))
+                {
+                    bPathTooLong = true;
+                    return;
+                }
+                if (wszItemPath && pmMatcher.Match(wszItemPath))
+                {
+                    vecLocalIndices.push_back(i);
+                }
+            }
+
+            if (!vecLocalIndices.empty())
+            {
+                lock_guard<mutex> lgLock(mLock);
+                mapRanges.emplace(ui32Start, move(vecLocalIndices));
+            }
+        }
+        catch (...)
+        {
+            bHasFailure = true;
+        }
+    }) != ARCHIVER_STATUS_SUCCESS)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    if (bPathTooLong)
+    {
+        SetError(E_INVALIDARG, L"Item path too long for a regex pattern");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    if (bHasFailure)
+    {
+        SetError(E_OUTOFMEMORY, L"Unable to collect matching items");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    for (const auto& itRange : mapRanges)
+    {
+        ui32MatchCount += static_cast<uint32_t>(itRange.second.size());
+    }
+
+    if (ui32MatchCount == 0)
+    {
+        return ARCHIVER_STATUS_SUCCESS;
+    }
+
+    *ppIndices = static_cast<uint32_t*>(malloc(ui32MatchCount * sizeof(uint32_t)));
+    if (!*ppIndices)
+    {
+        SetError(E_OUTOFMEMORY, L"Unable to allocate matching items");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    // Ranges are keyed by their start, so the indices come out ascending
+    for (const auto& itRange : mapRanges)
+    {
+        memcpy(*ppIndices + *pui32Count, itRange.second.data(), itRange.second.size() * sizeof(uint32_t));
+        *pui32Count += static_cast<uint32_t>(itRange.second.size());
+    }
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::FreeArchiveItemIndices(uint32_t* pIndices)
+{
+    free(pIndices);
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::GetArchiveItemTable(uint32_t ui32Columns, ArchiveItemTable** ppTable)
+{
+    ARCHIVE_LOADED();
+
+    bool bUtf8 = (ui32Columns & ARCHIVE_TABLE_PATH_UTF8) != 0;
+    size_t szCharSize = bUtf8 ? sizeof(char) : sizeof(wchar_t);
+    uint64_t ui64PoolLength = 0;
+    uint64_t ui64PoolOffset = 0;
+    uint64_t ui64TableSize;
+    uint32_t ui32ItemCount;
+    uint8_t* pCursor;
+    ArchiveItemTable* pTable;
+
+    *ppTable = nullptr;
+
+    if (EnsureArchiveIndex() != ARCHIVER_STATUS_SUCCESS)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    ui32ItemCount = m_spIndex->ItemCount();
+
+    if (ui32Columns & ARCHIVE_TABLE_COLUMN_PATH)
+    {
+        for (uint32_t i = 0; i < ui32ItemCount; ++i)
+        {
+            const wchar_t* wszItemPath = m_spIndex->Path(i);
+            if (wszItemPath)
+            {
+                uint32_t ui32PathLength = m_spIndex->Record(i).ui32PathLength;
+                ui64PoolLength += bUtf8 ? CompatWideToUtf8(wszItemPath, ui32PathLength, nullptr) : ui32PathLength;
+            }
+            ++ui64PoolLength;
+        }
+    }
+
+    // Every column is 8 byte aligned inside the one allocation
+    auto fnColumnSize = [](uint64_t ui64Size) { return (ui64Size + 7) & ~static_cast<uint64_t>(7); };
+
+    ui64TableSize = fnColumnSize(sizeof(ArchiveItemTable));
+    ui64TableSize += (ui32Columns & ARCHIVE_TABLE_COLUMN_INDEX) ? fnColumnSize(ui32ItemCount * sizeof(uint32_t)) : 0;
+    ui64TableSize += (ui32Columns & ARCHIVE_TABLE_COLUMN_SIZE) ? fnColumnSize(ui32ItemCount * sizeof(uint64_t)) : 0;
+    ui64TableSize += (ui32Columns & ARCHIVE_TABLE_COLUMN_MTIME) ? fnColumnSize(ui32ItemCount * sizeof(uint64_t)) : 0;
+    ui64TableSize += (ui32Columns & ARCHIVE_TABLE_COLUMN_ISDIR) ? fnColumnSize(ui32ItemCount * sizeof(uint8_t)) : 0;
+    ui64TableSize += (ui32Columns & ARCHIVE_TABLE_COLUMN_PATH) ? fnColumnSize((static_cast<uint64_t>(ui32ItemCount) + 1) * sizeof(uint64_t)) + fnColumnSize(ui64PoolLength * szCharSize) : 0;
+
+    if (ui64TableSize > SIZE_MAX)
+    {
+        SetError(E_OUTOFMEMORY, L"Archive item table too large for memory");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    pTable = static_cast<ArchiveItemTable*>(calloc(1, static_cast<size_t>(ui64TableSize)));
+    if (!pTable)
+    {
+        SetError(E_OUTOFMEMORY, L"Unable to create ArchiveItemTable");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    pTable->ui32ItemCount = ui32ItemCount;
+    pTable->ui32Columns = ui32Columns;
+    pCursor = reinterpret_cast<uint8_t*>(pTable) + fnColumnSize(sizeof(ArchiveItemTable));
+
+    if (ui32Columns & ARCHIVE_TABLE_COLUMN_SIZE)
+    {
+        pTable->pSizes = reinterpret_cast<uint64_t*>(pCursor);
+        pCursor += fnColumnSize(ui32ItemCount * sizeof(uint64_t));
+    }
+    if (ui32Columns & ARCHIVE_TABLE_COLUMN_MTIME)
+    {
+        pTable->pMTimes = reinterpret_cast<uint64_t*>(pCursor);
+        pCursor += fnColumnSize(ui32ItemCount * sizeof(uint64_t));
+    }
+    if (ui32Columns & ARCHIVE_TABLE_COLUMN_PATH)
+    {
+        pTable->pPathOffsets = reinterpret_cast<uint64_t*>(pCursor);
+        pCursor += fnColumnSize((static_cast<uint64_t>(ui32ItemCount) + 1) * sizeof(uint64_t));
+        pTable->pPathPool = pCursor;
+        pCursor += fnColumnSize(ui64PoolLength * szCharSize);
+    }
+    if (ui32Columns & ARCHIVE_TABLE_COLUMN_INDEX)
+    {
+        pTable->pIndices = reinterpret_cast<uint32_t*>(pCursor);
+        pCursor += fnColumnSize(ui32ItemCount * sizeof(uint32_t));
+    }
+    if (ui32Columns & ARCHIVE_TABLE_COLUMN_ISDIR)
+    {
+        pTable->pIsDir = pCursor;
+    }
+
+    for (uint32_t i = 0; i < ui32ItemCount; ++i)
+    {
+        const ArchiveIndexRecord& airRecord = m_spIndex->Record(i);
+
+        if (pTable->pIndices)
+        {
+            pTable->pIndices[i] = i;
+        }
+        if (pTable->pSizes)
+        {
+            pTable->pSizes[i] = airRecord.ui64Size;
+        }
+        if (pTable->pMTimes)
+        {
+            pTable->pMTimes[i] = airRecord.ui64MTime;
+        }
+        if (pTable->pIsDir)
+        {
+            pTable->pIsDir[i] = (airRecord.ui32Flags & CArchiveIndex::kFlagIsDir) ? 1 : 0;
+        }
+        if (pTable->pPathOffsets)
+        {
+            const wchar_t* wszItemPath = m_spIndex->Path(i);
+
+            pTable->pPathOffsets[i] = ui64PoolOffset;
+            if (wszItemPath && bUtf8)
+            {
+                ui64PoolOffset += CompatWideToUtf8(wszItemPath, airRecord.ui32PathLength, static_cast<char*>(pTable->pPathPool) + ui64PoolOffset);
+            }
+            else if (wszItemPath)
+            {
+                memcpy(static_cast<wchar_t*>(pTable->pPathPool) + ui64PoolOffset, wszItemPath, airRecord.ui32PathLength * sizeof(wchar_t));
+                ui64PoolOffset += airRecord.ui32PathLength;
+            }
+            // The terminator is already zeroed by calloc
+            ++ui64PoolOffset;
+            pTable->pPathOffsets[i + 1] = ui64PoolOffset;
+        }
+    }
+
+    *ppTable = pTable;
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::FreeArchiveItemTable(ArchiveItemTable* pTable)
+{
+    free(pTable);
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::ExtractArchiveItemToBuffer(uint32_t ui32ItemIndex, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword)
+{
+    return ExtractArchiveItemToBufferEx(ui32ItemIndex, pBuf, ui64BufSize, wszPassword, nullptr);
+}
+
+ARCHIVER_STATUS C7ZipArchiver::ExtractArchiveItemToBufferEx(uint32_t ui32ItemIndex, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword, uint64_t* pui64Written)
+{
+    ARCHIVE_LOADED();
+
+    HRESULT hr;
+    CArchiveExtractCallback* pArchiveExtractCallback;
+    IArchiveExtractCallback* pArchiveExtractCallbackInterface;
+
+    if (EnsureInArchive() != ARCHIVER_STATUS_SUCCESS)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    if (!wszPassword && !m_wstrPassword.empty())
+    {
+        wszPassword = m_wstrPassword.c_str();
+    }
+
+    CStatsTimer stExtract(m_pStats, StatsHistogram::Extract);
+    
+    try
+    {        
+        pArchiveExtractCallback = new CArchiveExtractCallback(pBuf, ui64BufSize, wszPassword);
+    }
+    catch (...)
+    {
+        SetError(E_OUTOFMEMORY, L"Out of memory creating CArchiveExtractCallback");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    hr = pArchiveExtractCallback->QueryInterface(IID_IArchiveExtractCallback, reinterpret_cast<void**>(&pArchiveExtractCallbackInterface));
+    if (FAILED(hr))
+    {
+        SetError(hr, L"QueryInterface failed on CArchiveExtractCallback");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    {
+        TRACE_SCOPE("Extract", ui32ItemIndex);
+        hr = m_pInArchive->Extract(&ui32ItemIndex, 1, 0, pArchiveExtractCallbackInterface);
+    }
+    if (hr == static_cast<HRESULT>(E_ABORT) && pArchiveExtractCallback->IsTruncated())
+    {
+        hr = S_OK;
+    }
+    if (pui64Written)
+    {
+        *pui64Written = pArchiveExtractCallback->GetWritten();
+    }
+    m_pStats->Add(StatsCounter::ItemsDecoded, SUCCEEDED(hr) ? 1 : 0);
+    m_pStats->Add(StatsCounter::BytesDecoded, pArchiveExtractCallback->GetDecoded());
+    m_pStats->Add(StatsCounter::BytesCopied, pArchiveExtractCallback->GetWritten());
+    pArchiveExtractCallback->Release();
+
+    if (FAILED(hr))
+    {
+        SetError(hr, L"InArchive Extract failed");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::ExtractArchiveItems(const uint32_t* pIndices, uint32_t ui32Count, uint32_t ui32MaxWorkers, const wchar_t* wszPassword, ArchiveItemCallback pCallback, void* pUser)
+{
+    ARCHIVE_LOADED();
+
+    vector<unique_ptr<IArchiver>> vecClones;
+    atomic_uint uiNextItem(0);
+    uint32_t ui32Workers = ui32MaxWorkers ? ui32MaxWorkers : CThreadPool::Instance().Concurrency();
+
+    if (EnsureInArchive() != ARCHIVER_STATUS_SUCCESS)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+    if (!ui32Count)
+    {
+        return ARCHIVER_STATUS_SUCCESS;
+    }
+
+    // Handlers are not thread safe, every worker after the first gets a clone with its own
+    ui32Workers = min(ui32Workers, ui32Count);
+    for (uint32_t i = 1; i < ui32Workers; ++i)
+    {
+        IArchiver* pClone;
+        if (CloneArchive(&pClone) != ARCHIVER_STATUS_SUCCESS)
+        {
+            break;
+        }
+
+        static_cast<C7ZipArchiver*>(pClone)->m_pStats = m_pStats;
+        unique_ptr<IArchiver> upClone(pClone);
+        try
+        {
+            vecClones.push_back(move(upClone));
+        }
+        catch (...)
+        {
+            break;
+        }
+    }
+    // Runs with fewer workers when a clone could not be created
+    ui32Workers = static_cast<uint32_t>(vecClones.size()) + 1;
+
+    // Items are handed out one at a time so workers stay busy when item sizes differ
+    CThreadPool::Instance().ParallelFor(ui32Workers, 1, [&](uint32_t ui32Start, uint32_t ui32End)
+    {
+        vector<uint8_t> vecBuf;
+
+        for (uint32_t ui32Worker = ui32Start; ui32Worker < ui32End; ++ui32Worker)
+        {
+            C7ZipArchiver* pArchiver = ui32Worker ? static_cast<C7ZipArchiver*>(vecClones[ui32Worker - 1].get()) : this;
+            uint32_t ui32Item;
+
+            while ((ui32Item = uiNextItem.fetch_add(1)) < ui32Count)
+            {
+                const uint32_t ui32ItemIndex = pIndices[ui32Item];
+                uint64_t ui64Size = 0;
+                uint64_t ui64Written = 0;
+                HRESULT hrError = S_OK;
+                const wchar_t* wszError = nullptr;
+                bool bSizeKnown = true;
+                ARCHIVER_STATUS asStatus = pArchiver->GetExtractSize(ui32ItemIndex, &ui64Size, &bSizeKnown);
+
+                if (asStatus == ARCHIVER_STATUS_SUCCESS && bSizeKnown && ui64Size)
+                {
+                    try
+                    {
+                        vecBuf.resize(static_cast<size_t>(min<uint64_t>(ui64Size, SIZE_MAX)));
+                        asStatus = pArchiver->ExtractArchiveItemToBufferEx(ui32ItemIndex, vecBuf.data(), vecBuf.size(), wszPassword, &ui64Written);
+                    }
+                    catch (...)
+                    {
+                        hrError = E_OUTOFMEMORY;
+                        wszError = L"Out of memory allocating item buffer";
+                    }
+                }
+                else if (asStatus == ARCHIVER_STATUS_SUCCESS && !bSizeKnown)
+                {
+                    // The handler doesn't know the size, stream the item into a growing buffer. Directories
+                    // and empty files are known to be empty and skip the decoder thread this takes
+                    asStatus = pArchiver->OpenItemStream(ui32ItemIndex, wszPassword, 0);
+                    try
+                    {
+                        uint64_t ui64Read = 0;
+
+                        while (asStatus == ARCHIVER_STATUS_SUCCESS)
+                        {
+                            if (vecBuf.size() - ui64Written < ui64DefaultItemStreamBuffer)
+                            {
+                                vecBuf.resize(static_cast<size_t>(max<uint64_t>(ui64Written + ui64DefaultItemStreamBuffer, vecBuf.size() * 2)));
+                            }
+                            asStatus = pArchiver->ReadItemStream(vecBuf.data() + ui64Written, vecBuf.size() - ui64Written, &ui64Read);
+                            ui64Written += ui64Read;
+                            if (!ui64Read)
+                            {
+                                break;
+                            }
+                        }
+                    }
+                    catch (...)
+                    {
+                        hrError = E_OUTOFMEMORY;
+                        wszError = L"Out of memory growing item buffer";
+                    }
+                    pArchiver->CloseItemStream();
+                }
+                if (asStatus != ARCHIVER_STATUS_SUCCESS)
+                {
+                    pArchiver->GetError(&hrError, &wszError);
+                }
+
+                pCallback(pUser, ui32ItemIndex, hrError, wszError, wszError ? nullptr : vecBuf.data(), wszError ? 0 : ui64Written);
+            }
+        }
+    });
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+// Size ExtractArchiveItems decodes into. *pbSizeKnown is false when the handler can't tell
+// without decoding, directories are known to be empty.
+ARCHIVER_STATUS C7ZipArchiver::GetExtractSize(uint32_t ui32ItemIndex, uint64_t* pui64Size, bool* pbSizeKnown)
+{
+    uint32_t ui32ItemCount;
+    HRESULT hr;
+
+    // Clones of an indexed archive open their handler on first use
+    if (EnsureInArchive() != ARCHIVER_STATUS_SUCCESS)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    C7ZipProperty c7zProp(m_pInArchive, m_pStats);
+
+    hr = m_pInArchive->GetNumberOfItems(&ui32ItemCount);
+    if (FAILED(hr))
+    {
+        SetError(hr, "GetNumberOfItems failed");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    if (ui32ItemIndex >= ui32ItemCount)
+    {
+        SetError(E_FAIL, "Invalid item index");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    *pui64Size = 0;
+    *pbSizeKnown = true;
+
+    hr = c7zProp.GetProperty(ui32ItemIndex, kpidIsDir);
+    if (FAILED(hr))
+    {
+        SetError(hr, L"GetProperty failed (kpidIsDir)");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+    if (c7zProp->vt == VT_BOOL && c7zProp->boolVal == VARIANT_TRUE)
+    {
+        return ARCHIVER_STATUS_SUCCESS;
+    }
+
+    hr = c7zProp.GetProperty(ui32ItemIndex, kpidSize);
+    if (FAILED(hr))
+    {
+        SetError(hr, L"GetProperty failed (kpidSize)");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+    *pbSizeKnown = c7zProp->vt != VT_EMPTY;
+    *pui64Size = c7zProp->vt == VT_UI4 ? c7zProp->ulVal : c7zProp->uhVal.QuadPart;
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::OpenItemStream(uint32_t ui32ItemIndex, const wchar_t* wszPassword, uint64_t ui64BufferSize)
+{
+    ARCHIVE_LOADED();
+
+    CArchiveExtractCallback* pArchiveExtractCallback;
+    IArchiveExtractCallback* pArchiveExtractCallbackInterface;
+    HRESULT hr;
+
+    CloseItemStream();
+
+    if (EnsureInArchive() != ARCHIVER_STATUS_SUCCESS)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    if (!wszPassword && !m_wstrPassword.empty())
+    {
+        wszPassword = m_wstrPassword.c_str();
+    }
+
+    try
+    {
+        m_upItemPipe.reset(new CItemPipe(static_cast<size_t>(min<uint64_t>(ui64BufferSize ? ui64BufferSize : ui64DefaultItemStreamBuffer, SIZE_MAX))));
+        pArchiveExtractCallback = new CArchiveExtractCallback(m_upItemPipe.get(), wszPassword);
+    }
+    catch (...)
+    {
+        m_upItemPipe.reset();
+        SetError(E_OUTOFMEMORY, L"Out of memory creating item stream");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    hr = pArchiveExtractCallback->QueryInterface(IID_IArchiveExtractCallback, reinterpret_cast<void**>(&pArchiveExtractCallbackInterface));
+    if (FAILED(hr))
+    {
+        m_upItemPipe.reset();
+        SetError(hr, L"QueryInterface failed on CArchiveExtractCallback");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    try
+    {
+        m_tItemDecoder = thread([this, ui32ItemIndex, pArchiveExtractCallback, pArchiveExtractCallbackInterface]
+        {
+            HRESULT hr;
+            {
+                CStatsTimer stExtract(m_pStats, StatsHistogram::Extract);
+                TRACE_SCOPE("ExtractStream", ui32ItemIndex);
+                hr = m_pInArchive->Extract(&ui32ItemIndex, 1, 0, pArchiveExtractCallbackInterface);
+                m_pStats->Add(StatsCounter::ItemsDecoded, SUCCEEDED(hr) ? 1 : 0);
+                m_pStats->Add(StatsCounter::BytesDecoded, pArchiveExtractCallback->GetDecoded());
+            }
+            pArchiveExtractCallback->Release();
+            m_upItemPipe->Finish(hr);
+        });
+        m_pStats->Add(StatsCounter::ThreadsSpawned, 1);
+    }
+    catch (...)
+    {
+        pArchiveExtractCallback->Release();
+        m_upItemPipe.reset();
+        SetError(E_FAIL, L"Unable to start item stream thread");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::ReadItemStream(uint8_t* pBuf, uint64_t ui64BufSize, uint64_t* pui64Read)
+{
+    HRESULT hr;
+
+    if (!m_upItemPipe)
+    {
+        SetError(E_FAIL, L"No item stream is open");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    *pui64Read = m_upItemPipe->Read(pBuf, static_cast<size_t>(min<uint64_t>(ui64BufSize, SIZE_MAX)), &hr);
+    m_pStats->Add(StatsCounter::BytesCopied, *pui64Read);
+    if (FAILED(hr))
+    {
+        SetError(hr, L"InArchive Extract failed");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::CloseItemStream()
+{
+    if (m_upItemPipe)
+    {
+        // Unblocks the decoder if the reader stopped before the end of the item
+        m_upItemPipe->Cancel();
+        m_tItemDecoder.join();
+        m_upItemPipe.reset();
+    }
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::ExtractArchiveItemToBuffer(const wchar_t* wszPath, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword)
+{
+    ARCHIVE_LOADED();
+
+    uint32_t ui32ItemIndex;
+
+    if (EnsureArchiveTree() != ARCHIVER_STATUS_SUCCESS)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    if (!m_spArchiveTree->Find(wszPath, &ui32ItemIndex) || ui32ItemIndex == UINT_MAX)
+    {
+        SetError(E_FAIL, L"Path not found");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return ExtractArchiveItemToBuffer(ui32ItemIndex, pBuf, ui64BufSize, wszPassword);
+}
+
+ARCHIVER_STATUS C7ZipArchiver::CloseArchive()
+{
+    // No INIT_CHECK, the registry held by the context keeps the handler's module loaded
+    CloseItemStream();
+
+    if (m_pInArchive)
+    {
+        if (m_bHasCacheKey)
+        {
+            uint32_t ui32ItemCount = 0;
+            m_pInArchive->GetNumberOfItems(&ui32ItemCount);
+            CArchiveCache::Instance().Release(m_ackCacheKey, m_spMmap, m_wstrArchiveFormat, m_pInArchive, m_spRegistry, ui32ItemCount);
+        }
+        else
+        {
+            RecycleInArchive(m_pInArchive, m_wstrArchiveFormat.c_str());
+        }
+        m_pInArchive = nullptr;
+    }
+
+    m_bHasCacheKey = false;
+    m_spRegistry.reset();
+
+    m_wstrArchiveFormat.clear();
+
+    m_spIndex.reset();
+    m_spArchiveTree.reset();
+    m_spMetadata.reset();
+    m_spMmap.reset();
+    m_pBuf = nullptr;
+    m_ui64BufSize = 0;
+    m_bHasFileIdentity = false;
+
+    if (m_iFd != -1)
+    {
+        close(m_iFd);
+        m_iFd = -1;
+    }
+
+    m_wstrPassword.clear();
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::ResetArchive()
+{
+    CloseArchive();
+
+    // Containers are cleared rather than released so the next open reuses their storage
+    m_vecTrialFormats.clear();
+    m_ui64TrialReadBudget = 0;
+    m_bCacheAttached = false;
+    m_hrError = S_OK;
+    m_wstrError.clear();
+    m_asStats.Reset();
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::CloneArchive(IArchiver** ppClone)
+{
+    ARCHIVE_LOADED();
+
+    C7ZipArchiver* pClone;
+    ArchiveCacheLease aclLease;
+
+    try
+    {
+        pClone = new C7ZipArchiver();
+    }
+    catch (...)
+    {
+        SetError(E_OUTOFMEMORY, L"Out of memory creating C7ZipArchiver");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    if (!m_spMetadata)
+    {
+        try
+        {
+            m_spMetadata = make_shared<ArchiveMetadata>();
+        }
+        catch (...)
+        {
+            SetError(E_OUTOFMEMORY, L"Out of memory creating ArchiveMetadata");
+            delete pClone;
+            return ARCHIVER_STATUS_FAILURE;
+        }
+    }
+
+    // The clone shares the mapping and metadata, only the handler is per context
+    pClone->m_spRegistry = m_spRegistry;
+    pClone->m_spMetadata = m_spMetadata;
+    pClone->m_spArchiveTree = m_spArchiveTree;
+    pClone->m_spMmap = m_spMmap;
+    pClone->m_pBuf = m_pBuf;
+    pClone->m_ui64BufSize = m_ui64BufSize;
+    pClone->m_bHasFileIdentity = m_bHasFileIdentity;
+    pClone->m_cfiFile = m_cfiFile;
+    pClone->m_spIndex = m_spIndex;
+    pClone->m_wstrArchiveFormat = m_wstrArchiveFormat;
+    pClone->m_wstrPassword = m_wstrPassword;
+    pClone->m_vecTrialFormats = m_vecTrialFormats;
+    pClone->m_ui64TrialReadBudget = m_ui64TrialReadBudget;
+    pClone->m_bCacheAttached = m_bCacheAttached;
+
+    if (m_bHasCacheKey)
+    {
+        pClone->m_ackCacheKey = m_ackCacheKey;
+        pClone->m_bHasCacheKey = true;
+        if (CArchiveCache::Instance().Acquire(m_ackCacheKey, m_wstrArchiveFormat.c_str(), &aclLease) && aclLease.pHandler)
+        {
+            pClone->m_pInArchive = static_cast<IInArchive*>(aclLease.pHandler);
+            pClone->m_spRegistry = static_pointer_cast<const FormatRegistry>(aclLease.spOwner);
+        }
+    }
+
+    // With an index loaded the handler is opened on first extraction like the parent's
+    if (!pClone->m_spIndex && pClone->EnsureInArchive() != ARCHIVER_STATUS_SUCCESS)
+    {
+        SetError(pClone->m_hrError, pClone->m_wstrError);
+        delete pClone;
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    *ppClone = pClone;
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::SaveArchiveIndex(const wchar_t* wszIndexPath)
+{
+    ARCHIVE_LOADED();
+
+    if (!m_bHasFileIdentity)
+    {
+        SetError(E_FAIL, L"Archive index requires an archive opened from a file");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    if (EnsureArchiveIndex() != ARCHIVER_STATUS_SUCCESS)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    if (!m_spIndex->Save(wszIndexPath, m_cfiFile))
+    {
+        SetError(E_FAIL, L"Unable to write archive index");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::AttachArchiveCache(bool bAttach)
+{
+    m_bCacheAttached = bAttach;
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::SetTrialOpenFormats(const wchar_t* wszFormats, uint64_t ui64HeaderReadBudget)
+{
+    INIT_CHECK();
+
+    shared_ptr<const FormatRegistry> spRegistry = AcquireFormatRegistry();
+    vector<wstring> vecTrialFormats;
+
+    if (!spRegistry)
+    {
+        SetError(E_FAIL, "GlobalInitialize has not been called");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    if (wszFormats)
+    {
+        const wchar_t* wszStart = wszFormats;
+        while (*wszStart != L'\0')
+        {
+            const wchar_t* wszEnd = wcschr(wszStart, L',');
+            wstring wstrFormat = wszEnd ? wstring(wszStart, wszEnd - wszStart) : wstring(wszStart);
+
+            if (wstrFormat != L"*" && spRegistry->mapFormats.find(wstrFormat) == spRegistry->mapFormats.end())
+            {
+                SetError(E_FAIL, L"\"" + wstrFormat + L"\" is not a supported format");
+                return ARCHIVER_STATUS_FAILURE;
+            }
+            if (!wstrFormat.empty())
+            {
+                vecTrialFormats.push_back(wstrFormat);
+            }
+
+            if (!wszEnd)
+            {
+                break;
+            }
+            wszStart = wszEnd + 1;
+        }
+    }
+
+    m_vecTrialFormats = move(vecTrialFormats);
+    m_ui64TrialReadBudget = ui64HeaderReadBudget;
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::GetError(HRESULT* pHr, const wchar_t** ppError)
+{
+    if (!pHr && !ppError)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    if (pHr)
+    {
+        *pHr = m_hrError;
+    }
+
+    if (ppError)
+    {
+        *ppError = m_wstrError.c_str();
+    }
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::GetStats(ArchiveStats* pStats)
+{
+    m_asStats.Get(pStats);
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::ResetStats()
+{
+    m_asStats.Reset();
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::OpenArchiveDiskUtf8(const char* szPath, const char* szPassword, const char* szFormat)
+{
+    INIT_CHECK();
+    CloseArchive();
+
+    wstring wstrPassword, wstrFormat;
+
+    if (!FromUtf8(szPassword, &wstrPassword) || !FromUtf8(szFormat, &wstrFormat))
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    // The path is not decoded, a file name does not have to be valid UTF-8
+    return OpenOwnedFD(CompatOpenArchiveBytes(szPath), nullptr, szPassword ? wstrPassword.c_str() : nullptr, szFormat ? wstrFormat.c_str() : nullptr);
+}
+
+ARCHIVER_STATUS C7ZipArchiver::ListDirectoryUtf8(const char* szPath, ArchiveItemUtf8** ppItems, uint64_t* pItemCount)
+{
+    ArchiveItem* pItems = nullptr;
+    ARCHIVER_STATUS asStatus;
+    wstring wstrPath;
+
+    *ppItems = nullptr;
+
+    if (!FromUtf8(szPath, &wstrPath))
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    asStatus = ListDirectory(wstrPath.c_str(), &pItems, pItemCount);
+
+    return ToUtf8Items(asStatus, pItems, ppItems);
+}
+
+ARCHIVER_STATUS C7ZipArchiver::WalkArchiveUtf8(const char* szRoot, ArchiveItemUtf8** ppItems, uint64_t* pItemCount)
+{
+    ArchiveItem* pItems = nullptr;
+    ARCHIVER_STATUS asStatus;
+    wstring wstrRoot;
+
+    *ppItems = nullptr;
+
+    if (!FromUtf8(szRoot, &wstrRoot))
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    asStatus = WalkArchive(wstrRoot.c_str(), &pItems, pItemCount);
+
+    return ToUtf8Items(asStatus, pItems, ppItems);
+}
+
+ARCHIVER_STATUS C7ZipArchiver::GetArchiveItemPropertiesUtf8(const char* szPath, ArchiveItemUtf8** ppItem)
+{
+    ArchiveItem* pItem = nullptr;
+    ARCHIVER_STATUS asStatus;
+    wstring wstrPath;
+
+    *ppItem = nullptr;
+
+    if (!FromUtf8(szPath, &wstrPath))
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    asStatus = GetArchiveItemProperties(wstrPath.c_str(), &pItem);
+
+    return ToUtf8Items(asStatus, pItem, ppItem);
+}
+
+ARCHIVER_STATUS C7ZipArchiver::GetArchiveItemPropertiesUtf8(uint32_t ui32ItemIndex, ArchiveItemUtf8** ppItem)
+{
+    ArchiveItem* pItem = nullptr;
+    ARCHIVER_STATUS asStatus;
+
+    *ppItem = nullptr;
+
+    asStatus = GetArchiveItemProperties(ui32ItemIndex, &pItem);
+
+    return ToUtf8Items(asStatus, pItem, ppItem);
+}
+
+ARCHIVER_STATUS C7ZipArchiver::FreeArchiveItemUtf8(ArchiveItemUtf8* pItem)
+{
+    // Items and their paths are one allocation owned by the first item
+    free(pItem);
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::ExtractArchiveItemToBufferUtf8(const char* szPath, uint8_t* pBuf, uint64_t ui64BufSize, const char* szPassword)
+{
+    wstring wstrPath, wstrPassword;
+
+    if (!FromUtf8(szPath, &wstrPath) || !FromUtf8(szPassword, &wstrPassword))
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return ExtractArchiveItemToBuffer(wstrPath.c_str(), pBuf, ui64BufSize, szPassword ? wstrPassword.c_str() : nullptr);
+}
+
+bool C7ZipArchiver::FromUtf8(const char* szStr, wstring* pwstrOut)
+{
+    size_t szLength;
+
+    // A missing optional argument stays missing, callers check the original pointer
+    if (!szStr)
+    {
+        return true;
+    }
+
+    szLength = strlen(szStr);
+
+    try
+    {
+        pwstrOut->resize(CompatUtf8ToWide(szStr, szLength, nullptr));
+    }
+    catch (...)
+    {
+        SetError(E_OUTOFMEMORY, L"Unable to convert UTF-8 argument");
+        return false;
+    }
+    CompatUtf8ToWide(szStr, szLength, &(*pwstrOut)[0]);
+
+    return true;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::ToUtf8Items(ARCHIVER_STATUS asStatus, ArchiveItem* pItems, ArchiveItemUtf8** ppItems)
+{
+    ArchiveItemUtf8* pUtf8Items;
+    ArchiveItemUtf8* pUtf8Item;
+    char* pPool;
+    uint64_t ui64ItemCount = 0;
+    uint64_t ui64PoolLength = 0;
+    uint64_t ui64Size;
+
+    if (asStatus != ARCHIVER_STATUS_SUCCESS || !pItems)
+    {
+        return asStatus;
+    }
+
+    for (ArchiveItem* pItem = pItems; pItem; pItem = pItem->pItemNext)
+    {
+        ++ui64ItemCount;
+        ui64PoolLength += CompatWideToUtf8(pItem->wszPath, wcslen(pItem->wszPath), nullptr) + 1;
+    }
+
+    ui64Size = ui64ItemCount * sizeof(ArchiveItemUtf8) + ui64PoolLength;
+    pUtf8Items = ui64Size <= SIZE_MAX ? static_cast<ArchiveItemUtf8*>(calloc(1, static_cast<size_t>(ui64Size))) : nullptr;
+    if (!pUtf8Items)
+    {
+        FreeArchiveItem(pItems);
+        SetError(E_OUTOFMEMORY, L"Unable to create ArchiveItemUtf8");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+    pPool = reinterpret_cast<char*>(pUtf8Items + ui64ItemCount);
+
+    // Same layout as the wide items, the paths are encoded straight into the pool
+    pUtf8Item = pUtf8Items;
+    for (ArchiveItem* pItem = pItems; pItem; pItem = pItem->pItemNext, ++pUtf8Item)
+    {
+        pUtf8Item->ui32Index = pItem->ui32Index;
+        pUtf8Item->cIsDir = pItem->cIsDir;
+        pUtf8Item->ui64Size = pItem->ui64Size;
+        pUtf8Item->ftModTime = pItem->ftModTime;
+        pUtf8Item->pItemNext = pItem->pItemNext ? pUtf8Item + 1 : nullptr;
+        pUtf8Item->szPath = pPool;
+        pPool += CompatWideToUtf8(pItem->wszPath, wcslen(pItem->wszPath), pPool) + 1;
+    }
+
+    FreeArchiveItem(pItems);
+    *ppItems = pUtf8Items;
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::GlobalInitialize(const wchar_t* wszLibPath)
+{
+    shared_ptr<FormatRegistry> spRegistry;
+    shared_ptr<const FormatRegistry>* pspRegistry;
+    CompatModule pModule;
+    bool bReload;
+
+#if !defined(TITANARCHIVE_STATIC_7Z)
+    if (!wszLibPath)
+    {
+        SetGlobalError(E_FAIL, "7z library path missing");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+#endif
+
+    lock_guard<mutex> lgLock(s_mRegistryLock);
+
+    try
+    {
+        spRegistry = make_shared<FormatRegistry>();
+    }
+    catch (...)
+    {
+        SetGlobalError(E_OUTOFMEMORY, "Out of memory creating FormatRegistry");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+#if defined(TITANARCHIVE_STATIC_7Z)
+    // Without a path the linked in handlers are used, there is no module to keep loaded
+    if (!wszLibPath)
+    {
+        spRegistry->pGetNumberOfFormats = GetNumberOfFormats;
+        spRegistry->pGetHandlerProperty2 = reinterpret_cast<FormatRegistry::fnGetHandlerProperty2>(GetHandlerProperty2);
+        spRegistry->pCreateObject = reinterpret_cast<FormatRegistry::fnCreateObject>(CreateObject);
+    }
+    else
+#endif
+    {
+        pModule = CompatDlopen(wszLibPath, RTLD_LOCAL | RTLD_NOW);
+        if (!pModule)
+        {
+            SetGlobalError(E_FAIL, dlerror());
+            return ARCHIVER_STATUS_FAILURE;
+        }
+
+        RESOLVE_FUNC_RET(pModule, spRegistry->pGetNumberOfFormats, "GetNumberOfFormats");
+        RESOLVE_FUNC_RET(pModule, spRegistry->pGetHandlerProperty2, "GetHandlerProperty2");
+        RESOLVE_FUNC_RET(pModule, spRegistry->pCreateObject, "CreateObject");
+
+        try
+        {
+            spRegistry->spModule = ShareModule(pModule);
+        }
+        catch (...)
+        {
+            dlclose(pModule);
+            SetGlobalError(E_OUTOFMEMORY, "Out of memory creating FormatRegistry");
+            return ARCHIVER_STATUS_FAILURE;
+        }
+    }
+
+    try
+    {
+        pspRegistry = new shared_ptr<const FormatRegistry>();
+    }
+    catch (...)
+    {
+        SetGlobalError(E_OUTOFMEMORY, "Out of memory creating FormatRegistry");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    // A failed reload leaves the previous registry in place
+    if (PopulateArchiveSupport(spRegistry.get()) != ARCHIVER_STATUS_SUCCESS)
+    {
+        delete pspRegistry;
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    *pspRegistry = move(spRegistry);
+    bReload = s_pspRegistry.load() != nullptr;
+    PublishFormatRegistry(pspRegistry);
+
+    // Cached handlers were created by the previous modules
+    if (bReload)
+    {
+        CArchiveCache::Instance().Flush();
+    }
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::GlobalAddCodec(const wchar_t* wszFormat, const wchar_t* wszLibPath)
+{
+    struct ArchiveType::CodecModule cmElem;
+    shared_ptr<FormatRegistry> spRegistry;
+    shared_ptr<const FormatRegistry>* pspRegistry;
+    CompatModule pModule;
+
+    lock_guard<mutex> lgLock(s_mRegistryLock);
+
+    if (!s_pspRegistry.load())
+    {
+        SetGlobalError(E_FAIL, "GlobalInitialize has not been called");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    // Publishers are serialized, so the current registry can be read without registering
+    const FormatRegistry& frCurrent = **s_pspRegistry.load();
+
+    if (frCurrent.mapFormats.find(wszFormat) == frCurrent.mapFormats.end())
+    {
+        SetGlobalError(E_FAIL, "Format is not supported");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    pModule = CompatDlopen(wszLibPath, RTLD_LOCAL | RTLD_NOW);
+    if (!pModule)
+    {
+        SetGlobalError(E_FAIL, dlerror());
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    RESOLVE_FUNC_RET(pModule, cmElem.pGetNumberOfMethods, "GetNumberOfMethods");
+    RESOLVE_FUNC_RET(pModule, cmElem.pCreateDecoder, "CreateDecoder");
+    RESOLVE_FUNC_RET(pModule, cmElem.pGetMethodProperty, "GetMethodProperty");
+
+    // The new registry shares every module with the current one except the replaced codec
+    try
+    {
+        cmElem.spModule = ShareModule(pModule);
+        spRegistry = make_shared<FormatRegistry>(frCurrent);
+
+        // Pooled handlers of this format were set up with the previous codec
+        spRegistry->mapFormats[wszFormat].spHandlerPool = make_shared<HandlerPool>();
+        pspRegistry = new shared_ptr<const FormatRegistry>();
+    }
+    catch (...)
+    {
+        if (!cmElem.spModule)
+        {
+            dlclose(pModule);
+        }
+        SetGlobalError(E_OUTOFMEMORY, "Out of memory creating FormatRegistry");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    spRegistry->mapFormats[wszFormat].cmCodec = move(cmElem);
+    *pspRegistry = move(spRegistry);
+    PublishFormatRegistry(pspRegistry);
+
+    CArchiveCache::Instance().Flush();
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::GlobalGetSupportedArchiveFormats(const wchar_t** ppArchiveFormats)
+{
+    shared_ptr<const FormatRegistry> spRegistry = AcquireFormatRegistry();
+
+    if (!spRegistry)
+    {
+        SetGlobalError(E_FAIL, "GlobalInitialize has not been called");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    // The list is shared by every registry until the next GlobalInitialize or GlobalUninitialize
+    *ppArchiveFormats = spRegistry->spFormatList->c_str();
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+void C7ZipArchiver::GlobalUninitialize()
+{
+    lock_guard<mutex> lgLock(s_mRegistryLock);
+
+    // Modules are unloaded once the last context and cached handler created from them are gone
+    PublishFormatRegistry(nullptr);
+
+    CArchiveCache::Instance().Flush();
+    CThreadPool::Instance().Shutdown();
+}
+
+ARCHIVER_STATUS C7ZipArchiver::IterateItems(function<void(uint32_t /* Start index */, uint32_t /* End index */)> const& f)
+{
+    uint32_t ui32ItemCount = 0;
+    HRESULT hr;
+    CStatsTimer stIterate(m_pStats, StatsHistogram::IterateItems);
+
+    m_pStats->Add(StatsCounter::IterateItemsCalls, 1);
+
+    if (m_spIndex)
+    {
+        ui32ItemCount = m_spIndex->ItemCount();
+    }
+    else
+    {
+        hr = m_pInArchive->GetNumberOfItems(&ui32ItemCount);
+        if (FAILED(hr))
+        {
+            SetError(hr, "GetNumberOfItems failed");
+            return ARCHIVER_STATUS_FAILURE;
+        }
+    }
+
+#ifndef SINGLE_THREADED_ITERATION
+    uint64_t ui64ItemCost = s_ui64ItemCost;
+    atomic<uint64_t> ui64Elapsed(0);
+    auto fTimed = [&](uint32_t ui32Start, uint32_t ui32End)
+    {
+        TRACE_SCOPE("IterateItems", ui32End - ui32Start);
+        auto tpStart = chrono::steady_clock::now();
+
+        f(ui32Start, ui32End);
+
+        ui64Elapsed += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - tpStart).count();
+    };
+
+    if (ui32ItemCount == 0)
+    {
+        return ARCHIVER_STATUS_SUCCESS;
+    }
+
+    // Waking the pool only pays off when the whole range is expected to take a while
+    if (ui32ItemCount * ui64ItemCost < ui64ParallelCostThreshold)
+    {
+        fTimed(0, ui32ItemCount);
+    }
+    else
+    {
+        CThreadPool::Instance().ParallelFor(ui32ItemCount, static_cast<uint32_t>(max<uint64_t>(ui64ChunkCost / max<uint64_t>(ui64ItemCost, 1), 1)), fTimed);
+    }
+
+    // Smoothed so a single slow or cached run does not flip the decision
+    s_ui64ItemCost = (ui64ItemCost * 3 + ui64Elapsed / ui32ItemCount) / 4;
+#else
+    TRACE_SCOPE("IterateItems", ui32ItemCount);
+    f(0, ui32ItemCount);
+#endif
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::EnsureInArchive()
+{
+    if (m_pInArchive)
+    {
+        return ARCHIVER_STATUS_SUCCESS;
+    }
+
+    // Opened from a sidecar index, the format is known so discovery is skipped
+    wstring wstrFormat = m_wstrArchiveFormat;
+    wstring wstrPassword = m_wstrPassword;
+
+    return OpenInArchive(m_pBuf, m_ui64BufSize, wstrPassword.empty() ? nullptr : wstrPassword.c_str(), wstrFormat.c_str());
+}
+
+ARCHIVER_STATUS C7ZipArchiver::EnsureArchiveIndex()
+{
+    if (!m_spMetadata)
+    {
+        try
+        {
+            m_spMetadata = make_shared<ArchiveMetadata>();
+        }
+        catch (...)
+        {
+            SetError(E_OUTOFMEMORY, L"Out of memory creating ArchiveMetadata");
+            return ARCHIVER_STATUS_FAILURE;
+        }
+    }
+
+    if (m_spIndex)
+    {
+        return ARCHIVER_STATUS_SUCCESS;
+    }
+
+    lock_guard<mutex> lgLock(m_spMetadata->mLock);
+
+    if (m_spMetadata->spIndex)
+    {
+        m_spIndex = m_spMetadata->spIndex;
+        return ARCHIVER_STATUS_SUCCESS;
     }
 
-    if (ppError)
+    if (BuildArchiveIndex() != ARCHIVER_STATUS_SUCCESS)
     {
-        *ppError = m_wstrError.c_str();
+        return ARCHIVER_STATUS_FAILURE;
     }
 
+    m_spMetadata->spIndex = m_spIndex;
+
     return ARCHIVER_STATUS_SUCCESS;
 }
 
-ARCHIVER_STATUS C7ZipArchiver::GlobalInitialize(const wchar_t* wszLibPath)
+ARCHIVER_STATUS C7ZipArchiver::EnsureArchiveTree()
 {
-    if (!wszLibPath)
-    {
-        SetGlobalError(E_FAIL, "7z library path missing");
-        return ARCHIVER_STATUS_FAILURE;
-    }
-
-    if (s_bIsInitialized)
+    if (m_spArchiveTree)
     {
-        GlobalUninitialize();
+        return ARCHIVER_STATUS_SUCCESS;
     }
 
-    s_p7zModule = CompatDlopen(wszLibPath, RTLD_LOCAL | RTLD_NOW);
-    if (!s_p7zModule)
+    // The tree is built from the item table so paths are only read from the handler once
+    if (EnsureArchiveIndex() != ARCHIVER_STATUS_SUCCESS)
     {
-        SetGlobalError(E_FAIL, dlerror());
         return ARCHIVER_STATUS_FAILURE;
     }
 
-    RESOLVE_FUNC_RET(s_p7zModule, s_GetNumberOfFormats, "GetNumberOfFormats");
-    RESOLVE_FUNC_RET(s_p7zModule, s_GetHandlerProperty2, "GetHandlerProperty2");
-    RESOLVE_FUNC_RET(s_p7zModule, s_CreateObject, "CreateObject");
+    lock_guard<mutex> lgLock(m_spMetadata->mLock);
 
-    if (PopulateArchiveSupport() != ARCHIVER_STATUS_SUCCESS)
+    if (!m_spMetadata->spArchiveTree)
     {
-        return ARCHIVER_STATUS_FAILURE;
+        try
+        {
+            m_spMetadata->spArchiveTree = make_shared<CArchiveTree>(*m_spIndex);
+        }
+        catch (...)
+        {
+            SetError(E_OUTOFMEMORY, L"Out of memory building archive tree");
+            return ARCHIVER_STATUS_FAILURE;
+        }
     }
 
-    s_bIsInitialized = true;
+    m_spArchiveTree = m_spMetadata->spArchiveTree;
+
     return ARCHIVER_STATUS_SUCCESS;
 }
 
-ARCHIVER_STATUS C7ZipArchiver::GlobalAddCodec(const wchar_t* wszFormat, const wchar_t* wszLibPath)
+ARCHIVER_STATUS C7ZipArchiver::BuildArchiveIndex()
 {
-    struct ArchiveType::CodecModule cmElem;
+    map<uint32_t /* Start index */, pair<vector<ArchiveIndexRecord>, vector<wchar_t>>> mapRanges;
+    vector<ArchiveIndexRecord> vecRecords;
+    vector<wchar_t> vecPool;
+    volatile bool bHasFailure = false;
+    mutex mLock;
 
-    if (!s_bIsInitialized)
+    if (IterateItems([=, &mLock, &bHasFailure, &mapRanges](uint32_t ui32Start, uint32_t ui32End)
     {
-        SetGlobalError(E_FAIL, "GlobalInitialize has not been called");
-        return ARCHIVER_STATUS_FAILURE;
-    }
-    
-    auto iterElem = s_mapSupportedFormats.find(wszFormat);
+        C7ZipProperty c7zProp(m_pInArchive, m_pStats);
+        vector<ArchiveIndexRecord> vecLocalRecords;
+        vector<wchar_t> vecLocalPool;
+
+        try
+        {
+            vecLocalRecords.reserve(ui32End - ui32Start);
+
+            for (uint32_t i = ui32Start; i < ui32End && !bHasFailure; ++i)
+            {
+                ArchiveIndexRecord airRecord = {0};
+
+                if (SUCCEEDED(c7zProp.GetProperty(i, kpidPath)) && c7zProp->vt == VT_BSTR && c7zProp->bstrVal)
+                {
+                    size_t szLength = wcslen(c7zProp->bstrVal);
+                    airRecord.ui64PathOffset = vecLocalPool.size();
+                    airRecord.ui32PathLength = static_cast<uint32_t>(szLength);
+                    airRecord.ui32Flags |= CArchiveIndex::kFlagHasPath;
+                    vecLocalPool.insert(vecLocalPool.end(), c7zProp->bstrVal, c7zProp->bstrVal + szLength + 1);
+                }
+
+                if (FAILED(c7zProp.GetProperty(i, kpidIsDir)))
+                {
+                    bHasFailure = true;
+                    break;
+                }
+                if (c7zProp->boolVal == VARIANT_TRUE)
+                {
+                    airRecord.ui32Flags |= CArchiveIndex::kFlagIsDir;
+                }
+
+                if (FAILED(c7zProp.GetProperty(i, kpidSize)))
+                {
+                    bHasFailure = true;
+                    break;
+                }
+                airRecord.ui64Size = c7zProp->uhVal.QuadPart;
+
+                if (FAILED(c7zProp.GetProperty(i, kpidMTime)))
+                {
+                    bHasFailure = true;
+                    break;
+                }
+                airRecord.ui64MTime = (static_cast<uint64_t>(c7zProp->filetime.dwHighDateTime) << 32) | c7zProp->filetime.dwLowDateTime;
+
+                if (SUCCEEDED(c7zProp.GetProperty(i, kpidPackSize)) && c7zProp->vt != VT_EMPTY)
+                {
+                    airRecord.ui64PackSize = c7zProp->vt == VT_UI4 ? c7zProp->ulVal : c7zProp->uhVal.QuadPart;
+                    airRecord.ui32Flags |= CArchiveIndex::kFlagHasPackSize;
+                }
+
+                if (SUCCEEDED(c7zProp.GetProperty(i, kpidOffset)) && c7zProp->vt != VT_EMPTY)
+                {
+                    airRecord.ui64Offset = c7zProp->vt == VT_UI4 ? c7zProp->ulVal : c7zProp->uhVal.QuadPart;
+                    airRecord.ui32Flags |= CArchiveIndex::kFlagHasOffset;
+                }
+
+                vecLocalRecords.push_back(airRecord);
+            }
 
-    if (iterElem == s_mapSupportedFormats.end())
+            mLock.lock();
+            mapRanges.emplace(ui32Start, make_pair(move(vecLocalRecords), move(vecLocalPool)));
+            mLock.unlock();
+        }
+        catch (...)
+        {
+            bHasFailure = true;
+        }
+    }) == ARCHIVER_STATUS_FAILURE)
     {
-        SetGlobalError(E_FAIL, "Format is not supported");
         return ARCHIVER_STATUS_FAILURE;
     }
 
-    cmElem.pModule = CompatDlopen(wszLibPath, RTLD_LOCAL | RTLD_NOW);
-    if (!cmElem.pModule)
+    if (bHasFailure)
     {
-        SetGlobalError(E_FAIL, dlerror());
+        SetError(E_FAIL, L"Unable to read item properties for archive index");
         return ARCHIVER_STATUS_FAILURE;
     }
 
-    RESOLVE_FUNC_RET(cmElem.pModule, cmElem.pGetNumberOfMethods, "GetNumberOfMethods");
-    RESOLVE_FUNC_RET(cmElem.pModule, cmElem.pCreateDecoder, "CreateDecoder");
-    RESOLVE_FUNC_RET(cmElem.pModule, cmElem.pGetMethodProperty, "GetMethodProperty");
-
-    if (iterElem->second.cmCodec.pModule)
+    try
     {
-        dlclose(iterElem->second.cmCodec.pModule);
-    }
-
-    iterElem->second.cmCodec = cmElem;
-
-    return ARCHIVER_STATUS_SUCCESS;
-}
+        for (auto& iterRange : mapRanges)
+        {
+            uint64_t ui64PoolBase = vecPool.size();
+            for (ArchiveIndexRecord& airRecord : iterRange.second.first)
+            {
+                airRecord.ui64PathOffset += ui64PoolBase;
+            }
+            vecRecords.insert(vecRecords.end(), iterRange.second.first.begin(), iterRange.second.first.end());
+            vecPool.insert(vecPool.end(), iterRange.second.second.begin(), iterRange.second.second.end());
+        }
 
-ARCHIVER_STATUS C7ZipArchiver::GlobalGetSupportedArchiveFormats(const wchar_t** ppArchiveFormats)
-{
-    if (!s_bIsInitialized)
+        m_spIndex = make_shared<CArchiveIndex>(m_wstrArchiveFormat, move(vecRecords), move(vecPool));
+    }
+    catch (...)
     {
-        SetGlobalError(E_FAIL, "GlobalInitialize has not been called");
+        SetError(E_OUTOFMEMORY, L"Out of memory building archive index");
         return ARCHIVER_STATUS_FAILURE;
     }
 
-    *ppArchiveFormats = s_wstrSupportedFormats.c_str();
-
     return ARCHIVER_STATUS_SUCCESS;
 }
 
-void C7ZipArchiver::GlobalUninitialize()
+void C7ZipArchiver::AdoptCachedArchive(ArchiveCacheLease& aclLease, const wchar_t* wszPassword)
 {
-    for (auto& iterSupportedType : s_mapSupportedFormats)
+    m_pInArchive = static_cast<IInArchive*>(aclLease.pHandler);
+    m_spRegistry = static_pointer_cast<const FormatRegistry>(aclLease.spOwner);
+    m_wstrArchiveFormat = aclLease.wstrFormat;
+    m_spMmap = move(aclLease.spMmap);
+
+    if (m_spMmap)
     {
-        if (iterSupportedType.second.cmCodec.pModule)
-        {
-            dlclose(iterSupportedType.second.cmCodec.pModule);
-        }
+        m_pBuf = static_cast<uint8_t*>(m_spMmap->Addr());
+        m_ui64BufSize = m_spMmap->Length();
     }
 
-    s_mapSupportedFormats.clear();
-    s_wstrSupportedFormats.clear();
-
-    if (s_p7zModule)
+    if (wszPassword)
     {
-        dlclose(s_p7zModule);
-        s_p7zModule = nullptr;
+        m_wstrPassword = wszPassword;
     }
-
-    s_GetNumberOfFormats = nullptr;
-    s_GetHandlerProperty2 = nullptr;
-    s_CreateObject = nullptr;
-
-    s_bIsInitialized = false;
 }
 
-ARCHIVER_STATUS C7ZipArchiver::IterateItems(function<void(uint32_t /* Start index */, uint32_t /* End index */)> const& f)
+bool C7ZipArchiver::AttachFormatRegistry()
 {
-    vector<thread> vecWorkers;
-    uint32_t ui32ThreadCount = thread::hardware_concurrency();
-#ifndef SINGLE_THREADED_ITERATION
-    constexpr uint32_t ui32ThreadThreshold = 500;
-#endif
-    uint32_t ui32ItemCount = 0;
-    HRESULT hr;
-    
-    if (!ui32ThreadCount)
+    m_spRegistry = AcquireFormatRegistry();
+    if (!m_spRegistry)
     {
-        SetError(E_FAIL, L"Unable to determine core count");
-        return ARCHIVER_STATUS_FAILURE;
+        SetError(E_FAIL, "GlobalInitialize has not been called");
+        return false;
     }
 
-    hr = m_pInArchive->GetNumberOfItems(&ui32ItemCount);
-    if (FAILED(hr))
-    {
-        SetError(hr, "GetNumberOfItems failed");
-        return ARCHIVER_STATUS_FAILURE;
-    }
+    return true;
+}
 
-#ifndef SINGLE_THREADED_ITERATION
-    if (ui32ItemCount < ui32ThreadThreshold)
+ArchiveItem* C7ZipArchiver::CreateArchiveItems(uint32_t ui32ItemCount, uint64_t ui64PoolLength)
+{
+    uint64_t ui64Size = ui32ItemCount * sizeof(ArchiveItem) + ui64PoolLength * sizeof(wchar_t);
+    ArchiveItem* pItems;
+
+    if (ui64Size > SIZE_MAX)
     {
-#endif
-        ui32ThreadCount = 1;
-#ifndef SINGLE_THREADED_ITERATION
+        SetError(E_OUTOFMEMORY, L"Unable to create ArchiveItem");
+        return nullptr;
     }
-#endif
 
-    for (uint32_t ui32Thread = 0; ui32Thread < ui32ThreadCount; ++ui32Thread)
+    // The zeroed pool leaves every path terminated once it is copied in
+    pItems = static_cast<ArchiveItem*>(calloc(1, static_cast<size_t>(ui64Size)));
+    if (!pItems)
     {
-        uint32_t ui32Start = (ui32ItemCount / ui32ThreadCount) * ui32Thread;
-        uint32_t ui32End = (ui32ItemCount / ui32ThreadCount) * (ui32Thread + 1);
-        
-        if (ui32End > ui32ItemCount || ui32Thread == ui32ThreadCount - 1)
-        {
-            ui32End = ui32ItemCount;
-        }
-#ifndef SINGLE_THREADED_ITERATION
-        vecWorkers.push_back(thread([=]()
-        {
-            f(ui32Start, ui32End);
-        }));
-#else
-        f(ui32Start, ui32End);
-#endif
+        SetError(E_OUTOFMEMORY, L"Unable to create ArchiveItem");
+        return nullptr;
     }
 
-#ifndef SINGLE_THREADED_ITERATION
-    for (thread& threadElem : vecWorkers)
+    for (uint32_t i = 0; i + 1 < ui32ItemCount; ++i)
     {
-        threadElem.join();
+        pItems[i].pItemNext = &pItems[i + 1];
     }
-#endif
 
-    return ARCHIVER_STATUS_SUCCESS;
+    return pItems;
+}
+
+void C7ZipArchiver::FillArchiveItem(uint32_t ui32ItemIndex, ArchiveItem* pItem)
+{
+    const ArchiveIndexRecord& airRecord = m_spIndex->Record(ui32ItemIndex);
+
+    pItem->ui32Index = ui32ItemIndex;
+    pItem->cIsDir = (airRecord.ui32Flags & CArchiveIndex::kFlagIsDir) != 0;
+    pItem->ui64Size = airRecord.ui64Size;
+    pItem->ftModTime.dwLowDateTime = static_cast<uint32_t>(airRecord.ui64MTime);
+    pItem->ftModTime.dwHighDateTime = static_cast<uint32_t>(airRecord.ui64MTime >> 32);
 }
 
 ArchiveItem* C7ZipArchiver::CreateDirectoryPlaceholder(const wchar_t* wszDirectoryPath)
 {
-    ArchiveItem* pItem = static_cast<ArchiveItem*>(calloc(1, sizeof(ArchiveItem)));
+    size_t szPathLength = wcslen(wszDirectoryPath);
+    ArchiveItem* pItem = CreateArchiveItems(1, szPathLength + 1);
     if (!pItem)
     {
-        SetError(E_OUTOFMEMORY, L"Unable to create ArchiveItem");
         return nullptr;
     }
     
     pItem->ui32Index = UINT_MAX;
-    pItem->wszPath = SysAllocString(wszDirectoryPath);
+    pItem->wszPath = reinterpret_cast<wchar_t*>(pItem + 1);
+    memcpy(pItem->wszPath, wszDirectoryPath, szPathLength * sizeof(wchar_t));
     pItem->cIsDir = 1;
     
     return pItem;
@@ -897,21 +2599,33 @@ C7ZipArchiver::IInArchive* C7ZipArchiver::CreateInArchive(const wchar_t* wszForm
         return nullptr;
     }
 
-    auto iterElem = s_mapSupportedFormats.find(wszFormat);
-    if (iterElem == s_mapSupportedFormats.end())
+    auto iterElem = m_spRegistry->mapFormats.find(wszFormat);
+    if (iterElem == m_spRegistry->mapFormats.end())
     {
         SetError(E_FAIL, L"\"" + wstring(wszFormat) + L"\" is not a supported format");
         return nullptr;
     }
 
-    hr = s_CreateObject(&iterElem->second.guidClassId, &IID_IInArchive, reinterpret_cast<void**>(&pInArchive));
+    // A closed handler of the same format skips creation and codec setup
+    {
+        lock_guard<mutex> lgLock(iterElem->second.spHandlerPool->mLock);
+        vector<IUnknown*>& vecIdle = iterElem->second.spHandlerPool->vecIdle;
+        if (!vecIdle.empty())
+        {
+            pInArchive = static_cast<IInArchive*>(vecIdle.back());
+            vecIdle.pop_back();
+            return pInArchive;
+        }
+    }
+
+    hr = m_spRegistry->pCreateObject(&iterElem->second.guidClassId, &IID_IInArchive, reinterpret_cast<void**>(&pInArchive));
     if (FAILED(hr))
     {
         SetError(hr, "Unable to create IInArchive object");
         return nullptr;
     }
     
-    if (iterElem->second.cmCodec.pModule)
+    if (iterElem->second.cmCodec.spModule)
     {
         ISetCompressCodecsInfo* pSetCompressCodecsInfo = nullptr;
 
@@ -920,7 +2634,7 @@ C7ZipArchiver::IInArchive* C7ZipArchiver::CreateInArchive(const wchar_t* wszForm
             CCompressCodecsInfo* pCompressCodecsInfo;
             try
             {
-                pCompressCodecsInfo = new CCompressCodecsInfo(&iterElem->second.cmCodec);
+                pCompressCodecsInfo = new CCompressCodecsInfo(iterElem->second.cmCodec);
             }
             catch(...)
             {
@@ -937,9 +2651,31 @@ C7ZipArchiver::IInArchive* C7ZipArchiver::CreateInArchive(const wchar_t* wszForm
     return pInArchive;
 }
 
+void C7ZipArchiver::RecycleInArchive(IInArchive* pInArchive, const wchar_t* wszFormat)
+{
+    auto iterElem = m_spRegistry->mapFormats.find(wszFormat);
+
+    pInArchive->Close();
+
+    if (iterElem != m_spRegistry->mapFormats.end())
+    {
+        lock_guard<mutex> lgLock(iterElem->second.spHandlerPool->mLock);
+        vector<IUnknown*>& vecIdle = iterElem->second.spHandlerPool->vecIdle;
+        if (vecIdle.size() < szMaxPooledHandlers)
+        {
+            vecIdle.push_back(pInArchive);
+            return;
+        }
+    }
+
+    pInArchive->Release();
+}
+
 const wchar_t* C7ZipArchiver::DiscoverArchiveFormat(uint8_t* pBuf, uint64_t ui64BufSize)
 {
-    for (const auto& itElem : s_mapSupportedFormats)
+    TRACE_SCOPE("DiscoverArchiveFormat", ui64BufSize);
+
+    for (const auto& itElem : m_spRegistry->mapFormats)
     {
         for (const auto& vecSig : itElem.second.vecSignatures)
         {
@@ -957,8 +2693,187 @@ const wchar_t* C7ZipArchiver::DiscoverArchiveFormat(uint8_t* pBuf, uint64_t ui64
     return nullptr;
 }
 
-ARCHIVER_STATUS C7ZipArchiver::PopulateArchiveSupport()
+C7ZipArchiver::IInArchive* C7ZipArchiver::TrialOpenArchive(uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword, const wchar_t** pwszFormat)
+{
+    struct TrialCandidate
+    {
+        const wchar_t* wszFormat;
+        IInArchive* pInArchive;
+        CBufInStream* pBufInStream;
+    };
+
+    vector<const wchar_t*> vecFormats;
+    vector<TrialCandidate> vecCandidates;
+    vector<char> vecOpened;
+    vector<thread> vecWorkers;
+    unique_ptr<atomic_bool[]> upCancel;
+    atomic_uint uiNextCandidate(0);
+    atomic_uint uiBest(UINT_MAX);
+    uint32_t ui32Winner = UINT_MAX;
+    uint32_t ui32ThreadCount = thread::hardware_concurrency();
+    TRACE_SCOPE("TrialOpenArchive", m_vecTrialFormats.size());
+
+    for (const wstring& wstrFormat : m_vecTrialFormats)
+    {
+        if (wstrFormat == L"*")
+        {
+            vecFormats.clear();
+            for (const auto& itElem : m_spRegistry->mapFormats)
+            {
+                vecFormats.push_back(itElem.first.c_str());
+            }
+            sort(vecFormats.begin(), vecFormats.end(), [this](const wchar_t* wszLeft, const wchar_t* wszRight)
+            {
+                return m_spRegistry->mapFormats.at(wszLeft).ui32Priority < m_spRegistry->mapFormats.at(wszRight).ui32Priority;
+            });
+            break;
+        }
+        vecFormats.push_back(wstrFormat.c_str());
+    }
+
+    // Handlers are created up front since CreateInArchive reports errors through the context
+    for (const wchar_t* wszCandidate : vecFormats)
+    {
+        TrialCandidate tcElem = {wszCandidate, nullptr, nullptr};
+
+        tcElem.pInArchive = CreateInArchive(wszCandidate);
+        if (!tcElem.pInArchive)
+        {
+            continue;
+        }
+
+        try
+        {
+            tcElem.pBufInStream = new CBufInStream(pBuf, ui64BufSize);
+        }
+        catch (...)
+        {
+            RecycleInArchive(tcElem.pInArchive, wszCandidate);
+            continue;
+        }
+        tcElem.pBufInStream->AddRef();
+
+        vecCandidates.push_back(tcElem);
+    }
+
+    // Candidates are in priority order, a success only cancels the ones after it
+    try
+    {
+        upCancel.reset(new atomic_bool[vecCandidates.size()]);
+        vecOpened.resize(vecCandidates.size(), 0);
+    }
+    catch (...)
+    {
+        for (TrialCandidate& tcElem : vecCandidates)
+        {
+            RecycleInArchive(tcElem.pInArchive, tcElem.wszFormat);
+            tcElem.pBufInStream->Release();
+        }
+        SetError(E_OUTOFMEMORY, L"Out of memory starting trial opens");
+        return nullptr;
+    }
+    for (uint32_t i = 0; i < vecCandidates.size(); ++i)
+    {
+        upCancel[i] = false;
+        vecCandidates[i].pBufInStream->SetReadLimits(m_ui64TrialReadBudget, &upCancel[i]);
+    }
+
+    if (ui32ThreadCount == 0)
+    {
+        ui32ThreadCount = 1;
+    }
+    if (ui32ThreadCount > vecCandidates.size())
+    {
+        ui32ThreadCount = static_cast<uint32_t>(vecCandidates.size());
+    }
+
+    for (uint32_t ui32Thread = 0; ui32Thread < ui32ThreadCount; ++ui32Thread)
+    {
+        vecWorkers.push_back(thread([&]()
+        {
+            for (uint32_t i = uiNextCandidate++; i < vecCandidates.size() && i < uiBest; i = uiNextCandidate++)
+            {
+                CArchiveOpenCallback* pArchiveOpenCallback;
+                HRESULT hr;
+
+                try
+                {
+                    pArchiveOpenCallback = new CArchiveOpenCallback(wszPassword, &upCancel[i]);
+                }
+                catch (...)
+                {
+                    continue;
+                }
+                pArchiveOpenCallback->AddRef();
+
+                // Handlers return S_FALSE when the data is not in their format
+                {
+                    TRACE_SCOPE("TrialOpenCandidate", i, vecCandidates[i].wszFormat);
+                    hr = vecCandidates[i].pInArchive->Open(vecCandidates[i].pBufInStream, nullptr, pArchiveOpenCallback);
+                }
+                pArchiveOpenCallback->Release();
+                m_pStats->Add(StatsCounter::Opens, 1);
+
+                if (hr == S_OK)
+                {
+                    uint32_t ui32Best = uiBest;
+
+                    vecOpened[i] = 1;
+                    while (i < ui32Best && !uiBest.compare_exchange_weak(ui32Best, i))
+                    {
+                    }
+                    for (uint32_t j = i + 1; j < vecCandidates.size() && i < ui32Best; ++j)
+                    {
+                        upCancel[j] = true;
+                    }
+                }
+            }
+        }));
+    }
+
+    for (thread& threadElem : vecWorkers)
+    {
+        threadElem.join();
+    }
+    m_pStats->Add(StatsCounter::ThreadsSpawned, vecWorkers.size());
+
+    // Every candidate before the winner has finished, so detection does not depend on timing
+    for (uint32_t i = 0; i < vecCandidates.size() && ui32Winner == UINT_MAX; ++i)
+    {
+        if (vecOpened[i])
+        {
+            ui32Winner = i;
+        }
+    }
+
+    for (uint32_t i = 0; i < vecCandidates.size(); ++i)
+    {
+        m_pStats->Add(StatsCounter::HeaderBytesRead, vecCandidates[i].pBufInStream->GetBytesRead());
+        if (i == ui32Winner)
+        {
+            vecCandidates[i].pBufInStream->SetReadLimits(0, nullptr);
+        }
+        else
+        {
+            RecycleInArchive(vecCandidates[i].pInArchive, vecCandidates[i].wszFormat);
+        }
+        vecCandidates[i].pBufInStream->Release();
+    }
+
+    if (ui32Winner == UINT_MAX)
+    {
+        SetError(E_FAIL, L"Unable to discover archive format");
+        return nullptr;
+    }
+
+    *pwszFormat = vecCandidates[ui32Winner].wszFormat;
+
+    return vecCandidates[ui32Winner].pInArchive;
+}
+
+ARCHIVER_STATUS C7ZipArchiver::PopulateArchiveSupport(FormatRegistry* pRegistry)
 {
+    wstring wstrFormatList;
     uint32_t ui32FormatCount;
     HRESULT hr;
 
@@ -978,7 +2893,7 @@ ARCHIVER_STATUS C7ZipArchiver::PopulateArchiveSupport()
         kFlags            // VT_UI4
     };
 
-    hr = s_GetNumberOfFormats(&ui32FormatCount);
+    hr = pRegistry->pGetNumberOfFormats(&ui32FormatCount);
     if (FAILED(hr))
     {
         SetGlobalError(hr, "GetNumberOfFormats failed");
@@ -992,7 +2907,7 @@ ARCHIVER_STATUS C7ZipArchiver::PopulateArchiveSupport()
 
     for (uint32_t i = 0; i < ui32FormatCount; ++i)
     {
-        C7ZipProperty c7zProp(s_GetHandlerProperty2);
+        C7ZipProperty c7zProp(pRegistry->pGetHandlerProperty2);
         ArchiveType iaElement = {0};
         wstring wstrName;
 
@@ -1052,16 +2967,20 @@ ARCHIVER_STATUS C7ZipArchiver::PopulateArchiveSupport()
             return ARCHIVER_STATUS_FAILURE;
         }
         iaElement.ui32SignatureOffset = c7zProp->ulVal;
+        iaElement.ui32Priority = i;
+        iaElement.spHandlerPool = make_shared<HandlerPool>();
 
-        s_mapSupportedFormats[wstrName] = iaElement;
+        pRegistry->mapFormats[wstrName] = iaElement;
 
-        if (!s_wstrSupportedFormats.empty())
+        if (!wstrFormatList.empty())
         {
-            s_wstrSupportedFormats += L",";
+            wstrFormatList += L",";
         }
-        s_wstrSupportedFormats += wstrName;
+        wstrFormatList += wstrName;
     }
 
+    pRegistry->spFormatList = make_shared<const wstring>(move(wstrFormatList));
+
     return ARCHIVER_STATUS_SUCCESS;
 }
 
@@ -1069,6 +2988,7 @@ void C7ZipArchiver::SetError(HRESULT hrError, const wstring& wstrError)
 {
     m_hrError = hrError;
     m_wstrError = wstrError;
+    m_pStats->Fail(hrError);
 }
 
 void C7ZipArchiver::SetError(HRESULT hrError, const string& strError)
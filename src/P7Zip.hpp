@@ -4,10 +4,18 @@
 #include <atomic>
 #include <memory>
 #include <vector>
+#include <unordered_map>
 #include <functional>
 #include <climits>
+#include <mutex>
+#include <thread>
 
 #include "TitanArchive.hpp"
+#include "ArchiveCache.hpp"
+#include "ArchiveIndex.hpp"
+#include "ArchiveTree.hpp"
+#include "ItemPipe.hpp"
+#include "ArchiveStats.hpp"
 
 // {23170F69-40C1-278A-0000-000600600000}
 DEFINE_GUID_CE(IID_IInArchive, 0x23170F69, 0x40C1, 0x278A, 0x00, 0x00, 0x00, 0x06, 0x00, 0x60, 0x00, 0x00);
@@ -36,21 +44,55 @@ DEFINE_GUID_CE(IID_IArchiveOpenCallback, 0x23170F69, 0x40C1, 0x278A, 0x00, 0x00,
 // {23170F69-40C1-278A-0000-000500100000} 
 DEFINE_GUID_CE(IID_ICryptoGetTextPassword, 0x23170F69, 0x40C1, 0x278A, 0x00, 0x00, 0x00, 0x05, 0x00, 0x10, 0x00, 0x00);
 
+// Closed handlers of one format, reused by later opens instead of creating new ones
+struct HandlerPool
+{
+    ~HandlerPool()
+    {
+        for (IUnknown* pHandler : vecIdle)
+        {
+            pHandler->Release();
+        }
+    }
+
+    std::mutex mLock;
+    std::vector<IUnknown*> vecIdle;
+};
+
 struct ArchiveType
 {
     GUID guidClassId;
     std::vector<std::vector<uint8_t>> vecSignatures;
     uint32_t ui32SignatureOffset;
+    uint32_t ui32Priority;          // Handler index, the lowest wins when several trial opens succeed
     struct CodecModule
     {
         using fnGetNumberOfMethods = HRESULT(*)(uint32_t *numMethods);
         using fnGetMethodProperty = HRESULT(*)(uint32_t index, PROPID propID, PROPVARIANT *value);
         using fnCreateDecoder = HRESULT(*)(uint32_t index, const GUID *iid, void **coder);
-        CompatModule pModule = nullptr;
+        std::shared_ptr<void> spModule;
         fnGetNumberOfMethods pGetNumberOfMethods;
         fnCreateDecoder pCreateDecoder;
         fnGetMethodProperty pGetMethodProperty;
     } cmCodec;
+    std::shared_ptr<HandlerPool> spHandlerPool;
+};
+
+// Formats and modules loaded by GlobalInitialize and GlobalAddCodec. A registry is never modified
+// once published, changes publish a new one. Contexts and cached handlers keep a reference, so
+// modules are only unloaded once nothing created from them is left.
+struct FormatRegistry
+{
+    using fnCreateObject = HRESULT(*)(const GUID*, const GUID*, void**);
+    using fnGetNumberOfFormats = HRESULT(*)(uint32_t*);
+    using fnGetHandlerProperty2 = HRESULT(*)(uint32_t, PROPID, PROPVARIANT*);
+
+    std::shared_ptr<void> spModule;
+    fnCreateObject pCreateObject = nullptr;
+    fnGetNumberOfFormats pGetNumberOfFormats = nullptr;
+    fnGetHandlerProperty2 pGetHandlerProperty2 = nullptr;
+    std::unordered_map<std::wstring /* Name */, ArchiveType> mapFormats;
+    std::shared_ptr<const std::wstring> spFormatList;   // Comma separated, kept across GlobalAddCodec
 };
 
 class C7ZipArchiver : public IArchiver
@@ -61,6 +103,7 @@ public:
 
     ARCHIVER_STATUS OpenArchiveMemory(uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword, const wchar_t* wszFormat) override;
     ARCHIVER_STATUS OpenArchiveDisk(const wchar_t* wszPath, const wchar_t* wszPassword, const wchar_t* wszFormat) override;
+    ARCHIVER_STATUS OpenArchiveDiskIndexed(const wchar_t* wszPath, const wchar_t* wszIndexPath, const wchar_t* wszPassword, const wchar_t* wszFormat) override;
 #if defined(_WIN32)
     ARCHIVER_STATUS OpenArchiveHandle(HANDLE hArchive, const wchar_t* wszPassword, const wchar_t* wszFormat) override;
 #else
@@ -69,13 +112,40 @@ public:
     ARCHIVER_STATUS GetArchiveFormat(const wchar_t** pwszFormat) override;
     ARCHIVER_STATUS GetArchiveItemCount(uint32_t* pArchiveItemCount) override;
     ARCHIVER_STATUS ListDirectory(const wchar_t* wszPath, ArchiveItem** ppItems, uint64_t* pItemCount) override;
+    ARCHIVER_STATUS WalkArchive(const wchar_t* wszRoot, ArchiveItem** ppItems, uint64_t* pItemCount) override;
     ARCHIVER_STATUS GetArchiveItemProperties(const wchar_t* wszPath, ArchiveItem** ppItem) override;
     ARCHIVER_STATUS GetArchiveItemProperties(uint32_t ui32ItemIndex, ArchiveItem** ppItem) override;
+    ARCHIVER_STATUS GetArchiveItemSize(uint32_t ui32ItemIndex, uint64_t* pui64Size) override;
     ARCHIVER_STATUS FreeArchiveItem(ArchiveItem* pItem) override;
+    ARCHIVER_STATUS GetArchiveItemPropertiesEx(uint32_t ui32ItemIndex, uint32_t ui32Properties, ArchiveItemEx** ppItem) override;
+    ARCHIVER_STATUS FreeArchiveItemEx(ArchiveItemEx* pItem) override;
+    ARCHIVER_STATUS FindArchiveItems(const wchar_t* wszPattern, uint32_t ui32Kind, uint32_t** ppIndices, uint32_t* pui32Count) override;
+    ARCHIVER_STATUS FreeArchiveItemIndices(uint32_t* pIndices) override;
+    ARCHIVER_STATUS GetArchiveItemTable(uint32_t ui32Columns, ArchiveItemTable** ppTable) override;
+    ARCHIVER_STATUS FreeArchiveItemTable(ArchiveItemTable* pTable) override;
     ARCHIVER_STATUS ExtractArchiveItemToBuffer(uint32_t ui32ItemIndex, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword) override;
     ARCHIVER_STATUS ExtractArchiveItemToBuffer(const wchar_t* wszPath, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword) override;
+    ARCHIVER_STATUS ExtractArchiveItemToBufferEx(uint32_t ui32ItemIndex, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword, uint64_t* pui64Written) override;
+    ARCHIVER_STATUS ExtractArchiveItems(const uint32_t* pIndices, uint32_t ui32Count, uint32_t ui32MaxWorkers, const wchar_t* wszPassword, ArchiveItemCallback pCallback, void* pUser) override;
+    ARCHIVER_STATUS OpenItemStream(uint32_t ui32ItemIndex, const wchar_t* wszPassword, uint64_t ui64BufferSize) override;
+    ARCHIVER_STATUS ReadItemStream(uint8_t* pBuf, uint64_t ui64BufSize, uint64_t* pui64Read) override;
+    ARCHIVER_STATUS CloseItemStream() override;
     ARCHIVER_STATUS CloseArchive() override;
+    ARCHIVER_STATUS ResetArchive() override;
+    ARCHIVER_STATUS CloneArchive(IArchiver** ppClone) override;
+    ARCHIVER_STATUS SaveArchiveIndex(const wchar_t* wszIndexPath) override;
+    ARCHIVER_STATUS SetTrialOpenFormats(const wchar_t* wszFormats, uint64_t ui64HeaderReadBudget) override;
+    ARCHIVER_STATUS AttachArchiveCache(bool bAttach) override;
     ARCHIVER_STATUS GetError(HRESULT* pHr, const wchar_t** ppError) override;
+    ARCHIVER_STATUS GetStats(ArchiveStats* pStats) override;
+    ARCHIVER_STATUS ResetStats() override;
+    ARCHIVER_STATUS OpenArchiveDiskUtf8(const char* szPath, const char* szPassword, const char* szFormat) override;
+    ARCHIVER_STATUS ListDirectoryUtf8(const char* szPath, ArchiveItemUtf8** ppItems, uint64_t* pItemCount) override;
+    ARCHIVER_STATUS WalkArchiveUtf8(const char* szRoot, ArchiveItemUtf8** ppItems, uint64_t* pItemCount) override;
+    ARCHIVER_STATUS GetArchiveItemPropertiesUtf8(const char* szPath, ArchiveItemUtf8** ppItem) override;
+    ARCHIVER_STATUS GetArchiveItemPropertiesUtf8(uint32_t ui32ItemIndex, ArchiveItemUtf8** ppItem) override;
+    ARCHIVER_STATUS FreeArchiveItemUtf8(ArchiveItemUtf8* pItem) override;
+    ARCHIVER_STATUS ExtractArchiveItemToBufferUtf8(const char* szPath, uint8_t* pBuf, uint64_t ui64BufSize, const char* szPassword) override;
     static ARCHIVER_STATUS GlobalInitialize(const wchar_t* wszLibPath);
     static ARCHIVER_STATUS GlobalAddCodec(const wchar_t* wszFormat, const wchar_t* wszLibPath);
     static ARCHIVER_STATUS GlobalGetSupportedArchiveFormats(const wchar_t** pwszFormats);
@@ -92,9 +162,15 @@ private:
         kpidPath = 3,
         kpidIsDir = 6,
         kpidSize = 7,
+        kpidPackSize = 8,
         kpidCTime = 10,
         kpidATime = 11,
         kpidMTime = 12,
+        kpidEncrypted = 15,
+        kpidCRC = 19,
+        kpidMethod = 22,
+        kpidBlock = 27,
+        kpidOffset = 36,
         kpidTimeType = 40
     };
 
@@ -163,7 +239,7 @@ private:
     struct CCompressCodecsInfo : public ICompressCodecsInfo
     {
     public:
-        CCompressCodecsInfo(const ArchiveType::CodecModule* pCodec) : m_uiRefCount(0), m_pCodec(pCodec) {}
+        CCompressCodecsInfo(const ArchiveType::CodecModule& cmCodec) : m_uiRefCount(0), m_cmCodec(cmCodec) {}
 
         HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override
         {
@@ -200,17 +276,17 @@ private:
 
         HRESULT STDMETHODCALLTYPE GetNumMethods(uint32_t *numMethods) override
         {
-            return m_pCodec->pGetNumberOfMethods(numMethods);
+            return m_cmCodec.pGetNumberOfMethods(numMethods);
         }
 
         HRESULT STDMETHODCALLTYPE GetProperty(uint32_t index, PROPID propID, PROPVARIANT *value) override
         {
-            return m_pCodec->pGetMethodProperty(index, propID, value);
+            return m_cmCodec.pGetMethodProperty(index, propID, value);
         }
 
         HRESULT STDMETHODCALLTYPE CreateDecoder(uint32_t index, const GUID *iid, void **coder) override
         {
-            return m_pCodec->pCreateDecoder(index, iid, coder);
+            return m_cmCodec.pCreateDecoder(index, iid, coder);
         }
 
         HRESULT STDMETHODCALLTYPE CreateEncoder(uint32_t index, const GUID *iid, void **coder) override
@@ -224,12 +300,14 @@ private:
     private:
         virtual ~CCompressCodecsInfo() {}
         std::atomic_uint m_uiRefCount;
-        const ArchiveType::CodecModule* m_pCodec;
+        // A copy, so the codec module stays loaded for as long as the handler uses it
+        const ArchiveType::CodecModule m_cmCodec;
     };
 
     struct CSequentialInStream : public ISequentialInStream
     {
         CSequentialInStream(uint8_t* pBuf, uint64_t ui64BufSize) : m_uiRefCount(0), m_pBuf(pBuf), m_ui64BufSize(ui64BufSize) {}
+        CSequentialInStream(CItemPipe* pPipe) : m_uiRefCount(0), m_pPipe(pPipe) {}
 
         HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override
         {
@@ -274,9 +352,17 @@ private:
             {
                 return S_OK;
             }
+            m_ui64Decoded += size;
+            if (m_pPipe)
+            {
+                // Blocks while the reader is behind, aborts the extraction once it stopped reading
+                return m_pPipe->Write(static_cast<const uint8_t*>(data), size) ? S_OK : E_ABORT;
+            }
             if (m_ui64BufPos >= m_ui64BufSize)
             {
-                return S_OK;
+                // Stops the handler instead of decoding the rest of an item larger than the buffer
+                m_bTruncated = true;
+                return E_ABORT;
             }
             uint64_t ui64Rem = m_ui64BufSize - m_ui64BufPos;
             if (ui64Rem > size)
@@ -289,6 +375,21 @@ private:
             return S_OK;
         }
 
+        uint64_t GetBufPos() const
+        {
+            return m_ui64BufPos;
+        }
+
+        uint64_t GetDecoded() const
+        {
+            return m_ui64Decoded;
+        }
+
+        bool IsTruncated() const
+        {
+            return m_bTruncated;
+        }
+
     private:
         virtual ~CSequentialInStream() {}
 
@@ -296,12 +397,15 @@ private:
         uint8_t* m_pBuf = nullptr;
         uint64_t m_ui64BufSize = 0;
         uint64_t m_ui64BufPos = 0;
+        uint64_t m_ui64Decoded = 0;     // Everything the handler wrote, m_ui64BufPos stops at the buffer size
+        bool m_bTruncated = false;
+        CItemPipe* m_pPipe = nullptr;
     };
 
     struct CArchiveOpenCallback : public IArchiveOpenCallback, public ICryptoGetTextPassword
     {
     public:
-        CArchiveOpenCallback(const wchar_t* wszPassword) : m_uiRefCount(0)
+        CArchiveOpenCallback(const wchar_t* wszPassword, const std::atomic_bool* pbCancel = nullptr) : m_uiRefCount(0), m_pbCancel(pbCancel)
         {
             if (wszPassword)
             {
@@ -350,14 +454,14 @@ private:
         {
             UNREFERENCED_PARAMETER(files);
             UNREFERENCED_PARAMETER(bytes);
-            return S_OK;
+            return IsCancelled() ? E_ABORT : S_OK;
         }
 
         HRESULT STDMETHODCALLTYPE SetCompleted(const uint64_t *files, const uint64_t *bytes) override
         {
             UNREFERENCED_PARAMETER(files);
             UNREFERENCED_PARAMETER(bytes);
-            return S_OK;
+            return IsCancelled() ? E_ABORT : S_OK;
         }
 
         HRESULT STDMETHODCALLTYPE CryptoGetTextPassword(BSTR *password) override
@@ -379,8 +483,14 @@ private:
     private:
         virtual ~CArchiveOpenCallback() {}
 
+        bool IsCancelled() const
+        {
+            return m_pbCancel && m_pbCancel->load(std::memory_order_relaxed);
+        }
+
         std::atomic_uint m_uiRefCount;
         std::wstring m_wstrPassword;
+        const std::atomic_bool* m_pbCancel = nullptr;
 
     };
 
@@ -394,6 +504,14 @@ private:
             }
         }
 
+        CArchiveExtractCallback(CItemPipe* pPipe, const wchar_t* wszPassword) : m_uiRefCount(0), m_pPipe(pPipe)
+        {
+            if (wszPassword)
+            {
+                m_wstrPassword = wszPassword;
+            }
+        }
+
         HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override
         {
             if (memcmp(&riid, &IID_IUnknown, sizeof(GUID)) == 0)
@@ -441,7 +559,7 @@ private:
             
             try
             {
-                m_pSequentialInStream = new CSequentialInStream(m_pBuf, m_ui64BufSize);
+                m_pSequentialInStream = m_pPipe ? new CSequentialInStream(m_pPipe) : new CSequentialInStream(m_pBuf, m_ui64BufSize);
             }
             catch (...)
             {
@@ -495,6 +613,23 @@ private:
             return S_OK;
         }
 
+        // Bytes stored in the buffer, the item is truncated when it is larger than the buffer
+        uint64_t GetWritten() const
+        {
+            return m_pSequentialInStream ? m_pSequentialInStream->GetBufPos() : 0;
+        }
+
+        uint64_t GetDecoded() const
+        {
+            return m_pSequentialInStream ? m_pSequentialInStream->GetDecoded() : 0;
+        }
+
+        // The handler was stopped once the buffer was full, its E_ABORT is not an error then
+        bool IsTruncated() const
+        {
+            return m_pSequentialInStream && m_pSequentialInStream->IsTruncated();
+        }
+
     private:
         virtual ~CArchiveExtractCallback()
         {
@@ -509,6 +644,7 @@ private:
         uint8_t* m_pBuf = nullptr;
         uint64_t m_ui64BufSize = 0;
         std::wstring m_wstrPassword;
+        CItemPipe* m_pPipe = nullptr;
         CSequentialInStream* m_pSequentialInStream = nullptr;
     };
 
@@ -518,9 +654,13 @@ private:
         using fn7ZipGetProperty = HRESULT(*)(uint32_t, PROPID, PROPVARIANT*);
 
         C7ZipProperty(fn7ZipGetProperty fnGetProperty) : m_GetProperty(fnGetProperty) {}
-        C7ZipProperty(IInArchive* pInArchive) : m_pInArchive(pInArchive) {}
+        C7ZipProperty(IInArchive* pInArchive, CArchiveStats* pStats = nullptr) : m_pInArchive(pInArchive), m_pStats(pStats) {}
         ~C7ZipProperty()
         {
+            if (m_pStats && m_ui64Calls)
+            {
+                m_pStats->Add(StatsCounter::PropertyCalls, m_ui64Calls);
+            }
             if (m_bNeedsFree)
             {
                 PropVariantFree(m_pvElement);
@@ -547,6 +687,7 @@ private:
             else
             {
                 hr = m_pInArchive->GetProperty(ui32Index, propId, &m_pvElement);
+                ++m_ui64Calls;
             }
 
             if (FAILED(hr))
@@ -576,6 +717,9 @@ private:
 
         fn7ZipGetProperty m_GetProperty = nullptr;
         IInArchive* m_pInArchive = nullptr;
+        // Calls are added to the stats once, when the property is destroyed
+        CArchiveStats* m_pStats = nullptr;
+        uint64_t m_ui64Calls = 0;
 
         PROPVARIANT m_pvElement = {0};
         bool m_bNeedsFree = false;
@@ -586,6 +730,18 @@ private:
     public:
         CBufInStream(uint8_t* pBuf, uint64_t ui64BufSize) : m_pBuf(pBuf), m_ui64BufSize(ui64BufSize), m_uiRefCount(0) {}
 
+        // Bounds the number of bytes a handler may read (0 is unbounded) and aborts reads once *pbCancel is set
+        void SetReadLimits(uint64_t ui64ReadBudget, const std::atomic_bool* pbCancel)
+        {
+            m_ui64ReadBudget = ui64ReadBudget;
+            m_pbCancel = pbCancel;
+        }
+
+        uint64_t GetBytesRead() const
+        {
+            return m_ui64BytesRead;
+        }
+
         HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override
         {
             if (memcmp(&riid, &IID_IUnknown, sizeof(GUID)) == 0)
@@ -629,6 +785,10 @@ private:
             {
                 return S_OK;
             }
+            if (m_pbCancel && m_pbCancel->load(std::memory_order_relaxed))
+            {
+                return E_ABORT;
+            }
             if (m_ui64BufPos >= m_ui64BufSize)
             {
                 return S_OK;
@@ -638,6 +798,18 @@ private:
             {
                 ui64Rem = size;
             }
+            if (m_ui64ReadBudget)
+            {
+                if (m_ui64BytesRead >= m_ui64ReadBudget)
+                {
+                    return E_ABORT;
+                }
+                if (ui64Rem > m_ui64ReadBudget - m_ui64BytesRead)
+                {
+                    ui64Rem = m_ui64ReadBudget - m_ui64BytesRead;
+                }
+            }
+            m_ui64BytesRead += ui64Rem;
             memcpy(data, m_pBuf + m_ui64BufPos, static_cast<size_t>(ui64Rem));
             m_ui64BufPos += ui64Rem;
             if (processedSize)
@@ -679,6 +851,9 @@ private:
         const uint8_t* m_pBuf = nullptr;
         uint64_t m_ui64BufSize = 0;
         uint64_t m_ui64BufPos = 0;
+        uint64_t m_ui64ReadBudget = 0;
+        uint64_t m_ui64BytesRead = 0;
+        const std::atomic_bool* m_pbCancel = nullptr;
         std::atomic_uint m_uiRefCount;
     };
 
@@ -691,24 +866,73 @@ private:
     }
 
     ARCHIVER_STATUS IterateItems(std::function<void(uint32_t /* Start index */, uint32_t /* End index */)> const& f);
+    ARCHIVER_STATUS OpenInArchive(uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword, const wchar_t* wszFormat);
+    ARCHIVER_STATUS OpenArchiveFDIndexed(int iFd, const wchar_t* wszIndexPath, const wchar_t* wszPassword, const wchar_t* wszFormat);
+    ARCHIVER_STATUS OpenOwnedFD(int iFd, const wchar_t* wszIndexPath, const wchar_t* wszPassword, const wchar_t* wszFormat);
+    ARCHIVER_STATUS EnsureInArchive();
+    ARCHIVER_STATUS GetExtractSize(uint32_t ui32ItemIndex, uint64_t* pui64Size, bool* pbSizeKnown);
+    ARCHIVER_STATUS EnsureArchiveIndex();
+    ARCHIVER_STATUS EnsureArchiveTree();
+    ARCHIVER_STATUS BuildArchiveIndex();
+    void AdoptCachedArchive(ArchiveCacheLease& aclLease, const wchar_t* wszPassword);
+    bool AttachFormatRegistry();
+    ArchiveItem* CreateArchiveItems(uint32_t ui32ItemCount, uint64_t ui64PoolLength);
+    void FillArchiveItem(uint32_t ui32ItemIndex, ArchiveItem* pItem);
     ArchiveItem* CreateDirectoryPlaceholder(const wchar_t* wszDirectoryPath);
+    bool FromUtf8(const char* szStr, std::wstring* pwstrOut);
+    ARCHIVER_STATUS ToUtf8Items(ARCHIVER_STATUS asStatus, ArchiveItem* pItems, ArchiveItemUtf8** ppItems);
     IInArchive* CreateInArchive(const wchar_t* wszFormat);
+    void RecycleInArchive(IInArchive* pInArchive, const wchar_t* wszFormat);
     const wchar_t* DiscoverArchiveFormat(uint8_t* pBuf, uint64_t ui64BufSize);
+    IInArchive* TrialOpenArchive(uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword, const wchar_t** pwszFormat);
 
     void SetError(HRESULT hrError, const std::wstring& wstrError);
     void SetError(HRESULT hrError, const std::string& strError);
 
-    static ARCHIVER_STATUS PopulateArchiveSupport();
+    static ARCHIVER_STATUS PopulateArchiveSupport(FormatRegistry* pRegistry);
 
+    // Snapshot the handler was created from, held until the archive is closed
+    std::shared_ptr<const FormatRegistry> m_spRegistry;
     IInArchive* m_pInArchive = nullptr;
     std::wstring m_wstrArchiveFormat;
     
     int m_iFd = -1;
 
-    CompatMmap m_cmMmap;
+    std::shared_ptr<CompatMmap> m_spMmap;
+    uint8_t* m_pBuf = nullptr;
+    uint64_t m_ui64BufSize = 0;
+
+    bool m_bHasFileIdentity = false;
+    CompatFileIdentity m_cfiFile;
+    std::shared_ptr<CArchiveIndex> m_spIndex;
+    std::shared_ptr<CArchiveTree> m_spArchiveTree;
+
+    // Metadata built on demand, shared with clones so it is only built once per archive
+    struct ArchiveMetadata
+    {
+        std::mutex mLock;
+        std::shared_ptr<CArchiveIndex> spIndex;
+        std::shared_ptr<CArchiveTree> spArchiveTree;
+    };
+    std::shared_ptr<ArchiveMetadata> m_spMetadata;
+
+    bool m_bCacheAttached = false;
+    bool m_bHasCacheKey = false;
+    ArchiveCacheKey m_ackCacheKey;
 
     std::wstring m_wstrPassword;
 
+    // Item decoded on m_tItemDecoder into m_upItemPipe, the handler is busy until CloseItemStream
+    std::unique_ptr<CItemPipe> m_upItemPipe;
+    std::thread m_tItemDecoder;
+
+    std::vector<std::wstring> m_vecTrialFormats;
+    uint64_t m_ui64TrialReadBudget = 0;
+
     HRESULT m_hrError = S_OK;
     std::wstring m_wstrError;
+
+    // Clones made for ExtractArchiveItems point m_pStats at the stats of the context they came from
+    CArchiveStats m_asStats;
+    CArchiveStats* m_pStats = &m_asStats;
 };
@@ -0,0 +1,270 @@
+#include <cwchar>
+#include <cwctype>
+#include <algorithm>
+
+#include "PathMatcher.hpp"
+#include "TitanArchive.hpp"
+
+using namespace std;
+
+bool CPathMatcher::Compile(const wchar_t* wszPattern, uint32_t ui32Kind)
+{
+    m_ui32Kind = ui32Kind;
+    m_wstrPattern = wszPattern;
+
+    switch (ui32Kind)
+    {
+    case ARCHIVE_FIND_GLOB:
+    case ARCHIVE_FIND_PREFIX:
+        for (wchar_t& wcChar : m_wstrPattern)
+        {
+            if (wcChar == L'/')
+            {
+                wcChar = SLASH_CHAR;
+            }
+        }
+        if (ui32Kind == ARCHIVE_FIND_GLOB)
+        {
+            try
+            {
+                CompileGlob();
+            }
+            catch (...)
+            {
+                return false;
+            }
+        }
+        return true;
+    case ARCHIVE_FIND_EXTENSION:
+        if (m_wstrPattern.empty() || m_wstrPattern[0] != L'.')
+        {
+            m_wstrPattern.insert(m_wstrPattern.begin(), L'.');
+        }
+        for (wchar_t& wcChar : m_wstrPattern)
+        {
+            wcChar = static_cast<wchar_t>(towlower(wcChar));
+        }
+        return true;
+    case ARCHIVE_FIND_REGEX:
+        try
+        {
+            m_wreRegex.assign(m_wstrPattern, regex_constants::ECMAScript | regex_constants::optimize);
+        }
+        catch (...)
+        {
+            return false;
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool CPathMatcher::CanMatch(const wchar_t* wszPath) const
+{
+    return m_ui32Kind != ARCHIVE_FIND_REGEX || wcslen(wszPath) <= szMaxRegexPathLength;
+}
+
+bool CPathMatcher::Match(const wchar_t* wszPath) const
+{
+    size_t szPathLength;
+
+    switch (m_ui32Kind)
+    {
+    case ARCHIVE_FIND_GLOB:
+        return GlobMatch(wszPath);
+    case ARCHIVE_FIND_PREFIX:
+        return wcsncmp(wszPath, m_wstrPattern.c_str(), m_wstrPattern.size()) == 0;
+    case ARCHIVE_FIND_EXTENSION:
+        szPathLength = wcslen(wszPath);
+        if (szPathLength < m_wstrPattern.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < m_wstrPattern.size(); ++i)
+        {
+            if (static_cast<wchar_t>(towlower(wszPath[szPathLength - m_wstrPattern.size() + i])) != m_wstrPattern[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    case ARCHIVE_FIND_REGEX:
+        return regex_match(wszPath, m_wreRegex);
+    default:
+        return false;
+    }
+}
+
+void CPathMatcher::CompileGlob()
+{
+    const wchar_t* wszStart = m_wstrPattern.c_str();
+    const wchar_t* wszPattern = wszStart;
+
+    m_vecGlob.clear();
+    while (*wszPattern != L'\0')
+    {
+        GlobElement geElement = {GlobToken::Char, *wszPattern, static_cast<size_t>(wszPattern - wszStart)};
+
+        if (wszPattern[0] == L'*' && wszPattern[1] == L'*')
+        {
+            geElement.gtToken = GlobToken::DoubleStar;
+            ++wszPattern;
+        }
+        else if (*wszPattern == L'*')
+        {
+            geElement.gtToken = GlobToken::Star;
+        }
+        else if (*wszPattern == L'?')
+        {
+            geElement.gtToken = GlobToken::AnyChar;
+        }
+        else if (*wszPattern == L'[')
+        {
+            // Only moves past the class when it is closed, otherwise the '[' is an ordinary character
+            const wchar_t* wszClassEnd = wszPattern;
+            ClassMatch(&wszClassEnd, L'\0');
+            if (wszClassEnd != wszPattern)
+            {
+                geElement.gtToken = GlobToken::Class;
+                wszPattern = wszClassEnd;
+            }
+        }
+
+        m_vecGlob.push_back(geElement);
+        ++wszPattern;
+    }
+}
+
+bool CPathMatcher::GlobStep(const GlobElement& geElement, wchar_t wcChar) const
+{
+    const wchar_t* wszClass;
+
+    switch (geElement.gtToken)
+    {
+    case GlobToken::Char:
+        return wcChar == geElement.wcChar;
+    case GlobToken::AnyChar:
+        return wcChar != SLASH_CHAR;
+    case GlobToken::Class:
+        wszClass = m_wstrPattern.c_str() + geElement.szOffset;
+        return wcChar != SLASH_CHAR && ClassMatch(&wszClass, wcChar);
+    default:
+        return false;
+    }
+}
+
+// Activates state i and the states reachable from it without consuming a character. Stars may
+// match nothing and "a/**/b" also matches "a/b". Recurses once per "**/" of the pattern at most.
+void CPathMatcher::GlobAddState(vector<uint8_t>& vecStates, size_t i) const
+{
+    for (; i < vecStates.size() && !vecStates[i]; ++i)
+    {
+        vecStates[i] = 1;
+        if (i == m_vecGlob.size())
+        {
+            break;
+        }
+        if (m_vecGlob[i].gtToken == GlobToken::DoubleStar && i + 1 < m_vecGlob.size() &&
+            m_vecGlob[i + 1].gtToken == GlobToken::Char && m_vecGlob[i + 1].wcChar == SLASH_CHAR)
+        {
+            GlobAddState(vecStates, i + 2);
+        }
+        else if (m_vecGlob[i].gtToken != GlobToken::Star && m_vecGlob[i].gtToken != GlobToken::DoubleStar)
+        {
+            break;
+        }
+    }
+}
+
+// Simulates every pattern position at once, one pass over the path without backtracking, so
+// patterns with many stars stay linear in the path length
+bool CPathMatcher::GlobMatch(const wchar_t* wszPath) const
+{
+    static thread_local vector<uint8_t> s_vecActive;
+    static thread_local vector<uint8_t> s_vecNext;
+    const size_t szStates = m_vecGlob.size() + 1;
+    bool bHasActive = true;
+
+    s_vecActive.assign(szStates, 0);
+    s_vecNext.assign(szStates, 0);
+
+    GlobAddState(s_vecActive, 0);
+
+    for (; *wszPath != L'\0' && bHasActive; ++wszPath)
+    {
+        bHasActive = false;
+        fill(s_vecNext.begin(), s_vecNext.end(), 0);
+
+        for (size_t i = 0; i < m_vecGlob.size(); ++i)
+        {
+            if (!s_vecActive[i])
+            {
+                continue;
+            }
+
+            const GlobElement& geElement = m_vecGlob[i];
+            if (geElement.gtToken == GlobToken::DoubleStar)
+            {
+                // Once '**' consumed a character the '/' after it has to match too
+                if (!s_vecNext[i])
+                {
+                    s_vecNext[i] = 1;
+                    GlobAddState(s_vecNext, i + 1);
+                }
+                bHasActive = true;
+            }
+            else if (geElement.gtToken == GlobToken::Star && *wszPath != SLASH_CHAR)
+            {
+                GlobAddState(s_vecNext, i);
+                bHasActive = true;
+            }
+            else if (GlobStep(geElement, *wszPath))
+            {
+                GlobAddState(s_vecNext, i + 1);
+                bHasActive = true;
+            }
+        }
+
+        s_vecActive.swap(s_vecNext);
+    }
+
+    return bHasActive && s_vecActive[m_vecGlob.size()];
+}
+
+bool CPathMatcher::ClassMatch(const wchar_t** pwszPattern, wchar_t wcChar)
+{
+    const wchar_t* wszClass = *pwszPattern + 1;
+    bool bNegate = false;
+    bool bMatch = false;
+
+    if (*wszClass == L'!' || *wszClass == L'^')
+    {
+        bNegate = true;
+        ++wszClass;
+    }
+
+    // A ']' right after the opening bracket is part of the class
+    for (const wchar_t* wszFirst = wszClass; *wszClass != L'\0' && (*wszClass != L']' || wszClass == wszFirst); ++wszClass)
+    {
+        if (wszClass[1] == L'-' && wszClass[2] != L'\0' && wszClass[2] != L']')
+        {
+            bMatch |= wcChar >= wszClass[0] && wcChar <= wszClass[2];
+            wszClass += 2;
+        }
+        else
+        {
+            bMatch |= wcChar == *wszClass;
+        }
+    }
+
+    // Without a closing bracket the '[' is an ordinary character
+    if (*wszClass == L'\0')
+    {
+        return wcChar == L'[';
+    }
+
+    *pwszPattern = wszClass;
+
+    return bMatch != bNegate;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "Compat.hpp"
+
+// std::wregex recurses once per character of the subject, so longer paths could overflow the
+// stack of the matching thread. Regex patterns refuse them instead.
+constexpr size_t szMaxRegexPathLength = 1024;
+
+// Compiled item path pattern. '/' in a pattern is accepted as separator on every platform.
+//   Glob:      '*' and '?' stay within a path component, '**' spans components, [a-z] / [!a-z] classes
+//   Prefix:    Path starts with the pattern
+//   Extension: Last component ends with '.' + pattern, case insensitive. A leading '.' is optional
+//   Regex:     ECMAScript regular expression matching the whole path, at most szMaxRegexPathLength long
+class CPathMatcher
+{
+public:
+    CPathMatcher() {}
+
+    // Returns false when the kind is unknown or the pattern does not compile
+    bool Compile(const wchar_t* wszPattern, uint32_t ui32Kind);
+    // False when the path is too long to be matched safely by this kind of pattern
+    bool CanMatch(const wchar_t* wszPath) const;
+    bool Match(const wchar_t* wszPath) const;
+
+private:
+    CPathMatcher(const CPathMatcher&) = delete;
+    CPathMatcher& operator=(const CPathMatcher&) = delete;
+
+    enum class GlobToken : uint8_t
+    {
+        Char,
+        AnyChar,        // '?'
+        Class,          // '[...]', wcChar of the token is unused
+        Star,           // '*'
+        DoubleStar,     // '**'
+    };
+
+    struct GlobElement
+    {
+        GlobToken gtToken;
+        wchar_t wcChar;
+        size_t szOffset;    // Of the token in m_wstrPattern
+    };
+
+    void CompileGlob();
+    void GlobAddState(std::vector<uint8_t>& vecStates, size_t i) const;
+    bool GlobMatch(const wchar_t* wszPath) const;
+    bool GlobStep(const GlobElement& geElement, wchar_t wcChar) const;
+    static bool ClassMatch(const wchar_t** pwszPattern, wchar_t wcChar);
+
+    uint32_t m_ui32Kind = 0;
+    std::wstring m_wstrPattern;
+    std::vector<GlobElement> m_vecGlob;
+    std::wregex m_wreRegex;
+};
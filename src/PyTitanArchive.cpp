@@ -0,0 +1,352 @@
+// CPython extension used by titanarchive.py when it is available. It works on contexts created
+// through the ctypes bindings and calls the library loaded by them, so both share one global state.
+// Decoding runs without the GIL and reads / writes go straight to buffer protocol objects.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <cstdint>
+#include <string>
+
+#include "TitanArchive.hpp"
+
+namespace
+{
+    using fnOpenArchiveMemory = ARCHIVER_STATUS(*)(void*, uint8_t*, uint64_t, const wchar_t*, const wchar_t*);
+    using fnGetArchiveItemSize = ARCHIVER_STATUS(*)(void*, uint32_t, uint64_t*);
+    using fnGetArchiveItemPropertiesByPathUtf8 = ARCHIVER_STATUS(*)(void*, const char*, ArchiveItemUtf8**);
+    using fnFreeArchiveItemUtf8 = ARCHIVER_STATUS(*)(void*, ArchiveItemUtf8*);
+    using fnExtractArchiveItemToBufferByIndexEx = ARCHIVER_STATUS(*)(void*, uint32_t, uint8_t*, uint64_t, const wchar_t*, uint64_t*);
+
+    fnOpenArchiveMemory s_pOpenArchiveMemory = nullptr;
+    fnGetArchiveItemSize s_pGetArchiveItemSize = nullptr;
+    fnGetArchiveItemPropertiesByPathUtf8 s_pGetArchiveItemPropertiesByPathUtf8 = nullptr;
+    fnFreeArchiveItemUtf8 s_pFreeArchiveItemUtf8 = nullptr;
+    fnExtractArchiveItemToBufferByIndexEx s_pExtractArchiveItemToBufferByIndexEx = nullptr;
+
+    // Owns the wchar_t copy of an optional str argument
+    class WideArg
+    {
+    public:
+        ~WideArg()
+        {
+            PyMem_Free(m_wszValue);
+        }
+
+        bool Set(PyObject* pObject)
+        {
+            if (pObject == Py_None)
+            {
+                return true;
+            }
+            m_wszValue = PyUnicode_AsWideCharString(pObject, nullptr);
+            return m_wszValue != nullptr;
+        }
+
+        const wchar_t* Get() const
+        {
+            return m_wszValue;
+        }
+
+    private:
+        wchar_t* m_wszValue = nullptr;
+    };
+
+    // "O&" converter for the integer handles passed from ctypes
+    int ParsePointer(PyObject* pObject, void* pResult)
+    {
+        *static_cast<void**>(pResult) = PyLong_AsVoidPtr(pObject);
+        return !PyErr_Occurred();
+    }
+
+    bool CheckBound()
+    {
+        if (!s_pOpenArchiveMemory)
+        {
+            PyErr_SetString(PyExc_RuntimeError, "TitanArchive module is not bound");
+            return false;
+        }
+        return true;
+    }
+
+    // Resolves the index and size of the item at szPath, returns false with the context error set
+    bool ResolvePath(void* pCtx, const char* szPath, uint32_t* pui32Index, uint64_t* pui64Size)
+    {
+        ArchiveItemUtf8* pItem;
+
+        if (s_pGetArchiveItemPropertiesByPathUtf8(pCtx, szPath, &pItem) != ARCHIVER_STATUS_SUCCESS)
+        {
+            return false;
+        }
+        *pui32Index = pItem->ui32Index;
+        *pui64Size = pItem->ui64Size;
+        s_pFreeArchiveItemUtf8(pCtx, pItem);
+
+        return true;
+    }
+
+    // Decodes the item into a new bytes object, None when the library failed
+    PyObject* ExtractToBytes(void* pCtx, uint32_t ui32Index, uint64_t ui64Size, const wchar_t* wszPassword)
+    {
+        ARCHIVER_STATUS asStatus;
+        uint64_t ui64Written = 0;
+        PyObject* pBytes;
+
+        if (ui64Size > static_cast<uint64_t>(PY_SSIZE_T_MAX))
+        {
+            return PyErr_NoMemory();
+        }
+
+        // Not zero filled, the decoder writes every byte of the item
+        pBytes = PyBytes_FromStringAndSize(nullptr, static_cast<Py_ssize_t>(ui64Size));
+        if (!pBytes || !ui64Size)
+        {
+            return pBytes;
+        }
+
+        Py_BEGIN_ALLOW_THREADS
+        asStatus = s_pExtractArchiveItemToBufferByIndexEx(pCtx, ui32Index, reinterpret_cast<uint8_t*>(PyBytes_AS_STRING(pBytes)), ui64Size, wszPassword, &ui64Written);
+        Py_END_ALLOW_THREADS
+
+        if (asStatus != ARCHIVER_STATUS_SUCCESS)
+        {
+            Py_DECREF(pBytes);
+            Py_RETURN_NONE;
+        }
+        if (ui64Written < ui64Size && _PyBytes_Resize(&pBytes, static_cast<Py_ssize_t>(ui64Written)) != 0)
+        {
+            return nullptr;
+        }
+
+        return pBytes;
+    }
+
+    // Decodes the item into a writable buffer, returns the bytes written or None when the library failed
+    PyObject* ExtractToBuffer(void* pCtx, uint32_t ui32Index, PyObject* pBuffer, const wchar_t* wszPassword)
+    {
+        ARCHIVER_STATUS asStatus;
+        uint64_t ui64Written = 0;
+        Py_buffer pbView;
+
+        if (PyObject_GetBuffer(pBuffer, &pbView, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) != 0)
+        {
+            return nullptr;
+        }
+        if (!pbView.len)
+        {
+            PyBuffer_Release(&pbView);
+            return PyLong_FromLong(0);
+        }
+
+        // The export keeps the buffer from being resized or freed while the GIL is released
+        Py_BEGIN_ALLOW_THREADS
+        asStatus = s_pExtractArchiveItemToBufferByIndexEx(pCtx, ui32Index, static_cast<uint8_t*>(pbView.buf), static_cast<uint64_t>(pbView.len), wszPassword, &ui64Written);
+        Py_END_ALLOW_THREADS
+
+        PyBuffer_Release(&pbView);
+
+        if (asStatus != ARCHIVER_STATUS_SUCCESS)
+        {
+            Py_RETURN_NONE;
+        }
+
+        return PyLong_FromUnsignedLongLong(ui64Written);
+    }
+}
+
+// bind(handle): resolves the exports of the library loaded by ctypes
+static PyObject* Bind(PyObject* pSelf, PyObject* pArgs)
+{
+    void* pHandle;
+    CompatModule pModule;
+
+    UNREFERENCED_PARAMETER(pSelf);
+
+    if (!PyArg_ParseTuple(pArgs, "O&", ParsePointer, &pHandle))
+    {
+        return nullptr;
+    }
+    pModule = reinterpret_cast<CompatModule>(pHandle);
+
+    s_pGetArchiveItemSize = reinterpret_cast<fnGetArchiveItemSize>(dlsym(pModule, "GetArchiveItemSize"));
+    s_pGetArchiveItemPropertiesByPathUtf8 = reinterpret_cast<fnGetArchiveItemPropertiesByPathUtf8>(dlsym(pModule, "GetArchiveItemPropertiesByPathUtf8"));
+    s_pFreeArchiveItemUtf8 = reinterpret_cast<fnFreeArchiveItemUtf8>(dlsym(pModule, "FreeArchiveItemUtf8"));
+    s_pExtractArchiveItemToBufferByIndexEx = reinterpret_cast<fnExtractArchiveItemToBufferByIndexEx>(dlsym(pModule, "ExtractArchiveItemToBufferByIndexEx"));
+    s_pOpenArchiveMemory = reinterpret_cast<fnOpenArchiveMemory>(dlsym(pModule, "OpenArchiveMemory"));
+
+    if (!s_pGetArchiveItemSize || !s_pGetArchiveItemPropertiesByPathUtf8 || !s_pFreeArchiveItemUtf8 || !s_pExtractArchiveItemToBufferByIndexEx || !s_pOpenArchiveMemory)
+    {
+        s_pOpenArchiveMemory = nullptr;
+        PyErr_SetString(PyExc_ImportError, "TitanArchive module is missing exports");
+        return nullptr;
+    }
+
+    Py_RETURN_NONE;
+}
+
+// open_memory(ctx, buffer, password, format): opens any contiguous buffer protocol object without copying it.
+// Returns a memoryview that must outlive the archive or None when the library failed.
+static PyObject* OpenMemory(PyObject* pSelf, PyObject* pArgs)
+{
+    void* pCtx;
+    PyObject* pBuffer;
+    PyObject* pPassword;
+    PyObject* pFormat;
+    PyObject* pView;
+    WideArg waPassword;
+    WideArg waFormat;
+    ARCHIVER_STATUS asStatus;
+    Py_buffer pbView;
+
+    UNREFERENCED_PARAMETER(pSelf);
+
+    if (!CheckBound() || !PyArg_ParseTuple(pArgs, "O&OOO", ParsePointer, &pCtx, &pBuffer, &pPassword, &pFormat) || !waPassword.Set(pPassword) || !waFormat.Set(pFormat))
+    {
+        return nullptr;
+    }
+
+    // The memoryview holds the export for as long as the archive reads from it
+    pView = PyMemoryView_FromObject(pBuffer);
+    if (!pView)
+    {
+        return nullptr;
+    }
+    if (PyObject_GetBuffer(pView, &pbView, PyBUF_C_CONTIGUOUS) != 0)
+    {
+        Py_DECREF(pView);
+        return nullptr;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    asStatus = s_pOpenArchiveMemory(pCtx, static_cast<uint8_t*>(pbView.buf), static_cast<uint64_t>(pbView.len), waPassword.Get(), waFormat.Get());
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&pbView);
+
+    if (asStatus != ARCHIVER_STATUS_SUCCESS)
+    {
+        Py_DECREF(pView);
+        Py_RETURN_NONE;
+    }
+
+    return pView;
+}
+
+// extract(ctx, index, password): returns the item as bytes or None when the library failed
+static PyObject* Extract(PyObject* pSelf, PyObject* pArgs)
+{
+    void* pCtx;
+    unsigned int uiIndex;
+    PyObject* pPassword;
+    WideArg waPassword;
+    uint64_t ui64Size;
+
+    UNREFERENCED_PARAMETER(pSelf);
+
+    if (!CheckBound() || !PyArg_ParseTuple(pArgs, "O&IO", ParsePointer, &pCtx, &uiIndex, &pPassword) || !waPassword.Set(pPassword))
+    {
+        return nullptr;
+    }
+
+    if (s_pGetArchiveItemSize(pCtx, uiIndex, &ui64Size) != ARCHIVER_STATUS_SUCCESS)
+    {
+        Py_RETURN_NONE;
+    }
+
+    return ExtractToBytes(pCtx, uiIndex, ui64Size, waPassword.Get());
+}
+
+// extract_path(ctx, path, password): returns the item as bytes or None when the library failed
+static PyObject* ExtractPath(PyObject* pSelf, PyObject* pArgs)
+{
+    void* pCtx;
+    const char* szPath;
+    PyObject* pPassword;
+    WideArg waPassword;
+    uint32_t ui32Index;
+    uint64_t ui64Size;
+
+    UNREFERENCED_PARAMETER(pSelf);
+
+    if (!CheckBound() || !PyArg_ParseTuple(pArgs, "O&sO", ParsePointer, &pCtx, &szPath, &pPassword) || !waPassword.Set(pPassword))
+    {
+        return nullptr;
+    }
+
+    if (!ResolvePath(pCtx, szPath, &ui32Index, &ui64Size))
+    {
+        Py_RETURN_NONE;
+    }
+
+    return ExtractToBytes(pCtx, ui32Index, ui64Size, waPassword.Get());
+}
+
+// extract_into(ctx, index, buffer, password): returns the bytes written or None when the library failed
+static PyObject* ExtractInto(PyObject* pSelf, PyObject* pArgs)
+{
+    void* pCtx;
+    unsigned int uiIndex;
+    PyObject* pBuffer;
+    PyObject* pPassword;
+    WideArg waPassword;
+
+    UNREFERENCED_PARAMETER(pSelf);
+
+    if (!CheckBound() || !PyArg_ParseTuple(pArgs, "O&IOO", ParsePointer, &pCtx, &uiIndex, &pBuffer, &pPassword) || !waPassword.Set(pPassword))
+    {
+        return nullptr;
+    }
+
+    return ExtractToBuffer(pCtx, uiIndex, pBuffer, waPassword.Get());
+}
+
+// extract_path_into(ctx, path, buffer, password): returns the bytes written or None when the library failed
+static PyObject* ExtractPathInto(PyObject* pSelf, PyObject* pArgs)
+{
+    void* pCtx;
+    const char* szPath;
+    PyObject* pBuffer;
+    PyObject* pPassword;
+    WideArg waPassword;
+    uint32_t ui32Index;
+    uint64_t ui64Size;
+
+    UNREFERENCED_PARAMETER(pSelf);
+
+    if (!CheckBound() || !PyArg_ParseTuple(pArgs, "O&sOO", ParsePointer, &pCtx, &szPath, &pBuffer, &pPassword) || !waPassword.Set(pPassword))
+    {
+        return nullptr;
+    }
+
+    if (!ResolvePath(pCtx, szPath, &ui32Index, &ui64Size))
+    {
+        Py_RETURN_NONE;
+    }
+
+    return ExtractToBuffer(pCtx, ui32Index, pBuffer, waPassword.Get());
+}
+
+static PyMethodDef s_pmdMethods[] =
+{
+    {"bind", Bind, METH_VARARGS, nullptr},
+    {"open_memory", OpenMemory, METH_VARARGS, nullptr},
+    {"extract", Extract, METH_VARARGS, nullptr},
+    {"extract_path", ExtractPath, METH_VARARGS, nullptr},
+    {"extract_into", ExtractInto, METH_VARARGS, nullptr},
+    {"extract_path_into", ExtractPathInto, METH_VARARGS, nullptr},
+    {nullptr, nullptr, 0, nullptr}
+};
+
+static PyModuleDef s_pmdModule =
+{
+    PyModuleDef_HEAD_INIT,
+    "_titanarchive",
+    nullptr,
+    -1,
+    s_pmdMethods
+};
+
+PyMODINIT_FUNC PyInit__titanarchive()
+{
+    return PyModule_Create(&s_pmdModule);
+}
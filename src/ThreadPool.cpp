@@ -0,0 +1,301 @@
+#include <algorithm>
+
+#include "ThreadPool.hpp"
+#include "ArchiveStats.hpp"
+
+using namespace std;
+
+static thread_local bool s_bIsWorker = false;
+
+// Ranges are packed as (End << 32) | Start so owner and thieves can update them with one CAS
+static uint64_t PackRange(uint32_t ui32Start, uint32_t ui32End)
+{
+    return (static_cast<uint64_t>(ui32End) << 32) | ui32Start;
+}
+
+struct CThreadPool::ThreadPoolJob
+{
+    ThreadPoolJob(uint32_t ui32Slots) : vecRanges(ui32Slots) {}
+
+    std::function<void(uint32_t, uint32_t)> const* pf = nullptr;
+    uint32_t ui32Grain = 1;
+    vector<atomic<uint64_t>> vecRanges;
+    atomic_uint uiNextSlot;
+    atomic_uint uiRemaining;
+    mutex mLock;
+    condition_variable cvDone;
+};
+
+CThreadPool& CThreadPool::Instance()
+{
+    static CThreadPool s_tpPool;
+    return s_tpPool;
+}
+
+CThreadPool::~CThreadPool()
+{
+    StopWorkers();
+}
+
+bool CThreadPool::Configure(uint32_t ui32ThreadCount, uint64_t ui64AffinityMask)
+{
+    if (s_bIsWorker)
+    {
+        return false;
+    }
+
+    {
+        lock_guard<mutex> lgLock(m_mLock);
+        m_ui32ThreadCount = ui32ThreadCount;
+        m_ui64AffinityMask = ui64AffinityMask;
+    }
+
+    // Workers are restarted with the new settings on the next ParallelFor
+    StopWorkers();
+
+    return true;
+}
+
+uint32_t CThreadPool::Concurrency()
+{
+    lock_guard<mutex> lgLock(m_mLock);
+    uint32_t ui32ThreadCount = m_ui32ThreadCount ? m_ui32ThreadCount : thread::hardware_concurrency();
+
+    return ui32ThreadCount ? ui32ThreadCount : 1;
+}
+
+void CThreadPool::Shutdown()
+{
+    StopWorkers();
+}
+
+void CThreadPool::StartLocked()
+{
+    uint32_t ui32ThreadCount = m_ui32ThreadCount ? m_ui32ThreadCount : thread::hardware_concurrency();
+    vector<uint32_t> vecCpus;
+
+    for (uint32_t i = 0; i < 64; ++i)
+    {
+        if (m_ui64AffinityMask & (1ULL << i))
+        {
+            vecCpus.push_back(i);
+        }
+    }
+
+    // The caller of ParallelFor is a participant too
+    for (uint32_t i = 1; i < ui32ThreadCount; ++i)
+    {
+        uint32_t ui32Cpu = vecCpus.empty() ? UINT32_MAX : vecCpus[(i - 1) % vecCpus.size()];
+        try
+        {
+            m_vecWorkers.push_back(thread(&CThreadPool::WorkerMain, this, m_ui32Generation, ui32Cpu));
+            CArchiveStats::GlobalAdd(StatsCounter::ThreadsSpawned, 1);
+        }
+        catch (...)
+        {
+            break;
+        }
+    }
+}
+
+void CThreadPool::StopWorkers()
+{
+    vector<thread> vecWorkers;
+
+    // A worker would join itself, the pool keeps running until a non-worker stops it
+    if (s_bIsWorker)
+    {
+        return;
+    }
+
+    {
+        lock_guard<mutex> lgLock(m_mLock);
+        ++m_ui32Generation;
+        vecWorkers.swap(m_vecWorkers);
+    }
+    m_cvWork.notify_all();
+
+    // Jobs in flight are finished by their callers
+    for (thread& threadElem : vecWorkers)
+    {
+        threadElem.join();
+    }
+}
+
+void CThreadPool::WorkerMain(uint32_t ui32Generation, uint32_t ui32Cpu)
+{
+    s_bIsWorker = true;
+
+    if (ui32Cpu != UINT32_MAX)
+    {
+        CompatPinCurrentThread(ui32Cpu);
+    }
+
+    for (;;)
+    {
+        shared_ptr<ThreadPoolJob> spJob;
+        uint32_t ui32Slot;
+
+        {
+            unique_lock<mutex> ulLock(m_mLock);
+            m_cvWork.wait(ulLock, [&]()
+            {
+                return m_ui32Generation != ui32Generation || !m_dqJobs.empty();
+            });
+
+            if (m_ui32Generation != ui32Generation)
+            {
+                return;
+            }
+
+            spJob = m_dqJobs.front();
+            ui32Slot = spJob->uiNextSlot++;
+            if (ui32Slot >= spJob->vecRanges.size())
+            {
+                // Every slot is taken, the remaining work is left to stealing
+                m_dqJobs.pop_front();
+                continue;
+            }
+        }
+
+        RunJob(*spJob, ui32Slot);
+    }
+}
+
+void CThreadPool::RunJob(ThreadPoolJob& tpjJob, uint32_t ui32Slot)
+{
+    atomic<uint64_t>& aRange = tpjJob.vecRanges[ui32Slot];
+    uint32_t ui32SlotCount = static_cast<uint32_t>(tpjJob.vecRanges.size());
+
+    for (;;)
+    {
+        uint64_t ui64Range = aRange.load();
+        uint32_t ui32Start = static_cast<uint32_t>(ui64Range);
+        uint32_t ui32End = static_cast<uint32_t>(ui64Range >> 32);
+        bool bStolen = false;
+
+        if (ui32Start < ui32End)
+        {
+            uint32_t ui32ChunkEnd = ui32Start + min(tpjJob.ui32Grain, ui32End - ui32Start);
+
+            if (!aRange.compare_exchange_weak(ui64Range, PackRange(ui32ChunkEnd, ui32End)))
+            {
+                continue;
+            }
+
+            (*tpjJob.pf)(ui32Start, ui32ChunkEnd);
+
+            if (tpjJob.uiRemaining.fetch_sub(ui32ChunkEnd - ui32Start) == ui32ChunkEnd - ui32Start)
+            {
+                lock_guard<mutex> lgLock(tpjJob.mLock);
+                tpjJob.cvDone.notify_all();
+            }
+            continue;
+        }
+
+        // Own range is drained, take the upper half of the first non-empty one
+        for (uint32_t i = 1; i < ui32SlotCount && !bStolen; ++i)
+        {
+            atomic<uint64_t>& aVictim = tpjJob.vecRanges[(ui32Slot + i) % ui32SlotCount];
+            uint64_t ui64Victim = aVictim.load();
+
+            for (;;)
+            {
+                uint32_t ui32VictimStart = static_cast<uint32_t>(ui64Victim);
+                uint32_t ui32VictimEnd = static_cast<uint32_t>(ui64Victim >> 32);
+                uint32_t ui32Split;
+
+                if (ui32VictimStart >= ui32VictimEnd)
+                {
+                    break;
+                }
+
+                ui32Split = ui32VictimEnd - ui32VictimStart <= tpjJob.ui32Grain ? ui32VictimStart : ui32VictimStart + (ui32VictimEnd - ui32VictimStart) / 2;
+                if (aVictim.compare_exchange_weak(ui64Victim, PackRange(ui32VictimStart, ui32Split)))
+                {
+                    // Thieves skip empty ranges, so nobody else writes this slot right now
+                    aRange.store(PackRange(ui32Split, ui32VictimEnd));
+                    bStolen = true;
+                    break;
+                }
+            }
+        }
+
+        if (!bStolen)
+        {
+            return;
+        }
+    }
+}
+
+void CThreadPool::ParallelFor(uint32_t ui32Count, uint32_t ui32Grain, std::function<void(uint32_t, uint32_t)> const& f)
+{
+    shared_ptr<ThreadPoolJob> spJob;
+    uint32_t ui32Slots;
+
+    if (ui32Count == 0)
+    {
+        return;
+    }
+
+    ui32Grain = max(ui32Grain, 1U);
+    ui32Slots = min(Concurrency(), (ui32Count + ui32Grain - 1) / ui32Grain);
+
+    // Nested calls from a worker run inline, waiting on the pool from inside it could deadlock
+    if (ui32Slots <= 1 || s_bIsWorker)
+    {
+        f(0, ui32Count);
+        return;
+    }
+
+    try
+    {
+        spJob = make_shared<ThreadPoolJob>(ui32Slots);
+    }
+    catch (...)
+    {
+        f(0, ui32Count);
+        return;
+    }
+
+    spJob->pf = &f;
+    spJob->ui32Grain = ui32Grain;
+    spJob->uiNextSlot = 1;
+    spJob->uiRemaining = ui32Count;
+    for (uint32_t i = 0; i < ui32Slots; ++i)
+    {
+        uint64_t ui64Start = static_cast<uint64_t>(ui32Count) * i / ui32Slots;
+        uint64_t ui64End = static_cast<uint64_t>(ui32Count) * (i + 1) / ui32Slots;
+        spJob->vecRanges[i] = PackRange(static_cast<uint32_t>(ui64Start), static_cast<uint32_t>(ui64End));
+    }
+
+    {
+        lock_guard<mutex> lgLock(m_mLock);
+        if (m_vecWorkers.empty())
+        {
+            StartLocked();
+        }
+        m_dqJobs.push_back(spJob);
+    }
+    m_cvWork.notify_all();
+
+    RunJob(*spJob, 0);
+
+    {
+        unique_lock<mutex> ulLock(spJob->mLock);
+        spJob->cvDone.wait(ulLock, [&]()
+        {
+            return spJob->uiRemaining == 0;
+        });
+    }
+
+    // Workers that have not picked the job up yet must not find it anymore
+    {
+        lock_guard<mutex> lgLock(m_mLock);
+        auto iterJob = find(m_dqJobs.begin(), m_dqJobs.end(), spJob);
+        if (iterJob != m_dqJobs.end())
+        {
+            m_dqJobs.erase(iterJob);
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include "Compat.hpp"
+
+// Process-wide pool shared by every archive context. A range is split evenly between the
+// caller and the workers, a participant that runs out of work steals half of another's rest.
+class CThreadPool
+{
+public:
+    static CThreadPool& Instance();
+
+    // ui32ThreadCount includes the calling thread, 0 uses the core count. Bit n of
+    // ui64AffinityMask allows core n, workers are pinned round-robin to the allowed cores.
+    // Fails when called from a pool worker, which can't wait for itself to stop.
+    bool Configure(uint32_t ui32ThreadCount, uint64_t ui64AffinityMask);
+    uint32_t Concurrency();
+
+    // Calls f on disjoint [Start, End) ranges covering [0, ui32Count), at most ui32Grain items
+    // each, and returns once all of them completed. The calling thread takes part.
+    void ParallelFor(uint32_t ui32Count, uint32_t ui32Grain, std::function<void(uint32_t /* Start index */, uint32_t /* End index */)> const& f);
+    void Shutdown();
+
+private:
+    CThreadPool() {}
+    ~CThreadPool();
+    CThreadPool(const CThreadPool&) = delete;
+    CThreadPool& operator=(const CThreadPool&) = delete;
+
+    struct ThreadPoolJob;
+
+    void StartLocked();
+    void StopWorkers();
+    void WorkerMain(uint32_t ui32Generation, uint32_t ui32Cpu);
+    static void RunJob(ThreadPoolJob& tpjJob, uint32_t ui32Slot);
+
+    std::mutex m_mLock;
+    std::condition_variable m_cvWork;
+    std::deque<std::shared_ptr<ThreadPoolJob>> m_dqJobs;
+    std::vector<std::thread> m_vecWorkers;
+    uint32_t m_ui32Generation = 0;   // Workers of an older generation exit
+    uint32_t m_ui32ThreadCount = 0;
+    uint64_t m_ui64AffinityMask = 0;
+};
@@ -9,9 +9,15 @@
 #endif
 
 #include <string>
+#include <vector>
+#include <mutex>
 
 #include "TitanArchive.hpp"
 #include "P7Zip.hpp"
+#include "ArchiveCache.hpp"
+#include "ThreadPool.hpp"
+#include "ArchiveStats.hpp"
+#include "Trace.hpp"
 
 using namespace std;
 
@@ -32,6 +38,7 @@ void SetGlobalError(HRESULT hrError, const std::wstring& wstrError)
 {
     s_hrGlobalError = hrError;
     s_wstrGlobalError = wstrError;
+    CArchiveStats::GlobalFail(hrError);
 }
 
 void SetGlobalError(HRESULT hrError, const std::string& strError)
@@ -39,8 +46,24 @@ void SetGlobalError(HRESULT hrError, const std::string& strError)
     SetGlobalError(hrError, conv(strError));
 }
 
+// Deleted contexts are reset and handed out again by CreateArchiveContext, so creating a
+// context per archive reuses the allocations of the previous one
+constexpr size_t szMaxPooledContexts = 64;
+static mutex s_mContextPoolLock;
+static vector<IArchiver*> s_vecContextPool;
+
 static IArchiver* ArchiverFactory()
 {
+    {
+        lock_guard<mutex> lgLock(s_mContextPoolLock);
+        if (!s_vecContextPool.empty())
+        {
+            IArchiver* pArchiver = s_vecContextPool.back();
+            s_vecContextPool.pop_back();
+            return pArchiver;
+        }
+    }
+
     try
     {
         return new C7ZipArchiver();
@@ -59,9 +82,17 @@ extern "C"
     EXPORT ARCHIVER_STATUS GlobalAddCodec(const wchar_t* wszFormat, const wchar_t* wszLibPath);
     EXPORT ARCHIVER_STATUS GlobalGetSupportedArchiveFormats(const wchar_t** pwszFormats);
     EXPORT void GlobalUninitialize();
+    EXPORT void GlobalConfigureArchiveCache(uint64_t ui64MemoryBudget);
+    EXPORT void GlobalFlushArchiveCache();
+    EXPORT ARCHIVER_STATUS GlobalSetConcurrency(uint32_t ui32ThreadCount, uint64_t ui64AffinityMask);
+    EXPORT ARCHIVER_STATUS GlobalGetStats(ArchiveStats* pStats);
+    EXPORT void GlobalResetStats();
+    EXPORT ARCHIVER_STATUS GlobalStartTrace(const wchar_t* wszPath);
+    EXPORT void GlobalStopTrace();
     EXPORT void* CreateArchiveContext();
     EXPORT ARCHIVER_STATUS OpenArchiveMemory(void* pCtx, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword, const wchar_t* wszFormat);
     EXPORT ARCHIVER_STATUS OpenArchiveDisk(void* pCtx, const wchar_t* wszPath, const wchar_t* wszPassword, const wchar_t* wszFormat);
+    EXPORT ARCHIVER_STATUS OpenArchiveDiskIndexed(void* pCtx, const wchar_t* wszPath, const wchar_t* wszIndexPath, const wchar_t* wszPassword, const wchar_t* wszFormat);
 #if defined(_WIN32)
     EXPORT ARCHIVER_STATUS OpenArchiveHandle(void* pCtx, HANDLE hArchive, const wchar_t* wszPassword, const wchar_t* wszFormat);
 #else
@@ -70,14 +101,41 @@ extern "C"
     EXPORT ARCHIVER_STATUS GetArchiveFormat(void* pCtx, const wchar_t** pwszFormat);
     EXPORT ARCHIVER_STATUS GetArchiveItemCount(void* pCtx, uint32_t* pArchiveItemCount);
     EXPORT ARCHIVER_STATUS ListDirectory(void* pCtx, const wchar_t* wszPath, ArchiveItem** ppItems, uint64_t* pItemCount);
+    EXPORT ARCHIVER_STATUS WalkArchive(void* pCtx, const wchar_t* wszRoot, ArchiveItem** ppItems, uint64_t* pItemCount);
     EXPORT ARCHIVER_STATUS GetArchiveItemPropertiesByPath(void* pCtx, const wchar_t* wszPath, ArchiveItem** ppItem);
     EXPORT ARCHIVER_STATUS GetArchiveItemPropertiesByIndex(void* pCtx, uint32_t ui32ItemIndex, ArchiveItem** ppItem);
+    EXPORT ARCHIVER_STATUS GetArchiveItemSize(void* pCtx, uint32_t ui32ItemIndex, uint64_t* pui64Size);
     EXPORT ARCHIVER_STATUS FreeArchiveItem(void* pCtx, ArchiveItem* pItem);
+    EXPORT ARCHIVER_STATUS GetArchiveItemPropertiesEx(void* pCtx, uint32_t ui32ItemIndex, uint32_t ui32Properties, ArchiveItemEx** ppItem);
+    EXPORT ARCHIVER_STATUS FreeArchiveItemEx(void* pCtx, ArchiveItemEx* pItem);
+    EXPORT ARCHIVER_STATUS FindArchiveItems(void* pCtx, const wchar_t* wszPattern, uint32_t ui32Kind, uint32_t** ppIndices, uint32_t* pui32Count);
+    EXPORT ARCHIVER_STATUS FreeArchiveItemIndices(void* pCtx, uint32_t* pIndices);
+    EXPORT ARCHIVER_STATUS GetArchiveItemTable(void* pCtx, uint32_t ui32Columns, ArchiveItemTable** ppTable);
+    EXPORT ARCHIVER_STATUS FreeArchiveItemTable(void* pCtx, ArchiveItemTable* pTable);
     EXPORT ARCHIVER_STATUS ExtractArchiveItemToBufferByIndex(void* pCtx, uint32_t ui32ItemIndex, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword);
     EXPORT ARCHIVER_STATUS ExtractArchiveItemToBufferByPath(void* pCtx, const wchar_t* wszPath, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword);
+    EXPORT ARCHIVER_STATUS ExtractArchiveItemToBufferByIndexEx(void* pCtx, uint32_t ui32ItemIndex, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword, uint64_t* pui64Written);
+    EXPORT ARCHIVER_STATUS ExtractArchiveItems(void* pCtx, const uint32_t* pIndices, uint32_t ui32Count, uint32_t ui32MaxWorkers, const wchar_t* wszPassword, ArchiveItemCallback pCallback, void* pUser);
+    EXPORT ARCHIVER_STATUS OpenArchiveItemStream(void* pCtx, uint32_t ui32ItemIndex, const wchar_t* wszPassword, uint64_t ui64BufferSize);
+    EXPORT ARCHIVER_STATUS ReadArchiveItemStream(void* pCtx, uint8_t* pBuf, uint64_t ui64BufSize, uint64_t* pui64Read);
+    EXPORT ARCHIVER_STATUS CloseArchiveItemStream(void* pCtx);
     EXPORT ARCHIVER_STATUS CloseArchive(void* pCtx);
+    EXPORT ARCHIVER_STATUS ResetArchiveContext(void* pCtx);
+    EXPORT ARCHIVER_STATUS SaveArchiveIndex(void* pCtx, const wchar_t* wszIndexPath);
+    EXPORT ARCHIVER_STATUS SetTrialOpenFormats(void* pCtx, const wchar_t* wszFormats, uint64_t ui64HeaderReadBudget);
+    EXPORT ARCHIVER_STATUS AttachArchiveCache(void* pCtx, uint32_t ui32Attach);
+    EXPORT void* CloneArchiveContext(void* pCtx);
     EXPORT ARCHIVER_STATUS DeleteArchiveContext(void* pCtx);
     EXPORT ARCHIVER_STATUS GetError(void* pCtx, HRESULT* pHr, const wchar_t** ppError);
+    EXPORT ARCHIVER_STATUS GetArchiveStats(void* pCtx, ArchiveStats* pStats);
+    EXPORT ARCHIVER_STATUS ResetArchiveStats(void* pCtx);
+    EXPORT ARCHIVER_STATUS OpenArchiveDiskUtf8(void* pCtx, const char* szPath, const char* szPassword, const char* szFormat);
+    EXPORT ARCHIVER_STATUS ListDirectoryUtf8(void* pCtx, const char* szPath, ArchiveItemUtf8** ppItems, uint64_t* pItemCount);
+    EXPORT ARCHIVER_STATUS WalkArchiveUtf8(void* pCtx, const char* szRoot, ArchiveItemUtf8** ppItems, uint64_t* pItemCount);
+    EXPORT ARCHIVER_STATUS GetArchiveItemPropertiesByPathUtf8(void* pCtx, const char* szPath, ArchiveItemUtf8** ppItem);
+    EXPORT ARCHIVER_STATUS GetArchiveItemPropertiesByIndexUtf8(void* pCtx, uint32_t ui32ItemIndex, ArchiveItemUtf8** ppItem);
+    EXPORT ARCHIVER_STATUS FreeArchiveItemUtf8(void* pCtx, ArchiveItemUtf8* pItem);
+    EXPORT ARCHIVER_STATUS ExtractArchiveItemToBufferByPathUtf8(void* pCtx, const char* szPath, uint8_t* pBuf, uint64_t ui64BufSize, const char* szPassword);
 }
 
 void* CreateArchiveContext()
@@ -112,9 +170,90 @@ ARCHIVER_STATUS GlobalGetSupportedArchiveFormats(const wchar_t** pwszFormats)
 
 void GlobalUninitialize()
 {
+    vector<IArchiver*> vecContexts;
+
+    s_mContextPoolLock.lock();
+    vecContexts.swap(s_vecContextPool);
+    s_mContextPoolLock.unlock();
+
+    for (IArchiver* pArchiver : vecContexts)
+    {
+        delete pArchiver;
+    }
+
     C7ZipArchiver::GlobalUninitialize();
 }
 
+void GlobalConfigureArchiveCache(uint64_t ui64MemoryBudget)
+{
+    CArchiveCache::Instance().Configure(ui64MemoryBudget);
+}
+
+void GlobalFlushArchiveCache()
+{
+    CArchiveCache::Instance().Flush();
+}
+
+ARCHIVER_STATUS GlobalSetConcurrency(uint32_t ui32ThreadCount, uint64_t ui64AffinityMask)
+{
+    if (!CThreadPool::Instance().Configure(ui32ThreadCount, ui64AffinityMask))
+    {
+        SetGlobalError(E_FAIL, "Concurrency can't be changed from a pool thread");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+ARCHIVER_STATUS GlobalGetStats(ArchiveStats* pStats)
+{
+    if (!pStats)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    CArchiveStats::GlobalGet(pStats);
+    return ARCHIVER_STATUS_SUCCESS;
+}
+
+void GlobalResetStats()
+{
+    CArchiveStats::GlobalReset();
+}
+
+ARCHIVER_STATUS GlobalStartTrace(const wchar_t* wszPath)
+{
+#if defined(TITANARCHIVE_NO_TRACING)
+    UNREFERENCED_PARAMETER(wszPath);
+    SetGlobalError(E_NOTIMPL, "Tracing was compiled out");
+    return ARCHIVER_STATUS_FAILURE;
+#else
+    if (!wszPath)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    if (CTrace::IsEnabled())
+    {
+        SetGlobalError(E_FAIL, "A trace is already being written");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    if (!CTrace::Start(wszPath))
+    {
+        SetGlobalError(E_FAIL, "Unable to create trace file");
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return ARCHIVER_STATUS_SUCCESS;
+#endif
+}
+
+void GlobalStopTrace()
+{
+    CTrace::Stop();
+}
+
 ARCHIVER_STATUS OpenArchiveMemory(void* pCtx, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword, const wchar_t* wszFormat)
 {
     IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
@@ -137,6 +276,17 @@ ARCHIVER_STATUS OpenArchiveDisk(void* pCtx, const wchar_t* wszPath, const wchar_
     return pArchiver->OpenArchiveDisk(wszPath, wszPassword, wszFormat);
 }
 
+ARCHIVER_STATUS OpenArchiveDiskIndexed(void* pCtx, const wchar_t* wszPath, const wchar_t* wszIndexPath, const wchar_t* wszPassword, const wchar_t* wszFormat)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || !wszPath || !wszIndexPath)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->OpenArchiveDiskIndexed(wszPath, wszIndexPath, wszPassword, wszFormat);
+}
+
 #if defined(_WIN32)
 ARCHIVER_STATUS OpenArchiveHandle(void* pCtx, HANDLE hArchive, const wchar_t* wszPassword, const wchar_t* wszFormat)
 {
@@ -194,6 +344,17 @@ ARCHIVER_STATUS ListDirectory(void* pCtx, const wchar_t* wszPath, ArchiveItem**
     return pArchiver->ListDirectory(wszPath, ppItems, pItemCount);     
 }
 
+ARCHIVER_STATUS WalkArchive(void* pCtx, const wchar_t* wszRoot, ArchiveItem** ppItems, uint64_t* pItemCount)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || !wszRoot || !ppItems)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->WalkArchive(wszRoot, ppItems, pItemCount);
+}
+
 ARCHIVER_STATUS GetArchiveItemPropertiesByPath(void* pCtx, const wchar_t* wszPath, ArchiveItem** ppItem)
 {
     IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
@@ -216,6 +377,17 @@ ARCHIVER_STATUS GetArchiveItemPropertiesByIndex(void* pCtx, uint32_t ui32ItemInd
     return pArchiver->GetArchiveItemProperties(ui32ItemIndex, ppItem);
 }
 
+ARCHIVER_STATUS GetArchiveItemSize(void* pCtx, uint32_t ui32ItemIndex, uint64_t* pui64Size)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || !pui64Size)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->GetArchiveItemSize(ui32ItemIndex, pui64Size);
+}
+
 ARCHIVER_STATUS FreeArchiveItem(void* pCtx, ArchiveItem* pItem)
 {
     IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
@@ -227,6 +399,72 @@ ARCHIVER_STATUS FreeArchiveItem(void* pCtx, ArchiveItem* pItem)
     return pArchiver->FreeArchiveItem(pItem);
 }
 
+ARCHIVER_STATUS GetArchiveItemPropertiesEx(void* pCtx, uint32_t ui32ItemIndex, uint32_t ui32Properties, ArchiveItemEx** ppItem)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || !ppItem)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->GetArchiveItemPropertiesEx(ui32ItemIndex, ui32Properties, ppItem);
+}
+
+ARCHIVER_STATUS FreeArchiveItemEx(void* pCtx, ArchiveItemEx* pItem)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->FreeArchiveItemEx(pItem);
+}
+
+ARCHIVER_STATUS FindArchiveItems(void* pCtx, const wchar_t* wszPattern, uint32_t ui32Kind, uint32_t** ppIndices, uint32_t* pui32Count)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || !wszPattern || !ppIndices || !pui32Count)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->FindArchiveItems(wszPattern, ui32Kind, ppIndices, pui32Count);
+}
+
+ARCHIVER_STATUS FreeArchiveItemIndices(void* pCtx, uint32_t* pIndices)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->FreeArchiveItemIndices(pIndices);
+}
+
+ARCHIVER_STATUS GetArchiveItemTable(void* pCtx, uint32_t ui32Columns, ArchiveItemTable** ppTable)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || !ppTable)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->GetArchiveItemTable(ui32Columns, ppTable);
+}
+
+ARCHIVER_STATUS FreeArchiveItemTable(void* pCtx, ArchiveItemTable* pTable)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || !pTable)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->FreeArchiveItemTable(pTable);
+}
+
 ARCHIVER_STATUS ExtractArchiveItemToBufferByIndex(void* pCtx, uint32_t ui32ItemIndex, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword)
 {
     IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
@@ -249,6 +487,61 @@ ARCHIVER_STATUS ExtractArchiveItemToBufferByPath(void* pCtx, const wchar_t* wszP
     return pArchiver->ExtractArchiveItemToBuffer(wszPath, pBuf, ui64BufSize, wszPassword); 
 }
 
+ARCHIVER_STATUS ExtractArchiveItemToBufferByIndexEx(void* pCtx, uint32_t ui32ItemIndex, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword, uint64_t* pui64Written)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || !pBuf || !ui64BufSize || !pui64Written)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->ExtractArchiveItemToBufferEx(ui32ItemIndex, pBuf, ui64BufSize, wszPassword, pui64Written);
+}
+
+ARCHIVER_STATUS ExtractArchiveItems(void* pCtx, const uint32_t* pIndices, uint32_t ui32Count, uint32_t ui32MaxWorkers, const wchar_t* wszPassword, ArchiveItemCallback pCallback, void* pUser)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || (!pIndices && ui32Count) || !pCallback)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->ExtractArchiveItems(pIndices, ui32Count, ui32MaxWorkers, wszPassword, pCallback, pUser);
+}
+
+ARCHIVER_STATUS OpenArchiveItemStream(void* pCtx, uint32_t ui32ItemIndex, const wchar_t* wszPassword, uint64_t ui64BufferSize)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->OpenItemStream(ui32ItemIndex, wszPassword, ui64BufferSize);
+}
+
+ARCHIVER_STATUS ReadArchiveItemStream(void* pCtx, uint8_t* pBuf, uint64_t ui64BufSize, uint64_t* pui64Read)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || !pBuf || !pui64Read)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->ReadItemStream(pBuf, ui64BufSize, pui64Read);
+}
+
+ARCHIVER_STATUS CloseArchiveItemStream(void* pCtx)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->CloseItemStream();
+}
+
 ARCHIVER_STATUS CloseArchive(void* pCtx)
 {
     IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
@@ -260,9 +553,94 @@ ARCHIVER_STATUS CloseArchive(void* pCtx)
     return pArchiver->CloseArchive();
 }
 
+ARCHIVER_STATUS ResetArchiveContext(void* pCtx)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->ResetArchive();
+}
+
+ARCHIVER_STATUS SaveArchiveIndex(void* pCtx, const wchar_t* wszIndexPath)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || !wszIndexPath)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->SaveArchiveIndex(wszIndexPath);
+}
+
+void* CloneArchiveContext(void* pCtx)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    IArchiver* pClone = nullptr;
+    if (!pArchiver)
+    {
+        return nullptr;
+    }
+
+    if (pArchiver->CloneArchive(&pClone) != ARCHIVER_STATUS_SUCCESS)
+    {
+        return nullptr;
+    }
+
+    return pClone;
+}
+
+ARCHIVER_STATUS SetTrialOpenFormats(void* pCtx, const wchar_t* wszFormats, uint64_t ui64HeaderReadBudget)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->SetTrialOpenFormats(wszFormats, ui64HeaderReadBudget);
+}
+
+ARCHIVER_STATUS AttachArchiveCache(void* pCtx, uint32_t ui32Attach)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->AttachArchiveCache(ui32Attach != 0);
+}
+
 ARCHIVER_STATUS DeleteArchiveContext(void* pCtx)
 {
-    delete static_cast<IArchiver*>(pCtx);
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver)
+    {
+        return ARCHIVER_STATUS_SUCCESS;
+    }
+
+    pArchiver->ResetArchive();
+
+    {
+        lock_guard<mutex> lgLock(s_mContextPoolLock);
+        if (s_vecContextPool.size() < szMaxPooledContexts)
+        {
+            try
+            {
+                s_vecContextPool.push_back(pArchiver);
+                return ARCHIVER_STATUS_SUCCESS;
+            }
+            catch (...)
+            {
+                // Unable to grow the pool, the context is deleted instead
+            }
+        }
+    }
+
+    delete pArchiver;
     return ARCHIVER_STATUS_SUCCESS;
 }
 
@@ -290,3 +668,102 @@ ARCHIVER_STATUS GetError(void* pCtx, HRESULT* pHr, const wchar_t** ppError)
 
     return ARCHIVER_STATUS_SUCCESS;
 }
+
+ARCHIVER_STATUS GetArchiveStats(void* pCtx, ArchiveStats* pStats)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || !pStats)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->GetStats(pStats);
+}
+
+ARCHIVER_STATUS ResetArchiveStats(void* pCtx)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->ResetStats();
+}
+
+ARCHIVER_STATUS OpenArchiveDiskUtf8(void* pCtx, const char* szPath, const char* szPassword, const char* szFormat)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || !szPath)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->OpenArchiveDiskUtf8(szPath, szPassword, szFormat);
+}
+
+ARCHIVER_STATUS ListDirectoryUtf8(void* pCtx, const char* szPath, ArchiveItemUtf8** ppItems, uint64_t* pItemCount)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || !szPath || !ppItems)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->ListDirectoryUtf8(szPath, ppItems, pItemCount);
+}
+
+ARCHIVER_STATUS WalkArchiveUtf8(void* pCtx, const char* szRoot, ArchiveItemUtf8** ppItems, uint64_t* pItemCount)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || !szRoot || !ppItems)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->WalkArchiveUtf8(szRoot, ppItems, pItemCount);
+}
+
+ARCHIVER_STATUS GetArchiveItemPropertiesByPathUtf8(void* pCtx, const char* szPath, ArchiveItemUtf8** ppItem)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || !szPath || !ppItem)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->GetArchiveItemPropertiesUtf8(szPath, ppItem);
+}
+
+ARCHIVER_STATUS GetArchiveItemPropertiesByIndexUtf8(void* pCtx, uint32_t ui32ItemIndex, ArchiveItemUtf8** ppItem)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || !ppItem)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->GetArchiveItemPropertiesUtf8(ui32ItemIndex, ppItem);
+}
+
+ARCHIVER_STATUS FreeArchiveItemUtf8(void* pCtx, ArchiveItemUtf8* pItem)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->FreeArchiveItemUtf8(pItem);
+}
+
+ARCHIVER_STATUS ExtractArchiveItemToBufferByPathUtf8(void* pCtx, const char* szPath, uint8_t* pBuf, uint64_t ui64BufSize, const char* szPassword)
+{
+    IArchiver* pArchiver = static_cast<IArchiver*>(pCtx);
+    if (!pArchiver || !szPath || !pBuf || !ui64BufSize)
+    {
+        return ARCHIVER_STATUS_FAILURE;
+    }
+
+    return pArchiver->ExtractArchiveItemToBufferUtf8(szPath, pBuf, ui64BufSize, szPassword);
+}
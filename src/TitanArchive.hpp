@@ -17,11 +17,117 @@ struct ArchiveItem
     ArchiveItem* pItemNext;
 };
 
+// ArchiveItem returned by the UTF-8 entry points, szPath points into the same allocation
+struct ArchiveItemUtf8
+{
+    uint32_t ui32Index;
+    char* szPath;
+    char cIsDir;
+    uint64_t ui64Size;
+    FILETIME ftModTime;
+
+    ArchiveItemUtf8* pItemNext;
+};
+
+#define ARCHIVE_ITEM_PROPERTY_PACK_SIZE     (1 << 0)
+#define ARCHIVE_ITEM_PROPERTY_METHOD        (1 << 1)
+#define ARCHIVE_ITEM_PROPERTY_CRC           (1 << 2)
+#define ARCHIVE_ITEM_PROPERTY_BLOCK         (1 << 3)
+#define ARCHIVE_ITEM_PROPERTY_OFFSET        (1 << 4)
+#define ARCHIVE_ITEM_PROPERTY_ENCRYPTED     (1 << 5)
+#define ARCHIVE_ITEM_PROPERTY_ALL           (0x3f)
+
+// ArchiveItem plus the properties selected by a mask, allocated as a single block.
+// ui32Properties holds the requested properties the handler provided, the others are zero.
+struct ArchiveItemEx
+{
+    ArchiveItem aiItem;
+    uint32_t ui32Properties;
+    uint64_t ui64PackSize;
+    uint64_t ui64Offset;
+    uint64_t ui64Block;         // Solid block the item is stored in
+    uint32_t ui32Crc;
+    char cIsEncrypted;
+    wchar_t* wszMethod;
+};
+
+#define ARCHIVE_FIND_GLOB                   (0)
+#define ARCHIVE_FIND_PREFIX                 (1)
+#define ARCHIVE_FIND_EXTENSION              (2)
+#define ARCHIVE_FIND_REGEX                  (3)
+
+#define ARCHIVE_TABLE_COLUMN_INDEX      (1 << 0)
+#define ARCHIVE_TABLE_COLUMN_SIZE       (1 << 1)
+#define ARCHIVE_TABLE_COLUMN_MTIME      (1 << 2)
+#define ARCHIVE_TABLE_COLUMN_ISDIR      (1 << 3)
+#define ARCHIVE_TABLE_COLUMN_PATH       (1 << 4)
+#define ARCHIVE_TABLE_PATH_UTF8         (1u << 31)  // Path pool holds UTF-8 instead of wchar_t
+
+// Metadata of every item as columns, allocated as a single block. Columns that were not
+// requested are nullptr.
+struct ArchiveItemTable
+{
+    uint32_t ui32ItemCount;
+    uint32_t ui32Columns;
+    uint32_t* pIndices;
+    uint64_t* pSizes;
+    uint64_t* pMTimes;          // FILETIME as a 64-bit value
+    uint8_t* pIsDir;
+    uint64_t* pPathOffsets;     // ui32ItemCount + 1 offsets into pPathPool, in characters
+    void* pPathPool;            // NUL terminated paths, char or wchar_t
+};
+
+// Receives every item extracted by ExtractArchiveItems, on the worker that extracted it. pBuf is only
+// valid during the call, wszError is nullptr on success.
+typedef void (*ArchiveItemCallback)(void* pUser, uint32_t ui32ItemIndex, HRESULT hrError, const wchar_t* wszError, const uint8_t* pBuf, uint64_t ui64Size);
+
+#define ARCHIVE_STATS_HISTOGRAM_BUCKETS     (16)
+#define ARCHIVE_STATS_MAX_FAILURES          (16)
+
+// Durations in nanoseconds. Bucket 0 counts samples below 1 us, bucket i samples below 4^i us and
+// the last bucket everything longer.
+struct ArchiveStatsHistogram
+{
+    uint64_t ui64Count;
+    uint64_t ui64TotalNs;
+    uint64_t ui64MaxNs;
+    uint64_t rgui64Buckets[ARCHIVE_STATS_HISTOGRAM_BUCKETS];
+};
+
+struct ArchiveStatsFailure
+{
+    HRESULT hrError;
+    uint64_t ui64Count;
+};
+
+// Counters of a context (GetArchiveStats) or of the whole process (GlobalGetStats) since their last
+// reset. Clones used by ExtractArchiveItems count towards the context they were made from.
+struct ArchiveStats
+{
+    uint64_t ui64Opens;                 // Handler opens, including failed ones and trial candidates
+    uint64_t ui64HeaderBytesRead;       // Bytes handlers read from the archive while opening
+    uint64_t ui64PropertyCalls;         // GetProperty calls into handlers
+    uint64_t ui64ItemsDecoded;
+    uint64_t ui64BytesDecoded;          // Bytes handlers produced, including what did not fit a buffer
+    uint64_t ui64BytesCopied;           // Bytes stored in caller buffers or read from item streams
+    uint64_t ui64IterateItemsCalls;     // Passes over all items reading metadata
+    uint64_t ui64ThreadsSpawned;
+    uint64_t ui64MmapBytes;             // Bytes of archive files mapped
+    uint64_t ui64MajorFaults;           // Major page faults taken during opens
+    ArchiveStatsHistogram ashOpen;
+    ArchiveStatsHistogram ashExtract;
+    ArchiveStatsHistogram ashIterateItems;
+    uint32_t ui32FailureCount;          // Distinct HRESULTs in rgFailures
+    ArchiveStatsFailure rgFailures[ARCHIVE_STATS_MAX_FAILURES];
+    uint64_t ui64OtherFailures;         // Failures whose HRESULT did not fit in rgFailures
+};
+
 interface IArchiver
 {
     virtual ~IArchiver() {}
     virtual ARCHIVER_STATUS OpenArchiveMemory(uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword, const wchar_t* wszFormat) = 0;
     virtual ARCHIVER_STATUS OpenArchiveDisk(const wchar_t* wszPath, const wchar_t* wszPassword, const wchar_t* wszFormat) = 0;
+    virtual ARCHIVER_STATUS OpenArchiveDiskIndexed(const wchar_t* wszPath, const wchar_t* wszIndexPath, const wchar_t* wszPassword, const wchar_t* wszFormat) = 0;
 #if defined(_WIN32)
     virtual ARCHIVER_STATUS OpenArchiveHandle(HANDLE hArchive, const wchar_t* wszPassword, const wchar_t* wszFormat) = 0;
 #else
@@ -30,13 +136,44 @@ interface IArchiver
     virtual ARCHIVER_STATUS GetArchiveFormat(const wchar_t** pwszFormat) = 0;
     virtual ARCHIVER_STATUS GetArchiveItemCount(uint32_t* pArchiveItemCount) = 0;
     virtual ARCHIVER_STATUS ListDirectory(const wchar_t* wszPath, ArchiveItem** ppItems, uint64_t* pItemCount) = 0;
+    virtual ARCHIVER_STATUS WalkArchive(const wchar_t* wszRoot, ArchiveItem** ppItems, uint64_t* pItemCount) = 0;
     virtual ARCHIVER_STATUS GetArchiveItemProperties(const wchar_t* wszPath, ArchiveItem** ppItem) = 0;
     virtual ARCHIVER_STATUS GetArchiveItemProperties(uint32_t ui32ItemIndex, ArchiveItem** ppItem) = 0;
+    virtual ARCHIVER_STATUS GetArchiveItemSize(uint32_t ui32ItemIndex, uint64_t* pui64Size) = 0;
     virtual ARCHIVER_STATUS FreeArchiveItem(ArchiveItem* pItem) = 0;
+    virtual ARCHIVER_STATUS GetArchiveItemPropertiesEx(uint32_t ui32ItemIndex, uint32_t ui32Properties, ArchiveItemEx** ppItem) = 0;
+    virtual ARCHIVER_STATUS FreeArchiveItemEx(ArchiveItemEx* pItem) = 0;
+    virtual ARCHIVER_STATUS FindArchiveItems(const wchar_t* wszPattern, uint32_t ui32Kind, uint32_t** ppIndices, uint32_t* pui32Count) = 0;
+    virtual ARCHIVER_STATUS FreeArchiveItemIndices(uint32_t* pIndices) = 0;
+    virtual ARCHIVER_STATUS GetArchiveItemTable(uint32_t ui32Columns, ArchiveItemTable** ppTable) = 0;
+    virtual ARCHIVER_STATUS FreeArchiveItemTable(ArchiveItemTable* pTable) = 0;
     virtual ARCHIVER_STATUS ExtractArchiveItemToBuffer(uint32_t ui32ItemIndex, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword) = 0;
     virtual ARCHIVER_STATUS ExtractArchiveItemToBuffer(const wchar_t* wszPath, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword) = 0;
+    virtual ARCHIVER_STATUS ExtractArchiveItemToBufferEx(uint32_t ui32ItemIndex, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword, uint64_t* pui64Written) = 0;
+    virtual ARCHIVER_STATUS ExtractArchiveItems(const uint32_t* pIndices, uint32_t ui32Count, uint32_t ui32MaxWorkers, const wchar_t* wszPassword, ArchiveItemCallback pCallback, void* pUser) = 0;
+    // Incremental extraction of one item, the context must not be used for anything else until the stream is closed
+    virtual ARCHIVER_STATUS OpenItemStream(uint32_t ui32ItemIndex, const wchar_t* wszPassword, uint64_t ui64BufferSize) = 0;
+    virtual ARCHIVER_STATUS ReadItemStream(uint8_t* pBuf, uint64_t ui64BufSize, uint64_t* pui64Read) = 0;
+    virtual ARCHIVER_STATUS CloseItemStream() = 0;
     virtual ARCHIVER_STATUS CloseArchive() = 0;
+    virtual ARCHIVER_STATUS ResetArchive() = 0;
+    virtual ARCHIVER_STATUS CloneArchive(IArchiver** ppClone) = 0;
+    virtual ARCHIVER_STATUS SaveArchiveIndex(const wchar_t* wszIndexPath) = 0;
+    virtual ARCHIVER_STATUS SetTrialOpenFormats(const wchar_t* wszFormats, uint64_t ui64HeaderReadBudget) = 0;
+    virtual ARCHIVER_STATUS AttachArchiveCache(bool bAttach) = 0;
     virtual ARCHIVER_STATUS GetError(HRESULT* pHr, const wchar_t** ppError) = 0;
+    virtual ARCHIVER_STATUS GetStats(ArchiveStats* pStats) = 0;
+    virtual ARCHIVER_STATUS ResetStats() = 0;
+
+    // UTF-8 variants of the path taking and returning calls, the disk path is handed to the file system
+    // as-is on POSIX so names that are not valid UTF-8 still open
+    virtual ARCHIVER_STATUS OpenArchiveDiskUtf8(const char* szPath, const char* szPassword, const char* szFormat) = 0;
+    virtual ARCHIVER_STATUS ListDirectoryUtf8(const char* szPath, ArchiveItemUtf8** ppItems, uint64_t* pItemCount) = 0;
+    virtual ARCHIVER_STATUS WalkArchiveUtf8(const char* szRoot, ArchiveItemUtf8** ppItems, uint64_t* pItemCount) = 0;
+    virtual ARCHIVER_STATUS GetArchiveItemPropertiesUtf8(const char* szPath, ArchiveItemUtf8** ppItem) = 0;
+    virtual ARCHIVER_STATUS GetArchiveItemPropertiesUtf8(uint32_t ui32ItemIndex, ArchiveItemUtf8** ppItem) = 0;
+    virtual ARCHIVER_STATUS FreeArchiveItemUtf8(ArchiveItemUtf8* pItem) = 0;
+    virtual ARCHIVER_STATUS ExtractArchiveItemToBufferUtf8(const char* szPath, uint8_t* pBuf, uint64_t ui64BufSize, const char* szPassword) = 0;
 };
 
 void SetGlobalError(HRESULT hrError, const std::wstring& wstrError);
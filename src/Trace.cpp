@@ -0,0 +1,172 @@
+#include <mutex>
+#include <string>
+#include <cstdio>
+#include <cwchar>
+
+#include "Compat.hpp"
+#include "Trace.hpp"
+
+#if defined(_WIN32)
+#include <process.h>
+#define getpid _getpid
+#endif
+
+using namespace std;
+
+#if defined(TRACE_USDT)
+volatile unsigned short titanarchive_scope__start_semaphore __attribute__((unused, section(".probes")));
+volatile unsigned short titanarchive_scope__done_semaphore __attribute__((unused, section(".probes")));
+#endif
+
+atomic<bool> CTrace::s_bEnabled(false);
+
+namespace
+{
+    constexpr size_t szFlushThreshold = 64 * 1024;
+
+    struct TraceWriter
+    {
+        mutex mLock;
+        FILE* pFile = nullptr;
+        string strBuf;
+        bool bFirstEvent = true;
+        int iPid = 0;
+        chrono::steady_clock::time_point tpOrigin;
+    };
+
+    // Never destroyed so scopes ending on threads that outlive static destruction stay safe
+    TraceWriter& Writer()
+    {
+        static TraceWriter* s_ptwWriter = new TraceWriter();
+        return *s_ptwWriter;
+    }
+
+    // Small sequential ids read better in trace viewers than native thread ids
+    uint32_t CurrentThreadId()
+    {
+        static atomic<uint32_t> s_ui32NextId(1);
+        thread_local uint32_t ui32Id = s_ui32NextId++;
+        return ui32Id;
+    }
+
+    void AppendEscaped(string& strOut, const wchar_t* wszStr)
+    {
+        const size_t szLength = wcslen(wszStr);
+        string strUtf8(CompatWideToUtf8(wszStr, szLength, nullptr), '\0');
+
+        CompatWideToUtf8(wszStr, szLength, &strUtf8[0]);
+        for (char c : strUtf8)
+        {
+            if (c == '"' || c == '\\')
+            {
+                strOut += '\\';
+                strOut += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char szEscape[8];
+                snprintf(szEscape, sizeof(szEscape), "\\u%04x", c);
+                strOut += szEscape;
+            }
+            else
+            {
+                strOut += c;
+            }
+        }
+    }
+
+    void FlushLocked(TraceWriter& twWriter)
+    {
+        fwrite(twWriter.strBuf.data(), 1, twWriter.strBuf.size(), twWriter.pFile);
+        twWriter.strBuf.clear();
+    }
+}
+
+bool CTrace::Start(const wchar_t* wszPath)
+{
+    TraceWriter& twWriter = Writer();
+    lock_guard<mutex> lgLock(twWriter.mLock);
+
+    if (twWriter.pFile)
+    {
+        return false;
+    }
+
+    twWriter.pFile = CompatFopen(wszPath, L"wb");
+    if (!twWriter.pFile)
+    {
+        return false;
+    }
+
+    twWriter.strBuf = "[\n";
+    twWriter.bFirstEvent = true;
+    twWriter.iPid = static_cast<int>(getpid());
+    twWriter.tpOrigin = chrono::steady_clock::now();
+    s_bEnabled.store(true, memory_order_relaxed);
+
+    return true;
+}
+
+void CTrace::Stop()
+{
+    TraceWriter& twWriter = Writer();
+    lock_guard<mutex> lgLock(twWriter.mLock);
+
+    s_bEnabled.store(false, memory_order_relaxed);
+    if (!twWriter.pFile)
+    {
+        return;
+    }
+
+    twWriter.strBuf += "\n]\n";
+    FlushLocked(twWriter);
+    fclose(twWriter.pFile);
+    twWriter.pFile = nullptr;
+    twWriter.strBuf.shrink_to_fit();
+}
+
+void CTrace::Complete(const char* szName, uint64_t ui64Arg, const wchar_t* wszDetail, chrono::steady_clock::time_point tpStart, chrono::steady_clock::time_point tpEnd)
+{
+    TraceWriter& twWriter = Writer();
+    const uint32_t ui32Tid = CurrentThreadId();
+    char szEvent[256];
+    lock_guard<mutex> lgLock(twWriter.mLock);
+
+    // The scope may have started before the writer was (re)started
+    if (!twWriter.pFile || tpStart < twWriter.tpOrigin)
+    {
+        return;
+    }
+
+    // Complete events, timestamps in microseconds since the trace was started
+    snprintf(szEvent, sizeof(szEvent), "%s{\"name\":\"%s\",\"cat\":\"titanarchive\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,\"args\":{\"arg\":%llu",
+        twWriter.bFirstEvent ? "" : ",\n", szName,
+        chrono::duration<double, micro>(tpStart - twWriter.tpOrigin).count(),
+        chrono::duration<double, micro>(tpEnd - tpStart).count(),
+        twWriter.iPid, ui32Tid, static_cast<unsigned long long>(ui64Arg));
+
+    // Built aside so a failed allocation never leaves half an event in the document
+    try
+    {
+        string strEvent = szEvent;
+
+        if (wszDetail)
+        {
+            strEvent += ",\"detail\":\"";
+            AppendEscaped(strEvent, wszDetail);
+            strEvent += '"';
+        }
+        strEvent += "}}";
+        twWriter.strBuf += strEvent;
+    }
+    catch (...)
+    {
+        return;
+    }
+    twWriter.bFirstEvent = false;
+
+    if (twWriter.strBuf.size() >= szFlushThreshold)
+    {
+        FlushLocked(twWriter);
+    }
+}
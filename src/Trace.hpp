@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Define TITANARCHIVE_NO_TRACING to compile every trace scope out. Otherwise each scope is a
+// USDT probe pair, a nop guarded by a semaphore that perf or bpftrace raise while attached, and
+// one relaxed load checking whether the trace-event writer was started with GlobalStartTrace.
+#if !defined(TITANARCHIVE_NO_TRACING) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define TRACE_USDT
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+extern "C" volatile unsigned short titanarchive_scope__start_semaphore;
+extern "C" volatile unsigned short titanarchive_scope__done_semaphore;
+#define TRACE_PROBES_ATTACHED()                             (titanarchive_scope__start_semaphore || titanarchive_scope__done_semaphore)
+#define TRACE_PROBE_START(szName, ui64Arg)                  STAP_PROBE2(titanarchive, scope__start, szName, ui64Arg)
+#define TRACE_PROBE_DONE(szName, ui64Arg, ui64Ns)           STAP_PROBE3(titanarchive, scope__done, szName, ui64Arg, ui64Ns)
+#endif
+#endif
+
+#if !defined(TRACE_USDT)
+#define TRACE_PROBES_ATTACHED()                             (false)
+#define TRACE_PROBE_START(szName, ui64Arg)
+#define TRACE_PROBE_DONE(szName, ui64Arg, ui64Ns)
+#endif
+
+// Writes Chrome trace-event JSON (chrome://tracing, Perfetto) while started
+class CTrace
+{
+public:
+    static bool Start(const wchar_t* wszPath);
+    static void Stop();
+
+    static bool IsEnabled()
+    {
+        return s_bEnabled.load(std::memory_order_relaxed);
+    }
+
+    static void Complete(const char* szName, uint64_t ui64Arg, const wchar_t* wszDetail, std::chrono::steady_clock::time_point tpStart, std::chrono::steady_clock::time_point tpEnd);
+
+private:
+    static std::atomic<bool> s_bEnabled;
+};
+
+// Traces the enclosing scope. szName must be a string literal, wszDetail must outlive the scope.
+class CTraceScope
+{
+public:
+    CTraceScope(const char* szName, uint64_t ui64Arg, const wchar_t* wszDetail = nullptr) : m_szName(szName), m_ui64Arg(ui64Arg), m_wszDetail(wszDetail)
+    {
+        m_bProbed = CTrace::IsEnabled() || TRACE_PROBES_ATTACHED();
+        if (m_bProbed)
+        {
+            m_tpStart = std::chrono::steady_clock::now();
+        }
+        TRACE_PROBE_START(m_szName, m_ui64Arg);
+    }
+
+    ~CTraceScope()
+    {
+        if (!m_bProbed)
+        {
+            return;
+        }
+
+        const std::chrono::steady_clock::time_point tpEnd = std::chrono::steady_clock::now();
+
+        TRACE_PROBE_DONE(m_szName, m_ui64Arg, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(tpEnd - m_tpStart).count()));
+        if (CTrace::IsEnabled())
+        {
+            CTrace::Complete(m_szName, m_ui64Arg, m_wszDetail, m_tpStart, tpEnd);
+        }
+    }
+
+private:
+    CTraceScope(const CTraceScope&) = delete;
+    CTraceScope& operator=(const CTraceScope&) = delete;
+
+    const char* m_szName;
+    uint64_t m_ui64Arg;
+    const wchar_t* m_wszDetail;
+    bool m_bProbed;
+    std::chrono::steady_clock::time_point m_tpStart;
+};
+
+#define TRACE_CONCAT_INNER(a, b)        a##b
+#define TRACE_CONCAT(a, b)              TRACE_CONCAT_INNER(a, b)
+
+#if defined(TITANARCHIVE_NO_TRACING)
+#define TRACE_SCOPE(...)
+#else
+#define TRACE_SCOPE(...)                CTraceScope TRACE_CONCAT(tsScope, __LINE__)(__VA_ARGS__)
+#endif
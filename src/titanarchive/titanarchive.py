@@ -1,4 +1,9 @@
+import asyncio
+import concurrent.futures
 import ctypes
+import io
+import itertools
+import threading
 from io import BytesIO
 from collections import namedtuple
 import os
@@ -11,6 +16,30 @@ ARCHIVER_STATUS_SUCCESS = 0
 ARCHIVER_STATUS_FAILURE = 1
 E_FAIL = 0x80004005
 
+ARCHIVE_ITEM_PROPERTY_PACK_SIZE = 1 << 0
+ARCHIVE_ITEM_PROPERTY_METHOD = 1 << 1
+ARCHIVE_ITEM_PROPERTY_CRC = 1 << 2
+ARCHIVE_ITEM_PROPERTY_BLOCK = 1 << 3
+ARCHIVE_ITEM_PROPERTY_OFFSET = 1 << 4
+ARCHIVE_ITEM_PROPERTY_ENCRYPTED = 1 << 5
+ARCHIVE_ITEM_PROPERTY_ALL = 0x3f
+
+ARCHIVE_FIND_GLOB = 0
+ARCHIVE_FIND_PREFIX = 1
+ARCHIVE_FIND_EXTENSION = 2
+ARCHIVE_FIND_REGEX = 3
+
+ARCHIVE_TABLE_COLUMN_INDEX = 1 << 0
+ARCHIVE_TABLE_COLUMN_SIZE = 1 << 1
+ARCHIVE_TABLE_COLUMN_MTIME = 1 << 2
+ARCHIVE_TABLE_COLUMN_ISDIR = 1 << 3
+ARCHIVE_TABLE_COLUMN_PATH = 1 << 4
+ARCHIVE_TABLE_COLUMN_ALL = 0x1f
+ARCHIVE_TABLE_PATH_UTF8 = 1 << 31
+
+ARCHIVE_STATS_HISTOGRAM_BUCKETS = 16
+ARCHIVE_STATS_MAX_FAILURES = 16
+
 if os.name == 'nt':
     ext = '.dll'
 elif os.name == 'posix':
@@ -49,9 +78,9 @@ if not os.path.isfile(TITAN_ARCHIVE_MODULE):
     raise Exception('Unable to find TitanArchive support module (%s)' % TITAN_ARCHIVE_MODULE_NAME)
 
 TITAN_ARCHIVE_7Z_MODULE = os.path.join(TITAN_ARCHIVE_MODULE_DIR, TITAN_ARCHIVE_7Z_MODULE_NAME)
-
+# Single-library builds have 7-Zip linked in and ship no separate module
 if not os.path.isfile(TITAN_ARCHIVE_7Z_MODULE):
-    raise Exception('Unable to find TitanArchive 7z support module (%s)' % TITAN_ARCHIVE_7Z_MODULE)
+    TITAN_ARCHIVE_7Z_MODULE = None
 
 class TitanArchiveException(Exception):
     def __init__(self, hr, err_string):
@@ -67,31 +96,220 @@ class _ArchiveItem(ctypes.Structure):
                 ('MTime', ctypes.c_ulonglong),
                 ('_ItemNext', ctypes.c_void_p)]
 
+class _ArchiveItemUtf8(ctypes.Structure):
+    _fields_ = [('Index', ctypes.c_uint),
+                ('Path', ctypes.c_char_p),
+                ('IsDir', ctypes.c_bool),
+                ('Size', ctypes.c_ulonglong),
+                ('MTime', ctypes.c_ulonglong),
+                ('_ItemNext', ctypes.c_void_p)]
+
+class _ArchiveItemEx(ctypes.Structure):
+    _fields_ = [('Item', _ArchiveItem),
+                ('_Properties', ctypes.c_uint),
+                ('PackSize', ctypes.c_ulonglong),
+                ('Offset', ctypes.c_ulonglong),
+                ('Block', ctypes.c_ulonglong),
+                ('CRC', ctypes.c_uint),
+                ('Encrypted', ctypes.c_bool),
+                ('Method', ctypes.c_wchar_p)]
+
+_ARCHIVE_ITEM_EX_PROPERTIES = [('PackSize', ARCHIVE_ITEM_PROPERTY_PACK_SIZE),
+                               ('Method', ARCHIVE_ITEM_PROPERTY_METHOD),
+                               ('CRC', ARCHIVE_ITEM_PROPERTY_CRC),
+                               ('Block', ARCHIVE_ITEM_PROPERTY_BLOCK),
+                               ('Offset', ARCHIVE_ITEM_PROPERTY_OFFSET),
+                               ('Encrypted', ARCHIVE_ITEM_PROPERTY_ENCRYPTED)]
+
+class _ArchiveItemTable(ctypes.Structure):
+    _fields_ = [('ItemCount', ctypes.c_uint),
+                ('Columns', ctypes.c_uint),
+                ('Indices', ctypes.POINTER(ctypes.c_uint)),
+                ('Sizes', ctypes.POINTER(ctypes.c_ulonglong)),
+                ('MTimes', ctypes.POINTER(ctypes.c_ulonglong)),
+                ('IsDir', ctypes.POINTER(ctypes.c_ubyte)),
+                ('PathOffsets', ctypes.POINTER(ctypes.c_ulonglong)),
+                ('PathPool', ctypes.c_void_p)]
+
+class _ArchiveStatsHistogram(ctypes.Structure):
+    _fields_ = [('Count', ctypes.c_ulonglong),
+                ('TotalNs', ctypes.c_ulonglong),
+                ('MaxNs', ctypes.c_ulonglong),
+                ('Buckets', ctypes.c_ulonglong * ARCHIVE_STATS_HISTOGRAM_BUCKETS)]
+
+class _ArchiveStatsFailure(ctypes.Structure):
+    _fields_ = [('Error', ctypes.c_int),
+                ('Count', ctypes.c_ulonglong)]
+
+class _ArchiveStats(ctypes.Structure):
+    _fields_ = [('Opens', ctypes.c_ulonglong),
+                ('HeaderBytesRead', ctypes.c_ulonglong),
+                ('PropertyCalls', ctypes.c_ulonglong),
+                ('ItemsDecoded', ctypes.c_ulonglong),
+                ('BytesDecoded', ctypes.c_ulonglong),
+                ('BytesCopied', ctypes.c_ulonglong),
+                ('IterateItemsCalls', ctypes.c_ulonglong),
+                ('ThreadsSpawned', ctypes.c_ulonglong),
+                ('MmapBytes', ctypes.c_ulonglong),
+                ('MajorFaults', ctypes.c_ulonglong),
+                ('Open', _ArchiveStatsHistogram),
+                ('Extract', _ArchiveStatsHistogram),
+                ('IterateItems', _ArchiveStatsHistogram),
+                ('FailureCount', ctypes.c_uint),
+                ('Failures', _ArchiveStatsFailure * ARCHIVE_STATS_MAX_FAILURES),
+                ('OtherFailures', ctypes.c_ulonglong)]
+
+# void ArchiveItemCallback(void* pUser, uint32_t ui32ItemIndex, HRESULT hrError, const wchar_t* wszError, const uint8_t* pBuf, uint64_t ui64Size)
+_ArchiveItemCallback = ctypes.CFUNCTYPE(None, ctypes.c_void_p, ctypes.c_uint, ctypes.c_int, ctypes.c_wchar_p, ctypes.c_void_p, ctypes.c_ulonglong)
+
+# Record types are created once, creating a namedtuple class per item dominated listing time
+ArchiveItem = namedtuple('ArchiveItem', ['Index', 'Path', 'IsDir', 'Size', 'MTime'])
+ArchiveItemEx = namedtuple('ArchiveItemEx', ArchiveItem._fields + tuple(field for field, _ in _ARCHIVE_ITEM_EX_PROPERTIES))
+
+class LazyArchiveItem():
+    # ArchiveItem whose Path is decoded from the shared UTF-8 path pool on first access
+    __slots__ = ('Index', 'IsDir', 'Size', 'MTime', '_pool', '_start', '_end', '_path')
+
+    def __init__(self, index, is_dir, size, mtime, pool, start, end):
+        self.Index = index
+        self.IsDir = is_dir
+        self.Size = size
+        self.MTime = mtime
+        self._pool = pool
+        self._start = start
+        self._end = end
+        self._path = None
+
+    @property
+    def Path(self):
+        if self._path is None:
+            self._path = self._pool[self._start:self._end].decode('utf-8')
+        return self._path
+
+    def __repr__(self):
+        return 'LazyArchiveItem(Index={}, Path={!r}, IsDir={}, Size={}, MTime={})'.format(self.Index, self.Path, self.IsDir, self.Size, self.MTime)
+
 def _GetDict(st):
-    d = dict((field, getattr(st, field)) for field, _ in st._fields_ if not field.startswith('_'))
-    ArchiveItem = namedtuple('ArchiveItem', d)
-    return ArchiveItem(**d)
+    return ArchiveItem(st.Index, st.Path, st.IsDir, st.Size, st.MTime)
+
+def _GetUtf8Dict(st):
+    return ArchiveItem(st.Index, st.Path.decode('utf-8') if st.Path is not None else None, st.IsDir, st.Size, st.MTime)
+
+def _EncodeUtf8(s):
+    return s.encode('utf-8') if s is not None else None
+
+# File names go out in the file system encoding so undecodable bytes (surrogateescape) survive
+def _EncodePath(path):
+    return os.fsencode(path) if path is not None else None
+
+def _GetStatsDict(st):
+    stats = {field: getattr(st, field) for field, field_type in _ArchiveStats._fields_ if field_type is ctypes.c_ulonglong}
+    for field in ('Open', 'Extract', 'IterateItems'):
+        h = getattr(st, field)
+        stats[field] = {'Count': h.Count, 'TotalNs': h.TotalNs, 'MaxNs': h.MaxNs, 'Buckets': list(h.Buckets)}
+    # HRESULTs as the unsigned values the E_* constants use
+    stats['Failures'] = {st.Failures[i].Error & 0xffffffff: st.Failures[i].Count for i in range(st.FailureCount)}
+    return stats
 
 def _GetNamedTuple(struct):
     rtn = collections.namedtuple()
 
+class ArchiveItemReader(io.RawIOBase):
+    # Decodes one item on a native thread into a bounded buffer while it is read. The reader owns a
+    # clone of the archive, so the TitanArchive it came from stays usable.
+
+    def __init__(self, archive, index, password = None, buffer_size = 0):
+        self._index = index
+        self._password = password
+        self._buffer_size = buffer_size
+        self._pos = 0
+        self._archive = None
+        self._archive = archive.Clone()
+        try:
+            self._size = self._archive.GetArchiveItemSize(index)
+            self._OpenStream()
+        except:
+            self.close()
+            raise
+
+    def _OpenStream(self):
+        if lib.OpenArchiveItemStream(self._archive._ctx, ctypes.c_uint(self._index), ctypes.c_wchar_p(self._password), ctypes.c_ulonglong(self._buffer_size)) != ARCHIVER_STATUS_SUCCESS:
+            raise TitanArchiveException(*self._archive.GetError())
+        self._pos = 0
+
+    def readable(self):
+        return True
+
+    def seekable(self):
+        return True
+
+    def readinto(self, b):
+        if self.closed:
+            raise ValueError('I/O operation on closed file')
+        view = memoryview(b).cast('B')
+        if view.nbytes == 0:
+            return 0
+        read = ctypes.c_ulonglong()
+        if lib.ReadArchiveItemStream(self._archive._ctx, (ctypes.c_char * view.nbytes).from_buffer(view), ctypes.c_ulonglong(view.nbytes), ctypes.byref(read)) != ARCHIVER_STATUS_SUCCESS:
+            raise TitanArchiveException(*self._archive.GetError())
+        self._pos += read.value
+        return read.value
+
+    def seek(self, offset, whence = io.SEEK_SET):
+        if self.closed:
+            raise ValueError('I/O operation on closed file')
+        if whence == io.SEEK_CUR:
+            offset += self._pos
+        elif whence == io.SEEK_END:
+            offset += self._size
+        elif whence != io.SEEK_SET:
+            raise ValueError('Invalid whence ({})'.format(whence))
+        if offset < 0:
+            raise ValueError('Negative seek position {}'.format(offset))
+        # The item can only be decoded forward, going back restarts it from the beginning
+        if offset < self._pos:
+            self._OpenStream()
+        skip = bytearray(min(offset - self._pos, 1 << 16))
+        while self._pos < offset:
+            if self.readinto(memoryview(skip)[:offset - self._pos]) == 0:
+                break
+        return self._pos
+
+    def tell(self):
+        return self._pos
+
+    def close(self):
+        if self._archive is not None:
+            lib.CloseArchiveItemStream(self._archive._ctx)
+            self._archive._DeleteArchiveContext()
+            self._archive = None
+        super().close()
+
 class TitanArchive():
 
     def __del__(self):
         self._DeleteArchiveContext()
 
-    def __init__(self, archive, password = None, archive_format = None):
+    def __init__(self, archive, password = None, archive_format = None, trial_formats = None, trial_read_budget = 0, cache = False, index_path = None):
         self.archive = archive
         self.password = password
         self.archive_format = archive_format
+        self._view = None
         self._ctx = ctypes.c_void_p(lib.CreateArchiveContext())
         
         if self._ctx.value == ctypes.c_void_p(0).value:
             raise TitanArchiveException(*GetGlobalError())
+        if trial_formats is not None:
+            self.SetTrialOpenFormats(trial_formats, trial_read_budget)
+        if cache:
+            self.AttachArchiveCache()
         if isinstance(self.archive, int):
             self.OpenArchiveFD(self.archive, self.password, self.archive_format)
         elif isinstance(self.archive, str):
-            self.OpenArchiveDisk(self.archive, self.password, self.archive_format)
+            if index_path is not None:
+                self.OpenArchiveDiskIndexed(self.archive, index_path, self.password, self.archive_format)
+            else:
+                self.OpenArchiveDisk(self.archive, self.password, self.archive_format)
         else:
             self.OpenArchiveMemory(self.archive, self.password, self.archive_format)
 
@@ -102,16 +320,51 @@ class TitanArchive():
         self._DeleteArchiveContext()
 
     def __iter__(self):
-        for i in range(0, self.GetArchiveItemCount()):
-            yield self.GetArchiveItemPropertiesByIndex(i)
+        return self.IterArchiveItems()
+
+    def IterArchiveItems(self, lazy_paths = False):
+        # Metadata of every item comes from a single GetArchiveItemTable call. With lazy_paths the
+        # items share one copy of the UTF-8 path pool and decode their path when it is first read.
+        table = ctypes.POINTER(_ArchiveItemTable)()
+        if lib.GetArchiveItemTable(self._ctx, ctypes.c_uint(ARCHIVE_TABLE_COLUMN_ALL | ARCHIVE_TABLE_PATH_UTF8), ctypes.byref(table)) != ARCHIVER_STATUS_SUCCESS:
+            raise TitanArchiveException(*self.GetError())
+        try:
+            t = table.contents
+            count = t.ItemCount
+            indices = t.Indices[:count]
+            is_dir = map(bool, ctypes.string_at(t.IsDir, count)) if count else []
+            sizes = t.Sizes[:count]
+            mtimes = t.MTimes[:count]
+            offsets = t.PathOffsets[:count + 1]
+            pool = ctypes.string_at(t.PathPool, offsets[count]) if count else b''
+        finally:
+            lib.FreeArchiveItemTable(self._ctx, table)
+        if lazy_paths:
+            # Each path ends at the NUL before the next offset
+            return map(LazyArchiveItem, indices, is_dir, sizes, mtimes, itertools.repeat(pool), offsets, [end - 1 for end in offsets[1:]])
+        return map(ArchiveItem, indices, pool.decode('utf-8').split('\0')[:count], is_dir, sizes, mtimes)
 
     def OpenArchiveMemory(self, buf, password = None, archive_format = None):
-        size = len(buf)
-        if lib.OpenArchiveMemory(self._ctx, buf, ctypes.c_ulonglong(size), ctypes.c_wchar_p(password), ctypes.c_wchar_p(archive_format)) != ARCHIVER_STATUS_SUCCESS:
+        # Any contiguous buffer protocol object is read in place, the view keeps it alive while the archive is open
+        if _native is not None:
+            view = _native.open_memory(self._ctx.value, buf, password, archive_format)
+            if view is None:
+                raise TitanArchiveException(*self.GetError())
+            self._view = view
+            return
+        if not isinstance(buf, bytes):
+            view = memoryview(buf).cast('B')
+            buf = bytes(view) if view.readonly else (ctypes.c_char * view.nbytes).from_buffer(view)
+        if lib.OpenArchiveMemory(self._ctx, buf, ctypes.c_ulonglong(len(buf)), ctypes.c_wchar_p(password), ctypes.c_wchar_p(archive_format)) != ARCHIVER_STATUS_SUCCESS:
             raise TitanArchiveException(*self.GetError())
+        self._view = buf
 
     def OpenArchiveDisk(self, path, password = None, archive_format = None):
-        if lib.OpenArchiveDisk(self._ctx, ctypes.c_wchar_p(path), ctypes.c_wchar_p(password), ctypes.c_wchar_p(archive_format)) != ARCHIVER_STATUS_SUCCESS:
+        if lib.OpenArchiveDiskUtf8(self._ctx, _EncodePath(path), _EncodeUtf8(password), _EncodeUtf8(archive_format)) != ARCHIVER_STATUS_SUCCESS:
+            raise TitanArchiveException(*self.GetError())
+
+    def OpenArchiveDiskIndexed(self, path, index_path, password = None, archive_format = None):
+        if lib.OpenArchiveDiskIndexed(self._ctx, ctypes.c_wchar_p(path), ctypes.c_wchar_p(index_path), ctypes.c_wchar_p(password), ctypes.c_wchar_p(archive_format)) != ARCHIVER_STATUS_SUCCESS:
             raise TitanArchiveException(*self.GetError())
 
     def OpenArchiveFD(self, fd, password = None, archive_format = None):
@@ -136,58 +389,234 @@ class TitanArchive():
 
     def ListDirectory(self, path = ''):
         rtn = []
-        ai = ctypes.POINTER(_ArchiveItem)()
+        ai = ctypes.POINTER(_ArchiveItemUtf8)()
+        count = ctypes.c_ulonglong()
+        if lib.ListDirectoryUtf8(self._ctx, _EncodeUtf8(path), ctypes.byref(ai), ctypes.byref(count)) != ARCHIVER_STATUS_SUCCESS:
+            raise TitanArchiveException(*self.GetError())
+        cur = ai
+        for i in range(0, count.value):
+            cur = cur.contents
+            rtn.append(_GetUtf8Dict(cur))
+            cur = ctypes.cast(cur._ItemNext, ctypes.POINTER(_ArchiveItemUtf8))
+        self._FreeArchiveItemUtf8(ai)
+        return rtn
+
+    def WalkArchive(self, root = ''):
+        rtn = []
+        ai = ctypes.POINTER(_ArchiveItemUtf8)()
         count = ctypes.c_ulonglong()
-        if lib.ListDirectory(self._ctx, ctypes.c_wchar_p(path), ctypes.byref(ai), ctypes.byref(count)) != ARCHIVER_STATUS_SUCCESS:
+        if lib.WalkArchiveUtf8(self._ctx, _EncodeUtf8(root), ctypes.byref(ai), ctypes.byref(count)) != ARCHIVER_STATUS_SUCCESS:
             raise TitanArchiveException(*self.GetError())
         cur = ai
         for i in range(0, count.value):
             cur = cur.contents
-            rtn.append(_GetDict(cur))
-            cur = ctypes.cast(cur._ItemNext, ctypes.POINTER(_ArchiveItem))
-        self._FreeArchiveItem(ai)
+            rtn.append(_GetUtf8Dict(cur))
+            cur = ctypes.cast(cur._ItemNext, ctypes.POINTER(_ArchiveItemUtf8))
+        self._FreeArchiveItemUtf8(ai)
         return rtn
 
     def GetArchiveItemPropertiesByPath(self, path):
-        ai = ctypes.POINTER(_ArchiveItem)()
-        if lib.GetArchiveItemPropertiesByPath(self._ctx, ctypes.c_wchar_p(path), ctypes.byref(ai)) != ARCHIVER_STATUS_SUCCESS:
+        ai = ctypes.POINTER(_ArchiveItemUtf8)()
+        if lib.GetArchiveItemPropertiesByPathUtf8(self._ctx, _EncodeUtf8(path), ctypes.byref(ai)) != ARCHIVER_STATUS_SUCCESS:
             raise TitanArchiveException(*self.GetError())
-        ai = ai.contents
-        rtn = _GetDict(ai)
-        self._FreeArchiveItem(ai)
+        rtn = _GetUtf8Dict(ai.contents)
+        self._FreeArchiveItemUtf8(ai)
         return rtn
 
     def GetArchiveItemPropertiesByIndex(self, index):
-        ai = ctypes.POINTER(_ArchiveItem)()
-        if lib.GetArchiveItemPropertiesByIndex(self._ctx, ctypes.c_uint(index), ctypes.byref(ai)) != ARCHIVER_STATUS_SUCCESS:
+        ai = ctypes.POINTER(_ArchiveItemUtf8)()
+        if lib.GetArchiveItemPropertiesByIndexUtf8(self._ctx, ctypes.c_uint(index), ctypes.byref(ai)) != ARCHIVER_STATUS_SUCCESS:
             raise TitanArchiveException(*self.GetError())
-        ai = ai.contents
-        rtn = _GetDict(ai)
-        self._FreeArchiveItem(ai)
+        rtn = _GetUtf8Dict(ai.contents)
+        self._FreeArchiveItemUtf8(ai)
         return rtn
 
-    def ExtractArchiveItemToBufferByIndex(self, index, password = None):
-        size = self.GetArchiveItemPropertiesByIndex(index).Size
-        rtn = BytesIO(bytearray(size))
-        if size and lib.ExtractArchiveItemToBufferByIndex(self._ctx, ctypes.c_uint(index), rtn.getvalue(), ctypes.c_ulonglong(size), ctypes.c_wchar_p(password)) != ARCHIVER_STATUS_SUCCESS:
+    def GetArchiveItemSize(self, index):
+        size = ctypes.c_ulonglong()
+        if lib.GetArchiveItemSize(self._ctx, ctypes.c_uint(index), ctypes.byref(size)) != ARCHIVER_STATUS_SUCCESS:
             raise TitanArchiveException(*self.GetError())
+        return size.value
+
+    def GetArchiveItemPropertiesEx(self, index, properties = ARCHIVE_ITEM_PROPERTY_ALL):
+        aie = ctypes.POINTER(_ArchiveItemEx)()
+        if lib.GetArchiveItemPropertiesEx(self._ctx, ctypes.c_uint(index), ctypes.c_uint(properties), ctypes.byref(aie)) != ARCHIVER_STATUS_SUCCESS:
+            raise TitanArchiveException(*self.GetError())
+        try:
+            e = aie.contents
+            # Properties that were not requested or that the format does not have are None
+            return ArchiveItemEx(*_GetDict(e.Item), *[getattr(e, field) if e._Properties & prop else None for field, prop in _ARCHIVE_ITEM_EX_PROPERTIES])
+        finally:
+            lib.FreeArchiveItemEx(self._ctx, aie)
+
+    def FindArchiveItems(self, pattern, kind = ARCHIVE_FIND_GLOB):
+        indices = ctypes.POINTER(ctypes.c_uint)()
+        count = ctypes.c_uint()
+        if lib.FindArchiveItems(self._ctx, ctypes.c_wchar_p(pattern), ctypes.c_uint(kind), ctypes.byref(indices), ctypes.byref(count)) != ARCHIVER_STATUS_SUCCESS:
+            raise TitanArchiveException(*self.GetError())
+        try:
+            rtn = indices[:count.value] if count.value else []
+        finally:
+            lib.FreeArchiveItemIndices(self._ctx, indices)
         return rtn
 
-    def ExtractArchiveItemToBufferByPath(self, path, password = None):
-        size = self.GetArchiveItemPropertiesByPath(path).Size
-        rtn = BytesIO(bytearray(size))
-        if size and lib.ExtractArchiveItemToBufferByPath(self._ctx, ctypes.c_wchar_p(path), ctypes.c_char_p(rtn.getvalue()), ctypes.c_ulonglong(size), ctypes.c_wchar_p(password)) != ARCHIVER_STATUS_SUCCESS:
+    def GetArchiveItemTable(self, columns = ARCHIVE_TABLE_COLUMN_ALL):
+        table = ctypes.POINTER(_ArchiveItemTable)()
+        if lib.GetArchiveItemTable(self._ctx, ctypes.c_uint(columns | ARCHIVE_TABLE_PATH_UTF8), ctypes.byref(table)) != ARCHIVER_STATUS_SUCCESS:
             raise TitanArchiveException(*self.GetError())
+        try:
+            t = table.contents
+            count = t.ItemCount
+            rtn = {}
+            if columns & ARCHIVE_TABLE_COLUMN_INDEX:
+                rtn['Index'] = t.Indices[:count]
+            if columns & ARCHIVE_TABLE_COLUMN_SIZE:
+                rtn['Size'] = t.Sizes[:count]
+            if columns & ARCHIVE_TABLE_COLUMN_MTIME:
+                rtn['MTime'] = t.MTimes[:count]
+            if columns & ARCHIVE_TABLE_COLUMN_ISDIR:
+                rtn['IsDir'] = [bool(is_dir) for is_dir in t.IsDir[:count]]
+            if columns & ARCHIVE_TABLE_COLUMN_PATH:
+                pool = ctypes.string_at(t.PathPool, t.PathOffsets[count]) if count else b''
+                rtn['Path'] = pool.decode('utf-8').split('\0')[:count]
+        finally:
+            lib.FreeArchiveItemTable(self._ctx, table)
         return rtn
 
+    def ExtractArchiveItemToBufferByIndex(self, index, password = None):
+        if _native is not None:
+            data = _native.extract(self._ctx.value, index, password)
+            if data is None:
+                raise TitanArchiveException(*self.GetError())
+            # BytesIO shares the bytes object until it is written to
+            return BytesIO(data)
+        buf = bytearray(self.GetArchiveItemSize(index))
+        return BytesIO(buf[:self.ExtractArchiveItemIntoBufferByIndex(index, buf, password)])
+
+    def ExtractArchiveItemToBufferByPath(self, path, password = None):
+        if _native is not None:
+            data = _native.extract_path(self._ctx.value, path, password)
+            if data is None:
+                raise TitanArchiveException(*self.GetError())
+            return BytesIO(data)
+        return self.ExtractArchiveItemToBufferByIndex(self.GetArchiveItemPropertiesByPath(path).Index, password)
+
+    def ExtractArchiveItemIntoBufferByIndex(self, index, buf, password = None):
+        # Decodes into a writable buffer (bytearray, memoryview, mmap, numpy array, ...), returns the bytes written.
+        # Items larger than the buffer are truncated.
+        if _native is not None:
+            written = _native.extract_into(self._ctx.value, index, buf, password)
+            if written is None:
+                raise TitanArchiveException(*self.GetError())
+            return written
+        view = memoryview(buf).cast('B')
+        if view.nbytes == 0:
+            return 0
+        written = ctypes.c_ulonglong()
+        if lib.ExtractArchiveItemToBufferByIndexEx(self._ctx, ctypes.c_uint(index), (ctypes.c_char * view.nbytes).from_buffer(view), ctypes.c_ulonglong(view.nbytes), ctypes.c_wchar_p(password), ctypes.byref(written)) != ARCHIVER_STATUS_SUCCESS:
+            raise TitanArchiveException(*self.GetError())
+        return written.value
+
+    def ExtractArchiveItemIntoBufferByPath(self, path, buf, password = None):
+        if _native is not None:
+            written = _native.extract_path_into(self._ctx.value, path, buf, password)
+            if written is None:
+                raise TitanArchiveException(*self.GetError())
+            return written
+        return self.ExtractArchiveItemIntoBufferByIndex(self.GetArchiveItemPropertiesByPath(path).Index, buf, password)
+
+    def extract_many(self, indices, max_workers = 0, password = None):
+        # Returns a concurrent.futures.Future per index, each resolving to a BytesIO. Items are extracted
+        # on the native pool from clones of this context, a single Python thread waits for the batch.
+        # max_workers of 0 uses the pool size.
+        indices = list(indices)
+        futures = [concurrent.futures.Future() for _ in indices]
+        if not indices:
+            return futures
+        pending = {}
+        for index, future in zip(indices, futures):
+            future.set_running_or_notify_cancel()
+            pending.setdefault(index, []).append(future)
+        batch = self.Clone()
+
+        def on_item(user, index, hr, err, buf, size):
+            future = pending[index].pop(0)
+            if err is None:
+                future.set_result(BytesIO(ctypes.string_at(buf, size) if size else b''))
+            else:
+                future.set_exception(TitanArchiveException(hr, err))
+
+        def run(callback):
+            try:
+                if lib.ExtractArchiveItems(batch._ctx, (ctypes.c_uint * len(indices))(*indices), ctypes.c_uint(len(indices)), ctypes.c_uint(max_workers), ctypes.c_wchar_p(password), callback, None) != ARCHIVER_STATUS_SUCCESS:
+                    error = batch.GetError()
+                else:
+                    error = (E_FAIL, 'Item was not extracted')
+            finally:
+                batch._DeleteArchiveContext()
+            for remaining in pending.values():
+                for future in remaining:
+                    future.set_exception(TitanArchiveException(*error))
+
+        threading.Thread(target = run, args = (_ArchiveItemCallback(on_item),), daemon = True).start()
+        return futures
+
+    async def aextract(self, indices, max_workers = 0, password = None):
+        # Awaitable extract_many, an int gives a single BytesIO and an iterable a list in the same order
+        if isinstance(indices, int):
+            return (await self.aextract([indices], 1, password))[0]
+        return await asyncio.gather(*[asyncio.wrap_future(future) for future in self.extract_many(indices, max_workers, password)])
+
+    def open(self, item, password = None, buffer_size = io.DEFAULT_BUFFER_SIZE, read_ahead = 0):
+        # File object over an item given by path or index, decoded incrementally as it is read.
+        # read_ahead bounds the decoded bytes buffered natively, 0 uses the library default.
+        if not isinstance(item, int):
+            item = self.GetArchiveItemPropertiesByPath(item).Index
+        return io.BufferedReader(ArchiveItemReader(self, item, password, read_ahead), buffer_size)
+
     def CloseArchive(self):
         if lib.CloseArchive(self._ctx) != ARCHIVER_STATUS_SUCCESS:
             raise TitanArchiveException(*self.GetError())
 
+    def Reset(self):
+        # Closes the archive and clears every setting, the context can then open another archive
+        if lib.ResetArchiveContext(self._ctx) != ARCHIVER_STATUS_SUCCESS:
+            raise TitanArchiveException(*self.GetError())
+
+    def Clone(self):
+        ctx = ctypes.c_void_p(lib.CloneArchiveContext(self._ctx))
+        if ctx.value == ctypes.c_void_p(0).value:
+            raise TitanArchiveException(*self.GetError())
+        clone = TitanArchive.__new__(TitanArchive)
+        # Keeps a memory buffer alive for as long as the clone references it
+        clone.archive = self.archive
+        clone.password = self.password
+        clone.archive_format = self.archive_format
+        clone._view = self._view
+        clone._ctx = ctx
+        return clone
+
+    def SaveArchiveIndex(self, index_path):
+        if lib.SaveArchiveIndex(self._ctx, ctypes.c_wchar_p(index_path)) != ARCHIVER_STATUS_SUCCESS:
+            raise TitanArchiveException(*self.GetError())
+
+    def SetTrialOpenFormats(self, formats, header_read_budget = 0):
+        if not isinstance(formats, str):
+            formats = ','.join(formats)
+        if lib.SetTrialOpenFormats(self._ctx, ctypes.c_wchar_p(formats), ctypes.c_ulonglong(header_read_budget)) != ARCHIVER_STATUS_SUCCESS:
+            raise TitanArchiveException(*self.GetError())
+
+    def AttachArchiveCache(self, attach = True):
+        if lib.AttachArchiveCache(self._ctx, ctypes.c_uint(1 if attach else 0)) != ARCHIVER_STATUS_SUCCESS:
+            raise TitanArchiveException(*self.GetError())
+
     def _FreeArchiveItem(self, ai):
         if lib.FreeArchiveItem(self._ctx, ai) != ARCHIVER_STATUS_SUCCESS:
             raise TitanArchiveException(*self.GetError())
 
+    def _FreeArchiveItemUtf8(self, ai):
+        if lib.FreeArchiveItemUtf8(self._ctx, ai) != ARCHIVER_STATUS_SUCCESS:
+            raise TitanArchiveException(*self.GetError())
+
     def _DeleteArchiveContext(self):
         if self._ctx.value != ctypes.c_void_p(0).value:
             if lib.DeleteArchiveContext(self._ctx) != ARCHIVER_STATUS_SUCCESS:
@@ -195,6 +624,16 @@ class TitanArchive():
             else:
                 self._ctx = ctypes.c_void_p(0)
 
+    def GetStats(self):
+        st = _ArchiveStats()
+        if lib.GetArchiveStats(self._ctx, ctypes.byref(st)) != ARCHIVER_STATUS_SUCCESS:
+            raise TitanArchiveException(*self.GetError())
+        return _GetStatsDict(st)
+
+    def ResetStats(self):
+        if lib.ResetArchiveStats(self._ctx) != ARCHIVER_STATUS_SUCCESS:
+            raise TitanArchiveException(*self.GetError())
+
     def GetError(self):
         hr = ctypes.c_int()
         err = ctypes.c_wchar_p()
@@ -226,6 +665,32 @@ def GlobalGetSupportedArchiveFormats():
 def GlobalUninitialize():
     lib.GlobalUninitialize()
 
+def GlobalConfigureArchiveCache(memory_budget):
+    lib.GlobalConfigureArchiveCache(ctypes.c_ulonglong(memory_budget))
+
+def GlobalFlushArchiveCache():
+    lib.GlobalFlushArchiveCache()
+
+def GlobalSetConcurrency(threads = 0, affinity_mask = 0):
+    if lib.GlobalSetConcurrency(ctypes.c_uint(threads), ctypes.c_ulonglong(affinity_mask)) != ARCHIVER_STATUS_SUCCESS:
+        raise TitanArchiveException(*GetGlobalError())
+
+def GlobalGetStats():
+    st = _ArchiveStats()
+    if lib.GlobalGetStats(ctypes.byref(st)) != ARCHIVER_STATUS_SUCCESS:
+        raise TitanArchiveException(E_FAIL, 'Unable to get stats')
+    return _GetStatsDict(st)
+
+def GlobalResetStats():
+    lib.GlobalResetStats()
+
+def GlobalStartTrace(path):
+    if lib.GlobalStartTrace(path) != ARCHIVER_STATUS_SUCCESS:
+        raise TitanArchiveException(*GetGlobalError())
+
+def GlobalStopTrace():
+    lib.GlobalStopTrace()
+
 lib = ctypes.CDLL(TITAN_ARCHIVE_MODULE)
 
 # ARCHIVER_STATUS GlobalInitialize(const wchar_t* wszLibPath)
@@ -243,6 +708,30 @@ lib.GlobalGetSupportedArchiveFormats.restype = ctypes.c_uint
 # void GlobalUninitialize()
 lib.GlobalUninitialize.argtypes = []
 
+# void GlobalConfigureArchiveCache(uint64_t ui64MemoryBudget)
+lib.GlobalConfigureArchiveCache.argtypes = [ctypes.c_ulonglong]
+
+# void GlobalFlushArchiveCache()
+lib.GlobalFlushArchiveCache.argtypes = []
+
+# ARCHIVER_STATUS GlobalSetConcurrency(uint32_t ui32ThreadCount, uint64_t ui64AffinityMask)
+lib.GlobalSetConcurrency.argtypes = [ctypes.c_uint, ctypes.c_ulonglong]
+lib.GlobalSetConcurrency.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS GlobalGetStats(ArchiveStats* pStats)
+lib.GlobalGetStats.argtypes = [ctypes.POINTER(_ArchiveStats)]
+lib.GlobalGetStats.restype = ctypes.c_uint
+
+# void GlobalResetStats()
+lib.GlobalResetStats.argtypes = []
+
+# ARCHIVER_STATUS GlobalStartTrace(const wchar_t* wszPath)
+lib.GlobalStartTrace.argtypes = [ctypes.c_wchar_p]
+lib.GlobalStartTrace.restype = ctypes.c_uint
+
+# void GlobalStopTrace()
+lib.GlobalStopTrace.argtypes = []
+
 # void* CreateArchiveContext()
 lib.CreateArchiveContext.restype = ctypes.c_void_p
 
@@ -254,6 +743,10 @@ lib.OpenArchiveMemory.restype = ctypes.c_uint
 lib.OpenArchiveDisk.argtypes = [ctypes.c_void_p, ctypes.c_wchar_p, ctypes.c_wchar_p, ctypes.c_wchar_p]
 lib.OpenArchiveDisk.restype = ctypes.c_uint
 
+# ARCHIVER_STATUS OpenArchiveDiskIndexed(void* pCtx, const wchar_t* wszPath, const wchar_t* wszIndexPath, const wchar_t* wszPassword, const wchar_t* wszFormat)
+lib.OpenArchiveDiskIndexed.argtypes = [ctypes.c_void_p, ctypes.c_wchar_p, ctypes.c_wchar_p, ctypes.c_wchar_p, ctypes.c_wchar_p]
+lib.OpenArchiveDiskIndexed.restype = ctypes.c_uint
+
 if os.name == 'nt':
     # ARCHIVER_STATUS OpenArchiveHandle(void* pCtx, HANDLE hArchive, const wchar_t* wszPassword, const wchar_t* wszFormat)
     lib.OpenArchiveHandle.argtypes = [ctypes.c_void_p, wintypes.HANDLE, ctypes.c_wchar_p, ctypes.c_wchar_p]
@@ -275,6 +768,10 @@ lib.GetArchiveItemCount.restype = ctypes.c_uint
 lib.ListDirectory.argtypes = [ctypes.c_void_p, ctypes.c_wchar_p, ctypes.POINTER(ctypes.POINTER(_ArchiveItem)), ctypes.POINTER(ctypes.c_ulonglong)]
 lib.ListDirectory.restype = ctypes.c_uint
 
+# ARCHIVER_STATUS WalkArchive(void* pCtx, const wchar_t* wszRoot, ArchiveItem** ppItems, uint64_t* pItemCount)
+lib.WalkArchive.argtypes = [ctypes.c_void_p, ctypes.c_wchar_p, ctypes.POINTER(ctypes.POINTER(_ArchiveItem)), ctypes.POINTER(ctypes.c_ulonglong)]
+lib.WalkArchive.restype = ctypes.c_uint
+
 # ARCHIVER_STATUS GetArchiveItemPropertiesByPath(void* pCtx, const wchar_t* wszPath, ArchiveItem** ppItem)
 lib.GetArchiveItemPropertiesByPath.argtypes = [ctypes.c_void_p, ctypes.c_wchar_p, ctypes.POINTER(ctypes.POINTER(_ArchiveItem))]
 lib.GetArchiveItemPropertiesByPath.restype = ctypes.c_uint
@@ -283,10 +780,38 @@ lib.GetArchiveItemPropertiesByPath.restype = ctypes.c_uint
 lib.GetArchiveItemPropertiesByIndex.argtypes = [ctypes.c_void_p, ctypes.c_uint, ctypes.POINTER(ctypes.POINTER(_ArchiveItem))]
 lib.GetArchiveItemPropertiesByIndex.restype = ctypes.c_uint
 
+# ARCHIVER_STATUS GetArchiveItemSize(void* pCtx, uint32_t ui32ItemIndex, uint64_t* pui64Size)
+lib.GetArchiveItemSize.argtypes = [ctypes.c_void_p, ctypes.c_uint, ctypes.POINTER(ctypes.c_ulonglong)]
+lib.GetArchiveItemSize.restype = ctypes.c_uint
+
 # ARCHIVER_STATUS FreeArchiveItem(void* pCtx, ArchiveItem* pItem)
 lib.FreeArchiveItem.argtypes = [ctypes.c_void_p, ctypes.POINTER(_ArchiveItem)]
 lib.FreeArchiveItem.restype = ctypes.c_uint
 
+# ARCHIVER_STATUS GetArchiveItemPropertiesEx(void* pCtx, uint32_t ui32ItemIndex, uint32_t ui32Properties, ArchiveItemEx** ppItem)
+lib.GetArchiveItemPropertiesEx.argtypes = [ctypes.c_void_p, ctypes.c_uint, ctypes.c_uint, ctypes.POINTER(ctypes.POINTER(_ArchiveItemEx))]
+lib.GetArchiveItemPropertiesEx.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS FreeArchiveItemEx(void* pCtx, ArchiveItemEx* pItem)
+lib.FreeArchiveItemEx.argtypes = [ctypes.c_void_p, ctypes.POINTER(_ArchiveItemEx)]
+lib.FreeArchiveItemEx.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS FindArchiveItems(void* pCtx, const wchar_t* wszPattern, uint32_t ui32Kind, uint32_t** ppIndices, uint32_t* pui32Count)
+lib.FindArchiveItems.argtypes = [ctypes.c_void_p, ctypes.c_wchar_p, ctypes.c_uint, ctypes.POINTER(ctypes.POINTER(ctypes.c_uint)), ctypes.POINTER(ctypes.c_uint)]
+lib.FindArchiveItems.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS FreeArchiveItemIndices(void* pCtx, uint32_t* pIndices)
+lib.FreeArchiveItemIndices.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_uint)]
+lib.FreeArchiveItemIndices.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS GetArchiveItemTable(void* pCtx, uint32_t ui32Columns, ArchiveItemTable** ppTable)
+lib.GetArchiveItemTable.argtypes = [ctypes.c_void_p, ctypes.c_uint, ctypes.POINTER(ctypes.POINTER(_ArchiveItemTable))]
+lib.GetArchiveItemTable.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS FreeArchiveItemTable(void* pCtx, ArchiveItemTable* pTable)
+lib.FreeArchiveItemTable.argtypes = [ctypes.c_void_p, ctypes.POINTER(_ArchiveItemTable)]
+lib.FreeArchiveItemTable.restype = ctypes.c_uint
+
 # ARCHIVER_STATUS ExtractArchiveItemToBufferByIndex(void* pCtx, uint32_t ui32ItemIndex, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword)
 lib.ExtractArchiveItemToBufferByIndex.argtypes = [ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p, ctypes.c_ulonglong, ctypes.c_wchar_p]
 lib.ExtractArchiveItemToBufferByIndex.restype = ctypes.c_uint
@@ -295,10 +820,78 @@ lib.ExtractArchiveItemToBufferByIndex.restype = ctypes.c_uint
 lib.ExtractArchiveItemToBufferByPath.argtypes = [ctypes.c_void_p, ctypes.c_wchar_p, ctypes.c_void_p, ctypes.c_ulonglong, ctypes.c_wchar_p]
 lib.ExtractArchiveItemToBufferByPath.restype = ctypes.c_uint
 
+# ARCHIVER_STATUS ExtractArchiveItemToBufferByIndexEx(void* pCtx, uint32_t ui32ItemIndex, uint8_t* pBuf, uint64_t ui64BufSize, const wchar_t* wszPassword, uint64_t* pui64Written)
+lib.ExtractArchiveItemToBufferByIndexEx.argtypes = [ctypes.c_void_p, ctypes.c_uint, ctypes.c_void_p, ctypes.c_ulonglong, ctypes.c_wchar_p, ctypes.POINTER(ctypes.c_ulonglong)]
+lib.ExtractArchiveItemToBufferByIndexEx.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS ExtractArchiveItems(void* pCtx, const uint32_t* pIndices, uint32_t ui32Count, uint32_t ui32MaxWorkers, const wchar_t* wszPassword, ArchiveItemCallback pCallback, void* pUser)
+lib.ExtractArchiveItems.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_uint), ctypes.c_uint, ctypes.c_uint, ctypes.c_wchar_p, _ArchiveItemCallback, ctypes.c_void_p]
+lib.ExtractArchiveItems.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS OpenArchiveItemStream(void* pCtx, uint32_t ui32ItemIndex, const wchar_t* wszPassword, uint64_t ui64BufferSize)
+lib.OpenArchiveItemStream.argtypes = [ctypes.c_void_p, ctypes.c_uint, ctypes.c_wchar_p, ctypes.c_ulonglong]
+lib.OpenArchiveItemStream.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS ReadArchiveItemStream(void* pCtx, uint8_t* pBuf, uint64_t ui64BufSize, uint64_t* pui64Read)
+lib.ReadArchiveItemStream.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_ulonglong, ctypes.POINTER(ctypes.c_ulonglong)]
+lib.ReadArchiveItemStream.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS CloseArchiveItemStream(void* pCtx)
+lib.CloseArchiveItemStream.argtypes = [ctypes.c_void_p]
+lib.CloseArchiveItemStream.restype = ctypes.c_uint
+
 # ARCHIVER_STATUS CloseArchive(void* pCtx)
 lib.CloseArchive.argtypes = [ctypes.c_void_p]
 lib.CloseArchive.restype = ctypes.c_uint
 
+# ARCHIVER_STATUS ResetArchiveContext(void* pCtx)
+lib.ResetArchiveContext.argtypes = [ctypes.c_void_p]
+lib.ResetArchiveContext.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS SaveArchiveIndex(void* pCtx, const wchar_t* wszIndexPath)
+lib.SaveArchiveIndex.argtypes = [ctypes.c_void_p, ctypes.c_wchar_p]
+lib.SaveArchiveIndex.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS SetTrialOpenFormats(void* pCtx, const wchar_t* wszFormats, uint64_t ui64HeaderReadBudget)
+lib.SetTrialOpenFormats.argtypes = [ctypes.c_void_p, ctypes.c_wchar_p, ctypes.c_ulonglong]
+lib.SetTrialOpenFormats.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS AttachArchiveCache(void* pCtx, uint32_t ui32Attach)
+lib.AttachArchiveCache.argtypes = [ctypes.c_void_p, ctypes.c_uint]
+lib.AttachArchiveCache.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS OpenArchiveDiskUtf8(void* pCtx, const char* szPath, const char* szPassword, const char* szFormat)
+lib.OpenArchiveDiskUtf8.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p]
+lib.OpenArchiveDiskUtf8.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS ListDirectoryUtf8(void* pCtx, const char* szPath, ArchiveItemUtf8** ppItems, uint64_t* pItemCount)
+lib.ListDirectoryUtf8.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.POINTER(ctypes.POINTER(_ArchiveItemUtf8)), ctypes.POINTER(ctypes.c_ulonglong)]
+lib.ListDirectoryUtf8.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS WalkArchiveUtf8(void* pCtx, const char* szRoot, ArchiveItemUtf8** ppItems, uint64_t* pItemCount)
+lib.WalkArchiveUtf8.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.POINTER(ctypes.POINTER(_ArchiveItemUtf8)), ctypes.POINTER(ctypes.c_ulonglong)]
+lib.WalkArchiveUtf8.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS GetArchiveItemPropertiesByPathUtf8(void* pCtx, const char* szPath, ArchiveItemUtf8** ppItem)
+lib.GetArchiveItemPropertiesByPathUtf8.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.POINTER(ctypes.POINTER(_ArchiveItemUtf8))]
+lib.GetArchiveItemPropertiesByPathUtf8.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS GetArchiveItemPropertiesByIndexUtf8(void* pCtx, uint32_t ui32ItemIndex, ArchiveItemUtf8** ppItem)
+lib.GetArchiveItemPropertiesByIndexUtf8.argtypes = [ctypes.c_void_p, ctypes.c_uint, ctypes.POINTER(ctypes.POINTER(_ArchiveItemUtf8))]
+lib.GetArchiveItemPropertiesByIndexUtf8.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS FreeArchiveItemUtf8(void* pCtx, ArchiveItemUtf8* pItem)
+lib.FreeArchiveItemUtf8.argtypes = [ctypes.c_void_p, ctypes.POINTER(_ArchiveItemUtf8)]
+lib.FreeArchiveItemUtf8.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS ExtractArchiveItemToBufferByPathUtf8(void* pCtx, const char* szPath, uint8_t* pBuf, uint64_t ui64BufSize, const char* szPassword)
+lib.ExtractArchiveItemToBufferByPathUtf8.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_void_p, ctypes.c_ulonglong, ctypes.c_char_p]
+lib.ExtractArchiveItemToBufferByPathUtf8.restype = ctypes.c_uint
+
+# void* CloneArchiveContext(void* pCtx)
+lib.CloneArchiveContext.argtypes = [ctypes.c_void_p]
+lib.CloneArchiveContext.restype = ctypes.c_void_p
+
 # ARCHIVER_STATUS DeleteArchiveContext(void* pCtx)
 lib.DeleteArchiveContext.argtypes = [ctypes.c_void_p]
 lib.DeleteArchiveContext.restype = ctypes.c_uint
@@ -307,4 +900,19 @@ lib.DeleteArchiveContext.restype = ctypes.c_uint
 lib.GetError.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_wchar_p)]
 lib.GetError.restype = ctypes.c_uint
 
+# ARCHIVER_STATUS GetArchiveStats(void* pCtx, ArchiveStats* pStats)
+lib.GetArchiveStats.argtypes = [ctypes.c_void_p, ctypes.POINTER(_ArchiveStats)]
+lib.GetArchiveStats.restype = ctypes.c_uint
+
+# ARCHIVER_STATUS ResetArchiveStats(void* pCtx)
+lib.ResetArchiveStats.argtypes = [ctypes.c_void_p]
+lib.ResetArchiveStats.restype = ctypes.c_uint
+
+# The C extension is optional, the ctypes bindings above are used without it
+try:
+    from titanarchive import _titanarchive as _native
+    _native.bind(lib._handle)
+except ImportError:
+    _native = None
+
 GlobalInitialize()
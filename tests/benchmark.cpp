@@ -0,0 +1,1779 @@
+// Native benchmark harness. Generates a reproducible corpus of archives, runs open / list / lookup /
+// extract scenarios over each of them through the exported C API and prints the results as JSON so
+// runs can be compared across releases.
+//
+// Build and run through setup.py:
+//   python3 setup.py benchmark --args="--scale 0.5 --output results.json"
+//
+// Options:
+//   --lib PATH          TitanArchive library, defaults to TitanArchive{32,64}.so from the loader path
+//   --codec PATH        7-Zip library passed to GlobalInitialize, defaults to the one next to --lib
+//   --corpus DIR        Directory the corpus is written to and reused from, defaults to a temporary one
+//   --scale FACTOR      Multiplier of the item counts and sizes, defaults to 1.0
+//   --iterations N      Runs per scenario, the median is reported. Defaults to 3
+//   --workers N         Workers used by bulk extraction, 0 for the library default
+//   --only NAME[,NAME]  Only run the named corpora
+//   --archives DIR      Also run the scenarios over every archive in DIR, their formats are discovered
+//   --output PATH       Write the JSON to PATH instead of stdout
+//
+// The generator does not depend on any compressor: zip entries are stored, gzip uses stored deflate
+// blocks and 7z uses the Copy coder. Timings therefore measure the library and container overhead
+// rather than a particular codec, --archives adds real compressed data to a run.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "TitanArchive.hpp"
+
+using namespace std;
+
+namespace
+{
+    using fnGlobalInitialize = ARCHIVER_STATUS(*)(const wchar_t*);
+    using fnGlobalUninitialize = void(*)();
+    using fnCreateArchiveContext = void*(*)();
+    using fnDeleteArchiveContext = ARCHIVER_STATUS(*)(void*);
+    using fnOpenArchiveDiskUtf8 = ARCHIVER_STATUS(*)(void*, const char*, const char*, const char*);
+    using fnGetArchiveItemCount = ARCHIVER_STATUS(*)(void*, uint32_t*);
+    using fnGetArchiveItemTable = ARCHIVER_STATUS(*)(void*, uint32_t, ArchiveItemTable**);
+    using fnFreeArchiveItemTable = ARCHIVER_STATUS(*)(void*, ArchiveItemTable*);
+    using fnGetArchiveItemPropertiesByPathUtf8 = ARCHIVER_STATUS(*)(void*, const char*, ArchiveItemUtf8**);
+    using fnFreeArchiveItemUtf8 = ARCHIVER_STATUS(*)(void*, ArchiveItemUtf8*);
+    using fnExtractArchiveItemToBufferByIndexEx = ARCHIVER_STATUS(*)(void*, uint32_t, uint8_t*, uint64_t, const wchar_t*, uint64_t*);
+    using fnExtractArchiveItems = ARCHIVER_STATUS(*)(void*, const uint32_t*, uint32_t, uint32_t, const wchar_t*, ArchiveItemCallback, void*);
+    using fnGetError = ARCHIVER_STATUS(*)(void*, HRESULT*, const wchar_t**);
+
+    struct Library
+    {
+        fnGlobalInitialize pGlobalInitialize;
+        fnGlobalUninitialize pGlobalUninitialize;
+        fnCreateArchiveContext pCreateArchiveContext;
+        fnDeleteArchiveContext pDeleteArchiveContext;
+        fnOpenArchiveDiskUtf8 pOpenArchiveDiskUtf8;
+        fnGetArchiveItemCount pGetArchiveItemCount;
+        fnGetArchiveItemTable pGetArchiveItemTable;
+        fnFreeArchiveItemTable pFreeArchiveItemTable;
+        fnGetArchiveItemPropertiesByPathUtf8 pGetArchiveItemPropertiesByPathUtf8;
+        fnFreeArchiveItemUtf8 pFreeArchiveItemUtf8;
+        fnExtractArchiveItemToBufferByIndexEx pExtractArchiveItemToBufferByIndexEx;
+        fnExtractArchiveItems pExtractArchiveItems;
+        fnGetError pGetError;
+    };
+
+    Library s_lib;
+
+    const uint64_t ui64KiB = 1024;
+    const uint64_t ui64MiB = 1024 * 1024;
+    const uint32_t ui32MaxLookups = 20000;
+    const uint32_t ui32MaxItemExtractions = 2000;
+    const char* szZipPassword = "benchmark";
+    const wchar_t* wszZipPassword = L"benchmark";
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Corpus generation
+
+    uint32_t s_rgui32CrcTable[256];
+
+    void InitCrcTable()
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t ui32Crc = i;
+            for (int j = 0; j < 8; j++)
+            {
+                ui32Crc = (ui32Crc >> 1) ^ (0xEDB88320 & (0 - (ui32Crc & 1)));
+            }
+            s_rgui32CrcTable[i] = ui32Crc;
+        }
+    }
+
+    inline uint32_t CrcByte(uint32_t ui32Crc, uint8_t ui8Byte)
+    {
+        return s_rgui32CrcTable[(ui32Crc ^ ui8Byte) & 0xff] ^ (ui32Crc >> 8);
+    }
+
+    // Running CRC32 without the final inversion, start with 0xFFFFFFFF and invert once done
+    uint32_t CrcUpdate(uint32_t ui32Crc, const uint8_t* pBuf, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            ui32Crc = CrcByte(ui32Crc, pBuf[i]);
+        }
+        return ui32Crc;
+    }
+
+    uint32_t Crc32(const uint8_t* pBuf, size_t size)
+    {
+        return ~CrcUpdate(0xFFFFFFFF, pBuf, size);
+    }
+
+    // xorshift64*, every file is generated from its own seed so the corpus is identical across runs
+    class CRandom
+    {
+    public:
+        explicit CRandom(uint64_t ui64Seed) : m_ui64State(ui64Seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+        uint64_t Next()
+        {
+            m_ui64State ^= m_ui64State >> 12;
+            m_ui64State ^= m_ui64State << 25;
+            m_ui64State ^= m_ui64State >> 27;
+            return m_ui64State * 0x2545F4914F6CDD1Dull;
+        }
+
+        uint64_t Range(uint64_t ui64Min, uint64_t ui64Max)
+        {
+            return ui64Min + Next() % (ui64Max - ui64Min + 1);
+        }
+
+    private:
+        uint64_t m_ui64State;
+    };
+
+    struct FileSpec
+    {
+        string strPath;         // '/' separated
+        bool bIsDir;
+        uint64_t ui64Size;
+        uint64_t ui64Seed;
+        uint32_t ui32Crc;
+    };
+
+    // Produces the content of a FileSpec chunk by chunk. Even seeds give text like data, odd seeds
+    // random bytes, so the corpus has a mix of compressible and incompressible items.
+    class CContent
+    {
+    public:
+        explicit CContent(const FileSpec& fs) : m_rRandom(fs.ui64Seed), m_bText(fs.ui64Seed % 2 == 0), m_ui64Left(fs.ui64Size) {}
+
+        size_t Read(uint8_t* pBuf, size_t size)
+        {
+            static const char* rgszWords[] = { "archive ", "item ", "stream ", "folder ", "solid ", "block ", "header ", "index ", "path ", "size ", "\n" };
+            size_t i = 0;
+
+            size = static_cast<size_t>(min<uint64_t>(size, m_ui64Left));
+            if (m_bText)
+            {
+                while (i < size)
+                {
+                    const char* szWord = rgszWords[m_rRandom.Next() % (sizeof(rgszWords) / sizeof(rgszWords[0]))];
+                    size_t len = min(strlen(szWord), size - i);
+                    memcpy(pBuf + i, szWord, len);
+                    i += len;
+                }
+            }
+            else
+            {
+                for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+                {
+                    uint64_t ui64Value = m_rRandom.Next();
+                    memcpy(pBuf + i, &ui64Value, sizeof(ui64Value));
+                }
+                for (; i < size; i++)
+                {
+                    pBuf[i] = static_cast<uint8_t>(m_rRandom.Next());
+                }
+            }
+            m_ui64Left -= size;
+            return size;
+        }
+
+    private:
+        CRandom m_rRandom;
+        bool m_bText;
+        uint64_t m_ui64Left;
+    };
+
+    void ComputeCrc(FileSpec& fs)
+    {
+        vector<uint8_t> vBuf(ui64MiB);
+        CContent cContent(fs);
+        uint32_t ui32Crc = 0xFFFFFFFF;
+        size_t size;
+
+        while ((size = cContent.Read(vBuf.data(), vBuf.size())) > 0)
+        {
+            ui32Crc = CrcUpdate(ui32Crc, vBuf.data(), size);
+        }
+        fs.ui32Crc = ~ui32Crc;
+    }
+
+    class CWriter
+    {
+    public:
+        bool Open(const string& strPath)
+        {
+            m_pFile = fopen(strPath.c_str(), "wb");
+            if (m_pFile)
+            {
+                setvbuf(m_pFile, nullptr, _IOFBF, ui64MiB);
+            }
+            return m_pFile != nullptr;
+        }
+
+        bool Close()
+        {
+            bool bResult = m_pFile && !ferror(m_pFile);
+            if (m_pFile && fclose(m_pFile) != 0)
+            {
+                bResult = false;
+            }
+            m_pFile = nullptr;
+            return bResult;
+        }
+
+        ~CWriter()
+        {
+            if (m_pFile)
+            {
+                fclose(m_pFile);
+            }
+        }
+
+        void Write(const void* pBuf, size_t size)
+        {
+            fwrite(pBuf, 1, size, m_pFile);
+            m_ui64Offset += size;
+        }
+
+        void Write(const vector<uint8_t>& vBuf)
+        {
+            Write(vBuf.data(), vBuf.size());
+        }
+
+        void U8(uint8_t ui8Value) { Write(&ui8Value, 1); }
+        void U16(uint16_t ui16Value) { uint8_t rg[2] = { uint8_t(ui16Value), uint8_t(ui16Value >> 8) }; Write(rg, 2); }
+        void U32(uint32_t ui32Value) { U16(uint16_t(ui32Value)); U16(uint16_t(ui32Value >> 16)); }
+        void U64(uint64_t ui64Value) { U32(uint32_t(ui64Value)); U32(uint32_t(ui64Value >> 32)); }
+
+        // Streams the content of fs through pTransform, which may modify the chunk before it is written
+        template <typename Transform>
+        void Content(const FileSpec& fs, Transform tTransform)
+        {
+            vector<uint8_t> vBuf(ui64MiB);
+            CContent cContent(fs);
+            size_t size;
+
+            while ((size = cContent.Read(vBuf.data(), vBuf.size())) > 0)
+            {
+                tTransform(vBuf.data(), size);
+                Write(vBuf.data(), size);
+            }
+        }
+
+        void Content(const FileSpec& fs)
+        {
+            Content(fs, [](uint8_t*, size_t) {});
+        }
+
+        uint64_t Offset() const
+        {
+            return m_ui64Offset;
+        }
+
+        FILE* m_pFile = nullptr;
+        uint64_t m_ui64Offset = 0;
+    };
+
+    // Traditional PKWARE encryption, used for the encrypted zip corpus
+    class CZipCrypto
+    {
+    public:
+        explicit CZipCrypto(const char* szPassword)
+        {
+            for (; *szPassword; szPassword++)
+            {
+                Update(static_cast<uint8_t>(*szPassword));
+            }
+        }
+
+        void Encrypt(uint8_t* pBuf, size_t size)
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                uint16_t ui16Temp = static_cast<uint16_t>(m_rgui32Keys[2] | 2);
+                uint8_t ui8Plain = pBuf[i];
+                pBuf[i] ^= static_cast<uint8_t>((ui16Temp * (ui16Temp ^ 1)) >> 8);
+                Update(ui8Plain);
+            }
+        }
+
+    private:
+        void Update(uint8_t ui8Byte)
+        {
+            m_rgui32Keys[0] = CrcByte(m_rgui32Keys[0], ui8Byte);
+            m_rgui32Keys[1] = (m_rgui32Keys[1] + (m_rgui32Keys[0] & 0xff)) * 134775813 + 1;
+            m_rgui32Keys[2] = CrcByte(m_rgui32Keys[2], static_cast<uint8_t>(m_rgui32Keys[1] >> 24));
+        }
+
+        uint32_t m_rgui32Keys[3] = { 0x12345678, 0x23456789, 0x34567890 };
+    };
+
+    // Stored entries, ZipCrypto when szPassword is set. Directories are implied by the file paths.
+    bool WriteZip(const string& strPath, const vector<FileSpec>& vFiles, const char* szPassword)
+    {
+        const uint16_t ui16Time = 0, ui16Date = (1 << 5) | 1;
+        const uint32_t ui32HeaderSize = szPassword ? 12 : 0;
+        vector<uint64_t> vOffsets;
+        vector<const FileSpec*> vEntries;
+        CWriter cWriter;
+        uint64_t ui64CentralOffset;
+
+        for (const FileSpec& fs : vFiles)
+        {
+            if (!fs.bIsDir)
+            {
+                vEntries.push_back(&fs);
+            }
+        }
+        if (vEntries.size() > 0xFFFF || !cWriter.Open(strPath))
+        {
+            return false;
+        }
+
+        for (const FileSpec* pfs : vEntries)
+        {
+            vOffsets.push_back(cWriter.Offset());
+            cWriter.U32(0x04034b50);
+            cWriter.U16(20);
+            cWriter.U16(szPassword ? 1 : 0);
+            cWriter.U16(0);
+            cWriter.U16(ui16Time);
+            cWriter.U16(ui16Date);
+            cWriter.U32(pfs->ui32Crc);
+            cWriter.U32(static_cast<uint32_t>(pfs->ui64Size + ui32HeaderSize));
+            cWriter.U32(static_cast<uint32_t>(pfs->ui64Size));
+            cWriter.U16(static_cast<uint16_t>(pfs->strPath.size()));
+            cWriter.U16(0);
+            cWriter.Write(pfs->strPath.data(), pfs->strPath.size());
+            if (szPassword)
+            {
+                CZipCrypto cCrypto(szPassword);
+                CRandom rRandom(pfs->ui64Seed ^ 0x5a5a);
+                uint8_t rgHeader[12];
+                for (int i = 0; i < 11; i++)
+                {
+                    rgHeader[i] = static_cast<uint8_t>(rRandom.Next());
+                }
+                rgHeader[11] = static_cast<uint8_t>(pfs->ui32Crc >> 24);
+                cCrypto.Encrypt(rgHeader, sizeof(rgHeader));
+                cWriter.Write(rgHeader, sizeof(rgHeader));
+                cWriter.Content(*pfs, [&cCrypto](uint8_t* pBuf, size_t size) { cCrypto.Encrypt(pBuf, size); });
+            }
+            else
+            {
+                cWriter.Content(*pfs);
+            }
+        }
+
+        ui64CentralOffset = cWriter.Offset();
+        for (size_t i = 0; i < vEntries.size(); i++)
+        {
+            const FileSpec* pfs = vEntries[i];
+            cWriter.U32(0x02014b50);
+            cWriter.U16(20);
+            cWriter.U16(20);
+            cWriter.U16(szPassword ? 1 : 0);
+            cWriter.U16(0);
+            cWriter.U16(ui16Time);
+            cWriter.U16(ui16Date);
+            cWriter.U32(pfs->ui32Crc);
+            cWriter.U32(static_cast<uint32_t>(pfs->ui64Size + ui32HeaderSize));
+            cWriter.U32(static_cast<uint32_t>(pfs->ui64Size));
+            cWriter.U16(static_cast<uint16_t>(pfs->strPath.size()));
+            cWriter.U16(0);
+            cWriter.U16(0);
+            cWriter.U16(0);
+            cWriter.U16(0);
+            cWriter.U32(0);
+            cWriter.U32(static_cast<uint32_t>(vOffsets[i]));
+            cWriter.Write(pfs->strPath.data(), pfs->strPath.size());
+        }
+
+        uint64_t ui64CentralSize = cWriter.Offset() - ui64CentralOffset;
+        cWriter.U32(0x06054b50);
+        cWriter.U16(0);
+        cWriter.U16(0);
+        cWriter.U16(static_cast<uint16_t>(vEntries.size()));
+        cWriter.U16(static_cast<uint16_t>(vEntries.size()));
+        cWriter.U32(static_cast<uint32_t>(ui64CentralSize));
+        cWriter.U32(static_cast<uint32_t>(ui64CentralOffset));
+        cWriter.U16(0);
+        return cWriter.Close();
+    }
+
+    // ustar header, paths longer than 100 characters are split into prefix and name at a '/'
+    bool TarHeader(const FileSpec& fs, vector<uint8_t>& vHeader)
+    {
+        string strPath = fs.bIsDir ? fs.strPath + "/" : fs.strPath;
+        string strPrefix, strName = strPath;
+        unsigned int uiChecksum = 0;
+        char* pHeader;
+
+        if (strName.size() > 100)
+        {
+            size_t pos = strPath.find('/', strPath.size() - 101);
+            if (pos == string::npos || pos > 155)
+            {
+                return false;
+            }
+            strPrefix = strPath.substr(0, pos);
+            strName = strPath.substr(pos + 1);
+        }
+
+        vHeader.assign(512, 0);
+        pHeader = reinterpret_cast<char*>(vHeader.data());
+        memcpy(pHeader, strName.data(), strName.size());
+        snprintf(pHeader + 100, 8, "%07o", fs.bIsDir ? 0755 : 0644);
+        snprintf(pHeader + 108, 8, "%07o", 0);
+        snprintf(pHeader + 116, 8, "%07o", 0);
+        snprintf(pHeader + 124, 12, "%011llo", static_cast<unsigned long long>(fs.ui64Size));
+        snprintf(pHeader + 136, 12, "%011o", 0);
+        pHeader[156] = fs.bIsDir ? '5' : '0';
+        memcpy(pHeader + 257, "ustar", 6);
+        memcpy(pHeader + 263, "00", 2);
+        memcpy(pHeader + 345, strPrefix.data(), strPrefix.size());
+        memset(pHeader + 148, ' ', 8);
+        for (uint8_t ui8Byte : vHeader)
+        {
+            uiChecksum += ui8Byte;
+        }
+        snprintf(pHeader + 148, 8, "%06o", uiChecksum);
+        return true;
+    }
+
+    // Emits the tar stream through fnWrite so it can be written directly or wrapped in gzip
+    template <typename WriteChunk>
+    bool TarStream(const vector<FileSpec>& vFiles, WriteChunk fnWrite)
+    {
+        vector<uint8_t> vHeader;
+        vector<uint8_t> vBuf(ui64MiB);
+
+        for (const FileSpec& fs : vFiles)
+        {
+            if (!TarHeader(fs, vHeader))
+            {
+                return false;
+            }
+            fnWrite(vHeader.data(), vHeader.size());
+            if (!fs.bIsDir)
+            {
+                CContent cContent(fs);
+                size_t size;
+                while ((size = cContent.Read(vBuf.data(), vBuf.size())) > 0)
+                {
+                    fnWrite(vBuf.data(), size);
+                }
+                memset(vBuf.data(), 0, 512);
+                fnWrite(vBuf.data(), (512 - fs.ui64Size % 512) % 512);
+            }
+        }
+        memset(vBuf.data(), 0, 1024);
+        fnWrite(vBuf.data(), 1024);
+        return true;
+    }
+
+    bool WriteTar(const string& strPath, const vector<FileSpec>& vFiles)
+    {
+        CWriter cWriter;
+
+        if (!cWriter.Open(strPath))
+        {
+            return false;
+        }
+        if (!TarStream(vFiles, [&cWriter](const uint8_t* pBuf, size_t size) { cWriter.Write(pBuf, size); }))
+        {
+            return false;
+        }
+        return cWriter.Close();
+    }
+
+    // gzip member holding the tar stream in stored deflate blocks
+    bool WriteTarGz(const string& strPath, const vector<FileSpec>& vFiles)
+    {
+        const uint8_t rgHeader[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+        vector<uint8_t> vBlock;
+        uint32_t ui32Crc = 0xFFFFFFFF;
+        uint64_t ui64Size = 0;
+        CWriter cWriter;
+
+        auto fnFlush = [&](bool bFinal)
+        {
+            uint16_t ui16Len = static_cast<uint16_t>(vBlock.size());
+            cWriter.U8(bFinal ? 1 : 0);
+            cWriter.U16(ui16Len);
+            cWriter.U16(static_cast<uint16_t>(~ui16Len));
+            cWriter.Write(vBlock);
+            vBlock.clear();
+        };
+
+        if (!cWriter.Open(strPath))
+        {
+            return false;
+        }
+        cWriter.Write(rgHeader, sizeof(rgHeader));
+        bool bResult = TarStream(vFiles, [&](const uint8_t* pBuf, size_t size)
+        {
+            ui32Crc = CrcUpdate(ui32Crc, pBuf, size);
+            ui64Size += size;
+            while (size > 0)
+            {
+                size_t len = min<size_t>(size, 0xFFFF - vBlock.size());
+                vBlock.insert(vBlock.end(), pBuf, pBuf + len);
+                pBuf += len;
+                size -= len;
+                if (vBlock.size() == 0xFFFF)
+                {
+                    fnFlush(false);
+                }
+            }
+        });
+        if (!bResult)
+        {
+            return false;
+        }
+        fnFlush(true);
+        cWriter.U32(~ui32Crc);
+        cWriter.U32(static_cast<uint32_t>(ui64Size));
+        return cWriter.Close();
+    }
+
+    // 7z header writer, see DOC/7zFormat.txt of the 7-Zip sources
+    class C7zHeader
+    {
+    public:
+        void Byte(uint8_t ui8Value)
+        {
+            m_vBuf.push_back(ui8Value);
+        }
+
+        void Number(uint64_t ui64Value)
+        {
+            uint8_t ui8First = 0, ui8Mask = 0x80;
+            int i;
+
+            for (i = 0; i < 8; i++)
+            {
+                if (ui64Value < (1ull << (7 * (i + 1))))
+                {
+                    ui8First |= static_cast<uint8_t>(ui64Value >> (8 * i));
+                    break;
+                }
+                ui8First |= ui8Mask;
+                ui8Mask >>= 1;
+            }
+            Byte(ui8First);
+            for (; i > 0; i--)
+            {
+                Byte(static_cast<uint8_t>(ui64Value));
+                ui64Value >>= 8;
+            }
+        }
+
+        void U32(uint32_t ui32Value)
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                Byte(static_cast<uint8_t>(ui32Value >> (8 * i)));
+            }
+        }
+
+        void Bits(const vector<bool>& vBits)
+        {
+            uint8_t ui8Value = 0, ui8Mask = 0x80;
+
+            for (bool bBit : vBits)
+            {
+                if (bBit)
+                {
+                    ui8Value |= ui8Mask;
+                }
+                ui8Mask >>= 1;
+                if (!ui8Mask)
+                {
+                    Byte(ui8Value);
+                    ui8Value = 0;
+                    ui8Mask = 0x80;
+                }
+            }
+            if (ui8Mask != 0x80)
+            {
+                Byte(ui8Value);
+            }
+        }
+
+        void Property(uint8_t ui8Id, const C7zHeader& hValue)
+        {
+            Byte(ui8Id);
+            Number(hValue.m_vBuf.size());
+            m_vBuf.insert(m_vBuf.end(), hValue.m_vBuf.begin(), hValue.m_vBuf.end());
+        }
+
+        vector<uint8_t> m_vBuf;
+    };
+
+    // Copy coder only. bSolid puts every file in one folder, otherwise each file gets its own.
+    bool Write7z(const string& strPath, const vector<FileSpec>& vFiles, bool bSolid)
+    {
+        enum { kEnd = 0x00, kHeader = 0x01, kMainStreamsInfo = 0x04, kFilesInfo = 0x05, kPackInfo = 0x06, kUnPackInfo = 0x07,
+               kSubStreamsInfo = 0x08, kSize = 0x09, kCRC = 0x0A, kFolder = 0x0B, kCodersUnPackSize = 0x0C, kNumUnPackStream = 0x0D,
+               kEmptyStream = 0x0E, kEmptyFile = 0x0F, kName = 0x11 };
+        vector<const FileSpec*> vStreams;
+        vector<bool> vEmptyStream, vEmptyFile;
+        vector<uint64_t> vFolderSizes;
+        C7zHeader hHeader, hNames;
+        CWriter cWriter;
+        uint8_t rgStart[32] = { '7', 'z', 0xBC, 0xAF, 0x27, 0x1C, 0, 4 };
+        uint64_t ui64Total = 0;
+        bool bAnyEmpty = false;
+
+        for (const FileSpec& fs : vFiles)
+        {
+            bool bEmpty = fs.bIsDir || fs.ui64Size == 0;
+            vEmptyStream.push_back(bEmpty);
+            if (bEmpty)
+            {
+                vEmptyFile.push_back(!fs.bIsDir);
+                bAnyEmpty = true;
+            }
+            else
+            {
+                vStreams.push_back(&fs);
+                ui64Total += fs.ui64Size;
+            }
+        }
+        if (bSolid && !vStreams.empty())
+        {
+            vFolderSizes.push_back(ui64Total);
+        }
+        else if (!bSolid)
+        {
+            for (const FileSpec* pfs : vStreams)
+            {
+                vFolderSizes.push_back(pfs->ui64Size);
+            }
+        }
+
+        if (!cWriter.Open(strPath))
+        {
+            return false;
+        }
+        cWriter.Write(rgStart, sizeof(rgStart));
+        for (const FileSpec* pfs : vStreams)
+        {
+            cWriter.Content(*pfs);
+        }
+
+        hHeader.Byte(kHeader);
+        if (!vStreams.empty())
+        {
+            hHeader.Byte(kMainStreamsInfo);
+
+            hHeader.Byte(kPackInfo);
+            hHeader.Number(0);
+            hHeader.Number(vFolderSizes.size());
+            hHeader.Byte(kSize);
+            for (uint64_t ui64Size : vFolderSizes)
+            {
+                hHeader.Number(ui64Size);
+            }
+            hHeader.Byte(kEnd);
+
+            hHeader.Byte(kUnPackInfo);
+            hHeader.Byte(kFolder);
+            hHeader.Number(vFolderSizes.size());
+            hHeader.Byte(0);
+            for (size_t i = 0; i < vFolderSizes.size(); i++)
+            {
+                hHeader.Number(1);      // One coder
+                hHeader.Byte(0x01);     // Simple coder with a one byte id
+                hHeader.Byte(0x00);     // Copy
+            }
+            hHeader.Byte(kCodersUnPackSize);
+            for (uint64_t ui64Size : vFolderSizes)
+            {
+                hHeader.Number(ui64Size);
+            }
+            hHeader.Byte(kEnd);
+
+            hHeader.Byte(kSubStreamsInfo);
+            if (bSolid)
+            {
+                hHeader.Byte(kNumUnPackStream);
+                hHeader.Number(vStreams.size());
+                if (vStreams.size() > 1)
+                {
+                    hHeader.Byte(kSize);
+                    for (size_t i = 0; i + 1 < vStreams.size(); i++)
+                    {
+                        hHeader.Number(vStreams[i]->ui64Size);
+                    }
+                }
+            }
+            hHeader.Byte(kCRC);
+            hHeader.Byte(1);            // All defined
+            for (const FileSpec* pfs : vStreams)
+            {
+                hHeader.U32(pfs->ui32Crc);
+            }
+            hHeader.Byte(kEnd);
+
+            hHeader.Byte(kEnd);
+        }
+
+        hHeader.Byte(kFilesInfo);
+        hHeader.Number(vFiles.size());
+        if (bAnyEmpty)
+        {
+            C7zHeader hEmptyStream, hEmptyFile;
+            hEmptyStream.Bits(vEmptyStream);
+            hHeader.Property(kEmptyStream, hEmptyStream);
+            hEmptyFile.Bits(vEmptyFile);
+            hHeader.Property(kEmptyFile, hEmptyFile);
+        }
+        hNames.Byte(0);
+        for (const FileSpec& fs : vFiles)
+        {
+            for (char c : fs.strPath)
+            {
+                hNames.Byte(static_cast<uint8_t>(c));
+                hNames.Byte(0);
+            }
+            hNames.Byte(0);
+            hNames.Byte(0);
+        }
+        hHeader.Property(kName, hNames);
+        hHeader.Byte(kEnd);
+        hHeader.Byte(kEnd);
+
+        cWriter.Write(hHeader.m_vBuf);
+        if (!cWriter.Close())
+        {
+            return false;
+        }
+
+        // Start header goes in last, it needs the offset and CRC of the header
+        uint64_t ui64NextOffset = ui64Total;    // Relative to the end of the start header
+        uint64_t ui64NextSize = hHeader.m_vBuf.size();
+        uint32_t ui32NextCrc = Crc32(hHeader.m_vBuf.data(), hHeader.m_vBuf.size());
+        for (int i = 0; i < 8; i++)
+        {
+            rgStart[12 + i] = static_cast<uint8_t>(ui64NextOffset >> (8 * i));
+            rgStart[20 + i] = static_cast<uint8_t>(ui64NextSize >> (8 * i));
+        }
+        for (int i = 0; i < 4; i++)
+        {
+            rgStart[28 + i] = static_cast<uint8_t>(ui32NextCrc >> (8 * i));
+        }
+        uint32_t ui32StartCrc = Crc32(rgStart + 12, 20);
+        for (int i = 0; i < 4; i++)
+        {
+            rgStart[8 + i] = static_cast<uint8_t>(ui32StartCrc >> (8 * i));
+        }
+
+        FILE* pFile = fopen(strPath.c_str(), "r+b");
+        if (!pFile)
+        {
+            return false;
+        }
+        bool bResult = fwrite(rgStart, 1, sizeof(rgStart), pFile) == sizeof(rgStart);
+        return fclose(pFile) == 0 && bResult;
+    }
+
+    enum class ContainerKind { Zip, EncryptedZip, Tar, TarGz, SolidSevenZip, SevenZip, External };
+
+    struct Corpus
+    {
+        const char* szName;
+        const char* szFormat;       // Passed to OpenArchiveDisk, nullptr to discover it
+        const char* szExtension;
+        ContainerKind ckKind;
+        vector<FileSpec> (*pfnFiles)(double dScale);
+    };
+
+    uint64_t Scaled(double dScale, uint64_t ui64Value, uint64_t ui64Min = 1)
+    {
+        return max<uint64_t>(ui64Min, static_cast<uint64_t>(ui64Value * dScale));
+    }
+
+    void AddFile(vector<FileSpec>& vFiles, string strPath, uint64_t ui64Size)
+    {
+        FileSpec fs;
+        fs.strPath = move(strPath);
+        fs.bIsDir = false;
+        fs.ui64Size = ui64Size;
+        fs.ui64Seed = vFiles.size() + 1;
+        fs.ui32Crc = 0;
+        vFiles.push_back(fs);
+    }
+
+    void AddDir(vector<FileSpec>& vFiles, string strPath)
+    {
+        AddFile(vFiles, move(strPath), 0);
+        vFiles.back().bIsDir = true;
+    }
+
+    // Many small files spread over a flat set of directories, kept below the zip entry limit
+    vector<FileSpec> TinyFiles(double dScale)
+    {
+        vector<FileSpec> vFiles;
+        uint64_t ui64Count = min<uint64_t>(Scaled(dScale, 20000), 0xFFFF);
+        CRandom rRandom(1);
+        char szPath[64];
+
+        for (uint64_t i = 0; i < ui64Count; i++)
+        {
+            snprintf(szPath, sizeof(szPath), "dir%03llu/file%06llu.txt", static_cast<unsigned long long>(i % 100), static_cast<unsigned long long>(i));
+            AddFile(vFiles, szPath, rRandom.Range(0, 512));
+        }
+        return vFiles;
+    }
+
+    vector<FileSpec> HugeFiles(double dScale)
+    {
+        vector<FileSpec> vFiles;
+
+        for (int i = 0; i < 3; i++)
+        {
+            AddFile(vFiles, "huge" + to_string(i) + ".bin", Scaled(dScale, 64 * ui64MiB, ui64MiB));
+        }
+        return vFiles;
+    }
+
+    // Medium sized files, also used for the encrypted zip
+    vector<FileSpec> MediumFiles(double dScale)
+    {
+        vector<FileSpec> vFiles;
+        uint64_t ui64Count = Scaled(dScale, 2000);
+        CRandom rRandom(2);
+        char szPath[64];
+
+        for (uint64_t i = 0; i < ui64Count; i++)
+        {
+            snprintf(szPath, sizeof(szPath), "data/part%02llu/item%05llu.dat", static_cast<unsigned long long>(i % 16), static_cast<unsigned long long>(i));
+            AddFile(vFiles, szPath, rRandom.Range(ui64KiB, 32 * ui64KiB));
+        }
+        return vFiles;
+    }
+
+    // Chains of nested directories with files and a few leaf directories at every level. Depth stays
+    // within what a ustar header can describe.
+    vector<FileSpec> DeepTree(double dScale)
+    {
+        const int iDepth = 24, iFilesPerLevel = 8, iLeavesPerLevel = 3;
+        vector<FileSpec> vFiles;
+        uint64_t ui64Trees = Scaled(dScale, 10);
+        CRandom rRandom(3);
+        char szName[32];
+
+        for (uint64_t t = 0; t < ui64Trees; t++)
+        {
+            snprintf(szName, sizeof(szName), "t%03llu", static_cast<unsigned long long>(t));
+            string strDir = szName;
+            AddDir(vFiles, strDir);
+            for (int d = 0; d < iDepth; d++)
+            {
+                for (int f = 0; f < iFilesPerLevel; f++)
+                {
+                    snprintf(szName, sizeof(szName), "/f%02d.txt", f);
+                    AddFile(vFiles, strDir + szName, rRandom.Range(0, 2048));
+                }
+                for (int l = 0; l < iLeavesPerLevel; l++)
+                {
+                    snprintf(szName, sizeof(szName), "/leaf%d", l);
+                    string strLeaf = strDir + szName;
+                    AddDir(vFiles, strLeaf);
+                    for (int f = 0; f < iFilesPerLevel; f++)
+                    {
+                        snprintf(szName, sizeof(szName), "/f%02d.txt", f);
+                        AddFile(vFiles, strLeaf + szName, rRandom.Range(0, 2048));
+                    }
+                }
+                snprintf(szName, sizeof(szName), "/d%02d", d);
+                strDir += szName;
+                AddDir(vFiles, strDir);
+            }
+        }
+        return vFiles;
+    }
+
+    const Corpus s_rgCorpora[] =
+    {
+        { "tiny_files_zip", "zip", ".zip", ContainerKind::Zip, TinyFiles },
+        { "huge_files_zip", "zip", ".zip", ContainerKind::Zip, HugeFiles },
+        { "encrypted_zip", "zip", ".zip", ContainerKind::EncryptedZip, MediumFiles },
+        { "deep_tree_tar", "tar", ".tar", ContainerKind::Tar, DeepTree },
+        { "tiny_files_tar_gz", "gzip", ".tar.gz", ContainerKind::TarGz, TinyFiles },
+        { "solid_7z", "7z", ".7z", ContainerKind::SolidSevenZip, MediumFiles },
+        { "non_solid_7z", "7z", ".7z", ContainerKind::SevenZip, MediumFiles },
+        { "huge_files_7z", "7z", ".7z", ContainerKind::SevenZip, HugeFiles },
+    };
+
+    bool WriteCorpus(const Corpus& cCorpus, const string& strPath, const vector<FileSpec>& vFiles)
+    {
+        switch (cCorpus.ckKind)
+        {
+        case ContainerKind::Zip:
+            return WriteZip(strPath, vFiles, nullptr);
+        case ContainerKind::EncryptedZip:
+            return WriteZip(strPath, vFiles, szZipPassword);
+        case ContainerKind::Tar:
+            return WriteTar(strPath, vFiles);
+        case ContainerKind::TarGz:
+            return WriteTarGz(strPath, vFiles);
+        case ContainerKind::SolidSevenZip:
+            return Write7z(strPath, vFiles, true);
+        case ContainerKind::SevenZip:
+            return Write7z(strPath, vFiles, false);
+        case ContainerKind::External:
+            break;
+        }
+        return false;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Measurements
+
+    using Clock = chrono::steady_clock;
+
+    double ElapsedMs(Clock::time_point tpStart)
+    {
+        return chrono::duration<double, milli>(Clock::now() - tpStart).count();
+    }
+
+    double Median(vector<double> vValues)
+    {
+        if (vValues.empty())
+        {
+            return 0;
+        }
+        sort(vValues.begin(), vValues.end());
+        size_t mid = vValues.size() / 2;
+        return vValues.size() % 2 ? vValues[mid] : (vValues[mid - 1] + vValues[mid]) / 2;
+    }
+
+    // Resets the peak RSS of the process where the platform allows it, returns false if the peak
+    // reported afterwards still covers everything since startup
+    bool ResetPeakRss()
+    {
+#if defined(__linux__)
+        FILE* pFile = fopen("/proc/self/clear_refs", "w");
+        if (pFile)
+        {
+            bool bResult = fputs("5", pFile) >= 0;
+            return fclose(pFile) == 0 && bResult;
+        }
+#endif
+        return false;
+    }
+
+    uint64_t PeakRssKiB()
+    {
+#if defined(__linux__)
+        FILE* pFile = fopen("/proc/self/status", "r");
+        if (pFile)
+        {
+            char szLine[256];
+            unsigned long long ullValue = 0;
+            while (fgets(szLine, sizeof(szLine), pFile))
+            {
+                if (sscanf(szLine, "VmHWM: %llu kB", &ullValue) == 1)
+                {
+                    break;
+                }
+            }
+            fclose(pFile);
+            if (ullValue)
+            {
+                return ullValue;
+            }
+        }
+#endif
+        struct rusage ru;
+        if (getrusage(RUSAGE_SELF, &ru) != 0)
+        {
+            return 0;
+        }
+#if defined(__APPLE__)
+        return static_cast<uint64_t>(ru.ru_maxrss) / 1024;
+#else
+        return static_cast<uint64_t>(ru.ru_maxrss);
+#endif
+    }
+
+    string Narrow(const wchar_t* wszValue)
+    {
+        string strValue;
+
+        for (; wszValue && *wszValue; wszValue++)
+        {
+            strValue += *wszValue < 0x80 ? static_cast<char>(*wszValue) : '?';
+        }
+        return strValue;
+    }
+
+    string ContextError(void* pCtx)
+    {
+        HRESULT hr = 0;
+        const wchar_t* wszError = nullptr;
+
+        s_lib.pGetError(pCtx, &hr, &wszError);
+        return Narrow(wszError);
+    }
+
+    class CJson
+    {
+    public:
+        void Key(const char* szKey)
+        {
+            Separator();
+            Quote(szKey);
+            m_strOut += ": ";
+            m_bValuePending = true;
+        }
+
+        void String(const string& strValue)
+        {
+            Separator();
+            Quote(strValue);
+        }
+
+        void Number(double dValue)
+        {
+            char szValue[32];
+            Separator();
+            snprintf(szValue, sizeof(szValue), "%.3f", dValue);
+            m_strOut += szValue;
+        }
+
+        void Number(uint64_t ui64Value)
+        {
+            Separator();
+            m_strOut += to_string(ui64Value);
+        }
+
+        void Bool(bool bValue)
+        {
+            Separator();
+            m_strOut += bValue ? "true" : "false";
+        }
+
+        void Null()
+        {
+            Separator();
+            m_strOut += "null";
+        }
+
+        void Begin(char cOpen)
+        {
+            Separator();
+            m_strOut += cOpen;
+            m_iIndent++;
+            m_bFirst = true;
+        }
+
+        void End(char cClose)
+        {
+            m_iIndent--;
+            m_strOut += '\n' + string(m_iIndent * 2, ' ') + cClose;
+            m_bFirst = false;
+        }
+
+        void Field(const char* szKey, double dValue) { Key(szKey); Number(dValue); }
+        void Field(const char* szKey, uint64_t ui64Value) { Key(szKey); Number(ui64Value); }
+        void Field(const char* szKey, uint32_t ui32Value) { Key(szKey); Number(static_cast<uint64_t>(ui32Value)); }
+        void Field(const char* szKey, bool bValue) { Key(szKey); Bool(bValue); }
+        void Field(const char* szKey, const string& strValue) { Key(szKey); String(strValue); }
+        void Field(const char* szKey, const char* szValue) { Key(szKey); String(szValue); }
+
+        const string& Str() const
+        {
+            return m_strOut;
+        }
+
+    private:
+        // Values right after a key stay on its line, everything else starts a new indented line
+        void Separator()
+        {
+            if (m_bValuePending)
+            {
+                m_bValuePending = false;
+                return;
+            }
+            if (m_iIndent > 0)
+            {
+                m_strOut += m_bFirst ? "\n" : ",\n";
+                m_strOut += string(m_iIndent * 2, ' ');
+            }
+            m_bFirst = false;
+        }
+
+        void Quote(const string& strValue)
+        {
+            m_strOut += '"';
+            for (char c : strValue)
+            {
+                if (c == '"' || c == '\\')
+                {
+                    m_strOut += '\\';
+                    m_strOut += c;
+                }
+                else if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char szEscape[8];
+                    snprintf(szEscape, sizeof(szEscape), "\\u%04x", c);
+                    m_strOut += szEscape;
+                }
+                else
+                {
+                    m_strOut += c;
+                }
+            }
+            m_strOut += '"';
+        }
+
+        string m_strOut;
+        int m_iIndent = 0;
+        bool m_bFirst = true;
+        bool m_bValuePending = false;
+    };
+
+    struct Options
+    {
+        string strLib;
+        string strCodec;
+        string strCorpus;
+        double dScale = 1.0;
+        uint32_t ui32Iterations = 3;
+        uint32_t ui32Workers = 0;
+        vector<string> vOnly;
+        string strArchives;
+        string strOutput;
+    };
+
+    struct Result
+    {
+        string strError;
+        uint32_t ui32Items = 0;
+        uint64_t ui64UnpackedBytes = 0;
+        uint64_t ui64ArchiveBytes = 0;
+        double dGenerateMs = 0;
+        double dOpenMs = 0;
+        double dListMs = 0;
+        double dTreeBuildMs = 0;
+        uint32_t ui32Lookups = 0;
+        double dLookupNs = 0;
+        uint32_t ui32ItemExtractions = 0;
+        double dExtractItemMs = 0;
+        uint64_t ui64ExtractItemBytes = 0;
+        double dExtractBulkMs = 0;
+        uint64_t ui64ExtractBulkBytes = 0;
+        uint64_t ui64VerifyFailures = 0;
+        uint64_t ui64PeakRssKiB = 0;
+    };
+
+    // Item of the opened archive, ui32Crc is only meaningful when bKnown is set
+    struct ArchiveEntry
+    {
+        uint32_t ui32Index;
+        uint64_t ui64Size;
+        string strPath;
+        bool bKnown;
+        uint32_t ui32Crc;
+    };
+
+    struct BulkState
+    {
+        const unordered_map<uint32_t, const ArchiveEntry*>* pmEntries;
+        atomic<uint64_t> ui64Bytes;
+        atomic<uint64_t> ui64Failures;
+    };
+
+    void BulkCallback(void* pUser, uint32_t ui32ItemIndex, HRESULT hrError, const wchar_t* wszError, const uint8_t* pBuf, uint64_t ui64Size)
+    {
+        BulkState* pState = static_cast<BulkState*>(pUser);
+        (void)wszError;
+
+        if (hrError != 0)
+        {
+            pState->ui64Failures++;
+            return;
+        }
+        pState->ui64Bytes += ui64Size;
+        auto it = pState->pmEntries->find(ui32ItemIndex);
+        if (it != pState->pmEntries->end() && it->second->bKnown && Crc32(pBuf, static_cast<size_t>(ui64Size)) != it->second->ui32Crc)
+        {
+            pState->ui64Failures++;
+        }
+    }
+
+    bool Open(void* pCtx, const string& strPath, const Corpus& cCorpus)
+    {
+        return s_lib.pOpenArchiveDiskUtf8(pCtx, strPath.c_str(), cCorpus.ckKind == ContainerKind::EncryptedZip ? szZipPassword : nullptr, cCorpus.szFormat) == ARCHIVER_STATUS_SUCCESS;
+    }
+
+    void RunScenarios(const Corpus& cCorpus, const string& strPath, const vector<FileSpec>& vFiles, const Options& oOptions, Result& rResult)
+    {
+        const wchar_t* wszPassword = cCorpus.ckKind == ContainerKind::EncryptedZip ? wszZipPassword : nullptr;
+        unordered_map<string, const FileSpec*> mSpecs;
+        unordered_map<uint32_t, const ArchiveEntry*> mEntries;
+        vector<ArchiveEntry> vEntries;
+        vector<double> vTimes;
+        void* pCtx;
+
+        for (const FileSpec& fs : vFiles)
+        {
+            mSpecs[fs.strPath] = &fs;
+        }
+
+        // open
+        for (uint32_t i = 0; i < oOptions.ui32Iterations; i++)
+        {
+            uint32_t ui32Count;
+            pCtx = s_lib.pCreateArchiveContext();
+            if (!pCtx)
+            {
+                rResult.strError = "CreateArchiveContext failed";
+                return;
+            }
+            Clock::time_point tpStart = Clock::now();
+            if (!Open(pCtx, strPath, cCorpus) || s_lib.pGetArchiveItemCount(pCtx, &ui32Count) != ARCHIVER_STATUS_SUCCESS)
+            {
+                rResult.strError = "open: " + ContextError(pCtx);
+                s_lib.pDeleteArchiveContext(pCtx);
+                return;
+            }
+            vTimes.push_back(ElapsedMs(tpStart));
+            rResult.ui32Items = ui32Count;
+            s_lib.pDeleteArchiveContext(pCtx);
+        }
+        rResult.dOpenMs = Median(vTimes);
+
+        pCtx = s_lib.pCreateArchiveContext();
+        if (!pCtx || !Open(pCtx, strPath, cCorpus))
+        {
+            rResult.strError = "open: " + (pCtx ? ContextError(pCtx) : string("CreateArchiveContext failed"));
+            if (pCtx)
+            {
+                s_lib.pDeleteArchiveContext(pCtx);
+            }
+            return;
+        }
+
+        // list, the last table is kept to drive the other scenarios
+        vTimes.clear();
+        for (uint32_t i = 0; i < oOptions.ui32Iterations; i++)
+        {
+            ArchiveItemTable* pTable;
+            Clock::time_point tpStart = Clock::now();
+            if (s_lib.pGetArchiveItemTable(pCtx, ARCHIVE_TABLE_COLUMN_INDEX | ARCHIVE_TABLE_COLUMN_SIZE | ARCHIVE_TABLE_COLUMN_ISDIR | ARCHIVE_TABLE_COLUMN_PATH | ARCHIVE_TABLE_PATH_UTF8, &pTable) != ARCHIVER_STATUS_SUCCESS)
+            {
+                rResult.strError = "list: " + ContextError(pCtx);
+                s_lib.pDeleteArchiveContext(pCtx);
+                return;
+            }
+            vTimes.push_back(ElapsedMs(tpStart));
+            if (i + 1 == oOptions.ui32Iterations)
+            {
+                const char* szPool = static_cast<const char*>(pTable->pPathPool);
+                for (uint32_t j = 0; j < pTable->ui32ItemCount; j++)
+                {
+                    if (pTable->pIsDir[j])
+                    {
+                        continue;
+                    }
+                    ArchiveEntry aeEntry;
+                    aeEntry.ui32Index = pTable->pIndices[j];
+                    aeEntry.ui64Size = pTable->pSizes[j];
+                    aeEntry.strPath.assign(szPool + pTable->pPathOffsets[j], szPool + pTable->pPathOffsets[j + 1] - 1);
+                    string strKey = aeEntry.strPath;
+                    replace(strKey.begin(), strKey.end(), '\\', '/');
+                    auto it = mSpecs.find(strKey);
+                    aeEntry.bKnown = it != mSpecs.end();
+                    aeEntry.ui32Crc = aeEntry.bKnown ? it->second->ui32Crc : 0;
+                    vEntries.push_back(move(aeEntry));
+                }
+            }
+            s_lib.pFreeArchiveItemTable(pCtx, pTable);
+        }
+        rResult.dListMs = Median(vTimes);
+        for (const ArchiveEntry& aeEntry : vEntries)
+        {
+            mEntries[aeEntry.ui32Index] = &aeEntry;
+            rResult.ui64UnpackedBytes += aeEntry.ui64Size;
+        }
+
+        // lookup by path, the first lookup builds the path tree and is reported on its own
+        if (!vEntries.empty())
+        {
+            size_t step = max<size_t>(1, vEntries.size() / ui32MaxLookups);
+            ArchiveItemUtf8* pItem;
+            Clock::time_point tpStart = Clock::now();
+
+            if (s_lib.pGetArchiveItemPropertiesByPathUtf8(pCtx, vEntries[0].strPath.c_str(), &pItem) == ARCHIVER_STATUS_SUCCESS)
+            {
+                s_lib.pFreeArchiveItemUtf8(pCtx, pItem);
+            }
+            rResult.dTreeBuildMs = ElapsedMs(tpStart);
+
+            vTimes.clear();
+            for (uint32_t i = 0; i < oOptions.ui32Iterations; i++)
+            {
+                uint32_t ui32Lookups = 0;
+                tpStart = Clock::now();
+                for (size_t j = 0; j < vEntries.size(); j += step, ui32Lookups++)
+                {
+                    if (s_lib.pGetArchiveItemPropertiesByPathUtf8(pCtx, vEntries[j].strPath.c_str(), &pItem) != ARCHIVER_STATUS_SUCCESS)
+                    {
+                        rResult.ui64VerifyFailures++;
+                        continue;
+                    }
+                    if (pItem->ui32Index != vEntries[j].ui32Index)
+                    {
+                        rResult.ui64VerifyFailures++;
+                    }
+                    s_lib.pFreeArchiveItemUtf8(pCtx, pItem);
+                }
+                vTimes.push_back(ElapsedMs(tpStart) * 1e6 / ui32Lookups);
+                rResult.ui32Lookups = ui32Lookups;
+            }
+            rResult.dLookupNs = Median(vTimes);
+        }
+
+        // per item extraction into a caller buffer
+        if (!vEntries.empty())
+        {
+            size_t step = max<size_t>(1, vEntries.size() / ui32MaxItemExtractions);
+            vector<uint8_t> vBuf(1);    // Empty items still need a valid buffer
+
+            vTimes.clear();
+            for (uint32_t i = 0; i < oOptions.ui32Iterations; i++)
+            {
+                uint32_t ui32Extractions = 0;
+                uint64_t ui64Bytes = 0;
+                Clock::time_point tpStart = Clock::now();
+                for (size_t j = 0; j < vEntries.size(); j += step, ui32Extractions++)
+                {
+                    const ArchiveEntry& aeEntry = vEntries[j];
+                    uint64_t ui64Written = 0;
+                    if (vBuf.size() < aeEntry.ui64Size)
+                    {
+                        vBuf.resize(static_cast<size_t>(aeEntry.ui64Size));
+                    }
+                    if (s_lib.pExtractArchiveItemToBufferByIndexEx(pCtx, aeEntry.ui32Index, vBuf.data(), vBuf.size(), wszPassword, &ui64Written) != ARCHIVER_STATUS_SUCCESS ||
+                        ui64Written != aeEntry.ui64Size)
+                    {
+                        rResult.ui64VerifyFailures++;
+                        continue;
+                    }
+                    ui64Bytes += ui64Written;
+                    if (i == 0 && aeEntry.bKnown && Crc32(vBuf.data(), static_cast<size_t>(ui64Written)) != aeEntry.ui32Crc)
+                    {
+                        rResult.ui64VerifyFailures++;
+                    }
+                }
+                vTimes.push_back(ElapsedMs(tpStart));
+                rResult.ui32ItemExtractions = ui32Extractions;
+                rResult.ui64ExtractItemBytes = ui64Bytes;
+            }
+            rResult.dExtractItemMs = Median(vTimes);
+        }
+
+        // bulk extraction of every file on the worker pool
+        if (!vEntries.empty())
+        {
+            vector<uint32_t> vIndices;
+            for (const ArchiveEntry& aeEntry : vEntries)
+            {
+                vIndices.push_back(aeEntry.ui32Index);
+            }
+
+            vTimes.clear();
+            for (uint32_t i = 0; i < oOptions.ui32Iterations; i++)
+            {
+                BulkState bsState;
+                bsState.pmEntries = &mEntries;
+                bsState.ui64Bytes = 0;
+                bsState.ui64Failures = 0;
+                Clock::time_point tpStart = Clock::now();
+                if (s_lib.pExtractArchiveItems(pCtx, vIndices.data(), static_cast<uint32_t>(vIndices.size()), oOptions.ui32Workers, wszPassword, BulkCallback, &bsState) != ARCHIVER_STATUS_SUCCESS)
+                {
+                    rResult.strError = "extract_bulk: " + ContextError(pCtx);
+                    break;
+                }
+                vTimes.push_back(ElapsedMs(tpStart));
+                rResult.ui64ExtractBulkBytes = bsState.ui64Bytes;
+                if (i == 0)
+                {
+                    rResult.ui64VerifyFailures += bsState.ui64Failures;
+                }
+            }
+            rResult.dExtractBulkMs = Median(vTimes);
+        }
+
+        s_lib.pDeleteArchiveContext(pCtx);
+    }
+
+    double MiBPerSecond(uint64_t ui64Bytes, double dMs)
+    {
+        return dMs > 0 ? (ui64Bytes / double(ui64MiB)) / (dMs / 1000) : 0;
+    }
+
+    void WriteResult(CJson& jOut, const Corpus& cCorpus, const string& strPath, const Result& rResult, bool bPeakReset)
+    {
+        jOut.Begin('{');
+        jOut.Field("name", cCorpus.szName);
+        jOut.Key("format");
+        if (cCorpus.szFormat)
+        {
+            jOut.String(cCorpus.szFormat);
+        }
+        else
+        {
+            jOut.Null();
+        }
+        jOut.Field("path", strPath);
+        jOut.Key("error");
+        if (rResult.strError.empty())
+        {
+            jOut.Null();
+        }
+        else
+        {
+            jOut.String(rResult.strError);
+        }
+        jOut.Field("items", rResult.ui32Items);
+        jOut.Field("unpacked_bytes", rResult.ui64UnpackedBytes);
+        jOut.Field("archive_bytes", rResult.ui64ArchiveBytes);
+        jOut.Field("generate_ms", rResult.dGenerateMs);
+        jOut.Field("open_ms", rResult.dOpenMs);
+        jOut.Field("list_ms", rResult.dListMs);
+        jOut.Field("tree_build_ms", rResult.dTreeBuildMs);
+        jOut.Field("lookups", rResult.ui32Lookups);
+        jOut.Field("lookup_ns", rResult.dLookupNs);
+        jOut.Field("item_extractions", rResult.ui32ItemExtractions);
+        jOut.Field("extract_item_ms", rResult.dExtractItemMs);
+        jOut.Field("extract_item_mib_s", MiBPerSecond(rResult.ui64ExtractItemBytes, rResult.dExtractItemMs));
+        jOut.Field("extract_bulk_ms", rResult.dExtractBulkMs);
+        jOut.Field("extract_bulk_mib_s", MiBPerSecond(rResult.ui64ExtractBulkBytes, rResult.dExtractBulkMs));
+        jOut.Field("verify_failures", rResult.ui64VerifyFailures);
+        jOut.Field("peak_rss_kib", rResult.ui64PeakRssKiB);
+        jOut.Field("peak_rss_per_corpus", bPeakReset);
+        jOut.End('}');
+    }
+
+    void Usage(const char* szArgv0)
+    {
+        fprintf(stderr, "usage: %s [--lib PATH] [--codec PATH] [--corpus DIR] [--scale FACTOR] [--iterations N] [--workers N] [--only NAME[,NAME]] [--archives DIR] [--output PATH]\n", szArgv0);
+    }
+
+    bool ParseOptions(int argc, char** argv, Options& oOptions)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            string strArg = argv[i];
+            if (i + 1 >= argc)
+            {
+                return false;
+            }
+            const char* szValue = argv[++i];
+            if (strArg == "--lib")
+            {
+                oOptions.strLib = szValue;
+            }
+            else if (strArg == "--codec")
+            {
+                oOptions.strCodec = szValue;
+            }
+            else if (strArg == "--corpus")
+            {
+                oOptions.strCorpus = szValue;
+            }
+            else if (strArg == "--scale")
+            {
+                oOptions.dScale = atof(szValue);
+            }
+            else if (strArg == "--iterations")
+            {
+                oOptions.ui32Iterations = static_cast<uint32_t>(max(1, atoi(szValue)));
+            }
+            else if (strArg == "--workers")
+            {
+                oOptions.ui32Workers = static_cast<uint32_t>(max(0, atoi(szValue)));
+            }
+            else if (strArg == "--only")
+            {
+                string strList = szValue;
+                size_t pos = 0, next;
+                while ((next = strList.find(',', pos)) != string::npos)
+                {
+                    oOptions.vOnly.push_back(strList.substr(pos, next - pos));
+                    pos = next + 1;
+                }
+                oOptions.vOnly.push_back(strList.substr(pos));
+            }
+            else if (strArg == "--archives")
+            {
+                oOptions.strArchives = szValue;
+            }
+            else if (strArg == "--output")
+            {
+                oOptions.strOutput = szValue;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return oOptions.dScale > 0;
+    }
+
+    bool LoadTitanArchive(Options& oOptions)
+    {
+        void* pModule;
+
+        if (oOptions.strLib.empty())
+        {
+            oOptions.strLib = sizeof(void*) == 8 ? "TitanArchive64.so" : "TitanArchive32.so";
+        }
+        pModule = dlopen(oOptions.strLib.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!pModule)
+        {
+            fprintf(stderr, "%s\n", dlerror());
+            return false;
+        }
+
+#define RESOLVE(name) \
+        s_lib.p##name = reinterpret_cast<fn##name>(dlsym(pModule, #name)); \
+        if (!s_lib.p##name) \
+        { \
+            fprintf(stderr, "Missing export %s\n", #name); \
+            return false; \
+        }
+
+        RESOLVE(GlobalInitialize)
+        RESOLVE(GlobalUninitialize)
+        RESOLVE(CreateArchiveContext)
+        RESOLVE(DeleteArchiveContext)
+        RESOLVE(OpenArchiveDiskUtf8)
+        RESOLVE(GetArchiveItemCount)
+        RESOLVE(GetArchiveItemTable)
+        RESOLVE(FreeArchiveItemTable)
+        RESOLVE(GetArchiveItemPropertiesByPathUtf8)
+        RESOLVE(FreeArchiveItemUtf8)
+        RESOLVE(ExtractArchiveItemToBufferByIndexEx)
+        RESOLVE(ExtractArchiveItems)
+        RESOLVE(GetError)
+#undef RESOLVE
+
+        // The 7-Zip library is installed next to TitanArchive, same as the Python package expects.
+        // Single-library builds have none and use the linked in handlers.
+        if (oOptions.strCodec.empty())
+        {
+            Dl_info diInfo;
+            string strDir;
+            struct stat st;
+            if (dladdr(reinterpret_cast<void*>(s_lib.pGlobalInitialize), &diInfo) && diInfo.dli_fname)
+            {
+                strDir = diInfo.dli_fname;
+                size_t pos = strDir.rfind('/');
+                strDir = pos == string::npos ? string() : strDir.substr(0, pos + 1);
+            }
+            oOptions.strCodec = strDir + (sizeof(void*) == 8 ? "TitanArchive64-7z.so" : "TitanArchive32-7z.so");
+            if (stat(oOptions.strCodec.c_str(), &st) != 0)
+            {
+                oOptions.strCodec.clear();
+            }
+        }
+
+        wstring wstrCodec(oOptions.strCodec.begin(), oOptions.strCodec.end());
+        if (s_lib.pGlobalInitialize(oOptions.strCodec.empty() ? nullptr : wstrCodec.c_str()) != ARCHIVER_STATUS_SUCCESS)
+        {
+            fprintf(stderr, "GlobalInitialize(%s) failed: %s\n", oOptions.strCodec.c_str(), ContextError(nullptr).c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Regular files of the directory sorted by name, so runs are comparable
+    vector<string> ListArchives(const string& strDir)
+    {
+        vector<string> vNames;
+        DIR* pDir = opendir(strDir.c_str());
+        struct dirent* pEntry;
+        struct stat st;
+
+        if (!pDir)
+        {
+            perror(strDir.c_str());
+            return vNames;
+        }
+        while ((pEntry = readdir(pDir)) != nullptr)
+        {
+            if (stat((strDir + "/" + pEntry->d_name).c_str(), &st) == 0 && S_ISREG(st.st_mode))
+            {
+                vNames.push_back(pEntry->d_name);
+            }
+        }
+        closedir(pDir);
+        sort(vNames.begin(), vNames.end());
+        return vNames;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options oOptions;
+    CJson jOut;
+    bool bTemporary = false;
+
+    if (!ParseOptions(argc, argv, oOptions))
+    {
+        Usage(argv[0]);
+        return 2;
+    }
+    if (!LoadTitanArchive(oOptions))
+    {
+        return 1;
+    }
+    InitCrcTable();
+
+    if (oOptions.strCorpus.empty())
+    {
+        char szTemplate[] = "/tmp/titanarchive-benchmark-XXXXXX";
+        if (!mkdtemp(szTemplate))
+        {
+            perror("mkdtemp");
+            return 1;
+        }
+        oOptions.strCorpus = szTemplate;
+        bTemporary = true;
+    }
+    else
+    {
+        mkdir(oOptions.strCorpus.c_str(), 0755);
+    }
+
+    jOut.Begin('{');
+    jOut.Field("library", oOptions.strLib);
+    jOut.Field("codec", oOptions.strCodec);
+    jOut.Field("scale", oOptions.dScale);
+    jOut.Field("iterations", oOptions.ui32Iterations);
+    jOut.Field("workers", oOptions.ui32Workers);
+    jOut.Key("corpora");
+    jOut.Begin('[');
+
+    for (const Corpus& cCorpus : s_rgCorpora)
+    {
+        if (!oOptions.vOnly.empty() && find(oOptions.vOnly.begin(), oOptions.vOnly.end(), cCorpus.szName) == oOptions.vOnly.end())
+        {
+            continue;
+        }
+
+        // The scale is part of the name so a kept corpus directory can hold several sizes
+        char szScale[32];
+        snprintf(szScale, sizeof(szScale), "%g", oOptions.dScale);
+        string strPath = oOptions.strCorpus + "/" + cCorpus.szName + "-" + szScale + cCorpus.szExtension;
+        vector<FileSpec> vFiles = cCorpus.pfnFiles(oOptions.dScale);
+        Result rResult;
+        struct stat st;
+
+        fprintf(stderr, "%s\n", cCorpus.szName);
+        Clock::time_point tpStart = Clock::now();
+        for (FileSpec& fs : vFiles)
+        {
+            ComputeCrc(fs);
+        }
+        if (bTemporary || stat(strPath.c_str(), &st) != 0)
+        {
+            if (!WriteCorpus(cCorpus, strPath, vFiles))
+            {
+                rResult.strError = "Failed to write " + strPath;
+            }
+        }
+        rResult.dGenerateMs = ElapsedMs(tpStart);
+        if (stat(strPath.c_str(), &st) == 0)
+        {
+            rResult.ui64ArchiveBytes = static_cast<uint64_t>(st.st_size);
+        }
+
+        bool bPeakReset = ResetPeakRss();
+        if (rResult.strError.empty())
+        {
+            RunScenarios(cCorpus, strPath, vFiles, oOptions, rResult);
+        }
+        rResult.ui64PeakRssKiB = PeakRssKiB();
+
+        WriteResult(jOut, cCorpus, strPath, rResult, bPeakReset);
+        if (bTemporary)
+        {
+            remove(strPath.c_str());
+        }
+    }
+
+    // Contents of these are unknown, lookups and sizes are verified but not the data
+    for (const string& strName : oOptions.strArchives.empty() ? vector<string>() : ListArchives(oOptions.strArchives))
+    {
+        if (!oOptions.vOnly.empty() && find(oOptions.vOnly.begin(), oOptions.vOnly.end(), strName) == oOptions.vOnly.end())
+        {
+            continue;
+        }
+
+        const Corpus cCorpus = { strName.c_str(), nullptr, "", ContainerKind::External, nullptr };
+        string strPath = oOptions.strArchives + "/" + strName;
+        Result rResult;
+        struct stat st;
+
+        fprintf(stderr, "%s\n", cCorpus.szName);
+        if (stat(strPath.c_str(), &st) == 0)
+        {
+            rResult.ui64ArchiveBytes = static_cast<uint64_t>(st.st_size);
+        }
+
+        bool bPeakReset = ResetPeakRss();
+        RunScenarios(cCorpus, strPath, vector<FileSpec>(), oOptions, rResult);
+        rResult.ui64PeakRssKiB = PeakRssKiB();
+
+        WriteResult(jOut, cCorpus, strPath, rResult, bPeakReset);
+    }
+
+    jOut.End(']');
+    jOut.End('}');
+
+    if (bTemporary)
+    {
+        rmdir(oOptions.strCorpus.c_str());
+    }
+    s_lib.pGlobalUninitialize();
+
+    if (oOptions.strOutput.empty())
+    {
+        printf("%s\n", jOut.Str().c_str());
+    }
+    else
+    {
+        FILE* pFile = fopen(oOptions.strOutput.c_str(), "w");
+        if (!pFile)
+        {
+            perror(oOptions.strOutput.c_str());
+            return 1;
+        }
+        fprintf(pFile, "%s\n", jOut.Str().c_str());
+        fclose(pFile);
+    }
+    return 0;
+}
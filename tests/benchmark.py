@@ -45,8 +45,20 @@ def benchmark_file(size):
             print('ZipFile: ' + str(timeit.timeit('zipfile_extract()', globals=globals(), number=1)) + 'sec')
             zip_file_path = None
 
-def benchmark_many_files():
-    pass
+def benchmark_many_files(count, size):
+    global zip_file_path
+    print('Benchmarking...')
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        zip_file_path = os.path.join(tmp_dir, 'files.zip')
+        with zipfile.ZipFile(zip_file_path, 'w') as z:
+            for i in range(0, count):
+                z.writestr('dir{:03}/file{:06}'.format(i % 100, i), os.urandom(size))
+        print('TitanArchive: ' + str(timeit.timeit('titanarchive_extract()', globals=globals(), number=1)) + 'sec')
+        print('ZipFile: ' + str(timeit.timeit('zipfile_extract()', globals=globals(), number=1)) + 'sec')
+        zip_file_path = None
 
+# Only compares against zipfile, the native harness in benchmark.cpp covers the other formats and
+# scenarios (python3 setup.py benchmark)
 if __name__ == '__main__':
-    benchmark_file(1024*1024*1024)
\ No newline at end of file
+    benchmark_file(1024*1024*1024)
+    benchmark_many_files(10000, 256)
\ No newline at end of file
@@ -3,9 +3,12 @@ import titanarchive
 import os
 import tempfile
 import zipfile
+import tarfile
 import time
+import threading
 import datetime
 import math
+import json
 from enum import Enum, auto
 
 ARCHIVE_PATH = os.path.dirname(os.path.realpath(__file__))
@@ -41,6 +44,16 @@ def open_with_wrong_format(cls, input_type):
     except titanarchive.TitanArchiveException:
         pass
 
+def strip_tar_magic(tar_path):
+    # Rewrite the first header as a pre-POSIX tar header so there is no signature to discover
+    with open(tar_path, 'r+b') as f:
+        header = bytearray(f.read(512))
+        header[257:265] = bytes(8)
+        header[148:156] = b' ' * 8
+        header[148:156] = '{:06o}\0 '.format(sum(header)).encode()
+        f.seek(0)
+        f.write(header)
+
 def extract_and_verify(cls, input_type, zip_on_disk, archive_format = None, password = None):
     if input_type == ArchiveInputType.MEMORY:
         with open(zip_on_disk, 'rb') as f:
@@ -137,6 +150,201 @@ class ExtractionTests(unittest.TestCase):
         else:
             raise Exception('Unknown Platform')
         extract_and_verify(self, ArchiveInputType.MEMORY, TEST_ZIP)
+    def test_GlobalInitLinked(self):
+        if titanarchive.TITAN_ARCHIVE_7Z_MODULE is not None:
+            self.skipTest('7-Zip is loaded from a separate module')
+        # Single-library builds resolve the handlers linked into TitanArchive
+        titanarchive.GlobalInitialize(None)
+        self.assertIn('zip', titanarchive.GlobalGetSupportedArchiveFormats())
+        extract_and_verify(self, ArchiveInputType.MEMORY, TEST_ZIP)
+    def test_GlobalReload(self):
+        with open(TEST_ZIP, 'rb') as f:
+            data = f.read()
+        errors = []
+        stop = threading.Event()
+        def worker():
+            try:
+                while not stop.is_set():
+                    with titanarchive.TitanArchive(data) as ta:
+                        self.assertEqual(ta.ExtractArchiveItemToBufferByPath('file_at_root.txt').getvalue(), b'Contents')
+            except Exception as e:
+                errors.append(e)
+        # Contexts opened before a reload keep working on the registry they were opened with
+        with titanarchive.TitanArchive(TEST_ZIP) as ta:
+            threads = [threading.Thread(target = worker) for i in range(0, 4)]
+            for t in threads:
+                t.start()
+            try:
+                for i in range(0, 20):
+                    titanarchive.GlobalInitialize()
+                    self.assertTrue(len(titanarchive.GlobalGetSupportedArchiveFormats()) > 0)
+            finally:
+                stop.set()
+                for t in threads:
+                    t.join()
+            self.assertEqual(errors, [])
+            self.assertEqual(ta.ExtractArchiveItemToBufferByPath('file_at_root.txt').getvalue(), b'Contents')
+        with titanarchive.TitanArchive(TEST_ZIP) as ta:
+            titanarchive.GlobalUninitialize()
+            ta.CloseArchive()
+        titanarchive.GlobalInitialize()
+    def test_ExtractIntoBuffer(self):
+        import mmap
+        with open(TEST_ZIP, 'rb') as f:
+            data = f.read()
+        native = titanarchive.titanarchive._native
+        # Runs against the C extension when it is built and always against the ctypes bindings
+        for backend in ([native, None] if native is not None else [None]):
+            titanarchive.titanarchive._native = backend
+            try:
+                for buf in [data, bytearray(data), memoryview(data), memoryview(bytearray(data))]:
+                    with titanarchive.TitanArchive(buf) as ta:
+                        index = ta.GetArchiveItemPropertiesByPath('file_at_root.txt').Index
+                        self.assertEqual(ta.ExtractArchiveItemToBufferByIndex(index).getvalue(), b'Contents')
+                        self.assertEqual(ta.ExtractArchiveItemToBufferByPath('file_at_root.txt').read(), b'Contents')
+                        out = bytearray(16)
+                        self.assertEqual(ta.ExtractArchiveItemIntoBufferByIndex(index, out), 8)
+                        self.assertEqual(out[:8], b'Contents')
+                        # Smaller buffers receive the start of the item
+                        out = bytearray(3)
+                        self.assertEqual(ta.ExtractArchiveItemIntoBufferByPath('file_at_root.txt', memoryview(out)), 3)
+                        self.assertEqual(out, b'Con')
+                        with mmap.mmap(-1, 8) as m:
+                            self.assertEqual(ta.ExtractArchiveItemIntoBufferByIndex(index, m), 8)
+                            self.assertEqual(m[:], b'Contents')
+                        self.assertRaises((TypeError, BufferError), ta.ExtractArchiveItemIntoBufferByIndex, index, b'readonly')
+                        self.assertRaises(titanarchive.TitanArchiveException, ta.ExtractArchiveItemIntoBufferByPath, 'Invalid Path', bytearray(8))
+                        self.assertRaises(titanarchive.TitanArchiveException, ta.ExtractArchiveItemToBufferByIndex, 99999999)
+                # A memory archive pins its buffer until the context is deleted
+                buf = bytearray(data)
+                ta = titanarchive.TitanArchive(buf)
+                if backend is not None:
+                    self.assertRaises(BufferError, buf.extend, b'\0')
+                ta.CloseArchive()
+                del ta
+                buf.extend(b'\0')
+            finally:
+                titanarchive.titanarchive._native = native
+    def test_OpenItemStream(self):
+        import io
+        import json
+        import csv
+        payload = bytes(range(256)) * 4096
+        records = [{'id': i, 'name': 'item{}'.format(i)} for i in range(0, 1000)]
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            zip_path = os.path.join(tmp_dir, 'test.zip')
+            with zipfile.ZipFile(zip_path, 'w', zipfile.ZIP_DEFLATED) as z:
+                z.writestr('payload.bin', payload)
+                z.writestr('records.json', json.dumps(records))
+                z.writestr('records.csv', ''.join('{},{}\n'.format(r['id'], r['name']) for r in records))
+                z.writestr('empty.txt', b'')
+            with titanarchive.TitanArchive(zip_path) as ta:
+                with ta.open('records.json') as f:
+                    self.assertEqual(json.load(f), records)
+                with ta.open('records.csv') as f:
+                    self.assertEqual([row for row in csv.reader(io.TextIOWrapper(f))], [[str(r['id']), r['name']] for r in records])
+                index = ta.GetArchiveItemPropertiesByPath('payload.bin').Index
+                # A small read ahead keeps the decoder blocked while the caller reads
+                with ta.open(index, read_ahead = 4096) as f:
+                    raw = f.raw
+                    out = bytearray(1000)
+                    self.assertEqual(raw.readinto(out), 1000)
+                    self.assertEqual(out, payload[:1000])
+                    self.assertEqual(f.read(10), payload[1000:1010])
+                    # The context the reader came from stays usable
+                    self.assertEqual(ta.ExtractArchiveItemToBufferByPath('records.json').getvalue(), json.dumps(records).encode())
+                    self.assertEqual(f.seek(500000), 500000)
+                    self.assertEqual(f.read(100), payload[500000:500100])
+                    self.assertEqual(f.seek(10), 10)
+                    self.assertEqual(f.read(5), payload[10:15])
+                    self.assertEqual(f.seek(-16, io.SEEK_END), len(payload) - 16)
+                    self.assertEqual(f.read(), payload[-16:])
+                    self.assertEqual(f.read(), b'')
+                with ta.open('empty.txt') as f:
+                    self.assertEqual(f.read(), b'')
+                # Closing before the end stops the decoder
+                for i in range(0, 20):
+                    f = ta.open(index, read_ahead = 1024)
+                    self.assertEqual(f.read(1), payload[:1])
+                    f.close()
+                    self.assertRaises(ValueError, f.read)
+                self.assertRaises(titanarchive.TitanArchiveException, ta.open, 'Invalid Path')
+                self.assertRaises(titanarchive.TitanArchiveException, ta.open, 99999999)
+            with tarfile.open(os.path.join(tmp_dir, 'inner.tar'), 'w') as tf:
+                tf.add(zip_path, 'test.zip')
+            with titanarchive.TitanArchive(os.path.join(tmp_dir, 'inner.tar'), trial_formats = ['tar']) as ta:
+                with ta.open('test.zip') as f:
+                    self.assertEqual(zipfile.ZipFile(io.BytesIO(f.read())).read('payload.bin'), payload)
+    def test_ExtractMany(self):
+        import asyncio
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            zip_path = os.path.join(tmp_dir, 'test.zip')
+            contents = dict(('file{}.txt'.format(i), os.urandom(i * 97)) for i in range(0, 200))
+            with zipfile.ZipFile(zip_path, 'w', zipfile.ZIP_DEFLATED) as z:
+                for name, data in contents.items():
+                    z.writestr(name, data)
+            with titanarchive.TitanArchive(zip_path) as ta:
+                items = list(ta)
+                expected = [contents[item.Path] for item in items]
+                for max_workers in [0, 1, 4]:
+                    futures = ta.extract_many([item.Index for item in items], max_workers)
+                    # The archive the batch came from stays usable while it runs
+                    self.assertEqual(ta.ExtractArchiveItemToBufferByIndex(items[5].Index).getvalue(), expected[5])
+                    self.assertEqual([future.result(timeout = 60).getvalue() for future in futures], expected)
+                # Failures are reported per item, duplicates get their own result
+                futures = ta.extract_many([items[1].Index, 99999999, items[1].Index])
+                self.assertEqual(futures[0].result(timeout = 60).getvalue(), expected[1])
+                self.assertRaises(titanarchive.TitanArchiveException, futures[1].result, 60)
+                self.assertEqual(futures[2].result(timeout = 60).getvalue(), expected[1])
+                self.assertEqual(ta.extract_many([]), [])
+
+                async def ingest():
+                    single = await ta.aextract(items[3].Index)
+                    many = await ta.aextract([item.Index for item in items[10:50]], 4)
+                    return single, many
+                single, many = asyncio.run(ingest())
+                self.assertEqual(single.getvalue(), expected[3])
+                self.assertEqual([data.getvalue() for data in many], expected[10:50])
+            # Directories and empty files are known to be empty and don't start a decoder thread
+            tree_path = os.path.join(tmp_dir, 'tree.zip')
+            with zipfile.ZipFile(tree_path, 'w') as z:
+                for i in range(0, 100):
+                    z.writestr('dir{}/'.format(i), b'')
+                    z.writestr('dir{}/empty.txt'.format(i), b'')
+            with titanarchive.TitanArchive(tree_path) as ta:
+                # Batches run on a clone, the process totals see its threads
+                titanarchive.GlobalResetStats()
+                futures = ta.extract_many([item.Index for item in ta], 4)
+                self.assertEqual([future.result(timeout = 60).getvalue() for future in futures], [b''] * 200)
+                self.assertLess(titanarchive.GlobalGetStats()['ThreadsSpawned'], 100)
+        with titanarchive.TitanArchive(PW_TEST_ZIP) as ta:
+            indices = [item.Index for item in ta if not item.IsDir]
+            self.assertTrue(all(future.result(timeout = 60) for future in ta.extract_many(indices, password = 'password')))
+            for future in ta.extract_many(indices, password = 'wrongpassword'):
+                self.assertRaises(titanarchive.TitanArchiveException, future.result, 60)
+    def test_ResetArchiveContext(self):
+        with open(TEST_ZIP, 'rb') as f:
+            data = f.read()
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            tar_path = os.path.join(tmp_dir, 'test.tar')
+            with tarfile.open(tar_path, 'w') as tf:
+                tf.add(os.path.join(ARCHIVE_PATH, 'archives', 'Test.zip'), 'inner.zip')
+            with titanarchive.TitanArchive(data) as ta:
+                for i in range(0, 3):
+                    ta.Reset()
+                    self.assertRaises(titanarchive.TitanArchiveException, ta.GetArchiveItemCount)
+                    self.assertRaises(titanarchive.TitanArchiveException, ta.OpenArchiveDisk, tar_path)
+                    ta.SetTrialOpenFormats(['tar'])
+                    ta.OpenArchiveDisk(tar_path)
+                    self.assertEqual(ta.GetArchiveFormat(), 'tar')
+                    self.assertEqual(ta.ExtractArchiveItemToBufferByPath('inner.zip').getvalue(), data)
+                    ta.Reset()
+                    ta.OpenArchiveMemory(data)
+                    self.assertEqual(ta.ExtractArchiveItemToBufferByPath('file_at_root.txt').getvalue(), b'Contents')
+        # Deleted contexts and closed handlers are reused by later opens
+        for i in range(0, 100):
+            with titanarchive.TitanArchive(data) as ta:
+                self.assertEqual(ta.ExtractArchiveItemToBufferByPath('file_at_root.txt').getvalue(), b'Contents')
     def test_GlobalArchiveFormats(self):
         self.assertTrue(len(titanarchive.GlobalGetSupportedArchiveFormats()) > 50)
     def test_OpenFromMemory(self):
@@ -210,6 +418,420 @@ class ExtractionTests(unittest.TestCase):
                 pass
             else:
                 raise Exception('Unreachable')
+    def test_TrialOpen(self):
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            tar_path = os.path.join(tmp_dir, 'test.tar')
+            with zipfile.ZipFile(TEST_ZIP, 'r') as z:
+                z.extractall(tmp_dir)
+            with tarfile.open(tar_path, 'w', format=tarfile.GNU_FORMAT) as t:
+                t.add(os.path.join(tmp_dir, 'file_at_root.txt'), 'file_at_root.txt')
+            strip_tar_magic(tar_path)
+            try:
+                titanarchive.TitanArchive(tar_path)
+                raise Exception('Unreachable')
+            except titanarchive.TitanArchiveException:
+                pass
+            with titanarchive.TitanArchive(tar_path, trial_formats = ['zip', 'tar']) as ta:
+                self.assertEqual(ta.GetArchiveFormat(), 'tar')
+                with open(os.path.join(tmp_dir, 'file_at_root.txt'), 'rb') as f:
+                    self.assertEqual(ta.ExtractArchiveItemToBufferByPath('file_at_root.txt').getvalue(), f.read())
+            with open(tar_path, 'rb') as f:
+                with titanarchive.TitanArchive(f.read(), trial_formats = '*') as ta:
+                    self.assertEqual(ta.GetArchiveFormat(), 'tar')
+            try:
+                titanarchive.TitanArchive(tar_path, trial_formats = ['tar'], trial_read_budget = 16)
+                raise Exception('Unreachable')
+            except titanarchive.TitanArchiveException:
+                pass
+
+    def test_ArchiveCache(self):
+        titanarchive.GlobalConfigureArchiveCache(64 * 1024 * 1024)
+        try:
+            for i in range(0, 3):
+                extract_and_verify(self, ArchiveInputType.DISK, TEST_ZIP)
+                with titanarchive.TitanArchive(TEST_ZIP, cache = True) as ta:
+                    self.assertEqual(ta.GetArchiveFormat(), 'zip')
+                    _extract_and_verify(self, TEST_ZIP, ta, None)
+            with open(PW_TEST_ZIP, 'rb') as f:
+                data = f.read()
+            for i in range(0, 3):
+                with titanarchive.TitanArchive(data, password = 'password', cache = True) as ta:
+                    _extract_and_verify(self, PW_TEST_ZIP, ta, 'password')
+            titanarchive.GlobalFlushArchiveCache()
+            with titanarchive.TitanArchive(TEST_ZIP, cache = True) as ta:
+                _extract_and_verify(self, TEST_ZIP, ta, None)
+        finally:
+            titanarchive.GlobalConfigureArchiveCache(0)
+
+    def test_ArchiveIndex(self):
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            zip_path = os.path.join(tmp_dir, 'test.zip')
+            index_path = os.path.join(tmp_dir, 'test.zip.idx')
+            with open(TEST_ZIP, 'rb') as src, open(zip_path, 'wb') as dst:
+                dst.write(src.read())
+            # Whatever sits at the old fixed temp name must not get in the way
+            os.mkdir(index_path + '.tmp')
+            for i in range(0, 2):
+                with titanarchive.TitanArchive(zip_path, index_path = index_path) as ta:
+                    self.assertEqual(ta.GetArchiveFormat(), 'zip')
+                    _extract_and_verify(self, TEST_ZIP, ta, None)
+                self.assertTrue(os.path.isfile(index_path))
+            os.rmdir(index_path + '.tmp')
+            with titanarchive.TitanArchive(zip_path) as ta:
+                errors = []
+                def saver():
+                    try:
+                        for j in range(0, 20):
+                            ta.SaveArchiveIndex(index_path)
+                    except Exception as e:
+                        errors.append(e)
+                threads = [threading.Thread(target = saver) for i in range(0, 4)]
+                for t in threads:
+                    t.start()
+                for t in threads:
+                    t.join()
+                self.assertEqual(errors, [])
+            self.assertEqual(sorted(os.listdir(tmp_dir)), ['test.zip', 'test.zip.idx'])
+            with titanarchive.TitanArchive(zip_path, index_path = index_path) as ta:
+                _extract_and_verify(self, TEST_ZIP, ta, None)
+            with open(index_path, 'wb') as f:
+                f.write(b'stale')
+            with titanarchive.TitanArchive(zip_path, index_path = index_path) as ta:
+                _extract_and_verify(self, TEST_ZIP, ta, None)
+            self.assertGreater(os.path.getsize(index_path), 5)
+            # A pool length that only matches the file size once multiplied modulo 2^64
+            with open(index_path, 'r+b') as f:
+                f.seek(88)
+                pool_length = int.from_bytes(f.read(8), 'little')
+                f.seek(88)
+                f.write((pool_length + (1 << 62)).to_bytes(8, 'little'))
+            with titanarchive.TitanArchive(zip_path, index_path = index_path) as ta:
+                _extract_and_verify(self, TEST_ZIP, ta, None)
+            with open(index_path, 'rb') as f:
+                f.seek(88)
+                self.assertEqual(int.from_bytes(f.read(8), 'little'), pool_length)
+            with open(TEST_ZIP, 'rb') as f:
+                with titanarchive.TitanArchive(f.read()) as ta:
+                    try:
+                        ta.SaveArchiveIndex(index_path)
+                        raise Exception('Unreachable')
+                    except titanarchive.TitanArchiveException:
+                        pass
+
+    def test_CloneArchiveContext(self):
+        with open(TEST_ZIP, 'rb') as f:
+            data = f.read()
+        for archive in [TEST_ZIP, data]:
+            ta = titanarchive.TitanArchive(archive)
+            clones = [ta.Clone() for i in range(0, 4)]
+            ta.CloseArchive()
+            errors = []
+            def worker(clone):
+                try:
+                    with clone:
+                        self.assertEqual(clone.GetArchiveFormat(), 'zip')
+                        _extract_and_verify(self, TEST_ZIP, clone, None)
+                except Exception as e:
+                    errors.append(e)
+            threads = [threading.Thread(target = worker, args = (clone,)) for clone in clones]
+            for t in threads:
+                t.start()
+            for t in threads:
+                t.join()
+            self.assertEqual(errors, [])
+            try:
+                ta.Clone()
+                raise Exception('Unreachable')
+            except titanarchive.TitanArchiveException:
+                pass
+
+    def test_PathLookup(self):
+        with titanarchive.TitanArchive(TEST_ZIP) as ta:
+            item = ta.GetArchiveItemPropertiesByPath('dir1' + SLASH_CHAR + 'another_file.txt')
+            for path in ['dir1' + SLASH_CHAR * 2 + 'another_file.txt', SLASH_CHAR + 'dir1' + SLASH_CHAR + 'another_file.txt' + SLASH_CHAR]:
+                self.assertEqual(ta.GetArchiveItemPropertiesByPath(path).Index, item.Index)
+                self.assertEqual(ta.ExtractArchiveItemToBufferByPath(path).getvalue(), b'Test Data 123')
+            try:
+                ta.GetArchiveItemPropertiesByPath('dir')
+                raise Exception('Unreachable')
+            except titanarchive.TitanArchiveException:
+                pass
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            zip_path = os.path.join(tmp_dir, 'test.zip')
+            with zipfile.ZipFile(zip_path, 'w') as z:
+                z.writestr('a/b/c.txt', b'abc')
+            with titanarchive.TitanArchive(zip_path) as ta:
+                for path in ['a', 'a' + SLASH_CHAR + 'b']:
+                    item = ta.GetArchiveItemPropertiesByPath(path)
+                    self.assertTrue(item.IsDir)
+                    self.assertEqual(item.Index, 0xffffffff)
+                self.assertEqual(ta.ExtractArchiveItemToBufferByPath(SLASH_CHAR.join(['a', 'b', 'c.txt'])).getvalue(), b'abc')
+
+    def test_ListDirectoryTree(self):
+        with titanarchive.TitanArchive(TEST_ZIP) as ta:
+            self.assertEqual([item.Path for item in ta.ListDirectory('')], ['dir1', 'empty_directory', 'file_at_root.txt'])
+            self.assertEqual([item.Path for item in ta.ListDirectory('dir1' + SLASH_CHAR)], ['another_file.txt', 'dir2', 'empty_directory'])
+            try:
+                ta.ListDirectory('dir')
+                raise Exception('Unreachable')
+            except titanarchive.TitanArchiveException:
+                pass
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            zip_path = os.path.join(tmp_dir, 'test.zip')
+            with zipfile.ZipFile(zip_path, 'w') as z:
+                for name in ['a/b/z.txt', 'a/b/c/d.txt', 'a/b/a.txt']:
+                    z.writestr(name, name.encode())
+            with titanarchive.TitanArchive(zip_path) as ta:
+                self.assertEqual([(item.Path, item.IsDir) for item in ta.ListDirectory('a')], [('b', True)])
+                items = ta.ListDirectory(SLASH_CHAR.join(['a', 'b']))
+                self.assertEqual([item.Path for item in items], ['a.txt', 'c', 'z.txt'])
+                self.assertEqual(items[0].Index, 2)
+
+    def test_WalkArchive(self):
+        def walk(ta, path):
+            rtn = []
+            for item in ta.ListDirectory(path):
+                full_path = os.path.join(path, item.Path) if path else item.Path
+                rtn.append((full_path, item.Index, item.IsDir))
+                if item.IsDir:
+                    rtn += walk(ta, full_path)
+            return rtn
+        with titanarchive.TitanArchive(TEST_ZIP) as ta:
+            items = ta.WalkArchive()
+            self.assertEqual([(item.Path, item.Index, item.IsDir) for item in items], walk(ta, ''))
+            self.assertEqual(len(items), ta.GetArchiveItemCount())
+            self.assertEqual([item.Path for item in ta.WalkArchive('dir1' + SLASH_CHAR + 'dir2')], [SLASH_CHAR.join(['dir1', 'dir2', name]) for name in ['another_file.txt', 'dir3', 'dir3' + SLASH_CHAR + 'file.txt', 'empty_directory', 'file.txt']])
+            self.assertEqual(ta.WalkArchive('file_at_root.txt'), [])
+            self.assertRaises(titanarchive.TitanArchiveException, ta.WalkArchive, 'dir')
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            zip_path = os.path.join(tmp_dir, 'test.zip')
+            with zipfile.ZipFile(zip_path, 'w') as z:
+                for name in ['a/b/z.txt', 'a/b/c/d.txt', 'a/b/a.txt', 'e.txt']:
+                    z.writestr(name, name.encode())
+            with titanarchive.TitanArchive(zip_path) as ta:
+                expected = [('a', True, 0xffffffff), ('a/b', True, 0xffffffff), ('a/b/a.txt', False, 2), ('a/b/c', True, 0xffffffff), ('a/b/c/d.txt', False, 1), ('a/b/z.txt', False, 0), ('e.txt', False, 3)]
+                self.assertEqual([(item.Path, item.IsDir, item.Index) for item in ta.WalkArchive()], [(path.replace('/', SLASH_CHAR), is_dir, index) for path, is_dir, index in expected])
+
+    def test_GetArchiveItemTable(self):
+        with titanarchive.TitanArchive(TEST_ZIP) as ta:
+            table = ta.GetArchiveItemTable()
+            self.assertEqual(len(table['Index']), ta.GetArchiveItemCount())
+            for i in table['Index']:
+                item = ta.GetArchiveItemPropertiesByIndex(i)
+                self.assertEqual((table['Path'][i], table['Size'][i], table['MTime'][i], table['IsDir'][i]), (item.Path, item.Size, item.MTime, item.IsDir))
+            table = ta.GetArchiveItemTable(titanarchive.ARCHIVE_TABLE_COLUMN_SIZE)
+            self.assertEqual(list(table.keys()), ['Size'])
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            zip_path = os.path.join(tmp_dir, 'test.zip')
+            with zipfile.ZipFile(zip_path, 'w') as z:
+                z.writestr('d\u00e9j\u00e0/\U0001f600.txt', b'')
+            with titanarchive.TitanArchive(zip_path) as ta:
+                self.assertEqual(ta.GetArchiveItemTable()['Path'], [ta.GetArchiveItemPropertiesByIndex(0).Path])
+
+    def test_IterArchiveItems(self):
+        with titanarchive.TitanArchive(TEST_ZIP) as ta:
+            expected = [ta.GetArchiveItemPropertiesByIndex(i) for i in range(0, ta.GetArchiveItemCount())]
+            items = list(ta)
+            self.assertEqual(items, expected)
+            self.assertTrue(all(type(item) is titanarchive.ArchiveItem for item in items + expected))
+            lazy = list(ta.IterArchiveItems(lazy_paths = True))
+            self.assertEqual([(item.Index, item.Path, item.IsDir, item.Size, item.MTime) for item in lazy], [tuple(item) for item in expected])
+            self.assertEqual(type(ta.GetArchiveItemPropertiesEx(0)), type(ta.GetArchiveItemPropertiesEx(1)))
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            zip_path = os.path.join(tmp_dir, 'test.zip')
+            with zipfile.ZipFile(zip_path, 'w') as z:
+                for i in range(0, 20000):
+                    z.writestr('d\u00e9j\u00e0/{}.txt'.format(i), b'')
+            with titanarchive.TitanArchive(zip_path) as ta:
+                paths = ['d\u00e9j\u00e0{}{}.txt'.format(SLASH_CHAR, i) for i in range(0, 20000)]
+                self.assertEqual([item.Path for item in ta], paths)
+                self.assertEqual([item.Path for item in ta.IterArchiveItems(lazy_paths = True)], paths)
+
+    def test_Utf8Api(self):
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            zip_path = os.path.join(tmp_dir, 'd\u00e9j\u00e0.zip')
+            name = 'd\u00e9j\u00e0/\U0001f600.txt'
+            with zipfile.ZipFile(zip_path, 'w') as z:
+                z.writestr(name, b'smile')
+            with titanarchive.TitanArchive(zip_path) as ta:
+                path = name.replace('/', SLASH_CHAR)
+                self.assertEqual([item.Path for item in ta.WalkArchive()], ['d\u00e9j\u00e0', path])
+                self.assertEqual([item.Path for item in ta.ListDirectory('d\u00e9j\u00e0')], ['\U0001f600.txt'])
+                self.assertEqual(ta.GetArchiveItemPropertiesByIndex(0).Path, path)
+                self.assertEqual(ta.GetArchiveItemPropertiesByPath(path).Size, 5)
+                self.assertEqual(ta.ExtractArchiveItemToBufferByPath(path).getvalue(), b'smile')
+                # The wide entry points see the same items
+                ai = titanarchive.ctypes.POINTER(titanarchive.titanarchive._ArchiveItem)()
+                self.assertEqual(titanarchive.lib.GetArchiveItemPropertiesByIndex(ta._ctx, 0, titanarchive.ctypes.byref(ai)), titanarchive.ARCHIVER_STATUS_SUCCESS)
+                self.assertEqual(ai.contents.Path, path)
+                titanarchive.lib.FreeArchiveItem(ta._ctx, ai)
+                self.assertRaises(titanarchive.TitanArchiveException, ta.GetArchiveItemPropertiesByPath, 'd\u00e9j\u00e0' + SLASH_CHAR + 'missing')
+            # A file name that is not UTF-8 arrives as surrogateescape and must reach the file system unchanged
+            if os.name != 'nt':
+                raw_path = os.path.join(os.fsencode(tmp_dir), b'\xff.zip')
+                with open(zip_path, 'rb') as src, open(raw_path, 'wb') as dst:
+                    dst.write(src.read())
+                for index_path in [None, os.fsdecode(raw_path + b'.idx')]:
+                    with titanarchive.TitanArchive(os.fsdecode(raw_path), index_path = index_path) as ta:
+                        self.assertEqual(ta.ExtractArchiveItemToBufferByPath(path).getvalue(), b'smile')
+                self.assertTrue(os.path.isfile(raw_path + b'.idx'))
+
+    def test_GetArchiveItemPropertiesEx(self):
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            zip_path = os.path.join(tmp_dir, 'test.zip')
+            with open(TEST_ZIP, 'rb') as src, open(zip_path, 'wb') as dst:
+                dst.write(src.read())
+            with zipfile.ZipFile(zip_path) as zf:
+                infos = dict((info.filename.rstrip('/').replace('/', os.sep), info) for info in zf.infolist())
+            for index_path in [None, os.path.join(tmp_dir, 'test.zip.idx'), os.path.join(tmp_dir, 'test.zip.idx')]:
+                with titanarchive.TitanArchive(zip_path, index_path = index_path) as ta:
+                    for i in range(0, ta.GetArchiveItemCount()):
+                        item = ta.GetArchiveItemPropertiesEx(i)
+                        info = infos[item.Path]
+                        self.assertEqual(item.Index, i)
+                        self.assertEqual(item.Size, info.file_size)
+                        self.assertEqual(item.PackSize, info.compress_size)
+                        self.assertEqual(item.CRC, info.CRC)
+                        self.assertGreaterEqual(item.Offset, info.header_offset)
+                        self.assertIn(item.Method, ['Deflate', 'Store'])
+                        self.assertFalse(item.Encrypted)
+                        self.assertIsNone(item.Block)
+                        item = ta.GetArchiveItemPropertiesEx(i, titanarchive.ARCHIVE_ITEM_PROPERTY_CRC)
+                        self.assertEqual(item.CRC, info.CRC)
+                        self.assertIsNone(item.PackSize)
+                        self.assertIsNone(item.Method)
+                    self.assertRaises(titanarchive.TitanArchiveException, ta.GetArchiveItemPropertiesEx, ta.GetArchiveItemCount())
+        with titanarchive.TitanArchive(PW_TEST_ZIP, password = 'password') as ta:
+            self.assertTrue(any(ta.GetArchiveItemPropertiesEx(i).Encrypted for i in range(0, ta.GetArchiveItemCount())))
+
+    def test_FindArchiveItems(self):
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            zip_path = os.path.join(tmp_dir, 'find.zip')
+            names = ['config/a.xml', 'config/sub/b.XML', 'config/sub/deep/c.xml', 'config/readme.txt', 'other/d.xml', 'e.xml', 'config2/f.xml', 'x[1].bin']
+            names += ['bulk/{}.dat'.format(i) for i in range(0, 2000)]
+            names += ['a' * 60]
+            with zipfile.ZipFile(zip_path, 'w') as zf:
+                for name in names:
+                    zf.writestr(name, name)
+            def find(pattern, kind = titanarchive.ARCHIVE_FIND_GLOB):
+                return [names[i] for i in ta.FindArchiveItems(pattern, kind)]
+            with titanarchive.TitanArchive(zip_path) as ta:
+                self.assertEqual(find('config/*.xml'), ['config/a.xml'])
+                self.assertEqual(find('config/**/*.xml'), ['config/a.xml', 'config/sub/deep/c.xml'])
+                self.assertEqual(find('**/*.xml'), ['config/a.xml', 'config/sub/deep/c.xml', 'other/d.xml', 'e.xml', 'config2/f.xml'])
+                self.assertEqual(find('*.xml'), ['e.xml'])
+                self.assertEqual(find('config?/[e-g].xml'), ['config2/f.xml'])
+                self.assertEqual(find('x[[]1].bin'), ['x[1].bin'])
+                self.assertEqual(find('config/[!a]*'), ['config/readme.txt'])
+                self.assertEqual(find('config/', titanarchive.ARCHIVE_FIND_PREFIX), names[0:4])
+                self.assertEqual(find('xml', titanarchive.ARCHIVE_FIND_EXTENSION), names[0:3] + names[4:7])
+                self.assertEqual(find('.XML', titanarchive.ARCHIVE_FIND_EXTENSION), names[0:3] + names[4:7])
+                self.assertEqual(find(r'bulk[/\\]1\d{3}\.dat', titanarchive.ARCHIVE_FIND_REGEX), ['bulk/{}.dat'.format(i) for i in range(1000, 2000)])
+                self.assertEqual(len(find('bulk/*')), 2000)
+                self.assertEqual(find('missing/*'), [])
+                # Many stars must not backtrack exponentially
+                start = time.time()
+                self.assertEqual(find('**a' * 20 + 'b'), [])
+                self.assertEqual(find('*a' * 20), ['a' * 60])
+                self.assertLess(time.time() - start, 1)
+                self.assertRaises(titanarchive.TitanArchiveException, ta.FindArchiveItems, '(', titanarchive.ARCHIVE_FIND_REGEX)
+                self.assertRaises(titanarchive.TitanArchiveException, ta.FindArchiveItems, '*', 100)
+
+    def test_GlobalSetConcurrency(self):
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            zip_path = os.path.join(tmp_dir, 'many.zip')
+            names = ['dir{}/file{}.txt'.format(i % 7, i) for i in range(0, 3000)]
+            with zipfile.ZipFile(zip_path, 'w') as zf:
+                for name in names:
+                    zf.writestr(name, name)
+            try:
+                for threads, affinity_mask in [(1, 0), (4, 0), (3, 1), (0, 0)]:
+                    titanarchive.GlobalSetConcurrency(threads, affinity_mask)
+                    for i in range(0, 2):
+                        with titanarchive.TitanArchive(zip_path) as ta:
+                            table = ta.GetArchiveItemTable()
+                            self.assertEqual(table['Path'], [name.replace('/', os.sep) for name in names])
+                            self.assertEqual(table['Index'], list(range(0, len(names))))
+            finally:
+                titanarchive.GlobalSetConcurrency()
+
+    def test_ArchiveStats(self):
+        titanarchive.GlobalResetStats()
+        with titanarchive.TitanArchive(TEST_ZIP) as ta:
+            stats = ta.GetStats()
+            self.assertEqual(stats['Opens'], 1)
+            self.assertGreater(stats['HeaderBytesRead'], 0)
+            self.assertEqual(stats['Open']['Count'], 1)
+            self.assertEqual(sum(stats['Open']['Buckets']), 1)
+            self.assertGreaterEqual(stats['Open']['TotalNs'], stats['Open']['MaxNs'])
+            self.assertEqual(stats['Extract']['Count'], 0)
+
+            files = [item for item in ta if not item.IsDir]
+            for item in files:
+                ta.ExtractArchiveItemToBufferByIndex(item.Index)
+            self.assertRaises(titanarchive.TitanArchiveException, ta.ExtractArchiveItemToBufferByIndex, 99999999)
+            stats = ta.GetStats()
+            self.assertEqual(stats['IterateItemsCalls'], 1)
+            self.assertEqual(stats['ItemsDecoded'], len(files))
+            self.assertEqual(stats['BytesDecoded'], sum(item.Size for item in files))
+            self.assertEqual(stats['Extract']['Count'], len(files))
+            self.assertEqual(sum(stats['Failures'].values()), 1)
+
+            global_stats = titanarchive.GlobalGetStats()
+            for field in ['Opens', 'HeaderBytesRead', 'ItemsDecoded', 'BytesDecoded']:
+                self.assertGreaterEqual(global_stats[field], stats[field])
+            self.assertGreaterEqual(global_stats['Extract']['Count'], stats['Extract']['Count'])
+
+            ta.ResetStats()
+            stats = ta.GetStats()
+            self.assertEqual(stats['Opens'], 0)
+            self.assertEqual(stats['ItemsDecoded'], 0)
+            self.assertEqual(stats['Open']['Count'], 0)
+            self.assertEqual(stats['Failures'], {})
+
+        titanarchive.GlobalResetStats()
+        self.assertEqual(titanarchive.GlobalGetStats()['Opens'], 0)
+
+    def test_Trace(self):
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            zip_path = os.path.join(tmp_dir, 'trace.zip')
+            trace_path = os.path.join(tmp_dir, 'trace.json')
+            with zipfile.ZipFile(zip_path, 'w') as zf:
+                zf.writestr('a.txt', 'a')
+                zf.writestr('b"\\.txt', 'b')
+
+            titanarchive.GlobalStartTrace(trace_path)
+            try:
+                self.assertRaises(titanarchive.TitanArchiveException, titanarchive.GlobalStartTrace, trace_path)
+                with open(zip_path, 'rb') as f:
+                    with titanarchive.TitanArchive(f.read()) as ta:
+                        items = list(ta)
+                        for item in items:
+                            ta.ExtractArchiveItemToBufferByIndex(item.Index)
+                with titanarchive.TitanArchive(zip_path, archive_format = 'zip') as ta:
+                    ta.GetArchiveItemCount()
+            finally:
+                titanarchive.GlobalStopTrace()
+            titanarchive.GlobalStopTrace()
+
+            with open(trace_path, 'r') as f:
+                events = json.load(f)
+            names = [event['name'] for event in events]
+            for name in ['OpenArchiveMemory', 'DiscoverArchiveFormat', 'InArchiveOpen', 'IterateItems', 'OpenArchiveFD']:
+                self.assertIn(name, names)
+            self.assertEqual(names.count('Extract'), len(items))
+            self.assertEqual(sorted(event['args']['arg'] for event in events if event['name'] == 'Extract'), [item.Index for item in items])
+            self.assertIn('zip', [event['args'].get('detail') for event in events if event['name'] == 'InArchiveOpen'])
+            for event in events:
+                self.assertEqual(event['ph'], 'X')
+                self.assertGreaterEqual(event['dur'], 0)
+
+            # Nothing is recorded once stopped
+            with titanarchive.TitanArchive(zip_path) as ta:
+                pass
+            with open(trace_path, 'r') as f:
+                self.assertEqual(len(json.load(f)), len(events))
+
     def test_MiscInvalid(self):
         with titanarchive.TitanArchive(TEST_ZIP) as ta:
             try:
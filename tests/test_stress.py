@@ -0,0 +1,367 @@
+import unittest
+import titanarchive
+import os
+import gc
+import random
+import struct
+import tempfile
+import time
+import zipfile
+import zlib
+
+# Archives are generated at full size by default, TITANARCHIVE_STRESS_SCALE shrinks them for a
+# quick run. Every bound is a growth ratio between a small and a large archive so it holds on any
+# machine: growing the input GROWTH times may grow time and peak memory at most GROWTH * SLACK
+# times (a quadratic algorithm grows GROWTH ** 2 times), lookups may not grow past SLACK times.
+STRESS_SCALE = float(os.environ.get('TITANARCHIVE_STRESS_SCALE', '1'))
+GROWTH = 8
+SLACK = 3
+
+# Differences below these are noise
+TIME_FLOOR = 0.02
+MEMORY_FLOOR = 8 * 1024 * 1024
+
+SAMPLE_COUNT = 2000
+
+def scaled(count):
+    return max(int(count * STRESS_SCALE), GROWTH * 16)
+
+def read_proc_status(field):
+    try:
+        with open('/proc/self/status', 'r') as f:
+            for line in f:
+                if line.startswith(field + ':'):
+                    return int(line.split()[1]) * 1024
+    except OSError:
+        pass
+    return None
+
+def reset_peak_rss():
+    # Resets VmHWM to the current RSS (Linux 4.0+)
+    try:
+        with open('/proc/self/clear_refs', 'w') as f:
+            f.write('5')
+        return True
+    except OSError:
+        return False
+
+def measure(fn):
+    # (seconds, peak RSS growth in bytes or None, result of fn)
+    gc.collect()
+    tracked = reset_peak_rss()
+    base = read_proc_status('VmRSS')
+    start = time.perf_counter()
+    result = fn()
+    elapsed = time.perf_counter() - start
+    peak = read_proc_status('VmHWM')
+    if not tracked or base is None or peak is None:
+        return elapsed, None, result
+    return elapsed, max(peak - base, 0), result
+
+def dos_time():
+    return (12 << 11) | (0 << 5), ((2020 - 1980) << 9) | (1 << 5) | 1
+
+def write_zip(path, entries):
+    # Stored entries (name, data), zip64 records are added once the counts or offsets need them.
+    # Names ending with / are directories.
+    mtime, mdate = dos_time()
+    central = []
+    with open(path, 'wb') as f:
+        offset = 0
+        for name, data in entries:
+            name = name.encode('utf-8')
+            crc = zlib.crc32(data)
+            extra = b''
+            local_offset = offset
+            if offset > 0xffffffff:
+                extra = struct.pack('<HHQ', 1, 8, offset)
+                local_offset = 0xffffffff
+            header = struct.pack('<IHHHHHIIIHH', 0x04034b50, 20, 0x800, 0, mtime, mdate, crc, len(data), len(data), len(name), 0)
+            f.write(header)
+            f.write(name)
+            f.write(data)
+            central.append(struct.pack('<IHHHHHHIIIHHHHHII', 0x02014b50, 45, 20, 0x800, 0, mtime, mdate, crc, len(data), len(data), len(name), len(extra), 0, 0, 0,
+                                       0x10 if name.endswith(b'/') else 0, local_offset) + name + extra)
+            offset += len(header) + len(name) + len(data)
+        cd_offset = offset
+        cd = b''.join(central)
+        f.write(cd)
+        count = len(central)
+        if count >= 0xffff or cd_offset >= 0xffffffff:
+            zip64_offset = cd_offset + len(cd)
+            f.write(struct.pack('<IQHHIIQQQQ', 0x06064b50, 44, 45, 45, 0, 0, count, count, len(cd), cd_offset))
+            f.write(struct.pack('<IIQI', 0x07064b50, 0, zip64_offset, 1))
+            f.write(struct.pack('<IHHHHIIH', 0x06054b50, 0, 0, 0xffff, 0xffff, min(len(cd), 0xffffffff), 0xffffffff, 0))
+        else:
+            f.write(struct.pack('<IHHHHIIH', 0x06054b50, 0, 0, count, count, len(cd), cd_offset, 0))
+
+def tar_header(name, size, typeflag):
+    header = bytearray(512)
+    name = name.encode('utf-8')
+    header[0:len(name)] = name
+    header[100:108] = b'0000644\0'
+    header[108:116] = b'0000000\0'
+    header[116:124] = b'0000000\0'
+    header[124:136] = '{:011o}\0'.format(size).encode()
+    header[136:148] = '{:011o}\0'.format(1577836800).encode()
+    header[148:156] = b' ' * 8
+    header[156:157] = typeflag
+    header[257:265] = b'ustar  \0'
+    header[148:156] = '{:06o}\0 '.format(sum(header)).encode()
+    return bytes(header)
+
+def write_tar(path, entries):
+    # GNU tar, names longer than the ustar field get a ././@LongLink record
+    with open(path, 'wb') as f:
+        for name, data in entries:
+            is_dir = name.endswith('/')
+            encoded = name.encode('utf-8')
+            if len(encoded) >= 100:
+                f.write(tar_header('././@LongLink', len(encoded) + 1, b'L'))
+                f.write(encoded + b'\0' * (512 - len(encoded) % 512))
+                name = encoded[:99].decode('utf-8', 'ignore')
+            f.write(tar_header(name, len(data), b'5' if is_dir else b'0'))
+            f.write(data)
+            if len(data) % 512:
+                f.write(b'\0' * (512 - len(data) % 512))
+        f.write(b'\0' * 1024)
+
+def write_bomb_zip(path, size):
+    # A single deflated item of zeros, deflate tops out around 1000:1
+    with zipfile.ZipFile(path, 'w', zipfile.ZIP_DEFLATED, compresslevel = 9) as zf:
+        chunk = bytes(16 * 1024 * 1024)
+        with zf.open('bomb.bin', 'w', force_zip64 = True) as f:
+            for offset in range(0, size, len(chunk)):
+                f.write(chunk[:min(len(chunk), size - offset)])
+
+def seven_zip_number(value):
+    # 7z variable length integer, the first byte's high bits count the extra bytes
+    for extra in range(0, 8):
+        if value < (1 << (7 * (extra + 1))):
+            first = (0xff00 >> extra) & 0xff
+            return bytes([first | (value >> (8 * extra))]) + value.to_bytes(8, 'little')[:extra]
+    return b'\xff' + value.to_bytes(8, 'little')
+
+def write_solid_7z(path, entries):
+    # One folder with the Copy coder holding every item, so each item sits in the same solid block
+    n = seven_zip_number
+    payload = b''.join(data for _, data in entries)
+    header = bytearray(b'\x01')                                  # Header
+    header += b'\x04'                                            # MainStreamsInfo
+    header += b'\x06' + n(0) + n(1) + b'\x09' + n(len(payload)) + b'\x00'
+    header += b'\x07' + b'\x0b' + n(1) + b'\x00'                 # UnpackInfo, one folder
+    header += n(1) + b'\x01\x00'                                 # One coder, Copy (id 00)
+    header += b'\x0c' + n(len(payload)) + b'\x00'
+    header += b'\x08' + b'\x0d' + n(len(entries))                # SubStreamsInfo
+    if len(entries) > 1:
+        header += b'\x09' + b''.join(n(len(data)) for _, data in entries[:-1])
+    header += b'\x0a\x01' + b''.join(struct.pack('<I', zlib.crc32(data)) for _, data in entries)
+    header += b'\x00\x00'
+    header += b'\x05' + n(len(entries))                          # FilesInfo
+    names = b''.join(name.encode('utf-16-le') + b'\0\0' for name, _ in entries)
+    header += b'\x11' + n(len(names) + 1) + b'\x00' + names
+    header += b'\x00\x00'
+    next_header_crc = zlib.crc32(header)
+    start_header = struct.pack('<QQI', len(payload), len(header), next_header_crc)
+    with open(path, 'wb') as f:
+        f.write(b'7z\xbc\xaf\x27\x1c\x00\x04')
+        f.write(struct.pack('<I', zlib.crc32(start_header)))
+        f.write(start_header)
+        f.write(payload)
+        f.write(header)
+
+def supports_format(archive_format):
+    return archive_format in titanarchive.GlobalGetSupportedArchiveFormats()
+
+class StressTests(unittest.TestCase):
+    def assertScales(self, small, large, name, growth = GROWTH):
+        # small and large are (seconds, peak bytes) of the same work on inputs growth times apart
+        self.assertLess(large[0], max(small[0], TIME_FLOOR) * growth * SLACK,
+                        '{} time grew from {:.3f}s to {:.3f}s'.format(name, small[0], large[0]))
+        if small[1] is not None and large[1] is not None:
+            self.assertLess(large[1], max(small[1], MEMORY_FLOOR) * growth * SLACK,
+                            '{} peak memory grew from {} to {} bytes'.format(name, small[1], large[1]))
+
+    def assertConstant(self, small, large, name):
+        self.assertScales(small, large, name, 1)
+
+    def run_scenarios(self, path, archive_format, names, sample_dir):
+        # Times the public entry points on one archive, returns {scenario: (seconds, peak bytes)}
+        results = {}
+        rng = random.Random(len(names))
+        samples = [rng.randrange(0, len(names)) for i in range(0, SAMPLE_COUNT)]
+        ta = titanarchive.TitanArchive(path, archive_format = archive_format)
+        try:
+            elapsed, peak, table = measure(lambda: ta.GetArchiveItemTable())
+            results['GetArchiveItemTable'] = (elapsed, peak)
+            self.assertEqual(len(table['Path']), len(names))
+
+            elapsed, peak, items = measure(lambda: ta.ListDirectory(sample_dir))
+            results['ListDirectory'] = (elapsed, peak)
+            self.assertGreater(len(items), 0)
+
+            elapsed, peak, found = measure(lambda: [ta.GetArchiveItemPropertiesByPath(names[i]).Index for i in samples])
+            results['GetArchiveItemPropertiesByPath'] = (elapsed, peak)
+            self.assertEqual([table['Path'][i] for i in found], [table['Path'][i] for i in samples])
+
+            elapsed, peak, _ = measure(lambda: [ta.ExtractArchiveItemToBufferByIndex(i) for i in samples])
+            results['Extract'] = (elapsed, peak)
+        finally:
+            ta.CloseArchive()
+        return results
+
+    def check_many_entries(self, writer, archive_format, data_for):
+        count = scaled(1000000)
+        results = []
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            for n in [count // GROWTH, count]:
+                path = os.path.join(tmp_dir, 'many.{}'.format(archive_format))
+                # A fixed number of directories, so each one grows with the archive
+                names = ['dir{:03}/file{:07}.txt'.format(i % 100, i) for i in range(0, n)]
+                writer(path, ((name, data_for(name)) for name in names))
+                results.append(self.run_scenarios(path, archive_format, [name.replace('/', os.sep) for name in names], 'dir007'))
+                os.remove(path)
+        for scenario in ['GetArchiveItemTable', 'ListDirectory']:
+            self.assertScales(results[0][scenario], results[1][scenario], scenario)
+        for scenario in ['GetArchiveItemPropertiesByPath', 'Extract']:
+            self.assertConstant(results[0][scenario], results[1][scenario], scenario)
+
+    def test_ManyEntriesZip(self):
+        self.check_many_entries(write_zip, 'zip', lambda name: name.encode())
+
+    def test_ManyEntriesTar(self):
+        self.check_many_entries(write_tar, 'tar', lambda name: b'')
+
+    def test_DeepNesting(self):
+        depth = scaled(10000)
+        results = []
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            for d in [depth // GROWTH, depth]:
+                path = os.path.join(tmp_dir, 'deep.zip')
+                leaf = 'n/' * d + 'leaf.txt'
+                write_zip(path, [('top.txt', b'top'), (leaf, b'leaf')])
+                leaf = leaf.replace('/', os.sep)
+
+                def scan():
+                    with titanarchive.TitanArchive(path) as ta:
+                        self.assertEqual([item.Path for item in ta.ListDirectory('')], ['n', 'top.txt'])
+                        self.assertEqual(ta.ExtractArchiveItemToBufferByPath(leaf).read(), b'leaf')
+                        parent = os.sep.join(['n'] * d)
+                        self.assertEqual([item.Path for item in ta.ListDirectory(parent)], ['leaf.txt'])
+                        self.assertTrue(ta.GetArchiveItemPropertiesByPath(os.sep.join(['n'] * (d // 2))).IsDir)
+                        self.assertEqual(len(list(ta)), 2)
+                elapsed, peak, _ = measure(scan)
+                results.append((elapsed, peak))
+        self.assertScales(results[0], results[1], 'DeepNesting')
+
+    def test_LongPaths(self):
+        count = scaled(2000)
+        results = []
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            for n in [count // GROWTH, count]:
+                path = os.path.join(tmp_dir, 'long.tar')
+                # 4 KiB paths through a few hundred shared and unique components
+                names = ['/'.join(['shared{:03}'.format(j) for j in range(0, 200)] + ['unique{:06}'.format(i) * 200, 'file.txt']) for i in range(0, n)]
+                write_tar(path, [(name, name[-64:].encode()) for name in names])
+                results.append(self.run_scenarios(path, 'tar', [name.replace('/', os.sep) for name in names], os.sep.join(['shared{:03}'.format(j) for j in range(0, 200)])))
+            for scenario in ['GetArchiveItemTable', 'ListDirectory']:
+                self.assertScales(results[0][scenario], results[1][scenario], scenario)
+            for scenario in ['GetArchiveItemPropertiesByPath', 'Extract']:
+                self.assertConstant(results[0][scenario], results[1][scenario], scenario)
+
+            # Zip caps names at 64 KiB
+            path = os.path.join(tmp_dir, 'longest.zip')
+            name = 'x' * 65000 + '/y.txt'
+            write_zip(path, [(name, b'longest')])
+            with titanarchive.TitanArchive(path) as ta:
+                self.assertEqual(ta.ExtractArchiveItemToBufferByPath(name.replace('/', os.sep)).read(), b'longest')
+                self.assertEqual([item.Path for item in ta.ListDirectory('x' * 65000)], ['y.txt'])
+                # Globs handle any length, regex matching recurses per character and refuses such paths
+                self.assertEqual(ta.FindArchiveItems('**/y.txt'), [0])
+                self.assertRaises(titanarchive.TitanArchiveException, ta.FindArchiveItems, '.*y', titanarchive.ARCHIVE_FIND_REGEX)
+
+    def test_ImplicitDirectories(self):
+        count = scaled(200000)
+        results = []
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            for n in [count // GROWTH, count]:
+                path = os.path.join(tmp_dir, 'implicit.zip')
+                # No directory entries at all, every directory is synthesized from item paths
+                names = ['a{:02}/b{:03}/c{:04}/file{:07}'.format(i % 97, i % 997, i % 9973, i) for i in range(0, n)]
+                write_zip(path, [(name, b'') for name in names])
+                expected = sum(1 for name in names if name.startswith('a01/b001/c0001/'))
+
+                def scan():
+                    with titanarchive.TitanArchive(path) as ta:
+                        top = ta.ListDirectory('')
+                        self.assertEqual(len(top), 97)
+                        self.assertTrue(all(item.IsDir and item.Index == 0xffffffff for item in top))
+                        self.assertTrue(ta.GetArchiveItemPropertiesByPath(os.sep.join(['a01', 'b001'])).IsDir)
+                        self.assertEqual(len(ta.ListDirectory(os.sep.join(['a01', 'b001', 'c0001']))), expected)
+                        walk = ta.WalkArchive('')
+                        self.assertEqual(sum(1 for item in walk if not item.IsDir), n)
+                elapsed, peak, _ = measure(scan)
+                results.append((elapsed, peak))
+        self.assertScales(results[0], results[1], 'ImplicitDirectories')
+
+    @unittest.skipUnless(supports_format('7z'), '7z handler not available')
+    def test_HugeSolidBlock(self):
+        count = scaled(100000)
+        results = []
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            for n in [count // GROWTH, count]:
+                path = os.path.join(tmp_dir, 'solid.7z')
+                entries = [('dir{:02}/file{:07}.bin'.format(i % 10, i), struct.pack('<Q', i) * 32) for i in range(0, n)]
+                write_solid_7z(path, entries)
+
+                def scan():
+                    with titanarchive.TitanArchive(path) as ta:
+                        table = ta.GetArchiveItemTable()
+                        self.assertEqual(len(table['Index']), n)
+                        self.assertEqual(len(ta.ListDirectory('dir03')), len(range(3, n, 10)))
+                        # Reaching the last item decodes the whole block once
+                        self.assertEqual(ta.ExtractArchiveItemToBufferByIndex(n - 1).read(), entries[n - 1][1])
+                        with ta.open(n // 2) as f:
+                            self.assertEqual(f.read(), entries[n // 2][1])
+                elapsed, peak, _ = measure(scan)
+                results.append((elapsed, peak))
+        self.assertScales(results[0], results[1], 'HugeSolidBlock')
+
+    def test_CompressionBomb(self):
+        size = scaled(4 * 1024 * 1024 * 1024)
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            path = os.path.join(tmp_dir, 'bomb.zip')
+            write_bomb_zip(path, size)
+            self.assertLess(os.path.getsize(path) * 500, size)
+
+            with titanarchive.TitanArchive(path) as ta:
+                # Metadata never touches the compressed data
+                elapsed, peak, item = measure(lambda: ta.GetArchiveItemPropertiesByPath('bomb.bin'))
+                self.assertEqual(item.Size, size)
+                self.assertLess(elapsed, 1)
+
+                # Decoding stops once a small buffer is full instead of inflating the whole item
+                buf = bytearray(4096)
+                elapsed, peak, written = measure(lambda: ta.ExtractArchiveItemIntoBufferByIndex(item.Index, buf))
+                self.assertEqual(written, len(buf))
+                self.assertLess(elapsed, 1)
+
+                # Streaming keeps memory bounded and abandoning the stream stops the decoder
+                def stream():
+                    with ta.open(item.Index, read_ahead = 1024 * 1024) as f:
+                        total = 0
+                        limit = min(size, 256 * 1024 * 1024)
+                        while total < limit:
+                            chunk = f.read(min(4 * 1024 * 1024, limit - total))
+                            if not chunk:
+                                break
+                            self.assertEqual(chunk, bytes(len(chunk)))
+                            total += len(chunk)
+                        self.assertEqual(total, limit)
+                elapsed, peak, _ = measure(stream)
+                if peak is not None:
+                    self.assertLess(peak, MEMORY_FLOOR * 4)
+                self.assertLess(elapsed, 30)
+
+if __name__ == '__main__':
+    unittest.main()